@@ -2,6 +2,8 @@
 #include <Arduino.h>
 #include <SPI.h>
 
+#include "PackedImage.h"
+
 class EInkDisplay {
  public:
   // Constructor with pin configuration
@@ -34,6 +36,14 @@ class EInkDisplay {
   static constexpr uint32_t X3_BUFFER_SIZE = X3_DISPLAY_WIDTH_BYTES * X3_DISPLAY_HEIGHT;
   static constexpr uint32_t MAX_BUFFER_SIZE = 52272;  // max(800x480, 792x528) / 8
 
+  // Overlay composition modes, applied to the pixels set in the overlay mask
+  enum OverlayMode {
+    OVERLAY_INVERT,  // XOR: flip the underlying pixels (cursors, selection highlights)
+    OVERLAY_WHITE,   // OR: force pixels white
+    OVERLAY_BLACK    // AND NOT: force pixels black (focus boxes)
+  };
+  static constexpr uint8_t MAX_OVERLAYS = 8;
+
   // Runtime dimensions
   uint16_t getDisplayWidth() const { return displayWidth; }
   uint16_t getDisplayHeight() const { return displayHeight; }
@@ -44,31 +54,103 @@ class EInkDisplay {
   void clearScreen(uint8_t color = 0xFF) const;
   void drawImage(const uint8_t* imageData, uint16_t x, uint16_t y, uint16_t w, uint16_t h, bool fromProgmem = false) const;
   void drawImageTransparent(const uint8_t* imageData, uint16_t x, uint16_t y, uint16_t w, uint16_t h, bool fromProgmem = false) const;
+  // Decodes the BW plane of a compressed image into the frame buffer a row at a time, placed and clipped like
+  // drawImage(); x must be a multiple of 8. Returns false for an unaligned x, or on corrupt data, rows before it are
+  // drawn.
+  bool drawImage(const PackedImage& image, uint16_t x, uint16_t y) const;
 #ifndef EINK_DISPLAY_SINGLE_BUFFER_MODE
   void swapBuffers();
 #endif
+
+  // Called to render the rows [y, y + h) exposed by a scroll, the strip is already cleared to the fill color
+  typedef void (*ScrollStripRenderer)(uint8_t* frameBuffer, uint16_t y, uint16_t h, void* context);
+  // Scrolls rows [regionY, regionY + regionH) of the frame on screen by dy rows (positive moves content up) with a
+  // memmove, renders only the exposed strip through the callback and marks the region dirty.
+  // Starts from the frame on screen, or from the frame buffer if anything was marked dirty since the last update.
+  // Returns false if the region is out of bounds.
+  bool scrollRegion(uint16_t regionY, uint16_t regionH, int16_t dy, ScrollStripRenderer renderStrip,
+                    void* context = nullptr, uint8_t fillColor = 0xFF);
+
+  // Dirty region tracking, cleared by displayBuffer() and by a displayWindow() covering it
+  void markDirty(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+  // Byte-aligned bounding box of everything marked dirty, ready for displayWindow(). Returns false if clean.
+  bool getDirtyWindow(uint16_t& x, uint16_t& y, uint16_t& w, uint16_t& h) const;
+  void clearDirty();
   void setFramebuffer(const uint8_t* bwBuffer) const;
 
   void copyGrayscaleBuffers(const uint8_t* lsbBuffer, const uint8_t* msbBuffer);
   void copyGrayscaleLsbBuffers(const uint8_t* lsbBuffer);
   void copyGrayscaleMsbBuffers(const uint8_t* msbBuffer);
+  // copyGrayscaleBuffers() with the gray planes of a full screen compressed image, decoded on the way to the controller
+  bool copyGrayscaleBuffers(const PackedImage& image);
 #ifdef EINK_DISPLAY_SINGLE_BUFFER_MODE
   void cleanupGrayscaleBuffers(const uint8_t* bwBuffer);
 #endif
 
   void displayBuffer(RefreshMode mode = FAST_REFRESH, bool turnOffScreen = false);
-  // EXPERIMENTAL: Windowed update - display only a rectangular region
+  // EXPERIMENTAL: Windowed update - display only a rectangular region of the frame buffer, x and w must be multiples
+  // of 8. Overlay changes lying inside the window are shown with it, the others wait for an update covering them.
+  // The frame buffers are not swapped, so the frame buffer keeps what was drawn into it. On X3 this is a full fast
+  // update.
   void displayWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h, bool turnOffScreen = false);
   void displayGrayBuffer(bool turnOffScreen = false);
+  // Grayscale update of one rectangle (e.g. an inline image) over the black/white frame on screen.
+  // Planes are packed (w / 8) x h with the same bit meaning as copyGrayscale*Buffers(); x and w must be multiples of 8.
+  // Only the window's pixels are driven. Pixels set in the LSB plane alone have no waveform here and stay black.
+  // Not supported over a streamed image.
+  void displayGrayWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t* lsbWindow,
+                         const uint8_t* msbWindow, bool turnOffScreen = false);
+
+  // Reads `length` bytes of a full screen 1bpp image, laid out like the frame buffer, starting at byte `offset`.
+  // Returns the bytes read; anything short of `length` aborts the stream.
+  typedef size_t (*ImageStreamSource)(uint8_t* buffer, uint32_t offset, size_t length, void* context);
+  // Shows a full screen image pulled from `source` in row chunks (e.g. a prerendered page on the SD card) straight
+  // into controller RAM, without touching the frame buffers. The panel is deselected and its SPI transaction ended
+  // before every call to `source`, so the source may use other devices on the same bus. X3 rows are mirrored on the
+  // fly, so there `source` is read bottom-up. Overlays are not composed into streamed images.
+  // Fast refreshes diff against the frame on screen and read the image twice. Returns false if `source` failed.
+  bool displayStream(ImageStreamSource source, void* context, RefreshMode mode = HALF_REFRESH,
+                     bool turnOffScreen = false);
+  // displayStream() of the BW plane of a full screen compressed image, e.g. a sleep screen in flash
+  bool displayStream(const PackedImage& image, RefreshMode mode = HALF_REFRESH, bool turnOffScreen = false);
 
   void refreshDisplay(RefreshMode mode = FAST_REFRESH, bool turnOffScreen = false);
 
+  // Async refresh: return as soon as a refresh is triggered instead of waiting for the waveform to finish, so the next
+  // frame can be drawn meanwhile. Any later controller access waits for the running refresh first.
+  // Only available in dual buffer mode on X4, ignored otherwise.
+  void setAsyncRefresh(bool enabled);
+  // True while an async refresh is still running
+  bool isRefreshing();
+  // Block until an async refresh has finished
+  void waitForRefreshComplete();
+
+  // Overlays are composed into the data streamed to the controller, the frame buffer is never modified.
+  // `mask` is an optional packed ((w + 7) / 8) x h bitmap (1 = affected pixel) that must outlive the overlay;
+  // without it the whole rectangle is affected. Returns the overlay id, or -1 if all slots are in use.
+  int8_t addOverlay(uint16_t x, uint16_t y, uint16_t w, uint16_t h, OverlayMode mode = OVERLAY_INVERT,
+                    const uint8_t* mask = nullptr);
+  bool moveOverlay(int8_t id, uint16_t x, uint16_t y);
+  void removeOverlay(int8_t id);
+  void clearOverlays();
+  // Byte-aligned bounding box of the overlay changes since the last update.
+  // Returns false if the overlays are unchanged.
+  bool getOverlayDirtyWindow(uint16_t& x, uint16_t& y, uint16_t& w, uint16_t& h) const;
+  // Fast update of just the overlay changes over the frame on screen, whatever was drawn into the frame buffer since.
+  // On X3 this is a full fast update of the frame buffer. Returns false if the overlays are unchanged, or if a
+  // streamed image is on screen (it is in no frame buffer to compose them over).
+  bool displayOverlays(bool turnOffScreen = false);
+
   // Hint the X3 policy to run a one-shot full resync on next update.
   void requestResync(uint8_t settlePasses = 0);
 
   // debug function
   void grayscaleRevert();
 
+  // Fold the grayscale revert into the next fast refresh instead of running it as a separate pass.
+  // Requires RED RAM to hold the last black/white frame (dual buffer mode, or cleanupGrayscaleBuffers()).
+  void setFusedGrayscaleRevert(bool enabled);
+
   // LUT control
   void setCustomLUT(bool enabled, const unsigned char* lutData = nullptr);
 
@@ -84,6 +166,14 @@ class EInkDisplay {
   void saveFrameBufferAsPBM(const char* filename);
 
  private:
+  struct Overlay {
+    const uint8_t* mask;
+    uint16_t x, y, w, h;
+    OverlayMode mode;
+    bool active;
+  };
+  enum OverlaySet { OVERLAYS_NONE, OVERLAYS_PENDING, OVERLAYS_SHOWN };
+
   // Internal geometry setter used by setDisplayX3().
   void setDisplayDimensions(uint16_t width, uint16_t height);
 
@@ -94,20 +184,38 @@ class EInkDisplay {
   uint16_t displayWidth = DISPLAY_WIDTH;
   uint16_t displayHeight = DISPLAY_HEIGHT;
   uint16_t displayWidthBytes = DISPLAY_WIDTH_BYTES;
+  static constexpr uint16_t STREAM_CHUNK_ROWS = 16;  // Rows per displayStream() chunk
   uint32_t bufferSize = BUFFER_SIZE;
   bool _x3Mode = false;
   bool _x3RedRamSynced = false;
   struct X3GrayState {
     bool lastBaseWasPartial = false;
     bool lsbValid = false;
+    bool windowValid = false;
+    uint16_t windowX = 0;
+    uint16_t windowY = 0;
+    uint16_t windowW = 0;
+    uint16_t windowH = 0;
   };
   X3GrayState _x3GrayState;
   uint8_t _x3InitialFullSyncsRemaining = 0;
   bool _x3ForceFullSyncNext = false;
   uint8_t _x3ForcedConditionPassesNext = 0;
+  struct DirtyRegion {
+    uint16_t x0, y0, x1, y1;
+    bool valid;
+  };
+  DirtyRegion dirty = {};
+  // Where RED RAM may no longer hold the frame on screen (X4), brought back by syncRamToScreen() when needed
+  DirtyRegion redRamStale = {};
+  // Overlays requested by the app, and the ones that were composed into the frame on screen
+  Overlay overlays[MAX_OVERLAYS] = {};
+  Overlay shownOverlays[MAX_OVERLAYS] = {};
   // Frame buffer (statically allocated)
   uint8_t frameBuffer0[MAX_BUFFER_SIZE];
   uint8_t* frameBuffer;
+  // Buffer holding the frame last sent to the panel
+  uint8_t* displayedFrameBuffer = nullptr;
 #ifndef EINK_DISPLAY_SINGLE_BUFFER_MODE
   uint8_t frameBuffer1[MAX_BUFFER_SIZE];
   uint8_t* frameBufferActive;
@@ -121,6 +229,13 @@ class EInkDisplay {
   bool customLutActive;
   bool inGrayscaleMode;
   bool drawGrayscale;
+  bool fusedGrayscaleRevert = false;
+  bool grayscaleWindowed = false;
+  bool bwRamStale = false;  // BW RAM holds a grayscale plane or part of a failed stream, not the frame on screen
+  bool asyncRefresh = false;
+  bool refreshInFlight = false;
+  bool streamedFrameShown = false;  // The frame on screen came from displayStream() and is in no frame buffer
+  const char* inFlightRefreshType = nullptr;
 
   // Low-level display control
   void resetDisplay();
@@ -133,5 +248,28 @@ class EInkDisplay {
 
   // Low-level display operations
   void setRamArea(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
-  void writeRamBuffer(uint8_t ramBuffer, const uint8_t* data, uint32_t size);
+  void writeRamBuffer(uint8_t ramBuffer, const uint8_t* data, uint32_t size, OverlaySet overlaySet = OVERLAYS_NONE);
+  void writeRamWindow(uint8_t ramBuffer, const uint8_t* frame, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                      const Overlay* overlayList);
+  void syncRamToScreen();
+  static void growRegion(DirtyRegion& region, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
+  void markRedStale(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+  void markRedStaleChanges(const uint8_t* shown, const uint8_t* previous);
+  void updateWindow(const uint8_t* source, uint16_t x, uint16_t y, uint16_t w, uint16_t h, bool turnOffScreen);
+  void updateFullScreen(const uint8_t* source, bool fusedRevert, bool turnOffScreen);
+  void sendMirroredPlane(const uint8_t* plane, bool invertBits, OverlaySet overlaySet = OVERLAYS_NONE);
+  void sendMirroredRows(const uint8_t* rows, uint16_t strideBytes, uint16_t widthBytes, uint16_t rowCount,
+                        bool invertBits);
+  void setX3PartialWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+  bool streamToRam(ImageStreamSource source, void* context, bool toBw, bool toRed);
+  bool streamMirroredToRam(ImageStreamSource source, void* context, bool invertBits);
+  bool displayStreamX3(ImageStreamSource source, void* context, RefreshMode mode, bool turnOffScreen);
+
+  // Overlay composition
+  bool hasOverlays(OverlaySet overlaySet) const;
+  void composeOverlays(uint8_t* row, uint16_t y, uint16_t xByte, uint16_t widthBytes, OverlaySet overlaySet) const;
+  void composeOverlays(uint8_t* row, uint16_t y, uint16_t xByte, uint16_t widthBytes, const Overlay* list) const;
+  void commitOverlays();
+  void windowOverlays(uint16_t x, uint16_t y, uint16_t w, uint16_t h, Overlay* out) const;
+  void refreshWithGrayscaleRevert(bool turnOffScreen);
 };
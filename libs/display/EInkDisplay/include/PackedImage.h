@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Compressed 1bpp image with optional grayscale planes, as written by tools/assets/imageconvert.py, decoded a row at
+ * a time straight into the frame buffer or the data streamed to the controller.
+ *
+ * The image is read in place, so it can be a const array in flash. Layout, little-endian:
+ *
+ *   Header  16 bytes   "XPI1", width u16, height u16, plane count u8 (1: BW, 3: BW, LSB, MSB), band height u8,
+ *                      reserved u16, code size u32
+ *   Bands   4 bytes    per plane, per band of `band height` rows: offset of the band's first row in the code u31,
+ *                      bit 31 set if the band is predicted
+ *   Code               the coded rows
+ *
+ * Planes have the frame buffer's layout and bit meaning: rows of (width + 7) / 8 bytes, MSB first, 1 white in the BW
+ * plane, and LSB/MSB as copyGrayscaleBuffers() takes them. Every row is coded on its own as a series of
+ *
+ *   0x00-0x7F  n + 1 literal bytes follow
+ *   0x80-0xBF  (n & 0x3F) + 1 zero bytes
+ *   0xC0-0xFF  the next byte, repeated (n & 0x3F) + 2 times
+ *
+ * In a predicted band each row is XORed with the row above before coding, so rows that repeat the one above, fully or
+ * in parts, shrink to zero runs. Every band starts over from a zero row, so any row is at most `band height` - 1 rows
+ * of decoding away, which lets a stream be read in any order of bands (bottom-up on X3).
+ */
+class PackedImage {
+ public:
+  static constexpr size_t HEADER_SIZE = 16;
+  static constexpr uint16_t MAX_WIDTH = 1024;
+  static constexpr uint16_t MAX_ROW_BYTES = MAX_WIDTH / 8;
+
+  enum Plane : uint8_t { PLANE_BW, PLANE_LSB, PLANE_MSB };
+
+  // Decodes one plane front to back, keeping only the last row
+  class Reader {
+   public:
+    // Positions the reader at row `y`, decoding the rows before it in the same band
+    bool begin(const PackedImage& image, Plane plane, uint16_t y = 0);
+    // The next row, valid until the next call; nullptr past the last row or on corrupt data
+    const uint8_t* readRow();
+    uint16_t getRow() const { return row; }
+
+    // EInkDisplay::ImageStreamSource over a full screen image, `context` is the Reader. Whole rows are decoded in
+    // any order, seeking back to the start of the band where the request does not continue the last one.
+    static size_t stream(uint8_t* buffer, uint32_t offset, size_t length, void* context);
+
+   private:
+    const PackedImage* image = nullptr;
+    const uint8_t* code = nullptr;
+    Plane plane = PLANE_BW;
+    uint16_t row = 0;
+    bool predicted = false;
+    uint8_t current[MAX_ROW_BYTES];
+  };
+
+  PackedImage() = default;
+  PackedImage(const uint8_t* data, size_t size) { begin(data, size); }
+
+  // Checks the header and band table against `size`, the data has to stay valid while the image is used
+  bool begin(const uint8_t* data, size_t size);
+  bool isValid() const { return data != nullptr; }
+
+  uint16_t getWidth() const { return width; }
+  uint16_t getHeight() const { return height; }
+  uint16_t getWidthBytes() const { return (width + 7) / 8; }
+  bool hasGray() const { return planeCount == 3; }
+  // Size of the planes uncompressed
+  uint32_t getRawSize() const { return static_cast<uint32_t>(getWidthBytes()) * height * planeCount; }
+
+ private:
+  uint32_t readBand(Plane plane, uint16_t band) const;
+
+  const uint8_t* data = nullptr;
+  const uint8_t* bands = nullptr;
+  const uint8_t* code = nullptr;
+  uint32_t codeSize = 0;
+  uint16_t width = 0;
+  uint16_t height = 0;
+  uint16_t bandCount = 0;
+  uint8_t bandHeight = 0;
+  uint8_t planeCount = 0;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <EInkDisplay.h>
+
+/**
+ * Coalescing front end for EInkDisplay updates.
+ *
+ * Submissions only record what needs to be shown; update() pushes them to the panel once it is idle. Everything
+ * submitted in between is merged: the newest frame buffer content is shown once, with the strongest refresh mode and
+ * the union of all windows. Pair with EInkDisplay::setAsyncRefresh(true) so a refresh can be in flight while input is
+ * handled and the next frame is drawn.
+ */
+class RefreshQueue {
+ public:
+  explicit RefreshQueue(EInkDisplay& display);
+
+  // Queue a full screen update of the frame buffer
+  void submit(EInkDisplay::RefreshMode mode = EInkDisplay::FAST_REFRESH);
+
+  // Queue a windowed update, x and w must be byte-aligned (multiples of 8)
+  void submitWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+
+  // Queue the display's dirty region (see EInkDisplay::markDirty()), if any
+  void submitDirty();
+
+  /**
+   * Pushes the merged submission to the panel if it is idle. Should be called regularly in the main loop.
+   *
+   * @return true if an update was started
+   */
+  bool update();
+
+  // Block until everything submitted is on screen
+  void flush();
+
+  bool hasPending() const { return pendingCount > 0; }
+
+  // Submissions merged into a later one instead of being shown on their own
+  uint32_t getSkippedFrames() const { return skippedFrames; }
+  // Updates actually sent to the panel
+  uint32_t getDisplayedFrames() const { return displayedFrames; }
+  void resetStats();
+
+ private:
+  enum PendingKind : uint8_t { PENDING_NONE, PENDING_WINDOW, PENDING_FULL };
+
+  void issue();
+
+  EInkDisplay& display;
+
+  PendingKind pendingKind = PENDING_NONE;
+  EInkDisplay::RefreshMode pendingMode = EInkDisplay::FAST_REFRESH;
+  uint16_t windowX0 = 0;
+  uint16_t windowY0 = 0;
+  uint16_t windowX1 = 0;
+  uint16_t windowY1 = 0;
+  uint32_t pendingCount = 0;
+
+  uint32_t skippedFrames = 0;
+  uint32_t displayedFrames = 0;
+};
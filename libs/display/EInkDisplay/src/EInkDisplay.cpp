@@ -107,6 +107,79 @@ const unsigned char lut_grayscale_revert[] PROGMEM = {
     // Reserved
     0x00, 0x00};
 
+// Fused grayscale revert + fast refresh LUT
+// Used with BW RAM = next frame and RED RAM = last BW frame (gray pixels were black in it), so one waveform
+// both settles the leftover grays back to black and applies the normal black/white differential update.
+const unsigned char lut_grayscale_fused_revert[] PROGMEM = {
+    // 00 black -> black (includes gray pixels): push back to black
+    0x54, 0x54, 0x54, 0x54, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 01 black -> white (includes gray pixels)
+    0xAA, 0xAA, 0xAA, 0xAA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 10 white -> black
+    0x55, 0x55, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 11 white -> white
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // L4 (VCOM)
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+
+    // TP/RP groups (global timing)
+    0x01, 0x01, 0x01, 0x01, 0x01,  // G0: A=1 B=1 C=1 D=1 RP=1
+    0x01, 0x01, 0x01, 0x01, 0x01,  // G1: A=1 B=1 C=1 D=1 RP=1
+    0x01, 0x01, 0x01, 0x01, 0x00,  // G2: A=1 B=1 C=1 D=1 RP=0
+    0x01, 0x01, 0x01, 0x01, 0x00,  // G3: A=1 B=1 C=1 D=1 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G4: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G5: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G6: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G7: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G8: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G9: A=0 B=0 C=0 D=0 RP=0
+
+    // Frame rate
+    0x8F, 0x8F, 0x8F, 0x8F, 0x8F,
+
+    // Voltages (VGH, VSH1, VSH2, VSL, VCOM)
+    0x17, 0x41, 0xA8, 0x32, 0x30,
+
+    // Reserved
+    0x00, 0x00};
+
+// Windowed grayscale LUT
+// Used with BW RAM = LSB and RED RAM = LSB ^ MSB inside the window, and the black/white frame in both RAMs outside
+// of it. Only the two mixed groups drive, so everything outside the window (00/11) is left untouched. They take the
+// dark gray and gray waveforms of lut_grayscale; its light gray (LSB only) lands in group 11 and is not driven.
+const unsigned char lut_grayscale_window[] PROGMEM = {
+    // 00 black/white
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 01 dark gray (LSB and MSB)
+    0xA2, 0x22, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 10 gray (MSB only)
+    0xAA, 0xA0, 0xA8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 11 black/white
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // L4 (VCOM)
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+
+    // TP/RP groups (global timing)
+    0x01, 0x01, 0x01, 0x01, 0x00,  // G0: A=1 B=1 C=1 D=1 RP=0 (4 frames)
+    0x01, 0x01, 0x01, 0x01, 0x00,  // G1: A=1 B=1 C=1 D=1 RP=0 (4 frames)
+    0x01, 0x01, 0x01, 0x01, 0x00,  // G2: A=1 B=1 C=1 D=1 RP=0 (4 frames)
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G3: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G4: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G5: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G6: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G7: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G8: A=0 B=0 C=0 D=0 RP=0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // G9: A=0 B=0 C=0 D=0 RP=0
+
+    // Frame rate
+    0x8F, 0x8F, 0x8F, 0x8F, 0x8F,
+
+    // Voltages (VGH, VSH1, VSH2, VSL, VCOM)
+    0x17, 0x41, 0xA8, 0x32, 0x30,
+
+    // Reserved
+    0x00, 0x00};
+
 // X3 reverse-exact full refresh LUTs (42 bytes each)
 const uint8_t lut_x3_vcom_full[] PROGMEM = {
     0x00, 0x06, 0x02, 0x06, 0x06, 0x01, 0x00, 0x05, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00,
@@ -244,9 +317,16 @@ void EInkDisplay::begin() {
   if (Serial) Serial.printf("[%lu] EInkDisplay: begin() called\n", millis());
 
   frameBuffer = frameBuffer0;
+  displayedFrameBuffer = frameBuffer0;
 #ifndef EINK_DISPLAY_SINGLE_BUFFER_MODE
   frameBufferActive = frameBuffer1;
+  // X4 fast updates swap the buffers, the one on screen is the active one. X3 updates never swap.
+  if (!_x3Mode) {
+    displayedFrameBuffer = frameBufferActive;
+  }
 #endif
+  bwRamStale = false;
+  redRamStale = {};
 
   // Initialize to white
   memset(frameBuffer0, 0xFF, bufferSize);
@@ -335,6 +415,11 @@ void EInkDisplay::waitForRefresh(const char* comment) {
 }
 
 void EInkDisplay::sendCommand(uint8_t command) {
+  // The controller can't take commands while a deferred refresh is still running
+  if (refreshInFlight) {
+    waitForRefreshComplete();
+  }
+
   SPI.beginTransaction(spiSettings);
   digitalWrite(_dc, LOW);  // Command mode
   digitalWrite(_cs, LOW);  // Select chip
@@ -361,6 +446,53 @@ void EInkDisplay::sendData(const uint8_t* data, uint16_t length) {
   SPI.endTransaction();
 }
 
+// Sends a full plane bottom-up (X3 RAM rows are mirrored), composing overlays on the way
+void EInkDisplay::sendMirroredPlane(const uint8_t* plane, const bool invertBits, const OverlaySet overlaySet) {
+  uint8_t row[128];
+  const bool compose = hasOverlays(overlaySet);
+  for (uint16_t y = 0; y < displayHeight; y++) {
+    const uint16_t srcY = static_cast<uint16_t>(displayHeight - 1 - y);
+    const uint8_t* src = plane + static_cast<uint32_t>(srcY) * displayWidthBytes;
+    memcpy(row, src, displayWidthBytes);
+    if (compose) {
+      composeOverlays(row, srcY, 0, displayWidthBytes, overlaySet);
+    }
+    if (invertBits) {
+      for (uint16_t x = 0; x < displayWidthBytes; x++) {
+        row[x] = static_cast<uint8_t>(~row[x]);
+      }
+    }
+    sendData(row, displayWidthBytes);
+  }
+}
+
+// Sends rows bottom-up, matching the mirrored row order of the X3 controller RAM
+void EInkDisplay::sendMirroredRows(const uint8_t* rows, const uint16_t strideBytes, const uint16_t widthBytes,
+                                   const uint16_t rowCount, const bool invertBits) {
+  uint8_t row[128];
+  for (uint16_t i = 0; i < rowCount; i++) {
+    const uint8_t* src = rows + static_cast<uint32_t>(rowCount - 1 - i) * strideBytes;
+    for (uint16_t x = 0; x < widthBytes; x++) {
+      row[x] = invertBits ? static_cast<uint8_t>(~src[x]) : src[x];
+    }
+    sendData(row, widthBytes);
+  }
+}
+
+// X3 partial window (0x90), y is mirrored to match the controller RAM rows
+void EInkDisplay::setX3PartialWindow(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h) {
+  const uint16_t xStart = x;
+  const uint16_t xEnd = static_cast<uint16_t>(x + w - 1);
+  const uint16_t yStart = static_cast<uint16_t>(displayHeight - y - h);
+  const uint16_t yEnd = static_cast<uint16_t>(displayHeight - y - 1);
+  const uint8_t window[9] = {
+      static_cast<uint8_t>(xStart >> 8), static_cast<uint8_t>(xStart & 0xFF), static_cast<uint8_t>(xEnd >> 8),
+      static_cast<uint8_t>(xEnd & 0xFF), static_cast<uint8_t>(yStart >> 8), static_cast<uint8_t>(yStart & 0xFF),
+      static_cast<uint8_t>(yEnd >> 8), static_cast<uint8_t>(yEnd & 0xFF), 0x01};
+  sendCommand(0x90);
+  sendData(window, 9);
+}
+
 void EInkDisplay::waitWhileBusy(const char* comment) {
   unsigned long start = millis();
   if (!_x3Mode) {
@@ -556,6 +688,33 @@ void EInkDisplay::drawImage(const uint8_t* imageData, const uint16_t x, const ui
   if (Serial) Serial.printf("[%lu]   Image drawn to frame buffer\n", millis());
 }
 
+bool EInkDisplay::drawImage(const PackedImage& image, const uint16_t x, const uint16_t y) const {
+  if (!frameBuffer) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Frame buffer not allocated!\n", millis());
+    return false;
+  }
+  if (x % 8 != 0) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Packed image x must be byte-aligned (multiple of 8)!\n", millis());
+    return false;
+  }
+  PackedImage::Reader reader;
+  if (!reader.begin(image, PackedImage::PLANE_BW)) {
+    return false;
+  }
+
+  const uint16_t xByte = x / 8;
+  const uint16_t copyBytes =
+      xByte < displayWidthBytes ? min(image.getWidthBytes(), static_cast<uint16_t>(displayWidthBytes - xByte)) : 0;
+  for (uint16_t row = 0; row < image.getHeight() && y + row < displayHeight; row++) {
+    const uint8_t* data = reader.readRow();
+    if (!data) {
+      return false;
+    }
+    memcpy(frameBuffer + static_cast<uint32_t>(y + row) * displayWidthBytes + xByte, data, copyBytes);
+  }
+  return true;
+}
+
 // Draws only black pixels from the image, leaves white pixels clear (unchanged in framebuffer)
 void EInkDisplay::drawImageTransparent(const uint8_t* imageData, const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h,
                                      const bool fromProgmem) const {
@@ -588,18 +747,382 @@ void EInkDisplay::drawImageTransparent(const uint8_t* imageData, const uint16_t
   if (Serial) Serial.printf("[%lu]   Transparent image drawn to frame buffer\n", millis());
 }
 
-void EInkDisplay::writeRamBuffer(uint8_t ramBuffer, const uint8_t* data, uint32_t size) {
+void EInkDisplay::writeRamBuffer(uint8_t ramBuffer, const uint8_t* data, uint32_t size, const OverlaySet overlaySet) {
   const char* bufferName = (ramBuffer == CMD_WRITE_RAM_BW) ? "BW" : "RED";
   const unsigned long startTime = millis();
   if (Serial) Serial.printf("[%lu]   Writing frame buffer to %s RAM (%lu bytes)...\n", startTime, bufferName, size);
 
   sendCommand(ramBuffer);
-  sendData(data, size);
+  if (!hasOverlays(overlaySet)) {
+    sendData(data, size);
+  } else {
+    // Full frame with overlays: compose row by row on the way out, the frame buffer itself is left untouched
+    uint8_t row[DISPLAY_WIDTH_BYTES];
+    const uint16_t rows = static_cast<uint16_t>(size / displayWidthBytes);
+    for (uint16_t y = 0; y < rows; y++) {
+      memcpy(row, data + static_cast<uint32_t>(y) * displayWidthBytes, displayWidthBytes);
+      composeOverlays(row, y, 0, displayWidthBytes, overlaySet);
+      sendData(row, displayWidthBytes);
+    }
+  }
 
   const unsigned long duration = millis() - startTime;
   if (Serial) Serial.printf("[%lu]   %s RAM write complete (%lu ms)\n", millis(), bufferName, duration);
 }
 
+// Writes a byte-aligned window of a full frame to BW or RED RAM, with the given overlays composed in
+void EInkDisplay::writeRamWindow(const uint8_t ramBuffer, const uint8_t* frame, const uint16_t x, const uint16_t y,
+                                 const uint16_t w, const uint16_t h, const Overlay* overlayList) {
+  const uint16_t xByte = x / 8;
+  const uint16_t widthBytes = w / 8;
+  uint8_t row[DISPLAY_WIDTH_BYTES];
+
+  setRamArea(x, y, w, h);
+  sendCommand(ramBuffer);
+  for (uint16_t r = 0; r < h; r++) {
+    memcpy(row, frame + static_cast<uint32_t>(y + r) * displayWidthBytes + xByte, widthBytes);
+    composeOverlays(row, y + r, xByte, widthBytes, overlayList);
+    sendData(row, widthBytes);
+  }
+}
+
+// Brings both RAMs back to the frame on screen where a grayscale plane, a failed stream or a window update left them
+// behind (X4). Updates that write only part of the RAM rely on the rest of it matching the screen.
+void EInkDisplay::syncRamToScreen() {
+  if (bwRamStale) {
+    setRamArea(0, 0, displayWidth, displayHeight);
+    writeRamBuffer(CMD_WRITE_RAM_BW, displayedFrameBuffer, bufferSize, OVERLAYS_SHOWN);
+    bwRamStale = false;
+  }
+  if (redRamStale.valid) {
+    const DirtyRegion& r = redRamStale;
+    if (Serial) Serial.printf("[%lu]   Syncing RED RAM (%u,%u)-(%u,%u)\n", millis(), r.x0, r.y0, r.x1, r.y1);
+    writeRamWindow(CMD_WRITE_RAM_RED, displayedFrameBuffer, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0, shownOverlays);
+    redRamStale.valid = false;
+  }
+}
+
+void EInkDisplay::markRedStale(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h) {
+  if (w == 0 || h == 0 || x >= displayWidth || y >= displayHeight) {
+    return;
+  }
+  // RAM windows are byte-aligned
+  const uint16_t x1 = min<uint16_t>(displayWidth, (x + w + 7) & ~0x07);
+  growRegion(redRamStale, x & ~0x07, y, x1, min<uint16_t>(displayHeight, y + h));
+}
+
+// Marks where RED RAM, still holding `previous` with the shown overlays, differs from `shown` now on screen with the
+// pending overlays
+void EInkDisplay::markRedStaleChanges(const uint8_t* shown, const uint8_t* previous) {
+  uint16_t firstRow = displayHeight, lastRow = 0;
+  uint16_t firstByte = displayWidthBytes, endByte = 0;
+  for (uint16_t y = 0; y < displayHeight; y++) {
+    const uint8_t* a = shown + static_cast<uint32_t>(y) * displayWidthBytes;
+    const uint8_t* b = previous + static_cast<uint32_t>(y) * displayWidthBytes;
+    if (memcmp(a, b, displayWidthBytes) == 0) {
+      continue;
+    }
+    firstRow = min(firstRow, y);
+    lastRow = y;
+    uint16_t i = 0;
+    while (i < firstByte && a[i] == b[i]) {
+      i++;
+    }
+    firstByte = i;
+    uint16_t j = displayWidthBytes;
+    while (j > endByte && a[j - 1] == b[j - 1]) {
+      j--;
+    }
+    endByte = j;
+  }
+  if (firstRow < displayHeight) {
+    markRedStale(firstByte * 8, firstRow, (endByte - firstByte) * 8, lastRow - firstRow + 1);
+  }
+
+  uint16_t x, y, w, h;
+  if (getOverlayDirtyWindow(x, y, w, h)) {
+    markRedStale(x, y, w, h);
+  }
+}
+
+// ============================================================================
+// Scrolling and dirty region tracking
+// ============================================================================
+
+bool EInkDisplay::scrollRegion(const uint16_t regionY, const uint16_t regionH, const int16_t dy,
+                               const ScrollStripRenderer renderStrip, void* context, const uint8_t fillColor) {
+  if (!frameBuffer) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Frame buffer not allocated!\n", millis());
+    return false;
+  }
+
+  if (regionH == 0 || regionY + regionH > displayHeight) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Scroll region exceeds display dimensions!\n", millis());
+    return false;
+  }
+
+  if (dy == 0) {
+    return true;
+  }
+
+  const uint16_t shift = static_cast<uint16_t>(min<int32_t>(dy < 0 ? -dy : dy, regionH));
+  const uint16_t keptRows = regionH - shift;
+  const uint32_t rowBytes = displayWidthBytes;
+  uint8_t* region = frameBuffer + regionY * rowBytes;
+
+  // In dual buffer mode the frame on screen may live in the other buffer, bring it over while shifting.
+  // Once something is marked dirty the frame buffer is the working copy and further scrolls build on it.
+  const uint8_t* source = (displayedFrameBuffer && !dirty.valid) ? displayedFrameBuffer : frameBuffer;
+  if (source != frameBuffer) {
+    memcpy(frameBuffer, source, regionY * rowBytes);
+    const uint32_t below = static_cast<uint32_t>(regionY + regionH) * rowBytes;
+    memcpy(frameBuffer + below, source + below, bufferSize - below);
+  }
+  const uint8_t* sourceRegion = source + regionY * rowBytes;
+
+  uint16_t stripY;
+  if (dy > 0) {
+    // Content moves up, new rows appear at the bottom
+    memmove(region, sourceRegion + shift * rowBytes, keptRows * rowBytes);
+    stripY = regionY + keptRows;
+  } else {
+    // Content moves down, new rows appear at the top
+    memmove(region + shift * rowBytes, sourceRegion, keptRows * rowBytes);
+    stripY = regionY;
+  }
+  memset(frameBuffer + stripY * rowBytes, fillColor, shift * rowBytes);
+
+  if (renderStrip) {
+    renderStrip(frameBuffer, stripY, shift, context);
+  }
+
+  // Every row of the region moved, not just the new strip
+  markDirty(0, regionY, displayWidth, regionH);
+  return true;
+}
+
+void EInkDisplay::markDirty(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h) {
+  if (w == 0 || h == 0 || x >= displayWidth || y >= displayHeight) {
+    return;
+  }
+
+  growRegion(dirty, x, y, min<uint16_t>(displayWidth, x + w), min<uint16_t>(displayHeight, y + h));
+}
+
+void EInkDisplay::growRegion(DirtyRegion& region, const uint16_t x0, const uint16_t y0, const uint16_t x1,
+                             const uint16_t y1) {
+  if (!region.valid) {
+    region = {x0, y0, x1, y1, true};
+    return;
+  }
+  region.x0 = min(region.x0, x0);
+  region.y0 = min(region.y0, y0);
+  region.x1 = max(region.x1, x1);
+  region.y1 = max(region.y1, y1);
+}
+
+bool EInkDisplay::getDirtyWindow(uint16_t& x, uint16_t& y, uint16_t& w, uint16_t& h) const {
+  if (!dirty.valid) {
+    return false;
+  }
+
+  // Widen to byte boundaries as required by displayWindow()
+  const uint16_t x0 = dirty.x0 & ~0x07;
+  const uint16_t x1 = min<uint16_t>(displayWidth, (dirty.x1 + 7) & ~0x07);
+  x = x0;
+  y = dirty.y0;
+  w = x1 - x0;
+  h = dirty.y1 - dirty.y0;
+  return true;
+}
+
+void EInkDisplay::clearDirty() {
+  dirty.valid = false;
+}
+
+// ============================================================================
+// Overlays
+// ============================================================================
+
+int8_t EInkDisplay::addOverlay(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h,
+                               const OverlayMode mode, const uint8_t* mask) {
+  if (w == 0 || h == 0) {
+    return -1;
+  }
+
+  for (uint8_t i = 0; i < MAX_OVERLAYS; i++) {
+    if (!overlays[i].active) {
+      overlays[i] = {mask, x, y, w, h, mode, true};
+      return static_cast<int8_t>(i);
+    }
+  }
+
+  if (Serial) Serial.printf("[%lu]   ERROR: No free overlay slots (max %u)\n", millis(), MAX_OVERLAYS);
+  return -1;
+}
+
+bool EInkDisplay::moveOverlay(const int8_t id, const uint16_t x, const uint16_t y) {
+  if (id < 0 || id >= MAX_OVERLAYS || !overlays[id].active) {
+    return false;
+  }
+  overlays[id].x = x;
+  overlays[id].y = y;
+  return true;
+}
+
+void EInkDisplay::removeOverlay(const int8_t id) {
+  if (id >= 0 && id < MAX_OVERLAYS) {
+    overlays[id].active = false;
+  }
+}
+
+void EInkDisplay::clearOverlays() {
+  for (auto& overlay : overlays) {
+    overlay.active = false;
+  }
+}
+
+bool EInkDisplay::getOverlayDirtyWindow(uint16_t& x, uint16_t& y, uint16_t& w, uint16_t& h) const {
+  uint16_t x0 = displayWidth, y0 = displayHeight, x1 = 0, y1 = 0;
+
+  auto include = [&](const Overlay& o) {
+    x0 = min<uint16_t>(x0, o.x);
+    y0 = min<uint16_t>(y0, o.y);
+    x1 = max<uint16_t>(x1, min<uint16_t>(displayWidth, o.x + o.w));
+    y1 = max<uint16_t>(y1, min<uint16_t>(displayHeight, o.y + o.h));
+  };
+
+  for (uint8_t i = 0; i < MAX_OVERLAYS; i++) {
+    const Overlay& pending = overlays[i];
+    const Overlay& shown = shownOverlays[i];
+    if (!pending.active && !shown.active) continue;
+    if (pending.active && shown.active && pending.x == shown.x && pending.y == shown.y && pending.w == shown.w &&
+        pending.h == shown.h && pending.mode == shown.mode && pending.mask == shown.mask) {
+      continue;
+    }
+    if (pending.active) include(pending);
+    if (shown.active) include(shown);
+  }
+
+  if (x0 >= x1 || y0 >= y1) {
+    return false;
+  }
+
+  // Widen to byte boundaries as required by displayWindow()
+  x0 &= ~0x07;
+  x1 = min<uint16_t>(displayWidth, (x1 + 7) & ~0x07);
+  x = x0;
+  y = y0;
+  w = x1 - x0;
+  h = y1 - y0;
+  return true;
+}
+
+bool EInkDisplay::hasOverlays(const OverlaySet overlaySet) const {
+  if (overlaySet == OVERLAYS_NONE) {
+    return false;
+  }
+  const Overlay* list = (overlaySet == OVERLAYS_PENDING) ? overlays : shownOverlays;
+  for (uint8_t i = 0; i < MAX_OVERLAYS; i++) {
+    if (list[i].active) return true;
+  }
+  return false;
+}
+
+// Composes the overlays of the given set into `row`, which holds `widthBytes` frame bytes of screen row `y`
+// starting at byte column `xByte`
+void EInkDisplay::composeOverlays(uint8_t* row, const uint16_t y, const uint16_t xByte, const uint16_t widthBytes,
+                                  const OverlaySet overlaySet) const {
+  if (overlaySet != OVERLAYS_NONE) {
+    composeOverlays(row, y, xByte, widthBytes, overlaySet == OVERLAYS_PENDING ? overlays : shownOverlays);
+  }
+}
+
+void EInkDisplay::composeOverlays(uint8_t* row, const uint16_t y, const uint16_t xByte, const uint16_t widthBytes,
+                                  const Overlay* list) const {
+  for (uint8_t i = 0; i < MAX_OVERLAYS; i++) {
+    const Overlay& o = list[i];
+    if (!o.active || y < o.y || y >= o.y + o.h) continue;
+
+    const uint16_t maskWidthBytes = (o.w + 7) / 8;
+    const uint8_t* maskRow = o.mask ? o.mask + static_cast<uint32_t>(y - o.y) * maskWidthBytes : nullptr;
+    const uint16_t firstByte = max<uint16_t>(xByte, o.x / 8);
+    const uint16_t lastByte = min<uint16_t>(xByte + widthBytes, (o.x + o.w + 7) / 8);
+
+    for (uint16_t b = firstByte; b < lastByte; b++) {
+      // Pixel range of this overlay inside byte b
+      const int32_t px0 = static_cast<int32_t>(b) * 8;
+      const uint8_t lo = static_cast<uint8_t>(max<int32_t>(o.x, px0) - px0);
+      const uint8_t hi = static_cast<uint8_t>(min<int32_t>(o.x + o.w, px0 + 8) - px0);
+      uint8_t m = static_cast<uint8_t>((0xFF >> lo) & (0xFF << (8 - hi)));
+
+      if (maskRow) {
+        const int32_t col0 = px0 - o.x;
+        uint8_t bits = 0;
+        if (col0 >= 0 && (col0 & 7) == 0) {
+          bits = maskRow[col0 / 8];
+        } else {
+          for (uint8_t k = lo; k < hi; k++) {
+            const int32_t col = col0 + k;
+            if ((maskRow[col / 8] >> (7 - (col & 7))) & 1) bits |= 0x80 >> k;
+          }
+        }
+        m &= bits;
+      }
+
+      uint8_t& dst = row[b - xByte];
+      switch (o.mode) {
+        case OVERLAY_INVERT:
+          dst ^= m;
+          break;
+        case OVERLAY_WHITE:
+          dst |= m;
+          break;
+        case OVERLAY_BLACK:
+          dst &= static_cast<uint8_t>(~m);
+          break;
+      }
+    }
+  }
+}
+
+// The overlays just sent to the panel become the baseline for the next differential update
+void EInkDisplay::commitOverlays() {
+  memcpy(shownOverlays, overlays, sizeof(overlays));
+}
+
+// The overlays on screen once a window update is done: a change is taken only if it lies entirely inside the window,
+// both where the overlay was and where it goes. Anything else stays as shown until an update covers it.
+void EInkDisplay::windowOverlays(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h,
+                                 Overlay* out) const {
+  const auto inside = [&](const Overlay& o) {
+    return !o.active || (o.x >= x && o.y >= y && min<uint16_t>(displayWidth, o.x + o.w) <= x + w &&
+                         min<uint16_t>(displayHeight, o.y + o.h) <= y + h);
+  };
+  for (uint8_t i = 0; i < MAX_OVERLAYS; i++) {
+    out[i] = inside(overlays[i]) && inside(shownOverlays[i]) ? overlays[i] : shownOverlays[i];
+  }
+}
+
+bool EInkDisplay::displayOverlays(const bool turnOffScreen) {
+  uint16_t x, y, w, h;
+  if (!frameBuffer || !getOverlayDirtyWindow(x, y, w, h)) {
+    return false;
+  }
+  if (streamedFrameShown) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Overlays cannot be updated over a streamed image\n", millis());
+    return false;
+  }
+
+  if (_x3Mode) {
+    displayBuffer(FAST_REFRESH, turnOffScreen);
+    return true;
+  }
+  if (Serial) Serial.printf("[%lu]   Displaying overlays at (%d,%d) size (%dx%d)\n", millis(), x, y, w, h);
+  updateWindow(displayedFrameBuffer, x, y, w, h, turnOffScreen);
+  return true;
+}
+
 void EInkDisplay::setFramebuffer(const uint8_t* bwBuffer) const {
   memcpy(frameBuffer, bwBuffer, bufferSize);
 }
@@ -619,12 +1142,27 @@ void EInkDisplay::grayscaleRevert() {
 
   inGrayscaleMode = false;
 
-  // Load the revert LUT
-  setCustomLUT(true, lut_grayscale_revert);
+  // Windowed grays leave the black/white frame in both RAMs, where the fused LUT's black->black group settles them
+  // and the regular revert LUT would darken every white pixel instead
+  setCustomLUT(true, grayscaleWindowed ? lut_grayscale_fused_revert : lut_grayscale_revert);
   refreshDisplay(FAST_REFRESH);
   setCustomLUT(false);
 }
 
+void EInkDisplay::setFusedGrayscaleRevert(const bool enabled) {
+  fusedGrayscaleRevert = enabled;
+}
+
+// Expects the next frame in BW RAM and the last black/white frame in RED RAM
+void EInkDisplay::refreshWithGrayscaleRevert(const bool turnOffScreen) {
+  inGrayscaleMode = false;
+
+  if (Serial) Serial.printf("[%lu]   Fused grayscale revert + fast refresh\n", millis());
+  setCustomLUT(true, lut_grayscale_fused_revert);
+  refreshDisplay(FAST_REFRESH, turnOffScreen);
+  setCustomLUT(false);
+}
+
 void EInkDisplay::copyGrayscaleLsbBuffers(const uint8_t* lsbBuffer) {
   if (!lsbBuffer) {
     _x3GrayState.lsbValid = false;
@@ -633,25 +1171,14 @@ void EInkDisplay::copyGrayscaleLsbBuffers(const uint8_t* lsbBuffer) {
 
   if (_x3Mode) {
     // X3 single-pass AA: write LSB plane to old-data RAM.
-    uint8_t row[128];
-    auto sendMirroredPlane = [&](const uint8_t* plane) {
-      for (uint16_t y = 0; y < displayHeight; y++) {
-        const uint16_t srcY = static_cast<uint16_t>(displayHeight - 1 - y);
-        const uint8_t* src = plane + static_cast<uint32_t>(srcY) * displayWidthBytes;
-        for (uint16_t x = 0; x < displayWidthBytes; x++) {
-          row[x] = src[x];
-        }
-        sendData(row, displayWidthBytes);
-      }
-    };
-
     sendCommand(0x10);
-    sendMirroredPlane(lsbBuffer);
+    sendMirroredPlane(lsbBuffer, false);
     _x3GrayState.lsbValid = true;
     return;
   }
   setRamArea(0, 0, displayWidth, displayHeight);
   writeRamBuffer(CMD_WRITE_RAM_BW, lsbBuffer, bufferSize);
+  bwRamStale = true;
 }
 
 void EInkDisplay::copyGrayscaleMsbBuffers(const uint8_t* msbBuffer) {
@@ -664,24 +1191,13 @@ void EInkDisplay::copyGrayscaleMsbBuffers(const uint8_t* msbBuffer) {
       return;
     }
 
-    uint8_t row[128];
-    auto sendMirroredPlane = [&](const uint8_t* plane) {
-      for (uint16_t y = 0; y < displayHeight; y++) {
-        const uint16_t srcY = static_cast<uint16_t>(displayHeight - 1 - y);
-        const uint8_t* src = plane + static_cast<uint32_t>(srcY) * displayWidthBytes;
-        for (uint16_t x = 0; x < displayWidthBytes; x++) {
-          row[x] = src[x];
-        }
-        sendData(row, displayWidthBytes);
-      }
-    };
-
     sendCommand(0x13);
-    sendMirroredPlane(msbBuffer);
+    sendMirroredPlane(msbBuffer, false);
     return;
   }
   setRamArea(0, 0, displayWidth, displayHeight);
   writeRamBuffer(CMD_WRITE_RAM_RED, msbBuffer, bufferSize);
+  markRedStale(0, 0, displayWidth, displayHeight);
 }
 
 void EInkDisplay::copyGrayscaleBuffers(const uint8_t* lsbBuffer, const uint8_t* msbBuffer) {
@@ -693,6 +1209,41 @@ void EInkDisplay::copyGrayscaleBuffers(const uint8_t* lsbBuffer, const uint8_t*
   setRamArea(0, 0, displayWidth, displayHeight);
   writeRamBuffer(CMD_WRITE_RAM_BW, lsbBuffer, bufferSize);
   writeRamBuffer(CMD_WRITE_RAM_RED, msbBuffer, bufferSize);
+  bwRamStale = true;
+  markRedStale(0, 0, displayWidth, displayHeight);
+}
+
+bool EInkDisplay::copyGrayscaleBuffers(const PackedImage& image) {
+  if (!image.hasGray() || image.getWidth() != displayWidth || image.getHeight() != displayHeight) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Not a full screen grayscale image\n", millis());
+    return false;
+  }
+  PackedImage::Reader lsb;
+  PackedImage::Reader msb;
+  if (!lsb.begin(image, PackedImage::PLANE_LSB) || !msb.begin(image, PackedImage::PLANE_MSB)) {
+    return false;
+  }
+
+  if (_x3Mode) {
+    _x3GrayState.lsbValid = false;
+    sendCommand(0x10);
+    if (!streamMirroredToRam(PackedImage::Reader::stream, &lsb, false)) {
+      return false;
+    }
+    sendCommand(0x13);
+    _x3GrayState.lsbValid = streamMirroredToRam(PackedImage::Reader::stream, &msb, false);
+    return _x3GrayState.lsbValid;
+  }
+
+  const bool uploaded = streamToRam(PackedImage::Reader::stream, &lsb, true, false) &&
+                        streamToRam(PackedImage::Reader::stream, &msb, false, true);
+  bwRamStale = true;
+  markRedStale(0, 0, displayWidth, displayHeight);
+  if (!uploaded && !streamedFrameShown) {
+    // Put the frame on screen back over the partly uploaded planes
+    syncRamToScreen();
+  }
+  return uploaded;
 }
 
 #ifdef EINK_DISPLAY_SINGLE_BUFFER_MODE
@@ -707,18 +1258,6 @@ void EInkDisplay::cleanupGrayscaleBuffers(const uint8_t* bwBuffer) {
       return;
     }
 
-    uint8_t row[128];
-    auto sendMirroredPlane = [&](const uint8_t* plane, bool invertBits) {
-      for (uint16_t y = 0; y < displayHeight; y++) {
-        const uint16_t srcY = static_cast<uint16_t>(displayHeight - 1 - y);
-        const uint8_t* src = plane + static_cast<uint32_t>(srcY) * displayWidthBytes;
-        for (uint16_t x = 0; x < displayWidthBytes; x++) {
-          row[x] = invertBits ? static_cast<uint8_t>(~src[x]) : src[x];
-        }
-        sendData(row, displayWidthBytes);
-      }
-    };
-
     // Rebase both X3 planes from restored BW buffer so next differential update
     // compares from a coherent known state.
     sendCommand(0x13);
@@ -734,6 +1273,7 @@ void EInkDisplay::cleanupGrayscaleBuffers(const uint8_t* bwBuffer) {
 
   setRamArea(0, 0, displayWidth, displayHeight);
   writeRamBuffer(CMD_WRITE_RAM_RED, bwBuffer, bufferSize);
+  redRamStale.valid = false;
 }
 #endif
 
@@ -744,9 +1284,11 @@ void EInkDisplay::displayBuffer(RefreshMode mode, const bool turnOffScreen) {
     mode = HALF_REFRESH;
   }
 
+  // Fast refreshes can fold the grayscale revert into the update itself (see setFusedGrayscaleRevert)
+  const bool fusedRevert = inGrayscaleMode && fusedGrayscaleRevert && mode == FAST_REFRESH && !_x3Mode;
+
   // If currently in grayscale mode, revert first to black/white
-  if (inGrayscaleMode) {
-    inGrayscaleMode = false;
+  if (inGrayscaleMode && !fusedRevert) {
     grayscaleRevert();
   }
 
@@ -757,7 +1299,6 @@ void EInkDisplay::displayBuffer(RefreshMode mode, const bool turnOffScreen) {
     // On X3, treat HALF refresh as fast differential mode.
     // Reader uses HALF as a cadence hint, but forcing full here makes turns too slow.
     const bool fastMode = (mode != FULL_REFRESH);
-    uint8_t row[128];
     auto sendCommandDataX3 = [&](uint8_t cmd, const uint8_t* data, uint16_t len) {
       SPI.beginTransaction(spiSettings);
       digitalWrite(_cs, LOW);
@@ -774,17 +1315,6 @@ void EInkDisplay::displayBuffer(RefreshMode mode, const bool turnOffScreen) {
       const uint8_t d[2] = {d0, d1};
       sendCommandDataX3(cmd, d, 2);
     };
-    auto sendMirroredPlane = [&](const uint8_t* plane, bool invertBits) {
-      for (uint16_t y = 0; y < displayHeight; y++) {
-        const uint16_t srcY = static_cast<uint16_t>(displayHeight - 1 - y);
-        const uint8_t* src = plane + static_cast<uint32_t>(srcY) * displayWidthBytes;
-        for (uint16_t x = 0; x < displayWidthBytes; x++) {
-          row[x] = invertBits ? static_cast<uint8_t>(~src[x]) : src[x];
-        }
-        sendData(row, displayWidthBytes);
-      }
-    };
-
     const bool forcedFullSync = _x3ForceFullSyncNext;
     const bool doFullSync = !fastMode || !_x3RedRamSynced ||
                             _x3InitialFullSyncsRemaining > 0 || forcedFullSync;
@@ -803,9 +1333,9 @@ void EInkDisplay::displayBuffer(RefreshMode mode, const bool turnOffScreen) {
       sendCommandDataX3(0x24, lut_x3_bb_img, 42);
 
       sendCommand(0x13);
-      sendMirroredPlane(frameBuffer, true);
+      sendMirroredPlane(frameBuffer, true, OVERLAYS_PENDING);
       sendCommand(0x10);
-      sendMirroredPlane(frameBuffer, true);
+      sendMirroredPlane(frameBuffer, true, OVERLAYS_PENDING);
 
       sendCommandDataByteX3(0x50, 0xA9, 0x07);
     } else {
@@ -818,7 +1348,19 @@ void EInkDisplay::displayBuffer(RefreshMode mode, const bool turnOffScreen) {
 
       // Write only new data to 0x13; controller diffs against 0x10
       sendCommand(0x13);
-      sendMirroredPlane(frameBuffer, false);
+      sendMirroredPlane(frameBuffer, false, OVERLAYS_PENDING);
+
+      // A windowed grayscale image is still on screen: store the inverse of the new frame as its old data so every
+      // pixel in the window gets driven, instead of gray pixels being skipped as unchanged
+      if (_x3GrayState.windowValid) {
+        const X3GrayState& g = _x3GrayState;
+        sendCommand(0x91);
+        setX3PartialWindow(g.windowX, g.windowY, g.windowW, g.windowH);
+        sendCommand(0x10);
+        sendMirroredRows(frameBuffer + static_cast<uint32_t>(g.windowY) * displayWidthBytes + g.windowX / 8,
+                         displayWidthBytes, g.windowW / 8, g.windowH, true);
+        sendCommand(0x92);
+      }
 
       sendCommandDataByteX3(0x50, 0x29, 0x07);
     }
@@ -853,15 +1395,6 @@ void EInkDisplay::displayBuffer(RefreshMode mode, const bool turnOffScreen) {
     }
 
     if (postConditionPasses > 0) {
-      const uint16_t xStart = 0;
-      const uint16_t xEnd = static_cast<uint16_t>(displayWidth - 1);
-      const uint16_t yStart = 0;
-      const uint16_t yEnd = static_cast<uint16_t>(displayHeight - 1);
-      const uint8_t w[9] = {
-          static_cast<uint8_t>(xStart >> 8), static_cast<uint8_t>(xStart & 0xFF), static_cast<uint8_t>(xEnd >> 8),
-          static_cast<uint8_t>(xEnd & 0xFF), static_cast<uint8_t>(yStart >> 8), static_cast<uint8_t>(yStart & 0xFF),
-          static_cast<uint8_t>(yEnd >> 8), static_cast<uint8_t>(yEnd & 0xFF), 0x01};
-
       sendCommandDataX3(0x20, lut_x3_vcom_full, 42);
       sendCommandDataX3(0x21, lut_x3_ww_full, 42);
       sendCommandDataX3(0x22, lut_x3_bw_full, 42);
@@ -872,9 +1405,9 @@ void EInkDisplay::displayBuffer(RefreshMode mode, const bool turnOffScreen) {
       for (uint8_t i = 0; i < postConditionPasses; i++) {
         if (Serial) Serial.printf("[%lu]   X3_OEM_COND %u/%u\n", millis(), static_cast<unsigned>(i + 1), static_cast<unsigned>(postConditionPasses));
         sendCommand(0x91);
-        sendCommandDataX3(0x90, w, 9);
+        setX3PartialWindow(0, 0, displayWidth, displayHeight);
         sendCommand(0x13);
-        sendMirroredPlane(frameBuffer, false);
+        sendMirroredPlane(frameBuffer, false, OVERLAYS_PENDING);
         sendCommand(0x92);
         if (!isScreenOn) {
           sendCommand(0x04);
@@ -890,8 +1423,13 @@ void EInkDisplay::displayBuffer(RefreshMode mode, const bool turnOffScreen) {
     // Sync RED RAM (0x10) with non-inverted current frame for next fast diff.
     // This is a controller memory write — doesn't need the charge pump.
     sendCommand(0x10);
-    sendMirroredPlane(frameBuffer, false);
+    sendMirroredPlane(frameBuffer, false, OVERLAYS_PENDING);
     _x3RedRamSynced = true;
+    _x3GrayState.windowValid = false;
+    displayedFrameBuffer = frameBuffer;
+    streamedFrameShown = false;
+    commitOverlays();
+    clearDirty();
 
     if (doFullSync && _x3InitialFullSyncsRemaining > 0) {
       _x3InitialFullSyncsRemaining--;
@@ -906,31 +1444,56 @@ void EInkDisplay::displayBuffer(RefreshMode mode, const bool turnOffScreen) {
 
   if (mode != FAST_REFRESH) {
     // For full refresh, write to both buffers before refresh
-    writeRamBuffer(CMD_WRITE_RAM_BW, frameBuffer, bufferSize);
-    writeRamBuffer(CMD_WRITE_RAM_RED, frameBuffer, bufferSize);
+    writeRamBuffer(CMD_WRITE_RAM_BW, frameBuffer, bufferSize, OVERLAYS_PENDING);
+    writeRamBuffer(CMD_WRITE_RAM_RED, frameBuffer, bufferSize, OVERLAYS_PENDING);
   } else {
     // For fast refresh, write to BW buffer only
-    writeRamBuffer(CMD_WRITE_RAM_BW, frameBuffer, bufferSize);
+    writeRamBuffer(CMD_WRITE_RAM_BW, frameBuffer, bufferSize, OVERLAYS_PENDING);
     // In single buffer mode, the RED RAM should already contain the previous frame
-    // In dual buffer mode, we write back frameBufferActive which is the last frame
+    // In dual buffer mode, we write back frameBufferActive which is the last frame, with the overlays it was shown with,
+    // unless a streamed image is on screen, which displayStream() already left in RED RAM
 #ifndef EINK_DISPLAY_SINGLE_BUFFER_MODE
-    writeRamBuffer(CMD_WRITE_RAM_RED, frameBufferActive, bufferSize);
+    if (!streamedFrameShown) {
+      writeRamBuffer(CMD_WRITE_RAM_RED, frameBufferActive, bufferSize, OVERLAYS_SHOWN);
+    }
 #endif
   }
 
 #ifndef EINK_DISPLAY_SINGLE_BUFFER_MODE
+  // RED RAM keeps the previous frame where it differs from this one, until an update that needs it catches it up
+  redRamStale.valid = false;
+  if (mode == FAST_REFRESH) {
+    if (streamedFrameShown) {
+      markRedStale(0, 0, displayWidth, displayHeight);
+    } else {
+      markRedStaleChanges(frameBuffer, frameBufferActive);
+    }
+  }
   swapBuffers();
 #endif
 
   // Refresh the display
-  refreshDisplay(mode, turnOffScreen);
+  if (fusedRevert) {
+    refreshWithGrayscaleRevert(turnOffScreen);
+  } else {
+    refreshDisplay(mode, turnOffScreen);
+  }
 
 #ifdef EINK_DISPLAY_SINGLE_BUFFER_MODE
   // In single buffer mode always sync RED RAM after refresh to prepare for next fast refresh
   // This ensures RED contains the currently displayed frame for differential comparison
   setRamArea(0, 0, displayWidth, displayHeight);
-  writeRamBuffer(CMD_WRITE_RAM_RED, frameBuffer, bufferSize);
+  writeRamBuffer(CMD_WRITE_RAM_RED, frameBuffer, bufferSize, OVERLAYS_PENDING);
+  displayedFrameBuffer = frameBuffer;
+  redRamStale.valid = false;
+#else
+  displayedFrameBuffer = frameBufferActive;
 #endif
+  bwRamStale = false;
+  grayscaleWindowed = false;
+  streamedFrameShown = false;
+  commitOverlays();
+  clearDirty();
 }
 
 // EXPERIMENTAL: Windowed update support
@@ -956,57 +1519,223 @@ void EInkDisplay::displayWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
     return;
   }
 
-  // displayWindow is not supported while the rest of the screen has grayscale content, revert it
-  if (inGrayscaleMode) {
-    inGrayscaleMode = false;
-    grayscaleRevert();
+  // The X3 controller is only driven through its own update policy, which does not swap buffers either
+  if (_x3Mode) {
+    displayBuffer(FAST_REFRESH, turnOffScreen);
+    return;
   }
 
-  // Calculate window buffer size
-  const uint16_t windowWidthBytes = w / 8;
-  const uint32_t windowBufferSize = windowWidthBytes * h;
+  updateWindow(frameBuffer, x, y, w, h, turnOffScreen);
+  if (dirty.valid && x <= dirty.x0 && y <= dirty.y0 && x + w >= dirty.x1 && y + h >= dirty.y1) {
+    clearDirty();
+  }
+  if (Serial) Serial.printf("[%lu]   Window display complete\n", millis());
+}
+
+// Fast update of a byte-aligned window of `source` on X4. Outside the window both RAMs must hold the frame on screen
+// so nothing there is driven. The frame buffers are never swapped: in dual buffer mode the window is copied into the
+// frame on screen and RED RAM catches up with it before the next update that relies on it.
+void EInkDisplay::updateWindow(const uint8_t* source, const uint16_t x, const uint16_t y, const uint16_t w,
+                               const uint16_t h, const bool turnOffScreen) {
+  // The grayscale content may extend past the window, so with the fused revert enabled widen the update to the
+  // full screen and settle the grays in the same waveform instead of paying for a separate revert pass.
+  // After a failed stream the rest of the screen is in neither RAM nor frame buffer, so it is replaced as well.
+  const bool fusedRevert = inGrayscaleMode && fusedGrayscaleRevert;
 
-  if (Serial) Serial.printf("[%lu]   Window buffer size: %lu bytes (%d x %d pixels)\n", millis(), windowBufferSize, w, h);
+  // displayWindow is not supported while the rest of the screen has grayscale content, revert it
+  if (inGrayscaleMode && !fusedRevert) {
+    grayscaleRevert();
+  }
+  if (fusedRevert || (streamedFrameShown && bwRamStale)) {
+    updateFullScreen(source, fusedRevert, turnOffScreen);
+    return;
+  }
+  // A streamed image is in no frame buffer, but displayStream() left it in both RAMs
+  if (!streamedFrameShown) {
+    syncRamToScreen();
+  }
 
-  // Allocate temporary buffer on stack
-  std::vector<uint8_t> windowBuffer(windowBufferSize);
+  Overlay shown[MAX_OVERLAYS];
+  windowOverlays(x, y, w, h, shown);
+  writeRamWindow(CMD_WRITE_RAM_BW, source, x, y, w, h, shown);
+  refreshDisplay(FAST_REFRESH, turnOffScreen);
 
-  // Extract window region from frame buffer
-  for (uint16_t row = 0; row < h; row++) {
-    const uint16_t srcY = y + row;
-    const uint16_t srcOffset = srcY * displayWidthBytes + (x / 8);
-    const uint16_t dstOffset = row * windowWidthBytes;
-    memcpy(&windowBuffer[dstOffset], &frameBuffer[srcOffset], windowWidthBytes);
+#ifndef EINK_DISPLAY_SINGLE_BUFFER_MODE
+  if (!streamedFrameShown) {
+    if (source != displayedFrameBuffer) {
+      for (uint16_t row = y; row < y + h; row++) {
+        const uint32_t offset = static_cast<uint32_t>(row) * displayWidthBytes + x / 8;
+        memcpy(displayedFrameBuffer + offset, source + offset, w / 8);
+      }
+    }
+    markRedStale(x, y, w, h);
+  } else {
+    writeRamWindow(CMD_WRITE_RAM_RED, source, x, y, w, h, shown);
   }
+#else
+  // Post-refresh: Sync RED RAM with current window (for next fast refresh)
+  writeRamWindow(CMD_WRITE_RAM_RED, source, x, y, w, h, shown);
+#endif
+  memcpy(shownOverlays, shown, sizeof(shown));
+}
 
-  // Configure RAM area for window
-  setRamArea(x, y, w, h);
+// updateWindow() widened to the full screen, still without swapping the frame buffers
+void EInkDisplay::updateFullScreen(const uint8_t* source, const bool fusedRevert, const bool turnOffScreen) {
+  // RED RAM must hold the frame on screen (for the fused revert the black/white frame under the grays), a streamed
+  // image is already there. BW RAM is rewritten anyway.
+  bwRamStale = false;
+  if (!streamedFrameShown) {
+    syncRamToScreen();
+  }
 
-  // Write to BW RAM (current frame)
-  writeRamBuffer(CMD_WRITE_RAM_BW, windowBuffer.data(), windowBufferSize);
+  setRamArea(0, 0, displayWidth, displayHeight);
+  writeRamBuffer(CMD_WRITE_RAM_BW, source, bufferSize, OVERLAYS_PENDING);
+  if (fusedRevert) {
+    refreshWithGrayscaleRevert(turnOffScreen);
+  } else {
+    refreshDisplay(FAST_REFRESH, turnOffScreen);
+  }
 
 #ifndef EINK_DISPLAY_SINGLE_BUFFER_MODE
-  // Dual buffer: Extract window from frameBufferActive (previous frame)
-  std::vector<uint8_t> previousWindowBuffer(windowBufferSize);
-  for (uint16_t row = 0; row < h; row++) {
-    const uint16_t srcY = y + row;
-    const uint16_t srcOffset = srcY * displayWidthBytes + (x / 8);
-    const uint16_t dstOffset = row * windowWidthBytes;
-    memcpy(&previousWindowBuffer[dstOffset], &frameBufferActive[srcOffset], windowWidthBytes);
+  if (streamedFrameShown) {
+    markRedStale(0, 0, displayWidth, displayHeight);
+  } else {
+    markRedStaleChanges(source, displayedFrameBuffer);
+  }
+  if (source != displayedFrameBuffer) {
+    memcpy(displayedFrameBuffer, source, bufferSize);
   }
-  writeRamBuffer(CMD_WRITE_RAM_RED, previousWindowBuffer.data(), windowBufferSize);
+#else
+  setRamArea(0, 0, displayWidth, displayHeight);
+  writeRamBuffer(CMD_WRITE_RAM_RED, source, bufferSize, OVERLAYS_PENDING);
 #endif
+  grayscaleWindowed = false;
+  streamedFrameShown = false;
+  commitOverlays();
+  if (Serial) Serial.printf("[%lu]   Window widened to the full screen\n", millis());
+}
 
-  // Perform fast refresh
-  refreshDisplay(FAST_REFRESH, turnOffScreen);
+// Grayscale update of a single rectangle (e.g. an inline image) on top of the black/white frame already on screen.
+// The gray pixels must be black in that frame, as with the full screen grayscale flow.
+// Requirements: x and w must be byte-aligned (multiples of 8 pixels), planes are packed (w / 8) x h bytes
+void EInkDisplay::displayGrayWindow(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h,
+                                    const uint8_t* lsbWindow, const uint8_t* msbWindow, const bool turnOffScreen) {
+  if (Serial) Serial.printf("[%lu]   Displaying grayscale window at (%d,%d) size (%dx%d)\n", millis(), x, y, w, h);
 
-#ifdef EINK_DISPLAY_SINGLE_BUFFER_MODE
-  // Post-refresh: Sync RED RAM with current window (for next fast refresh)
+  if (x + w > displayWidth || y + h > displayHeight) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Window bounds exceed display dimensions!\n", millis());
+    return;
+  }
+
+  if (x % 8 != 0 || w % 8 != 0) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Window x and width must be byte-aligned (multiples of 8)!\n", millis());
+    return;
+  }
+
+  if (!frameBuffer || !lsbWindow || !msbWindow) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Frame buffer or grayscale planes not allocated!\n", millis());
+    return;
+  }
+
+  // The black/white baseline restored afterwards comes from the frame on screen, which a streamed image is not in
+  if (streamedFrameShown) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Grayscale window over a streamed image is not supported\n", millis());
+    return;
+  }
+
+  const uint16_t windowWidthBytes = w / 8;
+  const uint8_t* shownWindow = displayedFrameBuffer + static_cast<uint32_t>(y) * displayWidthBytes + x / 8;
+
+  if (_x3Mode) {
+    auto sendCommandDataX3 = [&](uint8_t cmd, const uint8_t* data, uint16_t len) {
+      SPI.beginTransaction(spiSettings);
+      digitalWrite(_cs, LOW);
+      digitalWrite(_dc, LOW);
+      SPI.transfer(cmd);
+      if (len > 0 && data != nullptr) {
+        digitalWrite(_dc, HIGH);
+        SPI.writeBytes(data, len);
+      }
+      digitalWrite(_cs, HIGH);
+      SPI.endTransaction();
+    };
+    auto sendCommandDataByteX3 = [&](uint8_t cmd, uint8_t d0, uint8_t d1) {
+      const uint8_t d[2] = {d0, d1};
+      sendCommandDataX3(cmd, d, 2);
+    };
+
+    sendCommandDataX3(0x20, lut_x3_vcom_gray, 42);
+    sendCommandDataX3(0x21, lut_x3_ww_gray, 42);
+    sendCommandDataX3(0x22, lut_x3_bw_gray, 42);
+    sendCommandDataX3(0x23, lut_x3_wb_gray, 42);
+    sendCommandDataX3(0x24, lut_x3_bb_gray, 42);
+    sendCommandDataByteX3(0x50, 0x29, 0x07);
+
+    // Partial mode keeps both the RAM writes and the refresh inside the window
+    sendCommand(0x91);
+    setX3PartialWindow(x, y, w, h);
+    sendCommand(0x10);
+    sendMirroredRows(lsbWindow, windowWidthBytes, windowWidthBytes, h, false);
+    sendCommand(0x13);
+    sendMirroredRows(msbWindow, windowWidthBytes, windowWidthBytes, h, false);
+
+    if (!isScreenOn) {
+      sendCommand(0x04);
+      waitForRefresh(" X3_CMD04(gray window)");
+      isScreenOn = true;
+    }
+
+    sendCommand(0x12);
+    waitForRefresh(" X3_CMD12(gray window)");
+
+    // Restore the differential baseline for the window only, the rest of the RAM was never touched
+    sendCommand(0x10);
+    sendMirroredRows(shownWindow, displayWidthBytes, windowWidthBytes, h, false);
+    sendCommand(0x13);
+    sendMirroredRows(shownWindow, displayWidthBytes, windowWidthBytes, h, false);
+    sendCommand(0x92);
+
+    if (turnOffScreen) {
+      sendCommand(0x02);
+      waitForRefresh(" X3_CMD02_POWEROFF(gray window)");
+      isScreenOn = false;
+    }
+
+    _x3GrayState.windowValid = true;
+    _x3GrayState.windowX = x;
+    _x3GrayState.windowY = y;
+    _x3GrayState.windowW = w;
+    _x3GrayState.windowH = h;
+    return;
+  }
+
+  // Outside the window both RAMs must hold the frame on screen so the LUT's 00/11 groups leave it alone
+  syncRamToScreen();
+
+  // BW = LSB, RED = LSB ^ MSB: dark gray lands in group 01, gray (MSB only) in group 10
+  uint8_t row[DISPLAY_WIDTH_BYTES];
   setRamArea(x, y, w, h);
-  writeRamBuffer(CMD_WRITE_RAM_RED, windowBuffer.data(), windowBufferSize);
-#endif
+  writeRamBuffer(CMD_WRITE_RAM_BW, lsbWindow, static_cast<uint32_t>(windowWidthBytes) * h);
+  sendCommand(CMD_WRITE_RAM_RED);
+  for (uint16_t r = 0; r < h; r++) {
+    const uint32_t offset = static_cast<uint32_t>(r) * windowWidthBytes;
+    for (uint16_t col = 0; col < windowWidthBytes; col++) {
+      row[col] = lsbWindow[offset + col] ^ msbWindow[offset + col];
+    }
+    sendData(row, windowWidthBytes);
+  }
 
-  if (Serial) Serial.printf("[%lu]   Window display complete\n", millis());
+  setCustomLUT(true, lut_grayscale_window);
+  refreshDisplay(FAST_REFRESH, turnOffScreen);
+  setCustomLUT(false);
+
+  // Restore the black/white baseline for the window only
+  writeRamWindow(CMD_WRITE_RAM_BW, displayedFrameBuffer, x, y, w, h, shownOverlays);
+  writeRamWindow(CMD_WRITE_RAM_RED, displayedFrameBuffer, x, y, w, h, shownOverlays);
+
+  grayscaleWindowed = true;
+  inGrayscaleMode = true;
+  if (Serial) Serial.printf("[%lu]   Grayscale window display complete\n", millis());
 }
 
 void EInkDisplay::displayGrayBuffer(const bool turnOffScreen) {
@@ -1035,18 +1764,6 @@ void EInkDisplay::displayGrayBuffer(const bool turnOffScreen) {
       const uint8_t d[2] = {d0, d1};
       sendCommandDataX3(cmd, d, 2);
     };
-    uint8_t row[128];
-    auto sendMirroredPlane = [&](const uint8_t* plane, bool invertBits) {
-      for (uint16_t y = 0; y < displayHeight; y++) {
-        const uint16_t srcY = static_cast<uint16_t>(displayHeight - 1 - y);
-        const uint8_t* src = plane + static_cast<uint32_t>(srcY) * displayWidthBytes;
-        for (uint16_t x = 0; x < displayWidthBytes; x++) {
-          row[x] = invertBits ? static_cast<uint8_t>(~src[x]) : src[x];
-        }
-        sendData(row, displayWidthBytes);
-      }
-    };
-
     const uint8_t* vcom = lut_x3_vcom_gray;
     const uint8_t* ww = lut_x3_ww_gray;
     const uint8_t* bw = lut_x3_bw_gray;
@@ -1084,11 +1801,13 @@ void EInkDisplay::displayGrayBuffer(const bool turnOffScreen) {
     _x3ForcedConditionPassesNext = 0;
 
     _x3GrayState.lsbValid = false;
+    _x3GrayState.windowValid = false;
     return;
   }
 
   drawGrayscale = false;
   inGrayscaleMode = true;
+  grayscaleWindowed = false;
 
   // activate the custom LUT for grayscale rendering and refresh
   setCustomLUT(true, lut_grayscale);
@@ -1096,6 +1815,196 @@ void EInkDisplay::displayGrayBuffer(const bool turnOffScreen) {
   setCustomLUT(false);
 }
 
+// ============================================================================
+// Streaming full screen images
+// ============================================================================
+
+// Sends the image top-down in chunks of whole rows to BW and/or RED RAM. Every chunk re-addresses the RAM, and
+// sendCommand()/sendData() end their SPI transaction, so the source runs with the bus free.
+bool EInkDisplay::streamToRam(const ImageStreamSource source, void* context, const bool toBw, const bool toRed) {
+  uint8_t chunk[STREAM_CHUNK_ROWS * DISPLAY_WIDTH_BYTES];
+  for (uint16_t y = 0; y < displayHeight; y += STREAM_CHUNK_ROWS) {
+    const uint16_t rows = min<uint16_t>(STREAM_CHUNK_ROWS, displayHeight - y);
+    const size_t bytes = static_cast<size_t>(rows) * displayWidthBytes;
+    if (source(chunk, static_cast<uint32_t>(y) * displayWidthBytes, bytes, context) != bytes) {
+      if (Serial) Serial.printf("[%lu]   ERROR: Image stream ended at row %u\n", millis(), y);
+      return false;
+    }
+    if (toBw) {
+      setRamArea(0, y, displayWidth, rows);
+      sendCommand(CMD_WRITE_RAM_BW);
+      sendData(chunk, bytes);
+    }
+    if (toRed) {
+      setRamArea(0, y, displayWidth, rows);
+      sendCommand(CMD_WRITE_RAM_RED);
+      sendData(chunk, bytes);
+    }
+  }
+  return true;
+}
+
+// X3 RAM rows are mirrored: read chunks bottom-up and send their rows in reverse, after the RAM command was issued
+bool EInkDisplay::streamMirroredToRam(const ImageStreamSource source, void* context, const bool invertBits) {
+  uint8_t chunk[STREAM_CHUNK_ROWS * DISPLAY_WIDTH_BYTES];
+  for (uint16_t end = displayHeight; end > 0;) {
+    const uint16_t rows = min<uint16_t>(STREAM_CHUNK_ROWS, end);
+    const uint16_t y = end - rows;
+    const size_t bytes = static_cast<size_t>(rows) * displayWidthBytes;
+    if (source(chunk, static_cast<uint32_t>(y) * displayWidthBytes, bytes, context) != bytes) {
+      if (Serial) Serial.printf("[%lu]   ERROR: Image stream ended at row %u\n", millis(), y);
+      return false;
+    }
+    sendMirroredRows(chunk, displayWidthBytes, displayWidthBytes, rows, invertBits);
+    end = y;
+  }
+  return true;
+}
+
+bool EInkDisplay::displayStream(const ImageStreamSource source, void* context, RefreshMode mode,
+                                const bool turnOffScreen) {
+  if (!source) {
+    return false;
+  }
+  if (Serial) Serial.printf("[%lu]   Displaying streamed image\n", millis());
+
+  if (!_x3Mode && !isScreenOn && !turnOffScreen) {
+    // Force half refresh if screen is off (non-X3 only)
+    mode = HALF_REFRESH;
+  }
+  if (inGrayscaleMode) {
+    grayscaleRevert();
+  }
+
+  if (_x3Mode) {
+    return displayStreamX3(source, context, mode, turnOffScreen);
+  }
+
+  // A fast refresh diffs against RED RAM, which must hold the frame on screen. After a previous stream it already
+  // does, in single buffer mode it always does.
+#ifndef EINK_DISPLAY_SINGLE_BUFFER_MODE
+  if (mode == FAST_REFRESH && !streamedFrameShown) {
+    setRamArea(0, 0, displayWidth, displayHeight);
+    writeRamBuffer(CMD_WRITE_RAM_RED, displayedFrameBuffer, bufferSize, OVERLAYS_SHOWN);
+    redRamStale.valid = false;
+  }
+#endif
+
+  if (!streamToRam(source, context, true, mode != FAST_REFRESH)) {
+    // BW RAM no longer matches the screen until the next update that relies on it syncs it, a partly streamed RED RAM
+    // is restored right away
+    bwRamStale = true;
+    if (mode != FAST_REFRESH && !streamedFrameShown) {
+      setRamArea(0, 0, displayWidth, displayHeight);
+      writeRamBuffer(CMD_WRITE_RAM_RED, displayedFrameBuffer, bufferSize, OVERLAYS_SHOWN);
+      redRamStale.valid = false;
+    }
+    return false;
+  }
+
+  refreshDisplay(mode, turnOffScreen);
+
+  // Leave the new image in RED RAM as the base for the next fast refresh
+  bool synced = true;
+  if (mode == FAST_REFRESH) {
+    synced = streamToRam(source, context, false, true);
+  }
+
+  streamedFrameShown = synced;
+  bwRamStale = false;
+  redRamStale.valid = false;
+  if (!synced) {
+    markRedStale(0, 0, displayWidth, displayHeight);
+  }
+  grayscaleWindowed = false;
+  if (Serial) Serial.printf("[%lu]   Streamed image displayed\n", millis());
+  return true;
+}
+
+bool EInkDisplay::displayStream(const PackedImage& image, const RefreshMode mode, const bool turnOffScreen) {
+  if (image.getWidth() != displayWidth || image.getHeight() != displayHeight) {
+    if (Serial) Serial.printf("[%lu]   ERROR: Streamed image is not full screen\n", millis());
+    return false;
+  }
+  PackedImage::Reader reader;
+  return reader.begin(image, PackedImage::PLANE_BW) &&
+         displayStream(PackedImage::Reader::stream, &reader, mode, turnOffScreen);
+}
+
+bool EInkDisplay::displayStreamX3(const ImageStreamSource source, void* context, const RefreshMode mode,
+                                  const bool turnOffScreen) {
+  // Same policy as displayBuffer(): differential against RED RAM (0x10) unless a full sync is due. A windowed
+  // grayscale image on screen also needs the full sync, the stream cannot re-drive just that window.
+  const bool fastMode = mode != FULL_REFRESH;
+  const bool doFullSync = !fastMode || !_x3RedRamSynced || _x3InitialFullSyncsRemaining > 0 ||
+                          _x3ForceFullSyncNext || _x3GrayState.windowValid;
+  _x3GrayState.lastBaseWasPartial = !doFullSync;
+
+  const auto sendLuts = [this](const unsigned char* vcom, const unsigned char* ww, const unsigned char* bw,
+                               const unsigned char* wb, const unsigned char* bb) {
+    const unsigned char* luts[5] = {vcom, ww, bw, wb, bb};
+    for (uint8_t i = 0; i < 5; i++) {
+      sendCommand(0x20 + i);
+      sendData(luts[i], 42);
+    }
+  };
+
+  bool ok;
+  if (doFullSync) {
+    sendLuts(lut_x3_vcom_img, lut_x3_ww_img, lut_x3_bw_img, lut_x3_wb_img, lut_x3_bb_img);
+    sendCommand(0x13);
+    ok = streamMirroredToRam(source, context, true);
+    if (ok) {
+      sendCommand(0x10);
+      ok = streamMirroredToRam(source, context, true);
+    }
+    sendCommand(0x50);
+    sendData(0xA9);
+    sendData(0x07);
+  } else {
+    sendLuts(lut_x3_vcom_full, lut_x3_ww_full, lut_x3_bw_full, lut_x3_wb_full, lut_x3_bb_full);
+    sendCommand(0x13);
+    ok = streamMirroredToRam(source, context, false);
+    sendCommand(0x50);
+    sendData(0x29);
+    sendData(0x07);
+  }
+
+  if (!ok) {
+    // 0x10 may be partly overwritten, resync from the frame buffer on the next update
+    _x3RedRamSynced = false;
+    return false;
+  }
+
+  if (!isScreenOn || doFullSync) {
+    sendCommand(0x04);
+    waitForRefresh(" X3_CMD04");
+    isScreenOn = true;
+  }
+  sendCommand(0x12);
+  waitForRefresh(" X3_CMD12(stream)");
+
+  if (turnOffScreen) {
+    sendCommand(0x02);
+    waitForRefresh(" X3_CMD02_POWEROFF");
+    isScreenOn = false;
+  }
+  if (!fastMode) delay(200);
+
+  // Sync RED RAM (0x10) with the non-inverted image for the next fast diff
+  sendCommand(0x10);
+  _x3RedRamSynced = streamMirroredToRam(source, context, false);
+  _x3GrayState.windowValid = false;
+  streamedFrameShown = true;
+
+  if (doFullSync && _x3InitialFullSyncsRemaining > 0) {
+    _x3InitialFullSyncsRemaining--;
+  }
+  _x3ForceFullSyncNext = false;
+  _x3ForcedConditionPassesNext = 0;
+  return true;
+}
+
 void EInkDisplay::refreshDisplay(const RefreshMode mode, const bool turnOffScreen) {
   if (_x3Mode) {
     displayBuffer(mode, turnOffScreen);
@@ -1152,11 +2061,54 @@ void EInkDisplay::refreshDisplay(const RefreshMode mode, const bool turnOffScree
 
   sendCommand(CMD_MASTER_ACTIVATION);
 
+#ifndef EINK_DISPLAY_SINGLE_BUFFER_MODE
+  // Let the caller draw the next frame into the back buffer while the panel is still updating
+  if (asyncRefresh) {
+    refreshInFlight = true;
+    inFlightRefreshType = refreshType;
+    if (Serial) Serial.printf("[%lu]   Refresh started (async)\n", millis());
+    return;
+  }
+#endif
+
   // Wait for display to finish updating
   if (Serial) Serial.printf("[%lu]   Waiting for display refresh...\n", millis());
   waitWhileBusy(refreshType);
 }
 
+void EInkDisplay::setAsyncRefresh(const bool enabled) {
+#ifdef EINK_DISPLAY_SINGLE_BUFFER_MODE
+  // RED RAM is synced from the frame buffer after each refresh, the caller can't touch it until then
+  (void)enabled;
+#else
+  if (!enabled && refreshInFlight) {
+    waitForRefreshComplete();
+  }
+  asyncRefresh = enabled && !_x3Mode;
+#endif
+}
+
+bool EInkDisplay::isRefreshing() {
+  if (!refreshInFlight) {
+    return false;
+  }
+  if (digitalRead(_busy) == HIGH) {
+    return true;
+  }
+  refreshInFlight = false;
+  if (Serial) Serial.printf("[%lu]   Refresh done: %s (async)\n", millis(), inFlightRefreshType);
+  return false;
+}
+
+void EInkDisplay::waitForRefreshComplete() {
+  if (!refreshInFlight) {
+    return;
+  }
+  // Cleared first, waitWhileBusy() must not recurse through sendCommand()
+  refreshInFlight = false;
+  waitWhileBusy(inFlightRefreshType);
+}
+
 void EInkDisplay::setCustomLUT(const bool enabled, const unsigned char* lutData) {
   if (enabled) {
     if (Serial) Serial.printf("[%lu]   Loading custom LUT...\n", millis());
@@ -0,0 +1,161 @@
+#include "PackedImage.h"
+
+#include <cstring>
+
+namespace {
+constexpr uint8_t MAGIC[4] = {'X', 'P', 'I', '1'};
+constexpr uint32_t PREDICTED = 0x80000000;
+
+uint16_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+uint32_t get32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+}  // namespace
+
+bool PackedImage::begin(const uint8_t* imageData, const size_t size) {
+  data = nullptr;
+  if (!imageData || size < HEADER_SIZE || memcmp(imageData, MAGIC, sizeof(MAGIC)) != 0) {
+    if (Serial) Serial.printf("[%lu] [PKI] Not a packed image\n", millis());
+    return false;
+  }
+  width = get16(imageData + 4);
+  height = get16(imageData + 6);
+  planeCount = imageData[8];
+  bandHeight = imageData[9];
+  codeSize = get32(imageData + 12);
+  if (width == 0 || width > MAX_WIDTH || height == 0 || (planeCount != 1 && planeCount != 3) || bandHeight == 0) {
+    if (Serial)
+      Serial.printf("[%lu] [PKI] Unsupported packed image: %ux%u, %u planes\n", millis(), width, height, planeCount);
+    return false;
+  }
+  bandCount = (height + bandHeight - 1) / bandHeight;
+  const size_t tables = HEADER_SIZE + static_cast<size_t>(bandCount) * planeCount * 4;
+  if (tables > size || codeSize > size - tables) {
+    if (Serial) Serial.printf("[%lu] [PKI] Truncated packed image\n", millis());
+    return false;
+  }
+  bands = imageData + HEADER_SIZE;
+  code = imageData + tables;
+  data = imageData;
+  return true;
+}
+
+uint32_t PackedImage::readBand(const Plane plane, const uint16_t band) const {
+  return get32(bands + (static_cast<size_t>(plane) * bandCount + band) * 4);
+}
+
+bool PackedImage::Reader::begin(const PackedImage& packed, const Plane p, const uint16_t y) {
+  image = nullptr;
+  if (!packed.isValid() || p >= packed.planeCount || y >= packed.height) {
+    return false;
+  }
+  image = &packed;
+  plane = p;
+  // readRow() loads the band when it reaches its first row
+  row = y - y % packed.bandHeight;
+  while (row < y) {
+    if (!readRow()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const uint8_t* PackedImage::Reader::readRow() {
+  if (!image || row >= image->height) {
+    return nullptr;
+  }
+  const uint16_t widthBytes = image->getWidthBytes();
+  const uint8_t* end = image->code + image->codeSize;
+  if (row % image->bandHeight == 0) {
+    const uint32_t band = image->readBand(plane, row / image->bandHeight);
+    if ((band & ~PREDICTED) >= image->codeSize) {
+      if (Serial) Serial.printf("[%lu] [PKI] Band offset outside the image at row %u\n", millis(), row);
+      image = nullptr;
+      return nullptr;
+    }
+    code = image->code + (band & ~PREDICTED);
+    predicted = (band & PREDICTED) != 0;
+    memset(current, 0, widthBytes);
+  }
+
+  // Predicted rows are decoded over the previous row in place: zero runs leave it as it is
+  uint16_t x = 0;
+  while (x < widthBytes) {
+    if (code >= end) {
+      break;
+    }
+    const uint8_t op = *code++;
+    if (op < 0x80) {
+      const uint16_t count = op + 1;
+      if (count > widthBytes - x || count > end - code) {
+        break;
+      }
+      if (predicted) {
+        for (uint16_t i = 0; i < count; i++) {
+          current[x + i] ^= code[i];
+        }
+      } else {
+        memcpy(current + x, code, count);
+      }
+      code += count;
+      x += count;
+    } else if (op < 0xC0) {
+      const uint16_t count = (op & 0x3F) + 1;
+      if (count > widthBytes - x) {
+        break;
+      }
+      if (!predicted) {
+        memset(current + x, 0, count);
+      }
+      x += count;
+    } else {
+      const uint16_t count = (op & 0x3F) + 2;
+      if (count > widthBytes - x || code >= end) {
+        break;
+      }
+      const uint8_t value = *code++;
+      if (predicted) {
+        for (uint16_t i = 0; i < count; i++) {
+          current[x + i] ^= value;
+        }
+      } else {
+        memset(current + x, value, count);
+      }
+      x += count;
+    }
+  }
+  if (x != widthBytes) {
+    if (Serial) Serial.printf("[%lu] [PKI] Corrupt packed image at row %u\n", millis(), row);
+    image = nullptr;
+    return nullptr;
+  }
+  row++;
+  return current;
+}
+
+size_t PackedImage::Reader::stream(uint8_t* buffer, const uint32_t offset, const size_t length, void* context) {
+  Reader& reader = *static_cast<Reader*>(context);
+  if (!reader.image) {
+    return 0;
+  }
+  const PackedImage& packed = *reader.image;
+  const uint16_t widthBytes = packed.getWidthBytes();
+  const uint32_t y = offset / widthBytes;
+  if (offset % widthBytes != 0 || length % widthBytes != 0 || y >= packed.height) {
+    return 0;
+  }
+  if (y != reader.row && !reader.begin(packed, reader.plane, y)) {
+    return 0;
+  }
+  size_t done = 0;
+  while (done < length) {
+    const uint8_t* next = reader.readRow();
+    if (!next) {
+      break;
+    }
+    memcpy(buffer + done, next, widthBytes);
+    done += widthBytes;
+  }
+  return done;
+}
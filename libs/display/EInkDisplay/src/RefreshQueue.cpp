@@ -0,0 +1,84 @@
+#include "RefreshQueue.h"
+
+RefreshQueue::RefreshQueue(EInkDisplay& display) : display(display) {}
+
+void RefreshQueue::submit(const EInkDisplay::RefreshMode mode) {
+  // FULL_REFRESH < HALF_REFRESH < FAST_REFRESH, keep the strongest mode requested
+  if (pendingKind != PENDING_FULL || mode < pendingMode) {
+    pendingMode = mode;
+  }
+  pendingKind = PENDING_FULL;
+  pendingCount++;
+}
+
+void RefreshQueue::submitWindow(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h) {
+  if (w == 0 || h == 0) {
+    return;
+  }
+
+  pendingCount++;
+  if (pendingKind == PENDING_FULL) {
+    // Already covered by the full screen update
+    return;
+  }
+
+  if (pendingKind == PENDING_NONE) {
+    windowX0 = x;
+    windowY0 = y;
+    windowX1 = x + w;
+    windowY1 = y + h;
+    pendingKind = PENDING_WINDOW;
+    return;
+  }
+
+  windowX0 = min(windowX0, x);
+  windowY0 = min(windowY0, y);
+  windowX1 = max<uint16_t>(windowX1, x + w);
+  windowY1 = max<uint16_t>(windowY1, y + h);
+}
+
+void RefreshQueue::submitDirty() {
+  uint16_t x, y, w, h;
+  if (display.getDirtyWindow(x, y, w, h)) {
+    submitWindow(x, y, w, h);
+  }
+}
+
+bool RefreshQueue::update() {
+  if (pendingKind == PENDING_NONE || display.isRefreshing()) {
+    return false;
+  }
+
+  issue();
+  return true;
+}
+
+void RefreshQueue::flush() {
+  if (pendingKind != PENDING_NONE) {
+    display.waitForRefreshComplete();
+    issue();
+  }
+  display.waitForRefreshComplete();
+}
+
+void RefreshQueue::resetStats() {
+  skippedFrames = 0;
+  displayedFrames = 0;
+}
+
+void RefreshQueue::issue() {
+  const PendingKind kind = pendingKind;
+  skippedFrames += pendingCount - 1;
+  displayedFrames++;
+  pendingKind = PENDING_NONE;
+  pendingCount = 0;
+
+  if (Serial) Serial.printf("[%lu] [RQ] Showing frame (%lu skipped so far)\n", millis(), skippedFrames);
+
+  if (kind == PENDING_FULL) {
+    display.displayBuffer(pendingMode);
+    pendingMode = EInkDisplay::FAST_REFRESH;
+  } else {
+    display.displayWindow(windowX0, windowY0, windowX1 - windowX0, windowY1 - windowY0);
+  }
+}
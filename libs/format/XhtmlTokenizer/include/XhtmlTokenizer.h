@@ -0,0 +1,275 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * SAX style XHTML tokenizer that turns a chapter into styled text runs and block boundaries.
+ *
+ * Input is pushed with write(), so any byte source works: SDCardManager::readFileToStream(), a ZipEntryReader read
+ * loop or a Print chain. Everything lives in a fixed-size state machine (open element stack, one text run buffer,
+ * a small CSS rule table); nothing is allocated per node and no tree is built.
+ *
+ * Output is a flat sequence of events:
+ *  - BLOCK_START / BLOCK_END around every paragraph-like block that contains text. Nested blocks without text of their
+ *    own do not produce events, so layout sees one level of paragraphs.
+ *  - TEXT runs of UTF-8 with whitespace collapsed and entities decoded. A run has one style; a style change, a full
+ *    run buffer or a block boundary ends it, so consecutive runs may split a word.
+ *  - LINE_BREAK for <br> and newlines in preformatted text, IMAGE for <img>, ANCHOR for elements with an id.
+ *
+ * Styling covers the HTML inline elements plus a CSS subset from style attributes, <style> elements and stylesheets
+ * passed to writeStylesheet(): font-weight, font-style, text-decoration, font-variant, vertical-align, text-align,
+ * display, white-space and page-break-before/break-before, matched by `tag`, `.class` or `tag.class` selectors.
+ * Descendant selectors are matched on their last part only.
+ */
+
+enum XhtmlEventType : uint8_t {
+  XHTML_BLOCK_START,
+  XHTML_BLOCK_END,
+  XHTML_TEXT,
+  XHTML_LINE_BREAK,
+  XHTML_IMAGE,
+  XHTML_ANCHOR,
+};
+
+enum XhtmlStyle : uint16_t {
+  XHTML_BOLD = 0x0001,
+  XHTML_ITALIC = 0x0002,
+  XHTML_UNDERLINE = 0x0004,
+  XHTML_STRIKE = 0x0008,
+  XHTML_SUPERSCRIPT = 0x0010,
+  XHTML_SUBSCRIPT = 0x0020,
+  XHTML_MONOSPACE = 0x0040,
+  XHTML_SMALL_CAPS = 0x0080,
+  XHTML_SMALL = 0x0100,
+  XHTML_LINK = 0x0200,
+};
+
+enum XhtmlBlockKind : uint8_t {
+  XHTML_PARAGRAPH,
+  XHTML_HEADING,  // level 1-6
+  XHTML_LIST_ITEM,
+  XHTML_QUOTE,
+  XHTML_PREFORMATTED,
+  XHTML_TABLE_CELL,
+  XHTML_RULE,  // <hr>, start and end without text in between
+};
+
+enum XhtmlAlign : uint8_t {
+  XHTML_ALIGN_DEFAULT,
+  XHTML_ALIGN_LEFT,
+  XHTML_ALIGN_CENTER,
+  XHTML_ALIGN_RIGHT,
+  XHTML_ALIGN_JUSTIFY,
+};
+
+struct XhtmlEvent {
+  XhtmlEventType type;
+  // TEXT: the run; IMAGE: the src attribute; ANCHOR: the id. Valid only during the callback, not null-terminated.
+  const char* text;
+  size_t length;
+  uint16_t style;  // XhtmlStyle flags of a TEXT run
+  // Block properties, set for all events
+  XhtmlBlockKind block;
+  uint8_t level;   // Heading level
+  uint8_t indent;  // Enclosing lists and quotes
+  XhtmlAlign align;
+  bool pageBreakBefore;  // BLOCK_START only
+  bool continued;        // BLOCK_START only: the rest of a block split at MAX_BLOCK_TEXT
+  // Input offset: TEXT the first byte of the run, BLOCK_START where the block's resume state was taken (its start tag,
+  // or the end of the tag that closed the previous block), others the tag
+  uint32_t offset;
+};
+
+class XhtmlTokenizer : public Print {
+ public:
+  typedef void (*EventCallback)(const XhtmlEvent& event, void* context);
+
+  static constexpr size_t MAX_DEPTH = 32;
+  static constexpr size_t RUN_SIZE = 256;
+  static constexpr size_t MAX_ATTRIBUTE_LENGTH = 255;
+  static constexpr size_t MAX_RULES = 64;
+  static constexpr size_t RESUME_FRAMES = 6;
+  // Text after which a block is split at the next whitespace, so resuming never re-reads more than this of a block
+  static constexpr uint32_t MAX_BLOCK_TEXT = 8192;
+
+  // Where a block starts and the innermost elements open at that point, enough to restart tokenizing there with
+  // resume() instead of from the start of the document. Plain bytes that can be stored as they are.
+  struct ResumeState {
+    uint32_t offset;
+    uint8_t depth;      // Elements in `frames`, outermost first
+    uint8_t continued;  // The block is the rest of one split at MAX_BLOCK_TEXT
+    uint8_t frames[RESUME_FRAMES * 8];
+  };
+
+  XhtmlTokenizer(EventCallback callback, void* context);
+
+  // Starts a new document. Stylesheet rules are kept.
+  void reset();
+  void clearStyles();
+  // Continues a document at a block saved with getBlockState(); feed it from `state.offset` on. Stylesheet rules are
+  // kept, rules from <style> elements before that point have to be fed again first.
+  void resume(const ResumeState& state);
+
+  /**
+   * Feeds document bytes.
+   *
+   * @return bytes consumed, less than `length` only if the callback called pause()
+   */
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* data, size_t length) override;
+  using Print::write;
+  // Ends the document, flushing the last run and block
+  void finish();
+
+  // Feeds CSS, e.g. a linked stylesheet read in chunks; endStylesheet() after the last chunk
+  void writeStylesheet(const uint8_t* data, size_t length);
+  void endStylesheet();
+
+  // Called from the callback to stop write() after the current byte, e.g. when a page is full. The next write()
+  // continues with the bytes that were not consumed.
+  void pause() { paused = true; }
+
+  // Total input bytes consumed since reset()
+  uint32_t getOffset() const { return offset; }
+  // Resume point of the block of the last BLOCK_START event. Elements nested deeper than RESUME_FRAMES are dropped,
+  // their end tags are then ignored.
+  const ResumeState& getBlockState() const { return blockState; }
+  size_t getRuleCount() const { return ruleCount; }
+
+ private:
+  enum LexState : uint8_t {
+    LEX_TEXT,
+    LEX_ENTITY,
+    LEX_TAG_OPEN,
+    LEX_TAG_NAME,
+    LEX_END_TAG_NAME,
+    LEX_ATTR_SPACE,
+    LEX_ATTR_NAME,
+    LEX_ATTR_AFTER_NAME,
+    LEX_ATTR_VALUE_START,
+    LEX_ATTR_VALUE,
+    LEX_BANG,
+    LEX_COMMENT,
+    LEX_CDATA,
+    LEX_SKIP_TO_GT,  // Declarations and processing instructions
+    LEX_RAW_TEXT,    // Content of <style> and <script>
+  };
+
+  enum CssState : uint8_t { CSS_SELECTOR, CSS_DECLARATIONS, CSS_COMMENT, CSS_AT_RULE };
+
+  // What a style attribute or CSS rule changes
+  struct StyleChange {
+    uint16_t set;
+    uint16_t clear;
+    XhtmlAlign align;
+    uint8_t display;  // 0 unchanged, then DISPLAY_NONE, DISPLAY_BLOCK or DISPLAY_INLINE
+    uint8_t whiteSpace;  // 0 unchanged, 1 collapse, 2 preserve
+    bool pageBreakBefore;
+  };
+
+  struct Rule {
+    uint32_t classHash;  // 0 for tag selectors
+    uint8_t tag;         // TAG_ANY for class selectors
+    StyleChange change;
+  };
+
+  struct Frame {
+    uint16_t nameHash;
+    uint8_t tag;
+    uint8_t flags;
+    uint16_t style;
+    XhtmlAlign align;
+    uint8_t indent;
+  };
+
+  bool hidden() const;
+  void process(uint8_t c);
+  void text(uint8_t c);
+  void appendToRun(const char* bytes, size_t length);
+  void flushRun();
+  void markBlockStart(uint32_t at);
+  void splitBlock();
+  void startBlockIfNeeded();
+  void endBlock();
+  void emit(XhtmlEventType type, const char* text, size_t length, uint32_t eventOffset);
+
+  void beginTag();
+  void finishAttribute();
+  void openElement();
+  void closeElement();
+  void emitEntity();
+  void appendCodepoint(uint32_t codepoint);
+
+  void css(uint8_t c);
+  void parseSelectors();
+  void finishDeclarations();
+  static void parseDeclarations(const char* text, size_t length, StyleChange& change);
+  static void applyChange(const StyleChange& change, uint16_t& style, XhtmlAlign& align, uint8_t& flags);
+
+  static uint8_t lookupTag(const char* name);
+  static uint32_t hashName(const char* name, size_t length);
+
+  EventCallback callback;
+  void* context;
+  bool paused = false;
+  uint32_t offset = 0;
+
+  // Lexer
+  LexState lex = LEX_TEXT;
+  char quote = 0;
+  uint8_t matched = 0;  // Progress through "--", "]]>" or "</style" style terminators
+  char name[16];
+  uint8_t nameLen = 0;
+  char attrName[16];
+  uint8_t attrNameLen = 0;
+  char attrValue[MAX_ATTRIBUTE_LENGTH + 1];
+  uint8_t attrValueLen = 0;
+  char entity[12];
+  uint8_t entityLen = 0;
+  uint32_t tagOffset = 0;
+  bool selfClosing = false;
+  uint8_t rawTag = 0;  // <style> or <script> whose content is being skipped
+
+  // Element being opened
+  uint8_t pendingTag = 0;
+  StyleChange pendingChange = {};
+  uint32_t pendingClasses[4];
+  uint8_t pendingClassCount = 0;
+  char pendingId[64];
+  uint8_t pendingIdLen = 0;
+  char pendingSrc[128];
+  uint8_t pendingSrcLen = 0;
+
+  // Open elements, deeper elements are only counted
+  Frame stack[MAX_DEPTH];
+  uint8_t depth = 0;
+  uint16_t overflow = 0;
+
+  // Current block and run
+  bool blockOpen = false;
+  bool pendingSpace = false;
+  bool pendingPageBreak = false;
+  ResumeState blockState = {};
+  XhtmlBlockKind blockKind = XHTML_PARAGRAPH;
+  uint8_t blockLevel = 0;
+  uint8_t blockIndent = 0;
+  XhtmlAlign blockAlign = XHTML_ALIGN_DEFAULT;
+  char run[RUN_SIZE];
+  size_t runLen = 0;
+  uint16_t runStyle = 0;
+  uint32_t runOffset = 0;
+  uint32_t blockText = 0;  // Bytes of text in the open block, or since it was last split
+
+  // Stylesheet
+  Rule rules[MAX_RULES];
+  size_t ruleCount = 0;
+  CssState cssState = CSS_SELECTOR;
+  CssState cssResume = CSS_SELECTOR;  // State to return to after a comment
+  uint8_t cssBraces = 0;
+  bool cssStar = false;  // Last character was '*' inside a comment
+  char cssBuffer[128];
+  uint8_t cssLen = 0;
+  Rule cssSelectors[8];
+  uint8_t cssSelectorCount = 0;
+  StyleChange cssChange = {};
+};
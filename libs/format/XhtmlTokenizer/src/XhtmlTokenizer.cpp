@@ -0,0 +1,1176 @@
+#include "XhtmlTokenizer.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr uint8_t TAG_UNKNOWN = 0;
+constexpr uint8_t TAG_ANY = 0xFF;
+
+constexpr uint8_t DISPLAY_NONE = 1;
+constexpr uint8_t DISPLAY_BLOCK = 2;
+constexpr uint8_t DISPLAY_INLINE = 3;
+
+// Frame flags, inherited by children except FRAME_BLOCK
+constexpr uint8_t FRAME_HIDDEN = 0x01;
+constexpr uint8_t FRAME_BLOCK = 0x02;
+constexpr uint8_t FRAME_PRE = 0x04;
+
+// Tag table flags
+constexpr uint16_t T_BLOCK = 0x0001;
+constexpr uint16_t T_HIDDEN = 0x0002;
+constexpr uint16_t T_VOID = 0x0004;
+constexpr uint16_t T_PRE = 0x0008;
+constexpr uint16_t T_RAW = 0x0010;     // Content is not markup: <style>, <script>
+constexpr uint16_t T_INDENT = 0x0020;  // Children are indented one level
+constexpr uint16_t T_CENTER = 0x0040;
+constexpr uint16_t T_CSS = 0x0080;  // Content is a stylesheet
+constexpr uint16_t T_BREAK = 0x0100;
+constexpr uint16_t T_IMAGE = 0x0200;
+constexpr uint16_t T_RULE = 0x0400;
+
+struct TagInfo {
+  const char* name;
+  uint16_t flags;
+  uint16_t style;
+  XhtmlBlockKind block;
+  uint8_t level;
+};
+
+// Index in this table is the tag id, 0 is any element not listed
+constexpr TagInfo TAGS[] = {
+    {"", 0, 0, XHTML_PARAGRAPH, 0},
+    {"html", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"body", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"head", T_HIDDEN, 0, XHTML_PARAGRAPH, 0},
+    {"title", T_HIDDEN, 0, XHTML_PARAGRAPH, 0},
+    {"style", T_HIDDEN | T_RAW | T_CSS, 0, XHTML_PARAGRAPH, 0},
+    {"script", T_HIDDEN | T_RAW, 0, XHTML_PARAGRAPH, 0},
+    {"p", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"div", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"section", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"article", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"header", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"footer", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"aside", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"nav", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"main", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"figure", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"figcaption", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"address", T_BLOCK, XHTML_ITALIC, XHTML_PARAGRAPH, 0},
+    {"center", T_BLOCK | T_CENTER, 0, XHTML_PARAGRAPH, 0},
+    {"h1", T_BLOCK, XHTML_BOLD, XHTML_HEADING, 1},
+    {"h2", T_BLOCK, XHTML_BOLD, XHTML_HEADING, 2},
+    {"h3", T_BLOCK, XHTML_BOLD, XHTML_HEADING, 3},
+    {"h4", T_BLOCK, XHTML_BOLD, XHTML_HEADING, 4},
+    {"h5", T_BLOCK, XHTML_BOLD, XHTML_HEADING, 5},
+    {"h6", T_BLOCK, XHTML_BOLD, XHTML_HEADING, 6},
+    {"blockquote", T_BLOCK | T_INDENT, 0, XHTML_QUOTE, 0},
+    {"ul", T_BLOCK | T_INDENT, 0, XHTML_PARAGRAPH, 0},
+    {"ol", T_BLOCK | T_INDENT, 0, XHTML_PARAGRAPH, 0},
+    {"dl", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"li", T_BLOCK, 0, XHTML_LIST_ITEM, 0},
+    {"dt", T_BLOCK, XHTML_BOLD, XHTML_LIST_ITEM, 0},
+    {"dd", T_BLOCK | T_INDENT, 0, XHTML_PARAGRAPH, 0},
+    {"pre", T_BLOCK | T_PRE, XHTML_MONOSPACE, XHTML_PREFORMATTED, 0},
+    {"table", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"tr", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"td", T_BLOCK, 0, XHTML_TABLE_CELL, 0},
+    {"th", T_BLOCK, XHTML_BOLD, XHTML_TABLE_CELL, 0},
+    {"caption", T_BLOCK, 0, XHTML_PARAGRAPH, 0},
+    {"hr", T_VOID | T_RULE, 0, XHTML_RULE, 0},
+    {"br", T_VOID | T_BREAK, 0, XHTML_PARAGRAPH, 0},
+    {"img", T_VOID | T_IMAGE, 0, XHTML_PARAGRAPH, 0},
+    {"image", T_VOID | T_IMAGE, 0, XHTML_PARAGRAPH, 0},  // SVG cover pages
+    {"meta", T_VOID, 0, XHTML_PARAGRAPH, 0},
+    {"link", T_VOID, 0, XHTML_PARAGRAPH, 0},
+    {"input", T_VOID, 0, XHTML_PARAGRAPH, 0},
+    {"col", T_VOID, 0, XHTML_PARAGRAPH, 0},
+    {"area", T_VOID, 0, XHTML_PARAGRAPH, 0},
+    {"base", T_VOID, 0, XHTML_PARAGRAPH, 0},
+    {"wbr", T_VOID, 0, XHTML_PARAGRAPH, 0},
+    {"b", 0, XHTML_BOLD, XHTML_PARAGRAPH, 0},
+    {"strong", 0, XHTML_BOLD, XHTML_PARAGRAPH, 0},
+    {"i", 0, XHTML_ITALIC, XHTML_PARAGRAPH, 0},
+    {"em", 0, XHTML_ITALIC, XHTML_PARAGRAPH, 0},
+    {"cite", 0, XHTML_ITALIC, XHTML_PARAGRAPH, 0},
+    {"dfn", 0, XHTML_ITALIC, XHTML_PARAGRAPH, 0},
+    {"var", 0, XHTML_ITALIC, XHTML_PARAGRAPH, 0},
+    {"u", 0, XHTML_UNDERLINE, XHTML_PARAGRAPH, 0},
+    {"ins", 0, XHTML_UNDERLINE, XHTML_PARAGRAPH, 0},
+    {"s", 0, XHTML_STRIKE, XHTML_PARAGRAPH, 0},
+    {"strike", 0, XHTML_STRIKE, XHTML_PARAGRAPH, 0},
+    {"del", 0, XHTML_STRIKE, XHTML_PARAGRAPH, 0},
+    {"sup", 0, XHTML_SUPERSCRIPT, XHTML_PARAGRAPH, 0},
+    {"sub", 0, XHTML_SUBSCRIPT, XHTML_PARAGRAPH, 0},
+    {"code", 0, XHTML_MONOSPACE, XHTML_PARAGRAPH, 0},
+    {"tt", 0, XHTML_MONOSPACE, XHTML_PARAGRAPH, 0},
+    {"kbd", 0, XHTML_MONOSPACE, XHTML_PARAGRAPH, 0},
+    {"samp", 0, XHTML_MONOSPACE, XHTML_PARAGRAPH, 0},
+    {"small", 0, XHTML_SMALL, XHTML_PARAGRAPH, 0},
+    {"a", 0, XHTML_LINK, XHTML_PARAGRAPH, 0},
+    {"span", 0, 0, XHTML_PARAGRAPH, 0},
+};
+constexpr uint8_t TAG_COUNT = sizeof(TAGS) / sizeof(TAGS[0]);
+
+struct NamedEntity {
+  const char* name;
+  uint16_t codepoint;
+};
+
+constexpr NamedEntity ENTITIES[] = {
+    {"amp", '&'},       {"lt", '<'},        {"gt", '>'},        {"quot", '"'},      {"apos", '\''},
+    {"nbsp", 0x00A0},   {"shy", 0x00AD},    {"mdash", 0x2014},  {"ndash", 0x2013},  {"hellip", 0x2026},
+    {"lsquo", 0x2018},  {"rsquo", 0x2019},  {"ldquo", 0x201C},  {"rdquo", 0x201D},  {"laquo", 0x00AB},
+    {"raquo", 0x00BB},  {"bull", 0x2022},   {"middot", 0x00B7}, {"copy", 0x00A9},   {"reg", 0x00AE},
+    {"trade", 0x2122},  {"deg", 0x00B0},    {"times", 0x00D7},  {"euro", 0x20AC},   {"sect", 0x00A7},
+    {"para", 0x00B6},   {"dagger", 0x2020}, {"Dagger", 0x2021}, {"thinsp", 0x2009}, {"ensp", 0x2002},
+    {"emsp", 0x2003},   {"zwnj", 0x200C},   {"zwj", 0x200D},    {"iexcl", 0x00A1},  {"iquest", 0x00BF},
+};
+
+bool isSpace(const uint8_t c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'; }
+
+char lower(const uint8_t c) { return static_cast<char>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c); }
+
+bool isAlnum(const uint8_t c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+size_t encodeUtf8(uint32_t codepoint, char* out) {
+  if (codepoint < 0x80) {
+    out[0] = static_cast<char>(codepoint);
+    return 1;
+  }
+  if (codepoint < 0x800) {
+    out[0] = static_cast<char>(0xC0 | (codepoint >> 6));
+    out[1] = static_cast<char>(0x80 | (codepoint & 0x3F));
+    return 2;
+  }
+  if (codepoint < 0x10000) {
+    out[0] = static_cast<char>(0xE0 | (codepoint >> 12));
+    out[1] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+    out[2] = static_cast<char>(0x80 | (codepoint & 0x3F));
+    return 3;
+  }
+  out[0] = static_cast<char>(0xF0 | (codepoint >> 18));
+  out[1] = static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+  out[2] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+  out[3] = static_cast<char>(0x80 | (codepoint & 0x3F));
+  return 4;
+}
+
+// Decodes an entity name without '&' and ';', 0 if unknown or invalid
+uint32_t decodeEntity(const char* name, const size_t length) {
+  if (length == 0) {
+    return 0;
+  }
+  if (name[0] == '#') {
+    uint32_t value = 0;
+    const bool hex = length > 1 && (name[1] == 'x' || name[1] == 'X');
+    size_t i = hex ? 2 : 1;
+    if (i == length) {
+      return 0;
+    }
+    for (; i < length; i++) {
+      const char c = lower(name[i]);
+      uint32_t digit;
+      if (c >= '0' && c <= '9') {
+        digit = c - '0';
+      } else if (hex && c >= 'a' && c <= 'f') {
+        digit = c - 'a' + 10;
+      } else {
+        return 0;
+      }
+      value = value * (hex ? 16 : 10) + digit;
+      if (value > 0x10FFFF) {
+        return 0;
+      }
+    }
+    // Surrogates and NUL cannot be encoded
+    return (value >= 0xD800 && value <= 0xDFFF) ? 0 : value;
+  }
+  for (const NamedEntity& entity : ENTITIES) {
+    if (strlen(entity.name) == length && memcmp(entity.name, name, length) == 0) {
+      return entity.codepoint;
+    }
+  }
+  return 0;
+}
+
+// Decodes entities in place, unknown ones are kept as written
+size_t decodeEntities(char* text, const size_t length) {
+  size_t out = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] == '&') {
+      const char* semicolon = static_cast<const char*>(memchr(text + i + 1, ';', length - i - 1));
+      if (semicolon && semicolon - (text + i) <= 12) {
+        const uint32_t codepoint = decodeEntity(text + i + 1, semicolon - (text + i + 1));
+        // Every entity is at least as long as its UTF-8 encoding, so this never overtakes the input
+        if (codepoint) {
+          out += encodeUtf8(codepoint, text + out);
+          i = semicolon - text;
+          continue;
+        }
+      }
+    }
+    text[out++] = text[i];
+  }
+  return out;
+}
+
+// Trims whitespace from both ends, lowercases and null-terminates into `out`
+void copyToken(const char* text, size_t length, char* out, const size_t outSize) {
+  while (length > 0 && isSpace(*text)) {
+    text++;
+    length--;
+  }
+  while (length > 0 && isSpace(text[length - 1])) {
+    length--;
+  }
+  if (length >= outSize) {
+    length = outSize - 1;
+  }
+  for (size_t i = 0; i < length; i++) {
+    out[i] = lower(text[i]);
+  }
+  out[length] = '\0';
+}
+
+XhtmlAlign parseAlign(const char* value) {
+  if (strcmp(value, "left") == 0 || strcmp(value, "start") == 0) {
+    return XHTML_ALIGN_LEFT;
+  }
+  if (strcmp(value, "center") == 0) {
+    return XHTML_ALIGN_CENTER;
+  }
+  if (strcmp(value, "right") == 0 || strcmp(value, "end") == 0) {
+    return XHTML_ALIGN_RIGHT;
+  }
+  if (strcmp(value, "justify") == 0) {
+    return XHTML_ALIGN_JUSTIFY;
+  }
+  return XHTML_ALIGN_DEFAULT;
+}
+}  // namespace
+
+XhtmlTokenizer::XhtmlTokenizer(const EventCallback callback, void* context) : callback(callback), context(context) {
+  reset();
+}
+
+void XhtmlTokenizer::reset() {
+  paused = false;
+  offset = 0;
+  lex = LEX_TEXT;
+  nameLen = 0;
+  entityLen = 0;
+  rawTag = 0;
+  depth = 0;
+  overflow = 0;
+  blockOpen = false;
+  pendingSpace = false;
+  pendingPageBreak = false;
+  blockState = {};
+  runLen = 0;
+  blockText = 0;
+  endStylesheet();
+}
+
+void XhtmlTokenizer::resume(const ResumeState& state) {
+  reset();
+  depth = state.depth < RESUME_FRAMES ? state.depth : RESUME_FRAMES;
+  memcpy(stack, state.frames, depth * sizeof(Frame));
+  offset = state.offset;
+  blockState = state;
+  blockState.depth = depth;
+}
+
+void XhtmlTokenizer::clearStyles() {
+  ruleCount = 0;
+  endStylesheet();
+}
+
+size_t XhtmlTokenizer::write(const uint8_t* data, const size_t length) {
+  paused = false;
+  for (size_t i = 0; i < length; i++) {
+    process(data[i]);
+    offset++;
+    if (paused) {
+      return i + 1;
+    }
+  }
+  return length;
+}
+
+void XhtmlTokenizer::finish() {
+  if (lex == LEX_ENTITY) {
+    lex = LEX_TEXT;
+    text('&');
+    for (uint8_t i = 0; i < entityLen; i++) {
+      text(entity[i]);
+    }
+  }
+  endBlock();
+}
+
+bool XhtmlTokenizer::hidden() const { return depth > 0 && (stack[depth - 1].flags & FRAME_HIDDEN); }
+
+void XhtmlTokenizer::process(const uint8_t c) {
+  switch (lex) {
+    case LEX_TEXT:
+      if (c == '<') {
+        tagOffset = offset;
+        lex = LEX_TAG_OPEN;
+      } else if (c == '&') {
+        entityLen = 0;
+        lex = LEX_ENTITY;
+      } else {
+        text(c);
+      }
+      break;
+
+    case LEX_ENTITY:
+      if (c == ';') {
+        lex = LEX_TEXT;
+        emitEntity();
+      } else if ((isAlnum(c) || c == '#') && entityLen < sizeof(entity) - 1) {
+        entity[entityLen++] = static_cast<char>(c);
+      } else {
+        // Not an entity, keep it as text
+        lex = LEX_TEXT;
+        text('&');
+        for (uint8_t i = 0; i < entityLen; i++) {
+          text(entity[i]);
+        }
+        process(c);
+      }
+      break;
+
+    case LEX_TAG_OPEN:
+      if (c == '/') {
+        nameLen = 0;
+        lex = LEX_END_TAG_NAME;
+      } else if (c == '!') {
+        nameLen = 0;
+        lex = LEX_BANG;
+      } else if (c == '?') {
+        lex = LEX_SKIP_TO_GT;
+      } else if (isAlnum(c)) {
+        beginTag();
+        name[0] = lower(c);
+        nameLen = 1;
+        lex = LEX_TAG_NAME;
+      } else {
+        lex = LEX_TEXT;
+        text('<');
+        process(c);
+      }
+      break;
+
+    case LEX_TAG_NAME:
+      if (!isSpace(c) && c != '/' && c != '>') {
+        if (nameLen < sizeof(name) - 1) {
+          name[nameLen++] = lower(c);
+        }
+        break;
+      }
+      name[nameLen] = '\0';
+      pendingTag = lookupTag(name);
+      lex = LEX_ATTR_SPACE;
+      process(c);
+      break;
+
+    case LEX_END_TAG_NAME:
+      if (c == '>') {
+        name[nameLen] = '\0';
+        lex = LEX_TEXT;
+        closeElement();
+      } else if (!isSpace(c) && nameLen < sizeof(name) - 1) {
+        name[nameLen++] = lower(c);
+      }
+      break;
+
+    case LEX_ATTR_SPACE:
+      if (c == '>') {
+        lex = LEX_TEXT;
+        openElement();
+      } else if (c == '/') {
+        selfClosing = true;
+      } else if (!isSpace(c)) {
+        selfClosing = false;
+        attrName[0] = lower(c);
+        attrNameLen = 1;
+        attrValueLen = 0;
+        lex = LEX_ATTR_NAME;
+      }
+      break;
+
+    case LEX_ATTR_NAME:
+      if (c == '=') {
+        lex = LEX_ATTR_VALUE_START;
+      } else if (isSpace(c)) {
+        lex = LEX_ATTR_AFTER_NAME;
+      } else if (c == '>' || c == '/') {
+        finishAttribute();
+        lex = LEX_ATTR_SPACE;
+        process(c);
+      } else if (attrNameLen < sizeof(attrName) - 1) {
+        attrName[attrNameLen++] = lower(c);
+      }
+      break;
+
+    case LEX_ATTR_AFTER_NAME:
+      if (c == '=') {
+        lex = LEX_ATTR_VALUE_START;
+      } else if (!isSpace(c)) {
+        finishAttribute();
+        lex = LEX_ATTR_SPACE;
+        process(c);
+      }
+      break;
+
+    case LEX_ATTR_VALUE_START:
+      if (c == '"' || c == '\'') {
+        quote = static_cast<char>(c);
+        lex = LEX_ATTR_VALUE;
+      } else if (c == '>') {
+        finishAttribute();
+        lex = LEX_ATTR_SPACE;
+        process(c);
+      } else if (!isSpace(c)) {
+        quote = 0;
+        attrValue[attrValueLen++] = static_cast<char>(c);
+        lex = LEX_ATTR_VALUE;
+      }
+      break;
+
+    case LEX_ATTR_VALUE:
+      if (quote ? c == quote : (isSpace(c) || c == '>')) {
+        finishAttribute();
+        lex = LEX_ATTR_SPACE;
+        if (c == '>') {
+          process(c);
+        }
+      } else if (attrValueLen < MAX_ATTRIBUTE_LENGTH) {
+        attrValue[attrValueLen++] = static_cast<char>(c);
+      }
+      break;
+
+    case LEX_BANG: {
+      // "<!--" starts a comment, "<![CDATA[" a CDATA section, anything else (DOCTYPE) is skipped
+      static constexpr char COMMENT_START[] = "--";
+      static constexpr char CDATA_START[] = "[CDATA[";
+      name[nameLen++] = static_cast<char>(c);
+      const bool commentPrefix = nameLen <= 2 && memcmp(name, COMMENT_START, nameLen) == 0;
+      const bool cdataPrefix = nameLen <= 7 && memcmp(name, CDATA_START, nameLen) == 0;
+      if (commentPrefix && nameLen == 2) {
+        matched = 0;
+        lex = LEX_COMMENT;
+      } else if (cdataPrefix && nameLen == 7) {
+        matched = 0;
+        lex = LEX_CDATA;
+      } else if (!commentPrefix && !cdataPrefix) {
+        lex = c == '>' ? LEX_TEXT : LEX_SKIP_TO_GT;
+      }
+      break;
+    }
+
+    case LEX_COMMENT:
+      if (c == '>' && matched == 2) {
+        lex = LEX_TEXT;
+      } else if (c == '-') {
+        matched = matched < 2 ? matched + 1 : 2;
+      } else {
+        matched = 0;
+      }
+      break;
+
+    case LEX_CDATA:
+      if (c == ']' && matched < 2) {
+        matched++;
+      } else if (c == ']') {
+        text(']');
+      } else if (c == '>' && matched == 2) {
+        lex = LEX_TEXT;
+      } else {
+        for (; matched > 0; matched--) {
+          text(']');
+        }
+        text(c);
+      }
+      break;
+
+    case LEX_SKIP_TO_GT:
+      if (c == '>') {
+        lex = LEX_TEXT;
+      }
+      break;
+
+    case LEX_RAW_TEXT: {
+      // Everything up to the matching end tag, which is handed to the end tag state once its name is complete
+      const char* rawName = TAGS[rawTag].name;
+      const size_t rawLength = strlen(rawName);
+      if (TAGS[rawTag].flags & T_CSS) {
+        css(c);
+      }
+      if (matched == 0 && c == '<') {
+        tagOffset = offset;
+        matched = 1;
+      } else if (matched == 1 && c == '/') {
+        matched = 2;
+      } else if (matched >= 2 && lower(c) == rawName[matched - 2]) {
+        matched++;
+        if (matched == rawLength + 2) {
+          memcpy(name, rawName, rawLength);
+          nameLen = rawLength;
+          lex = LEX_END_TAG_NAME;
+        }
+      } else {
+        matched = c == '<' ? 1 : 0;
+        if (c == '<') {
+          tagOffset = offset;
+        }
+      }
+      break;
+    }
+  }
+}
+
+void XhtmlTokenizer::text(const uint8_t c) {
+  if (hidden()) {
+    return;
+  }
+  const bool preformatted = depth > 0 && (stack[depth - 1].flags & FRAME_PRE);
+  if (preformatted) {
+    if (c == '\r') {
+      return;
+    }
+    if (c == '\n') {
+      startBlockIfNeeded();
+      flushRun();
+      emit(XHTML_LINE_BREAK, nullptr, 0, offset);
+      if (blockText >= MAX_BLOCK_TEXT) {
+        splitBlock();
+      }
+      return;
+    }
+  } else if (isSpace(c)) {
+    // Leading whitespace of a block is dropped, everything else collapses to one space
+    if (blockOpen && blockText >= MAX_BLOCK_TEXT) {
+      splitBlock();
+    } else if (blockOpen) {
+      pendingSpace = true;
+    }
+    return;
+  }
+
+  startBlockIfNeeded();
+  const uint16_t style = depth > 0 ? stack[depth - 1].style : 0;
+  if (runLen > 0 && style != runStyle) {
+    flushRun();
+  }
+  runStyle = style;
+  if (pendingSpace) {
+    pendingSpace = false;
+    appendToRun(" ", 1);
+  }
+  const char ch = static_cast<char>(c);
+  appendToRun(&ch, 1);
+}
+
+void XhtmlTokenizer::appendToRun(const char* bytes, const size_t length) {
+  blockText += length;
+  for (size_t i = 0; i < length; i++) {
+    const uint8_t b = bytes[i];
+    // A full run is emitted before the lead byte of a character, never in the middle of one
+    if (runLen + 4 > RUN_SIZE && (b & 0xC0) != 0x80) {
+      flushRun();
+    }
+    if (runLen == 0) {
+      runOffset = offset;
+    }
+    if (runLen < RUN_SIZE) {
+      run[runLen++] = static_cast<char>(b);
+    }
+  }
+}
+
+void XhtmlTokenizer::flushRun() {
+  if (runLen == 0) {
+    return;
+  }
+  const size_t length = runLen;
+  runLen = 0;
+  emit(XHTML_TEXT, run, length, runOffset);
+}
+
+void XhtmlTokenizer::markBlockStart(const uint32_t at) {
+  static_assert(sizeof(Frame) == 8, "ResumeState stores 8 bytes per frame");
+  const uint8_t count = depth < RESUME_FRAMES ? depth : RESUME_FRAMES;
+  blockState.offset = at;
+  blockState.depth = count;
+  blockState.continued = 0;
+  memcpy(blockState.frames, stack + depth - count, count * sizeof(Frame));
+}
+
+// Ends the block at the whitespace or newline just consumed, the rest goes on as a new block resumable from here
+void XhtmlTokenizer::splitBlock() {
+  endBlock();
+  markBlockStart(offset + 1);
+  blockState.continued = 1;
+}
+
+void XhtmlTokenizer::startBlockIfNeeded() {
+  if (blockOpen) {
+    return;
+  }
+  blockText = 0;
+  blockKind = XHTML_PARAGRAPH;
+  blockLevel = 0;
+  blockIndent = 0;
+  blockAlign = XHTML_ALIGN_DEFAULT;
+  for (size_t i = depth; i > 0; i--) {
+    const Frame& frame = stack[i - 1];
+    if (frame.flags & FRAME_BLOCK) {
+      const TagInfo& info = TAGS[frame.tag];
+      blockKind = info.block == XHTML_RULE ? XHTML_PARAGRAPH : info.block;
+      blockLevel = info.level;
+      blockIndent = frame.indent;
+      blockAlign = frame.align;
+      break;
+    }
+  }
+  blockOpen = true;
+  pendingSpace = false;
+  emit(XHTML_BLOCK_START, nullptr, 0, blockState.offset);
+  pendingPageBreak = false;
+}
+
+void XhtmlTokenizer::endBlock() {
+  flushRun();
+  pendingSpace = false;
+  if (!blockOpen) {
+    return;
+  }
+  blockOpen = false;
+  emit(XHTML_BLOCK_END, nullptr, 0, offset);
+}
+
+void XhtmlTokenizer::emit(const XhtmlEventType type, const char* text, const size_t length,
+                          const uint32_t eventOffset) {
+  XhtmlEvent event;
+  event.type = type;
+  event.text = text;
+  event.length = length;
+  event.style = type == XHTML_TEXT ? runStyle : 0;
+  event.block = blockKind;
+  event.level = blockLevel;
+  event.indent = blockIndent;
+  event.align = blockAlign;
+  event.pageBreakBefore = type == XHTML_BLOCK_START && pendingPageBreak;
+  event.continued = type == XHTML_BLOCK_START && blockState.continued;
+  event.offset = eventOffset;
+  callback(event, context);
+}
+
+void XhtmlTokenizer::beginTag() {
+  selfClosing = false;
+  pendingChange = {};
+  pendingClassCount = 0;
+  pendingIdLen = 0;
+  pendingSrcLen = 0;
+}
+
+void XhtmlTokenizer::finishAttribute() {
+  attrName[attrNameLen] = '\0';
+  attrValueLen = decodeEntities(attrValue, attrValueLen);
+
+  if (strcmp(attrName, "class") == 0) {
+    size_t start = 0;
+    while (start < attrValueLen && pendingClassCount < 4) {
+      while (start < attrValueLen && isSpace(attrValue[start])) {
+        start++;
+      }
+      size_t end = start;
+      while (end < attrValueLen && !isSpace(attrValue[end])) {
+        end++;
+      }
+      if (end > start) {
+        pendingClasses[pendingClassCount++] = hashName(attrValue + start, end - start);
+      }
+      start = end;
+    }
+  } else if (strcmp(attrName, "style") == 0) {
+    parseDeclarations(attrValue, attrValueLen, pendingChange);
+  } else if (strcmp(attrName, "id") == 0 || (strcmp(attrName, "name") == 0 && pendingIdLen == 0)) {
+    pendingIdLen = attrValueLen < sizeof(pendingId) ? attrValueLen : sizeof(pendingId) - 1;
+    memcpy(pendingId, attrValue, pendingIdLen);
+  } else if (strcmp(attrName, "src") == 0 || strcmp(attrName, "href") == 0 || strcmp(attrName, "xlink:href") == 0) {
+    pendingSrcLen = attrValueLen < sizeof(pendingSrc) ? attrValueLen : sizeof(pendingSrc) - 1;
+    memcpy(pendingSrc, attrValue, pendingSrcLen);
+  } else if (strcmp(attrName, "align") == 0) {
+    // Presentational attribute, a style attribute takes precedence
+    char value[16];
+    copyToken(attrValue, attrValueLen, value, sizeof(value));
+    if (pendingChange.align == XHTML_ALIGN_DEFAULT) {
+      pendingChange.align = parseAlign(value);
+    }
+  }
+  attrNameLen = 0;
+  attrValueLen = 0;
+}
+
+void XhtmlTokenizer::openElement() {
+  const TagInfo& info = TAGS[pendingTag];
+
+  Frame frame = {};
+  if (depth > 0) {
+    const Frame& parent = stack[depth - 1];
+    frame.style = parent.style;
+    frame.align = parent.align;
+    frame.flags = parent.flags & (FRAME_HIDDEN | FRAME_PRE);
+    frame.indent = parent.indent;
+  }
+  frame.nameHash = static_cast<uint16_t>(hashName(name, nameLen));
+  frame.tag = pendingTag;
+  frame.style |= info.style;
+  if (info.flags & T_BLOCK) {
+    frame.flags |= FRAME_BLOCK;
+  }
+  if (info.flags & T_HIDDEN) {
+    frame.flags |= FRAME_HIDDEN;
+  }
+  if (info.flags & T_PRE) {
+    frame.flags |= FRAME_PRE;
+  }
+  if (info.flags & T_CENTER) {
+    frame.align = XHTML_ALIGN_CENTER;
+  }
+  if ((info.flags & T_INDENT) && frame.indent < 15) {
+    frame.indent++;
+  }
+
+  // Cascade: tag rules, then class rules, then the style attribute
+  bool pageBreak = pendingChange.pageBreakBefore;
+  for (size_t i = 0; i < ruleCount; i++) {
+    if (rules[i].classHash == 0 && rules[i].tag == pendingTag) {
+      applyChange(rules[i].change, frame.style, frame.align, frame.flags);
+      pageBreak |= rules[i].change.pageBreakBefore;
+    }
+  }
+  for (size_t i = 0; i < ruleCount; i++) {
+    if (rules[i].classHash == 0 || (rules[i].tag != TAG_ANY && rules[i].tag != pendingTag)) {
+      continue;
+    }
+    for (uint8_t c = 0; c < pendingClassCount; c++) {
+      if (pendingClasses[c] == rules[i].classHash) {
+        applyChange(rules[i].change, frame.style, frame.align, frame.flags);
+        pageBreak |= rules[i].change.pageBreakBefore;
+        break;
+      }
+    }
+  }
+  applyChange(pendingChange, frame.style, frame.align, frame.flags);
+
+  if (!(frame.flags & FRAME_HIDDEN)) {
+    if ((frame.flags & FRAME_BLOCK) || (info.flags & T_RULE)) {
+      endBlock();
+      markBlockStart(tagOffset);
+      pendingPageBreak |= pageBreak;
+    }
+    if (pendingIdLen > 0) {
+      flushRun();
+      emit(XHTML_ANCHOR, pendingId, pendingIdLen, tagOffset);
+    }
+    if (info.flags & T_BREAK) {
+      startBlockIfNeeded();
+      flushRun();
+      pendingSpace = false;
+      emit(XHTML_LINE_BREAK, nullptr, 0, tagOffset);
+    }
+    if ((info.flags & T_IMAGE) && pendingSrcLen > 0) {
+      startBlockIfNeeded();
+      flushRun();
+      pendingSpace = false;
+      emit(XHTML_IMAGE, pendingSrc, pendingSrcLen, tagOffset);
+    }
+    if (info.flags & T_RULE) {
+      blockKind = XHTML_RULE;
+      blockLevel = 0;
+      blockIndent = frame.indent;
+      blockAlign = frame.align;
+      emit(XHTML_BLOCK_START, nullptr, 0, tagOffset);
+      pendingPageBreak = false;
+      emit(XHTML_BLOCK_END, nullptr, 0, tagOffset);
+    }
+  }
+
+  if ((info.flags & T_VOID) || selfClosing) {
+    // Text after an empty block or a rule is resumed behind the tag, so resuming there does not repeat the rule
+    if (!(frame.flags & FRAME_HIDDEN) && ((frame.flags & FRAME_BLOCK) || (info.flags & T_RULE))) {
+      endBlock();
+      markBlockStart(offset + 1);
+    }
+    return;
+  }
+  if (depth < MAX_DEPTH) {
+    stack[depth++] = frame;
+  } else {
+    overflow++;
+  }
+  if (info.flags & T_RAW) {
+    rawTag = pendingTag;
+    matched = 0;
+    lex = LEX_RAW_TEXT;
+    if (info.flags & T_CSS) {
+      endStylesheet();
+    }
+  }
+}
+
+void XhtmlTokenizer::closeElement() {
+  // Elements past MAX_DEPTH were only counted, assume the end tag belongs to the innermost of them
+  if (overflow > 0) {
+    overflow--;
+    return;
+  }
+  // Pop up to the matching element, which also closes elements whose end tag is missing. Stray end tags are ignored.
+  const uint16_t hash = static_cast<uint16_t>(hashName(name, nameLen));
+  size_t match = depth;
+  while (match > 0 && stack[match - 1].nameHash != hash) {
+    match--;
+  }
+  bool blockClosed = false;
+  while (match > 0 && depth >= match) {
+    const Frame& frame = stack[--depth];
+    if (TAGS[frame.tag].flags & T_CSS) {
+      endStylesheet();
+    }
+    if ((frame.flags & (FRAME_BLOCK | FRAME_HIDDEN)) == FRAME_BLOCK) {
+      endBlock();
+      blockClosed = true;
+    }
+  }
+  // Text that follows belongs to the enclosing block and resumes behind this end tag
+  if (blockClosed) {
+    markBlockStart(offset + 1);
+  }
+}
+
+void XhtmlTokenizer::emitEntity() {
+  const uint32_t codepoint = decodeEntity(entity, entityLen);
+  if (codepoint) {
+    appendCodepoint(codepoint);
+    return;
+  }
+  text('&');
+  for (uint8_t i = 0; i < entityLen; i++) {
+    text(entity[i]);
+  }
+  text(';');
+}
+
+void XhtmlTokenizer::appendCodepoint(const uint32_t codepoint) {
+  char bytes[4];
+  const size_t length = encodeUtf8(codepoint, bytes);
+  for (size_t i = 0; i < length; i++) {
+    text(bytes[i]);
+  }
+}
+
+void XhtmlTokenizer::writeStylesheet(const uint8_t* data, const size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    css(data[i]);
+  }
+}
+
+void XhtmlTokenizer::endStylesheet() {
+  cssState = CSS_SELECTOR;
+  cssBraces = 0;
+  cssStar = false;
+  cssLen = 0;
+  cssSelectorCount = 0;
+  cssChange = {};
+}
+
+void XhtmlTokenizer::css(const uint8_t c) {
+  if (cssState == CSS_COMMENT) {
+    if (cssStar && c == '/') {
+      cssState = cssResume;
+    }
+    cssStar = c == '*';
+    return;
+  }
+  if (cssState == CSS_AT_RULE) {
+    // @media, @font-face and friends are skipped as a whole
+    if (c == '{') {
+      cssBraces++;
+    } else if (c == '}' && --cssBraces == 0) {
+      cssState = CSS_SELECTOR;
+    }
+    return;
+  }
+  if (c == '*' && cssLen > 0 && cssLen < sizeof(cssBuffer) && cssBuffer[cssLen - 1] == '/') {
+    cssLen--;
+    cssResume = cssState;
+    cssState = CSS_COMMENT;
+    cssStar = false;
+    return;
+  }
+
+  if (cssState == CSS_SELECTOR) {
+    if (c == '{') {
+      size_t start = 0;
+      while (start < cssLen && isSpace(cssBuffer[start])) {
+        start++;
+      }
+      if (start < cssLen && cssBuffer[start] == '@') {
+        cssState = CSS_AT_RULE;
+        cssBraces = 1;
+      } else {
+        parseSelectors();
+        cssChange = {};
+        cssState = CSS_DECLARATIONS;
+      }
+      cssLen = 0;
+    } else if (c == ';' || c == '}') {
+      // End of @import or @charset, or a stray brace
+      cssLen = 0;
+    } else if (cssLen < sizeof(cssBuffer)) {
+      cssBuffer[cssLen++] = static_cast<char>(c);
+    }
+  } else {
+    if (c == '}') {
+      finishDeclarations();
+      cssState = CSS_SELECTOR;
+    } else if (c == ';') {
+      // A declaration that did not fit the buffer is dropped rather than parsed truncated
+      if (cssLen < sizeof(cssBuffer)) {
+        parseDeclarations(cssBuffer, cssLen, cssChange);
+      }
+      cssLen = 0;
+    } else if (cssLen < sizeof(cssBuffer)) {
+      cssBuffer[cssLen++] = static_cast<char>(c);
+    }
+  }
+}
+
+void XhtmlTokenizer::parseSelectors() {
+  cssSelectorCount = 0;
+  size_t length = cssLen;
+  if (length == sizeof(cssBuffer)) {
+    // Truncated list, keep the selectors before the last comma
+    while (length > 0 && cssBuffer[length - 1] != ',') {
+      length--;
+    }
+  }
+
+  size_t start = 0;
+  while (start < length && cssSelectorCount < sizeof(cssSelectors) / sizeof(cssSelectors[0])) {
+    size_t end = start;
+    while (end < length && cssBuffer[end] != ',') {
+      end++;
+    }
+    // Only the last compound selector of a descendant or child chain is matched
+    size_t last = end;
+    while (last > start && isSpace(cssBuffer[last - 1])) {
+      last--;
+    }
+    size_t first = last;
+    while (first > start && !isSpace(cssBuffer[first - 1]) && cssBuffer[first - 1] != '>' &&
+           cssBuffer[first - 1] != '+' && cssBuffer[first - 1] != '~') {
+      first--;
+    }
+    start = end + 1;
+
+    const char* selector = cssBuffer + first;
+    const size_t selectorLength = last - first;
+    if (selectorLength == 0 || memchr(selector, ':', selectorLength) || memchr(selector, '[', selectorLength) ||
+        memchr(selector, '#', selectorLength)) {
+      continue;
+    }
+    const char* dot = static_cast<const char*>(memchr(selector, '.', selectorLength));
+    const size_t tagLength = dot ? dot - selector : selectorLength;
+    const size_t classLength = dot ? selectorLength - tagLength - 1 : 0;
+    if (dot && (classLength == 0 || memchr(dot + 1, '.', classLength))) {
+      // Compound classes are not supported
+      continue;
+    }
+
+    Rule& rule = cssSelectors[cssSelectorCount];
+    rule.tag = TAG_ANY;
+    if (tagLength > 0 && !(tagLength == 1 && selector[0] == '*')) {
+      char tagName[16];
+      copyToken(selector, tagLength, tagName, sizeof(tagName));
+      rule.tag = lookupTag(tagName);
+      if (rule.tag == TAG_UNKNOWN) {
+        continue;
+      }
+    }
+    rule.classHash = classLength > 0 ? hashName(dot + 1, classLength) : 0;
+    if (rule.tag != TAG_ANY || rule.classHash != 0) {
+      cssSelectorCount++;
+    }
+  }
+}
+
+void XhtmlTokenizer::finishDeclarations() {
+  if (cssLen > 0 && cssLen < sizeof(cssBuffer)) {
+    parseDeclarations(cssBuffer, cssLen, cssChange);
+  }
+  cssLen = 0;
+
+  const bool empty = cssChange.set == 0 && cssChange.clear == 0 && cssChange.align == XHTML_ALIGN_DEFAULT &&
+                     cssChange.display == 0 && cssChange.whiteSpace == 0 && !cssChange.pageBreakBefore;
+  for (uint8_t i = 0; i < cssSelectorCount && !empty; i++) {
+    if (ruleCount == MAX_RULES) {
+      if (Serial) Serial.printf("[%lu] [XHT] Rule table full, ignoring the rest of the stylesheet\n", millis());
+      break;
+    }
+    rules[ruleCount] = cssSelectors[i];
+    rules[ruleCount].change = cssChange;
+    ruleCount++;
+  }
+  cssSelectorCount = 0;
+  cssChange = {};
+}
+
+void XhtmlTokenizer::parseDeclarations(const char* text, const size_t length, StyleChange& change) {
+  auto setFlag = [&change](const uint16_t flag, const bool on) {
+    if (on) {
+      change.set |= flag;
+      change.clear &= ~flag;
+    } else {
+      change.clear |= flag;
+      change.set &= ~flag;
+    }
+  };
+
+  size_t start = 0;
+  while (start < length) {
+    size_t end = start;
+    while (end < length && text[end] != ';') {
+      end++;
+    }
+    const char* colon = static_cast<const char*>(memchr(text + start, ':', end - start));
+    if (!colon) {
+      start = end + 1;
+      continue;
+    }
+    char property[24];
+    char value[32];
+    copyToken(text + start, colon - (text + start), property, sizeof(property));
+    copyToken(colon + 1, text + end - colon - 1, value, sizeof(value));
+    start = end + 1;
+    char* important = strchr(value, '!');
+    if (important) {
+      while (important > value && isSpace(important[-1])) {
+        important--;
+      }
+      *important = '\0';
+    }
+
+    if (strcmp(property, "font-weight") == 0) {
+      if (strcmp(value, "bold") == 0 || strcmp(value, "bolder") == 0) {
+        setFlag(XHTML_BOLD, true);
+      } else if (strcmp(value, "normal") == 0 || strcmp(value, "lighter") == 0) {
+        setFlag(XHTML_BOLD, false);
+      } else if (value[0] >= '1' && value[0] <= '9') {
+        setFlag(XHTML_BOLD, atoi(value) >= 600);
+      }
+    } else if (strcmp(property, "font-style") == 0) {
+      if (strcmp(value, "italic") == 0 || strcmp(value, "oblique") == 0) {
+        setFlag(XHTML_ITALIC, true);
+      } else if (strcmp(value, "normal") == 0) {
+        setFlag(XHTML_ITALIC, false);
+      }
+    } else if (strcmp(property, "text-decoration") == 0 || strcmp(property, "text-decoration-line") == 0) {
+      if (strcmp(value, "none") == 0) {
+        setFlag(XHTML_UNDERLINE, false);
+        setFlag(XHTML_STRIKE, false);
+      } else {
+        if (strstr(value, "underline")) {
+          setFlag(XHTML_UNDERLINE, true);
+        }
+        if (strstr(value, "line-through")) {
+          setFlag(XHTML_STRIKE, true);
+        }
+      }
+    } else if (strcmp(property, "font-variant") == 0 || strcmp(property, "font-variant-caps") == 0) {
+      if (strcmp(value, "small-caps") == 0) {
+        setFlag(XHTML_SMALL_CAPS, true);
+      } else if (strcmp(value, "normal") == 0) {
+        setFlag(XHTML_SMALL_CAPS, false);
+      }
+    } else if (strcmp(property, "font-family") == 0) {
+      if (strstr(value, "mono") || strstr(value, "courier")) {
+        setFlag(XHTML_MONOSPACE, true);
+      }
+    } else if (strcmp(property, "vertical-align") == 0) {
+      if (strcmp(value, "super") == 0) {
+        setFlag(XHTML_SUPERSCRIPT, true);
+        setFlag(XHTML_SUBSCRIPT, false);
+      } else if (strcmp(value, "sub") == 0) {
+        setFlag(XHTML_SUBSCRIPT, true);
+        setFlag(XHTML_SUPERSCRIPT, false);
+      } else if (strcmp(value, "baseline") == 0) {
+        setFlag(XHTML_SUPERSCRIPT, false);
+        setFlag(XHTML_SUBSCRIPT, false);
+      }
+    } else if (strcmp(property, "text-align") == 0) {
+      const XhtmlAlign align = parseAlign(value);
+      if (align != XHTML_ALIGN_DEFAULT) {
+        change.align = align;
+      }
+    } else if (strcmp(property, "display") == 0) {
+      if (strcmp(value, "none") == 0) {
+        change.display = DISPLAY_NONE;
+      } else if (strcmp(value, "inline") == 0 || strcmp(value, "inline-block") == 0) {
+        change.display = DISPLAY_INLINE;
+      } else if (value[0] != '\0') {
+        // block, list-item, table-cell, flex and the like all start a new line
+        change.display = DISPLAY_BLOCK;
+      }
+    } else if (strcmp(property, "white-space") == 0) {
+      change.whiteSpace = strncmp(value, "pre", 3) == 0 ? 2 : 1;
+    } else if (strcmp(property, "page-break-before") == 0 || strcmp(property, "break-before") == 0) {
+      change.pageBreakBefore = strcmp(value, "always") == 0 || strcmp(value, "page") == 0 ||
+                               strcmp(value, "left") == 0 || strcmp(value, "right") == 0 ||
+                               strcmp(value, "recto") == 0 || strcmp(value, "verso") == 0;
+    }
+  }
+}
+
+void XhtmlTokenizer::applyChange(const StyleChange& change, uint16_t& style, XhtmlAlign& align, uint8_t& flags) {
+  style = (style | change.set) & ~change.clear;
+  if (change.align != XHTML_ALIGN_DEFAULT) {
+    align = change.align;
+  }
+  if (change.display == DISPLAY_NONE) {
+    flags |= FRAME_HIDDEN;
+  } else if (change.display == DISPLAY_BLOCK) {
+    flags |= FRAME_BLOCK;
+  } else if (change.display == DISPLAY_INLINE) {
+    flags &= ~FRAME_BLOCK;
+  }
+  if (change.whiteSpace == 2) {
+    flags |= FRAME_PRE;
+  } else if (change.whiteSpace == 1) {
+    flags &= ~FRAME_PRE;
+  }
+}
+
+uint8_t XhtmlTokenizer::lookupTag(const char* name) {
+  for (uint8_t i = 1; i < TAG_COUNT; i++) {
+    if (TAGS[i].name[0] == name[0] && strcmp(TAGS[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return TAG_UNKNOWN;
+}
+
+uint32_t XhtmlTokenizer::hashName(const char* name, const size_t length) {
+  // FNV-1a, never 0 so 0 can mean "no class"
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619u;
+  }
+  return hash ? hash : 1;
+}
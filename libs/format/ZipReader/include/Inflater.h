@@ -0,0 +1,118 @@
+#pragma once
+
+#include <BufferedReader.h>
+
+/**
+ * Streaming decoder for raw deflate data (RFC 1951), as stored in ZIP entries.
+ *
+ * Compressed bytes are pulled from a BufferedReader or a byte source callback as needed and the output is produced in
+ * caller sized pieces, so memory is the 32 KB history window plus about 3 KB of decoding tables regardless of the entry
+ * size. Huffman codes of up to 9 bits are decoded with one table lookup, longer ones bit by bit.
+ *
+ * A block callback runs before every block header is read. At that point the decoder state is fully described by
+ * inputBitPosition(), totalOut() and the window, which is what ZipEntryReader stores as a seek checkpoint and hands
+ * back to resume().
+ */
+class Inflater {
+ public:
+  static constexpr size_t WINDOW_SIZE = 32768;
+
+  // Runs on a block boundary
+  typedef void (*BlockCallback)(Inflater& inflater, void* context);
+  // Next compressed byte, or -1 at the end of the input
+  typedef int (*ByteSource)(void* context);
+
+  Inflater() = default;
+  ~Inflater();
+
+  Inflater(const Inflater&) = delete;
+  Inflater& operator=(const Inflater&) = delete;
+
+  // Starts decoding at the current position of `input`, allocates the window on first use
+  bool begin(BufferedReader& input);
+  // Starts decoding bytes pulled one at a time from `source`, for deflate data split over several pieces of a file
+  // such as PNG IDAT chunks
+  bool begin(ByteSource source, void* context);
+  // Continues at a block boundary saved earlier. `input` must be positioned at byte `bitPosition / 8` of the compressed
+  // data and the window must already hold what it held at that point.
+  bool resume(BufferedReader& input, uint32_t bitPosition, uint32_t outputPosition);
+  void end();
+
+  /**
+   * Decodes up to `length` bytes.
+   *
+   * @param out destination, or nullptr to decode and discard (for seeking)
+   * @return bytes produced, short only at the end of the stream or on an error
+   */
+  size_t read(uint8_t* out, size_t length);
+
+  void setBlockCallback(BlockCallback callback, void* context) {
+    blockCallback = callback;
+    blockContext = context;
+  }
+
+  bool finished() const { return state == STATE_DONE; }
+  bool hasError() const { return state == STATE_ERROR; }
+  uint32_t totalOut() const { return outPos; }
+  // Compressed bits consumed since begin(), meaningful for resume() only on a block boundary
+  uint32_t inputBitPosition() const { return inputBytes * 8 - bitCount + padBits; }
+
+  // The circular history buffer, byte `i` of the output lives at index `i % WINDOW_SIZE`
+  uint8_t* getWindow() { return window; }
+
+ private:
+  static constexpr uint8_t MAX_BITS = 15;
+  static constexpr uint8_t FAST_BITS = 9;
+  static constexpr uint16_t MAX_SYMBOLS = 288;
+
+  enum State : uint8_t { STATE_HEADER, STATE_STORED, STATE_CODES, STATE_DONE, STATE_ERROR };
+
+  // Canonical Huffman code. `fast` maps the next FAST_BITS input bits to (length << 9) | symbol, 0 for longer codes.
+  struct Huffman {
+    uint16_t count[MAX_BITS + 1];
+    uint16_t symbol[MAX_SYMBOLS];
+    uint16_t fast[1 << FAST_BITS];
+  };
+
+  static bool build(Huffman& h, const uint8_t* lengths, uint16_t n);
+  int decode(const Huffman& h);
+
+  void need(uint8_t n);
+  void consume(uint8_t n) {
+    bitBuffer >>= n;
+    bitCount -= n;
+  }
+  // True once bits past the end of the input were consumed
+  bool overrun() const { return bitCount < padBits; }
+  uint32_t bits(uint8_t n);
+  bool readHeader();
+  bool readDynamicTables();
+  size_t copyStored(uint8_t* out, size_t length);
+  size_t decodeCodes(uint8_t* out, size_t length);
+  size_t fail(const char* reason);
+  bool start(uint32_t bitPosition, uint32_t outputPosition);
+  int nextByte() { return input ? input->read() : byteSource(sourceContext); }
+
+  BufferedReader* input = nullptr;
+  ByteSource byteSource = nullptr;
+  void* sourceContext = nullptr;
+  uint8_t* window = nullptr;
+  uint32_t outPos = 0;
+
+  State state = STATE_DONE;
+  bool lastBlock = false;
+  uint32_t storedRemaining = 0;
+  uint16_t copyLength = 0;  // Rest of a match that did not fit into the last read()
+  uint16_t copyDistance = 0;
+
+  uint32_t bitBuffer = 0;
+  uint8_t bitCount = 0;
+  uint8_t padBits = 0;  // Zero bits appended past the end of the input
+  uint32_t inputBytes = 0;
+
+  BlockCallback blockCallback = nullptr;
+  void* blockContext = nullptr;
+
+  Huffman lengthCode;
+  Huffman distanceCode;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <BlockCache.h>
+#include <BufferedReader.h>
+#include <SDCardManager.h>
+
+#include "Inflater.h"
+
+/**
+ * ZIP archive (e.g. an EPUB) on the SD card, opened without extracting anything.
+ *
+ * The central directory is parsed once and cached as a compact index under /.sdcache/zip, sorted by a hash of the
+ * entry name; find() binary searches it through the block cache, so opening an archive again costs one small read and
+ * a lookup a few cached page reads. The index is rebuilt when the archive's size or modify time changes.
+ *
+ * Only stored and deflated entries are supported, and no ZIP64 or encryption.
+ */
+class ZipArchive {
+ public:
+  static constexpr size_t MAX_ENTRY_NAME_LENGTH = 255;
+
+  struct Entry {
+    uint32_t localHeaderOffset;
+    uint32_t compressedSize;
+    uint32_t uncompressedSize;
+    uint32_t crc32;
+    uint16_t method;  // 0 stored, 8 deflated
+  };
+
+  explicit ZipArchive(SDCardManager& sd = SdMan);
+  ~ZipArchive() { close(); }
+
+  ZipArchive(const ZipArchive&) = delete;
+  ZipArchive& operator=(const ZipArchive&) = delete;
+
+  // Opens the archive at `path`, building its index first if it is missing or stale
+  bool open(const char* path);
+  void close();
+  bool isOpen() const { return static_cast<bool>(file); }
+
+  // Looks up an entry by its full name, e.g. "OEBPS/chapter1.xhtml"
+  bool find(const char* name, Entry& entry);
+
+  // Number of file entries (directories are not indexed)
+  uint32_t size() const { return entryCount; }
+  // Entry `index` in index order, which is by name hash and not alphabetical
+  bool entryAt(uint32_t index, Entry& entry, char* name, size_t nameSize);
+
+  // True if the last open() had to build the index
+  bool wasRebuilt() const { return rebuilt; }
+  // Identifies the archive's path, used to name cache files
+  uint32_t getKey() const { return key; }
+  // Changes whenever the archive is replaced (its size or modify time does), e.g. to key caches of its contents
+  uint32_t getIdentity() const;
+  SDCardManager& getSd() { return sd; }
+
+ private:
+  friend class ZipEntryReader;
+
+  bool loadIndex();
+  bool buildIndex();
+  bool findCentralDirectory(uint32_t& offset, uint32_t& size, uint16_t& count);
+  bool readRecord(uint32_t index, Entry& entry, uint32_t& hash, uint32_t& nameOffset, uint16_t& nameLength);
+
+  SDCardManager& sd;
+  FsFile file;
+  uint32_t archiveSize = 0;
+  uint16_t archiveDate = 0;
+  uint16_t archiveTime = 0;
+  uint32_t key = 0;
+  char indexPath[40] = {};
+
+  CachedFile index;
+  uint32_t entryCount = 0;
+  uint32_t recordsOffset = 0;
+  bool rebuilt = false;
+};
+
+/**
+ * Streams the contents of one ZIP entry.
+ *
+ * Deflated entries are decoded with an Inflater, so memory stays at the 32 KB window plus the input buffer whatever
+ * the entry size; stored entries are read directly and need no window. Seeking backwards re-inflates from the nearest
+ * checkpoint: while an entry is read front to back, the decoder state is saved every `checkpointInterval` bytes of
+ * output to a file under /.sdcache/zip, reused by later readers of the same entry.
+ *
+ * The CRC-32 of the entry is verified when it is read from the start to the end without seeking.
+ */
+class ZipEntryReader {
+ public:
+  static constexpr uint32_t DEFAULT_CHECKPOINT_INTERVAL = 65536;
+  static constexpr size_t MAX_CHECKPOINTS = 64;
+
+  explicit ZipEntryReader(size_t inputSectors = 2);
+  ~ZipEntryReader() { close(); }
+
+  ZipEntryReader(const ZipEntryReader&) = delete;
+  ZipEntryReader& operator=(const ZipEntryReader&) = delete;
+
+  bool open(ZipArchive& archive, const char* name);
+  bool open(ZipArchive& archive, const ZipArchive::Entry& entry);
+  void close();
+  bool isOpen() const { return static_cast<bool>(file); }
+
+  // Reads up to `length` bytes, returns the number of bytes read
+  size_t read(void* out, size_t length);
+  // Next byte, or -1 at the end of the entry
+  int read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+  }
+
+  bool seek(uint32_t position);
+  uint32_t position() const { return pos; }
+  uint32_t size() const { return entry.uncompressedSize; }
+  bool eof() const { return pos >= entry.uncompressedSize; }
+  // True after corrupt data or a CRC mismatch
+  bool hasError() const { return failed; }
+
+  // Output bytes between checkpoints, 0 disables checkpoints. Takes effect on the next open().
+  void setCheckpointInterval(uint32_t bytes) { checkpointInterval = bytes; }
+
+ private:
+  struct Checkpoint {
+    uint32_t output;
+    uint32_t inputBits;
+  };
+
+  static void onBlock(Inflater& inflater, void* context);
+  bool restart();
+  bool restore(size_t checkpoint);
+  void loadCheckpoints();
+  void saveCheckpoint();
+
+  FsFile file;
+  BufferedReader input;
+  Inflater inflater;
+  ZipArchive::Entry entry = {};
+  uint32_t dataOffset = 0;
+  uint32_t pos = 0;
+  bool failed = false;
+
+  uint32_t crc = 0;
+  bool crcValid = false;  // Every byte so far went through `crc`
+
+  uint32_t checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+  SDCardManager* sd = nullptr;
+  char checkpointPath[48] = {};
+  FsFile checkpointFile;
+  Checkpoint checkpoints[MAX_CHECKPOINTS];
+  size_t checkpointCount = 0;
+  bool checkpointsLoaded = false;
+};
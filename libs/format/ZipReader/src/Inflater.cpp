@@ -0,0 +1,418 @@
+#include "Inflater.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr uint32_t WINDOW_MASK = Inflater::WINDOW_SIZE - 1;
+
+constexpr uint16_t LENGTH_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                      2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t DISTANCE_BASE[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+                                        33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+                                        1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+constexpr uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                        6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Order in which code length code lengths are stored
+constexpr uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+}  // namespace
+
+Inflater::~Inflater() { end(); }
+
+bool Inflater::begin(BufferedReader& source) { return resume(source, 0, 0); }
+
+bool Inflater::begin(const ByteSource source, void* context) {
+  input = nullptr;
+  byteSource = source;
+  sourceContext = context;
+  return start(0, 0);
+}
+
+bool Inflater::resume(BufferedReader& source, const uint32_t bitPosition, const uint32_t outputPosition) {
+  input = &source;
+  byteSource = nullptr;
+  sourceContext = nullptr;
+  return start(bitPosition, outputPosition);
+}
+
+bool Inflater::start(const uint32_t bitPosition, const uint32_t outputPosition) {
+  if (!window) {
+    window = static_cast<uint8_t*>(malloc(WINDOW_SIZE));
+    if (!window) {
+      if (Serial) Serial.printf("[%lu] [INF] Failed to allocate %u byte window\n", millis(), WINDOW_SIZE);
+      return false;
+    }
+  }
+
+  outPos = outputPosition;
+  state = STATE_HEADER;
+  lastBlock = false;
+  storedRemaining = 0;
+  copyLength = 0;
+  copyDistance = 0;
+  bitBuffer = 0;
+  bitCount = 0;
+  padBits = 0;
+  inputBytes = bitPosition / 8;
+
+  const uint8_t skipBits = bitPosition % 8;
+  if (skipBits > 0) {
+    need(skipBits);
+    consume(skipBits);
+  }
+  return true;
+}
+
+void Inflater::end() {
+  free(window);
+  window = nullptr;
+  input = nullptr;
+  byteSource = nullptr;
+  state = STATE_DONE;
+}
+
+// Tops the bit buffer up to at least `n` bits, padding with zero bits at the end of the input
+void Inflater::need(const uint8_t n) {
+  while (bitCount < n) {
+    int b = nextByte();
+    if (b < 0) {
+      b = 0;
+      padBits += 8;
+    } else {
+      inputBytes++;
+    }
+    bitBuffer |= static_cast<uint32_t>(b) << bitCount;
+    bitCount += 8;
+  }
+}
+
+uint32_t Inflater::bits(const uint8_t n) {
+  need(n);
+  const uint32_t v = bitBuffer & ((1u << n) - 1);
+  consume(n);
+  return v;
+}
+
+size_t Inflater::fail(const char* reason) {
+  if (Serial)
+    Serial.printf("[%lu] [INF] Invalid deflate data at output byte %lu: %s\n", millis(),
+                  static_cast<unsigned long>(outPos), reason);
+  state = STATE_ERROR;
+  return 0;
+}
+
+bool Inflater::build(Huffman& h, const uint8_t* lengths, const uint16_t n) {
+  memset(h.count, 0, sizeof(h.count));
+  for (uint16_t i = 0; i < n; i++) {
+    h.count[lengths[i]]++;
+  }
+  h.count[0] = 0;
+
+  // Over-subscribed codes are invalid, incomplete ones are allowed (a single distance code is common)
+  int left = 1;
+  for (uint8_t len = 1; len <= MAX_BITS; len++) {
+    left <<= 1;
+    left -= h.count[len];
+    if (left < 0) {
+      return false;
+    }
+  }
+
+  uint16_t offsets[MAX_BITS + 1];
+  uint16_t nextCode[MAX_BITS + 1];
+  offsets[1] = 0;
+  nextCode[1] = 0;
+  for (uint8_t len = 1; len < MAX_BITS; len++) {
+    offsets[len + 1] = offsets[len] + h.count[len];
+    nextCode[len + 1] = (nextCode[len] + h.count[len]) << 1;
+  }
+
+  memset(h.fast, 0, sizeof(h.fast));
+  for (uint16_t symbol = 0; symbol < n; symbol++) {
+    const uint8_t len = lengths[symbol];
+    if (len == 0) {
+      continue;
+    }
+    h.symbol[offsets[len]++] = symbol;
+
+    const uint16_t code = nextCode[len]++;
+    if (len <= FAST_BITS) {
+      // Codes are stored most significant bit first, the bit buffer is filled least significant bit first
+      uint16_t reversed = 0;
+      for (uint8_t i = 0; i < len; i++) {
+        reversed |= ((code >> i) & 1) << (len - 1 - i);
+      }
+      for (uint16_t k = reversed; k < (1u << FAST_BITS); k += 1u << len) {
+        h.fast[k] = static_cast<uint16_t>((len << 9) | symbol);
+      }
+    }
+  }
+  return true;
+}
+
+int Inflater::decode(const Huffman& h) {
+  need(MAX_BITS);
+  const uint16_t entry = h.fast[bitBuffer & ((1u << FAST_BITS) - 1)];
+  if (entry != 0) {
+    consume(entry >> 9);
+    return entry & 0x1FF;
+  }
+
+  // Canonical decoding one bit at a time, for codes longer than FAST_BITS
+  int code = 0;
+  int first = 0;
+  int index = 0;
+  for (uint8_t len = 1; len <= MAX_BITS; len++) {
+    code |= (bitBuffer >> (len - 1)) & 1;
+    const int count = h.count[len];
+    if (code - count < first) {
+      consume(len);
+      return h.symbol[index + (code - first)];
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+bool Inflater::readHeader() {
+  lastBlock = bits(1);
+  const uint32_t type = bits(2);
+
+  if (type == 0) {
+    consume(bitCount % 8);
+    const uint32_t length = bits(16);
+    const uint32_t complement = bits(16);
+    if (length != (~complement & 0xFFFF)) {
+      return fail("stored block length mismatch");
+    }
+    storedRemaining = length;
+    state = length > 0 ? STATE_STORED : STATE_HEADER;
+  } else if (type == 1) {
+    uint8_t lengths[MAX_SYMBOLS];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    build(lengthCode, lengths, MAX_SYMBOLS);
+    memset(lengths, 5, 30);
+    build(distanceCode, lengths, 30);
+    state = STATE_CODES;
+  } else if (type == 2) {
+    if (!readDynamicTables()) {
+      return false;
+    }
+    state = STATE_CODES;
+  } else {
+    return fail("invalid block type");
+  }
+
+  if (overrun()) {
+    return fail("unexpected end of data");
+  }
+  return true;
+}
+
+bool Inflater::readDynamicTables() {
+  const uint16_t lengthCount = bits(5) + 257;
+  const uint16_t distanceCount = bits(5) + 1;
+  const uint16_t codeLengthCount = bits(4) + 4;
+  if (lengthCount > 286 || distanceCount > 30) {
+    return fail("too many codes");
+  }
+
+  uint8_t lengths[286 + 30] = {};
+  for (uint16_t i = 0; i < codeLengthCount; i++) {
+    lengths[CODE_LENGTH_ORDER[i]] = bits(3);
+  }
+  // The code length code is only needed while reading the tables, so it borrows the length code's storage
+  if (!build(lengthCode, lengths, 19)) {
+    return fail("invalid code length code");
+  }
+
+  const uint16_t total = lengthCount + distanceCount;
+  uint16_t index = 0;
+  while (index < total) {
+    const int symbol = decode(lengthCode);
+    if (symbol < 0 || overrun()) {
+      return fail("invalid code length");
+    }
+    if (symbol < 16) {
+      lengths[index++] = symbol;
+      continue;
+    }
+
+    uint8_t value = 0;
+    uint16_t repeat;
+    if (symbol == 16) {
+      if (index == 0) {
+        return fail("repeat with no previous length");
+      }
+      value = lengths[index - 1];
+      repeat = 3 + bits(2);
+    } else if (symbol == 17) {
+      repeat = 3 + bits(3);
+    } else {
+      repeat = 11 + bits(7);
+    }
+    if (index + repeat > total) {
+      return fail("too many code lengths");
+    }
+    memset(lengths + index, value, repeat);
+    index += repeat;
+  }
+
+  if (lengths[256] == 0) {
+    return fail("missing end of block code");
+  }
+  if (!build(lengthCode, lengths, lengthCount) || !build(distanceCode, lengths + lengthCount, distanceCount)) {
+    return fail("invalid literal/length or distance code");
+  }
+  return true;
+}
+
+size_t Inflater::copyStored(uint8_t* out, const size_t length) {
+  const size_t n = min(static_cast<size_t>(storedRemaining), length);
+  size_t done = 0;
+
+  // Whole bytes already pulled into the bit buffer come first
+  while (done < n && bitCount >= 8 && !overrun()) {
+    const uint8_t b = bitBuffer & 0xFF;
+    consume(8);
+    window[outPos & WINDOW_MASK] = b;
+    if (out) {
+      out[done] = b;
+    }
+    outPos++;
+    done++;
+  }
+
+  // A byte source has no bulk read, its bytes go through one at a time
+  while (!input && done < n) {
+    const int b = padBits == 0 ? byteSource(sourceContext) : -1;
+    if (b < 0) {
+      storedRemaining -= done;
+      return done + fail("unexpected end of stored block");
+    }
+    inputBytes++;
+    window[outPos & WINDOW_MASK] = b;
+    if (out) {
+      out[done] = b;
+    }
+    outPos++;
+    done++;
+  }
+
+  // The rest goes straight from the input into the window
+  while (done < n) {
+    const size_t offset = outPos & WINDOW_MASK;
+    const size_t chunk = min(n - done, WINDOW_SIZE - offset);
+    const size_t r = padBits == 0 ? input->read(window + offset, chunk) : 0;
+    inputBytes += r;
+    if (out) {
+      memcpy(out + done, window + offset, r);
+    }
+    outPos += r;
+    done += r;
+    if (r < chunk) {
+      storedRemaining -= done;
+      return done + fail("unexpected end of stored block");
+    }
+  }
+
+  storedRemaining -= done;
+  if (storedRemaining == 0) {
+    state = STATE_HEADER;
+  }
+  return done;
+}
+
+size_t Inflater::decodeCodes(uint8_t* out, const size_t length) {
+  size_t produced = 0;
+  while (produced < length) {
+    if (copyLength > 0) {
+      const size_t n = min(static_cast<size_t>(copyLength), length - produced);
+      for (size_t i = 0; i < n; i++) {
+        const uint8_t b = window[(outPos - copyDistance) & WINDOW_MASK];
+        window[outPos & WINDOW_MASK] = b;
+        if (out) {
+          out[produced + i] = b;
+        }
+        outPos++;
+      }
+      produced += n;
+      copyLength -= n;
+      continue;
+    }
+
+    const int symbol = decode(lengthCode);
+    if (symbol < 0) {
+      return produced + fail("invalid literal/length code");
+    }
+    if (symbol < 256) {
+      window[outPos & WINDOW_MASK] = symbol;
+      if (out) {
+        out[produced] = symbol;
+      }
+      outPos++;
+      produced++;
+    } else if (symbol == 256) {
+      state = STATE_HEADER;
+      break;
+    } else {
+      const int lengthSymbol = symbol - 257;
+      if (lengthSymbol >= 29) {
+        return produced + fail("invalid length symbol");
+      }
+      const uint16_t matchLength = LENGTH_BASE[lengthSymbol] + bits(LENGTH_EXTRA[lengthSymbol]);
+      const int distanceSymbol = decode(distanceCode);
+      if (distanceSymbol < 0 || distanceSymbol >= 30) {
+        return produced + fail("invalid distance code");
+      }
+      const uint32_t distance = DISTANCE_BASE[distanceSymbol] + bits(DISTANCE_EXTRA[distanceSymbol]);
+      if (distance > outPos) {
+        return produced + fail("distance too far back");
+      }
+      copyLength = matchLength;
+      copyDistance = distance;
+    }
+
+    if (overrun()) {
+      return produced + fail("unexpected end of data");
+    }
+  }
+  return produced;
+}
+
+size_t Inflater::read(uint8_t* out, const size_t length) {
+  size_t produced = 0;
+  while (produced < length) {
+    uint8_t* dst = out ? out + produced : nullptr;
+    switch (state) {
+      case STATE_HEADER:
+        if (lastBlock) {
+          state = STATE_DONE;
+          return produced;
+        }
+        if (blockCallback) {
+          blockCallback(*this, blockContext);
+        }
+        if (!readHeader()) {
+          return produced;
+        }
+        break;
+      case STATE_STORED:
+        produced += copyStored(dst, length - produced);
+        break;
+      case STATE_CODES:
+        produced += decodeCodes(dst, length - produced);
+        break;
+      default:
+        return produced;
+    }
+  }
+  return produced;
+}
@@ -0,0 +1,602 @@
+#include "ZipReader.h"
+
+#include <BinaryIO.h>
+#include <BufferedWriter.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr const char* CACHE_DIR = "/.sdcache/zip";
+
+constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+constexpr uint32_t END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06054b50;
+constexpr size_t LOCAL_HEADER_SIZE = 30;
+constexpr size_t CENTRAL_HEADER_SIZE = 46;
+constexpr size_t END_OF_CENTRAL_DIRECTORY_SIZE = 22;
+constexpr uint16_t METHOD_STORED = 0;
+constexpr uint16_t METHOD_DEFLATED = 8;
+constexpr uint16_t FLAG_ENCRYPTED = 0x0001;
+
+// Index file: entry names, then the records sorted by name hash, then the footer
+constexpr uint8_t INDEX_MAGIC[4] = {'Z', 'I', 'X', '1'};
+constexpr size_t INDEX_FOOTER_SIZE = 32;
+// Record: name hash u32, name offset u32, name length u16, method u16, local header offset u32, compressed size u32,
+// uncompressed size u32, crc32 u32
+constexpr size_t RECORD_SIZE = 28;
+
+// Checkpoint file: per checkpoint the window, then one sector with the position. The trailer is written last, so a
+// torn checkpoint never validates.
+constexpr uint8_t CHECKPOINT_MAGIC[4] = {'Z', 'C', 'K', '1'};
+constexpr size_t CHECKPOINT_TRAILER_SIZE = 512;
+constexpr size_t CHECKPOINT_STRIDE = Inflater::WINDOW_SIZE + CHECKPOINT_TRAILER_SIZE;
+
+using BinaryIO::CRC_INIT;
+using BinaryIO::crc32;
+using BinaryIO::fnv1a;
+using BinaryIO::get16;
+using BinaryIO::get32;
+using BinaryIO::put16;
+using BinaryIO::put32;
+
+int compareRecords(const void* a, const void* b) {
+  const uint32_t hashA = get32(static_cast<const uint8_t*>(a));
+  const uint32_t hashB = get32(static_cast<const uint8_t*>(b));
+  return hashA < hashB ? -1 : (hashA > hashB ? 1 : 0);
+}
+}  // namespace
+
+ZipArchive::ZipArchive(SDCardManager& sd) : sd(sd), index(BlockCache::getInstance()) {}
+
+bool ZipArchive::open(const char* path) {
+  close();
+  if (!sd.openFileForRead("ZIP", path, file)) {
+    return false;
+  }
+
+  const uint64_t size = file.fileSize();
+  if (size > UINT32_MAX) {
+    if (Serial) Serial.printf("[%lu] [ZIP] %s is too large, ZIP64 is not supported\n", millis(), path);
+    file.close();
+    return false;
+  }
+  archiveSize = static_cast<uint32_t>(size);
+  file.getModifyDateTime(&archiveDate, &archiveTime);
+  key = fnv1a(path, strlen(path));
+  snprintf(indexPath, sizeof(indexPath), "%s/%08lx.idx", CACHE_DIR, static_cast<unsigned long>(key));
+
+  rebuilt = false;
+  if (!loadIndex()) {
+    if (!buildIndex() || !loadIndex()) {
+      close();
+      return false;
+    }
+    rebuilt = true;
+  }
+  return true;
+}
+
+void ZipArchive::close() {
+  index.close();
+  if (file) {
+    file.close();
+  }
+  entryCount = 0;
+  recordsOffset = 0;
+}
+
+bool ZipArchive::loadIndex() {
+  if (!sd.exists(indexPath) || !index.open(indexPath, sd)) {
+    return false;
+  }
+
+  uint8_t footer[INDEX_FOOTER_SIZE];
+  const uint64_t size = index.size();
+  if (size < INDEX_FOOTER_SIZE ||
+      index.pread(footer, INDEX_FOOTER_SIZE, size - INDEX_FOOTER_SIZE) != INDEX_FOOTER_SIZE ||
+      memcmp(footer, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || get32(footer + 12) != archiveSize ||
+      get16(footer + 16) != archiveDate || get16(footer + 18) != archiveTime || get32(footer + 20) != key) {
+    index.close();
+    return false;
+  }
+
+  entryCount = get32(footer + 4);
+  recordsOffset = get32(footer + 8);
+  if (static_cast<uint64_t>(recordsOffset) + static_cast<uint64_t>(entryCount) * RECORD_SIZE + INDEX_FOOTER_SIZE !=
+      size) {
+    index.close();
+    return false;
+  }
+  return true;
+}
+
+// Finds the end of central directory record, which sits behind an optional comment of up to 64 KB
+bool ZipArchive::findCentralDirectory(uint32_t& offset, uint32_t& size, uint16_t& count) {
+  if (archiveSize < END_OF_CENTRAL_DIRECTORY_SIZE) {
+    return false;
+  }
+
+  const uint32_t lowest = archiveSize - min(archiveSize, static_cast<uint32_t>(END_OF_CENTRAL_DIRECTORY_SIZE + 0xFFFF));
+  uint8_t buf[512 + 3];  // Chunks overlap by three bytes so a signature across a chunk border is found
+  uint32_t end = archiveSize - END_OF_CENTRAL_DIRECTORY_SIZE + 1;  // Past the last possible record start
+  while (end > lowest) {
+    const uint32_t start = end - min(end - lowest, static_cast<uint32_t>(512));
+    const size_t length = min(static_cast<size_t>(archiveSize - start), sizeof(buf));
+    if (!file.seekSet(start) || file.read(buf, length) != static_cast<int>(length)) {
+      return false;
+    }
+
+    for (int32_t i = static_cast<int32_t>(end - start) - 1; i >= 0; i--) {
+      if (get32(buf + i) != END_OF_CENTRAL_DIRECTORY_SIGNATURE) {
+        continue;
+      }
+      uint8_t record[END_OF_CENTRAL_DIRECTORY_SIZE];
+      if (!file.seekSet(start + i) || file.read(record, sizeof(record)) != static_cast<int>(sizeof(record))) {
+        return false;
+      }
+      count = get16(record + 10);
+      size = get32(record + 12);
+      offset = get32(record + 16);
+      if (count == 0xFFFF || offset == 0xFFFFFFFF) {
+        if (Serial) Serial.printf("[%lu] [ZIP] ZIP64 archives are not supported\n", millis());
+        return false;
+      }
+      return static_cast<uint64_t>(offset) + size <= start + i;
+    }
+    end = start;
+  }
+  return false;
+}
+
+bool ZipArchive::buildIndex() {
+  const unsigned long startMs = millis();
+  uint32_t centralOffset;
+  uint32_t centralSize;
+  uint16_t count;
+  if (!findCentralDirectory(centralOffset, centralSize, count)) {
+    if (Serial) Serial.printf("[%lu] [ZIP] No central directory found, not a ZIP archive?\n", millis());
+    return false;
+  }
+  if (!sd.ensureDirectoryExists(CACHE_DIR)) {
+    return false;
+  }
+
+  auto* records = static_cast<uint8_t*>(malloc(count > 0 ? count * RECORD_SIZE : 1));
+  if (!records) {
+    if (Serial) Serial.printf("[%lu] [ZIP] Not enough memory to index %u entries\n", millis(), count);
+    return false;
+  }
+
+  BufferedWriter writer;
+  BufferedReader reader;
+  if (!writer.open(indexPath, 0, sd) || !file.seekSet(centralOffset) || !reader.attach(file)) {
+    free(records);
+    return false;
+  }
+
+  uint32_t nameBytes = 0;
+  uint32_t kept = 0;
+  bool ok = true;
+  for (uint16_t i = 0; i < count && ok; i++) {
+    uint8_t header[CENTRAL_HEADER_SIZE];
+    if (reader.read(header, CENTRAL_HEADER_SIZE) != CENTRAL_HEADER_SIZE ||
+        get32(header) != CENTRAL_HEADER_SIGNATURE) {
+      if (Serial) Serial.printf("[%lu] [ZIP] Corrupt central directory at entry %u\n", millis(), i);
+      ok = false;
+      break;
+    }
+
+    const uint16_t flags = get16(header + 8);
+    const uint16_t method = get16(header + 10);
+    const uint32_t compressedSize = get32(header + 20);
+    const uint32_t uncompressedSize = get32(header + 24);
+    const uint16_t nameLength = get16(header + 28);
+    const size_t trailing = get16(header + 30) + get16(header + 32);  // Extra field and comment
+    const uint32_t localOffset = get32(header + 42);
+
+    char name[MAX_ENTRY_NAME_LENGTH];
+    if (nameLength == 0 || nameLength > MAX_ENTRY_NAME_LENGTH) {
+      reader.skip(nameLength + trailing);
+      continue;
+    }
+    if (reader.read(name, nameLength) != nameLength || reader.skip(trailing) != trailing) {
+      ok = false;
+      break;
+    }
+    if (name[nameLength - 1] == '/') {
+      continue;  // Directory
+    }
+    if ((flags & FLAG_ENCRYPTED) || compressedSize == 0xFFFFFFFF || uncompressedSize == 0xFFFFFFFF ||
+        localOffset == 0xFFFFFFFF) {
+      if (Serial) Serial.printf("[%lu] [ZIP] Skipping encrypted or ZIP64 entry %.*s\n", millis(), nameLength, name);
+      continue;
+    }
+
+    if (writer.write(reinterpret_cast<const uint8_t*>(name), nameLength) != nameLength) {
+      ok = false;
+      break;
+    }
+    uint8_t* record = records + kept * RECORD_SIZE;
+    put32(record, fnv1a(name, nameLength));
+    put32(record + 4, nameBytes);
+    put16(record + 8, nameLength);
+    put16(record + 10, method);
+    put32(record + 12, localOffset);
+    put32(record + 16, compressedSize);
+    put32(record + 20, uncompressedSize);
+    put32(record + 24, get32(header + 16));
+    nameBytes += nameLength;
+    kept++;
+  }
+  reader.close();
+
+  if (!ok) {
+    writer.abort();
+    free(records);
+    return false;
+  }
+
+  qsort(records, kept, RECORD_SIZE, compareRecords);
+  writer.write(records, kept * RECORD_SIZE);
+  free(records);
+
+  uint8_t footer[INDEX_FOOTER_SIZE] = {};
+  memcpy(footer, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  put32(footer + 4, kept);
+  put32(footer + 8, nameBytes);
+  put32(footer + 12, archiveSize);
+  put16(footer + 16, archiveDate);
+  put16(footer + 18, archiveTime);
+  put32(footer + 20, key);
+  writer.write(footer, INDEX_FOOTER_SIZE);
+  if (!writer.commit()) {
+    return false;
+  }
+  // Pages of the stale index read by the failed loadIndex() must not answer for the new one
+  BlockCache::getInstance().invalidatePath(indexPath);
+
+  if (Serial)
+    Serial.printf("[%lu] [ZIP] Indexed %lu entries in %lu ms\n", millis(), static_cast<unsigned long>(kept),
+                  millis() - startMs);
+  return true;
+}
+
+bool ZipArchive::readRecord(const uint32_t i, Entry& entry, uint32_t& hash, uint32_t& nameOffset,
+                            uint16_t& nameLength) {
+  uint8_t record[RECORD_SIZE];
+  if (i >= entryCount || index.pread(record, RECORD_SIZE, recordsOffset + i * RECORD_SIZE) != RECORD_SIZE) {
+    return false;
+  }
+  hash = get32(record);
+  nameOffset = get32(record + 4);
+  nameLength = get16(record + 8);
+  entry.method = get16(record + 10);
+  entry.localHeaderOffset = get32(record + 12);
+  entry.compressedSize = get32(record + 16);
+  entry.uncompressedSize = get32(record + 20);
+  entry.crc32 = get32(record + 24);
+  return true;
+}
+
+uint32_t ZipArchive::getIdentity() const {
+  uint8_t stamp[8];
+  put32(stamp, archiveSize);
+  put16(stamp + 4, archiveDate);
+  put16(stamp + 6, archiveTime);
+  return fnv1a(stamp, sizeof(stamp));
+}
+
+bool ZipArchive::find(const char* name, Entry& entry) {
+  if (!index.isOpen()) {
+    return false;
+  }
+
+  const size_t length = strlen(name);
+  const uint32_t target = fnv1a(name, length);
+
+  // First record whose hash is not below the target
+  uint32_t lo = 0;
+  uint32_t hi = entryCount;
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    uint8_t hash[4];
+    if (index.pread(hash, sizeof(hash), recordsOffset + mid * RECORD_SIZE) != sizeof(hash)) {
+      return false;
+    }
+    if (get32(hash) < target) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // Names with the same hash are adjacent, compare them in full
+  uint32_t hash;
+  uint32_t nameOffset;
+  uint16_t nameLength;
+  char stored[MAX_ENTRY_NAME_LENGTH];
+  for (uint32_t i = lo; readRecord(i, entry, hash, nameOffset, nameLength) && hash == target; i++) {
+    if (nameLength == length && index.pread(stored, nameLength, nameOffset) == nameLength &&
+        memcmp(stored, name, length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ZipArchive::entryAt(const uint32_t i, Entry& entry, char* name, const size_t nameSize) {
+  uint32_t hash;
+  uint32_t nameOffset;
+  uint16_t nameLength;
+  if (nameSize == 0 || !readRecord(i, entry, hash, nameOffset, nameLength)) {
+    return false;
+  }
+  const size_t n = min(static_cast<size_t>(nameLength), nameSize - 1);
+  if (index.pread(name, n, nameOffset) != n) {
+    return false;
+  }
+  name[n] = '\0';
+  return true;
+}
+
+ZipEntryReader::ZipEntryReader(const size_t inputSectors) : input(inputSectors) {}
+
+bool ZipEntryReader::open(ZipArchive& archive, const char* name) {
+  ZipArchive::Entry found;
+  if (!archive.find(name, found)) {
+    if (Serial) Serial.printf("[%lu] [ZIP] Entry not found: %s\n", millis(), name);
+    return false;
+  }
+  return open(archive, found);
+}
+
+bool ZipEntryReader::open(ZipArchive& archive, const ZipArchive::Entry& zipEntry) {
+  close();
+  if (!archive.isOpen()) {
+    return false;
+  }
+  if (zipEntry.method != METHOD_STORED && zipEntry.method != METHOD_DEFLATED) {
+    if (Serial) Serial.printf("[%lu] [ZIP] Unsupported compression method %u\n", millis(), zipEntry.method);
+    return false;
+  }
+
+  // A copy is a separate handle with its own position, so several entries can be open at once
+  file = archive.file;
+  uint8_t header[LOCAL_HEADER_SIZE];
+  if (!file.seekSet(zipEntry.localHeaderOffset) ||
+      file.read(header, LOCAL_HEADER_SIZE) != static_cast<int>(LOCAL_HEADER_SIZE) ||
+      get32(header) != LOCAL_HEADER_SIGNATURE) {
+    if (Serial)
+      Serial.printf("[%lu] [ZIP] Invalid local header at %lu\n", millis(),
+                    static_cast<unsigned long>(zipEntry.localHeaderOffset));
+    file.close();
+    return false;
+  }
+
+  // The local extra field can differ from the central one, so the data offset is only known here
+  dataOffset = zipEntry.localHeaderOffset + LOCAL_HEADER_SIZE + get16(header + 26) + get16(header + 28);
+  if (static_cast<uint64_t>(dataOffset) + zipEntry.compressedSize > archive.archiveSize) {
+    if (Serial) Serial.printf("[%lu] [ZIP] Entry data past the end of the archive\n", millis());
+    file.close();
+    return false;
+  }
+
+  entry = zipEntry;
+  sd = &archive.sd;
+  snprintf(checkpointPath, sizeof(checkpointPath), "%s/%08lx-%08lx.ckp", CACHE_DIR,
+           static_cast<unsigned long>(archive.key), static_cast<unsigned long>(entry.localHeaderOffset));
+  checkpointCount = 0;
+  checkpointsLoaded = false;
+
+  if (!file.seekSet(dataOffset) || !input.attach(file) || !restart()) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void ZipEntryReader::close() {
+  input.close();
+  if (file) {
+    file.close();
+  }
+  if (checkpointFile) {
+    checkpointFile.close();
+  }
+  entry = {};
+  pos = 0;
+  failed = false;
+  crcValid = false;
+}
+
+bool ZipEntryReader::restart() {
+  pos = 0;
+  crc = CRC_INIT;
+  crcValid = true;
+  if (!input.seek(dataOffset)) {
+    return false;
+  }
+  if (entry.method == METHOD_STORED) {
+    return true;
+  }
+  if (!inflater.begin(input)) {
+    return false;
+  }
+  inflater.setBlockCallback(checkpointInterval > 0 ? onBlock : nullptr, this);
+  return true;
+}
+
+size_t ZipEntryReader::read(void* out, size_t length) {
+  if (!file || failed || pos >= entry.uncompressedSize) {
+    return 0;
+  }
+
+  length = min(length, static_cast<size_t>(entry.uncompressedSize - pos));
+  size_t n;
+  if (entry.method == METHOD_STORED) {
+    n = input.read(out, length);
+  } else {
+    n = inflater.read(static_cast<uint8_t*>(out), length);
+    if (inflater.hasError()) {
+      failed = true;
+    }
+  }
+  if (n < length && !failed) {
+    if (Serial)
+      Serial.printf("[%lu] [ZIP] Entry data ended early at %lu\n", millis(), static_cast<unsigned long>(pos + n));
+    failed = true;
+  }
+
+  if (crcValid) {
+    crc = crc32(crc, out, n);
+  }
+  pos += n;
+  if (crcValid && pos == entry.uncompressedSize) {
+    crcValid = false;
+    if ((crc ^ CRC_INIT) != entry.crc32) {
+      if (Serial)
+        Serial.printf("[%lu] [ZIP] CRC mismatch in entry at %lu\n", millis(),
+                      static_cast<unsigned long>(entry.localHeaderOffset));
+      failed = true;
+    }
+  }
+  return n;
+}
+
+bool ZipEntryReader::seek(const uint32_t position) {
+  if (!file || position > entry.uncompressedSize) {
+    return false;
+  }
+  if (position == pos) {
+    return true;
+  }
+
+  if (entry.method == METHOD_STORED) {
+    if (!input.seek(dataOffset + position)) {
+      return false;
+    }
+    pos = position;
+    crcValid = false;
+    return true;
+  }
+
+  if (checkpointInterval > 0) {
+    loadCheckpoints();
+  }
+  // Latest checkpoint at or before the target
+  int32_t best = -1;
+  for (size_t i = 0; i < checkpointCount && checkpoints[i].output <= position; i++) {
+    best = static_cast<int32_t>(i);
+  }
+
+  if (position < pos || failed) {
+    failed = false;
+    if (best >= 0 ? !restore(best) : !restart()) {
+      failed = true;
+      return false;
+    }
+  } else if (best >= 0 && checkpoints[best].output > pos && !restore(best)) {
+    failed = true;
+    return false;
+  }
+
+  // Decode and discard up to the target
+  if (position > pos) {
+    crcValid = false;
+  }
+  while (pos < position) {
+    const size_t n = inflater.read(nullptr, position - pos);
+    if (n == 0) {
+      failed = true;
+      return false;
+    }
+    pos += n;
+  }
+  return true;
+}
+
+bool ZipEntryReader::restore(const size_t i) {
+  const Checkpoint& checkpoint = checkpoints[i];
+  if (!checkpointFile || !checkpointFile.seekSet(static_cast<uint64_t>(i) * CHECKPOINT_STRIDE) ||
+      !input.seek(dataOffset + checkpoint.inputBits / 8) ||
+      !inflater.resume(input, checkpoint.inputBits, checkpoint.output) ||
+      checkpointFile.read(inflater.getWindow(), Inflater::WINDOW_SIZE) != static_cast<int>(Inflater::WINDOW_SIZE)) {
+    if (Serial) Serial.printf("[%lu] [ZIP] Failed to restore checkpoint %u\n", millis(), static_cast<unsigned>(i));
+    return false;
+  }
+  pos = checkpoint.output;
+  crcValid = false;
+  return true;
+}
+
+void ZipEntryReader::loadCheckpoints() {
+  if (checkpointsLoaded) {
+    return;
+  }
+  checkpointsLoaded = true;
+  checkpointCount = 0;
+  if (!sd->exists(checkpointPath)) {
+    return;
+  }
+  checkpointFile = sd->open(checkpointPath, O_RDWR);
+  if (!checkpointFile) {
+    return;
+  }
+
+  const uint64_t available = checkpointFile.fileSize() / CHECKPOINT_STRIDE;
+  uint8_t trailer[20];
+  while (checkpointCount < MAX_CHECKPOINTS && checkpointCount < available) {
+    const uint64_t at = checkpointCount * CHECKPOINT_STRIDE + Inflater::WINDOW_SIZE;
+    if (!checkpointFile.seekSet(at) || checkpointFile.read(trailer, sizeof(trailer)) != sizeof(trailer) ||
+        memcmp(trailer, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 || get32(trailer + 4) != entry.crc32 ||
+        get32(trailer + 8) != entry.compressedSize) {
+      break;
+    }
+    const uint32_t output = get32(trailer + 12);
+    if (checkpointCount > 0 && output <= checkpoints[checkpointCount - 1].output) {
+      break;
+    }
+    checkpoints[checkpointCount++] = {output, get32(trailer + 16)};
+  }
+}
+
+void ZipEntryReader::onBlock(Inflater&, void* context) { static_cast<ZipEntryReader*>(context)->saveCheckpoint(); }
+
+void ZipEntryReader::saveCheckpoint() {
+  const uint32_t output = inflater.totalOut();
+  const uint32_t last = checkpointCount > 0 ? checkpoints[checkpointCount - 1].output : 0;
+  if (output < last + checkpointInterval) {
+    return;
+  }
+  loadCheckpoints();
+  if (checkpointCount >= MAX_CHECKPOINTS ||
+      (checkpointCount > 0 && output < checkpoints[checkpointCount - 1].output + checkpointInterval)) {
+    return;
+  }
+
+  if (!checkpointFile) {
+    if (!sd->ensureDirectoryExists(CACHE_DIR)) {
+      return;
+    }
+    checkpointFile = sd->open(checkpointPath, O_RDWR | O_CREAT);
+  }
+
+  // Checkpoints are only ever appended, anything behind the last valid one is stale
+  const uint64_t at = checkpointCount * CHECKPOINT_STRIDE;
+  uint8_t trailer[CHECKPOINT_TRAILER_SIZE] = {};
+  memcpy(trailer, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  put32(trailer + 4, entry.crc32);
+  put32(trailer + 8, entry.compressedSize);
+  put32(trailer + 12, output);
+  put32(trailer + 16, inflater.inputBitPosition());
+  if (!checkpointFile || (checkpointFile.fileSize() > at && !checkpointFile.truncate(at)) ||
+      !checkpointFile.seekSet(at) ||
+      checkpointFile.write(inflater.getWindow(), Inflater::WINDOW_SIZE) != Inflater::WINDOW_SIZE ||
+      checkpointFile.write(trailer, sizeof(trailer)) != sizeof(trailer) || !checkpointFile.sync()) {
+    if (Serial) Serial.printf("[%lu] [ZIP] Failed to write checkpoint, disabling checkpoints\n", millis());
+    inflater.setBlockCallback(nullptr, nullptr);
+    return;
+  }
+  checkpoints[checkpointCount++] = {output, inflater.inputBitPosition()};
+}
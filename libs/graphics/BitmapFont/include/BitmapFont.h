@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Packed 1bpp bitmap font, as written by tools/assets/fontconvert.py, and a blitter that draws its glyphs into a
+ * frame buffer laid out like EInkDisplay's (rows of width / 8 bytes, MSB first, 0 bits black).
+ *
+ * The font is read in place, so it can be a const array in flash or a file loaded into RAM. Layout, little-endian:
+ *
+ *   Header  16 bytes   "XBF1", glyph count u16, kerning pair count u16, line height u8, ascent u8, descent u8,
+ *                      flags u8, font id u32
+ *   Glyphs  12 bytes   codepoint u32, bitmap offset u24, advance u8, width u8, height u8, left i8, top i8;
+ *                      sorted by codepoint
+ *   Kerning 6 bytes    left glyph index u16, right glyph index u16, adjustment i8, padding; sorted by the pair
+ *   Bitmaps            Per glyph `height` rows of (width + 7) / 8 bytes, MSB first, 1 bits ink, unused bits 0
+ *
+ * Glyphs may be drawn at any x; rows are shifted into place a byte at a time and clipped at the buffer edges.
+ */
+class BitmapFont {
+ public:
+  static constexpr size_t HEADER_SIZE = 16;
+  static constexpr size_t GLYPH_SIZE = 12;
+  static constexpr size_t KERNING_SIZE = 6;
+
+  struct Glyph {
+    const uint8_t* bitmap;
+    uint16_t index;
+    uint8_t advance;
+    uint8_t width;
+    uint8_t height;
+    int8_t left;  // Origin to the first column
+    int8_t top;   // Baseline to the first row, up is positive
+  };
+
+  BitmapFont() = default;
+  explicit BitmapFont(const uint8_t* data, size_t size) { begin(data, size); }
+
+  // Checks the header and table sizes against `size`, the data has to stay valid while the font is used
+  bool begin(const uint8_t* data, size_t size);
+  bool isValid() const { return data != nullptr; }
+
+  // Missing glyphs fall back to U+FFFD or '?' when the font has them
+  bool getGlyph(uint32_t codepoint, Glyph& glyph) const;
+  // Whether the font has the glyph itself, without falling back
+  bool hasGlyph(uint32_t codepoint) const { return data && findGlyph(codepoint) != NO_GLYPH; }
+  int8_t getKerning(uint16_t leftIndex, uint16_t rightIndex) const;
+  uint8_t getAdvance(uint32_t codepoint) const;
+
+  uint8_t getLineHeight() const { return lineHeight; }
+  uint8_t getAscent() const { return ascent; }
+  uint8_t getDescent() const { return descent; }
+  uint32_t getId() const { return id; }
+  uint16_t getGlyphCount() const { return glyphCount; }
+
+  // Draws with the glyph origin on the baseline at (x, y). `black` false draws white, e.g. on a dark background.
+  static void drawGlyph(uint8_t* frameBuffer, uint16_t width, uint16_t height, int16_t x, int16_t y,
+                        const Glyph& glyph, bool black = true);
+  // Draws a UTF-8 string with kerning, returns the x after its last glyph
+  int16_t drawText(uint8_t* frameBuffer, uint16_t width, uint16_t height, int16_t x, int16_t y, const char* text,
+                   size_t length, bool black = true) const;
+  int16_t drawText(uint8_t* frameBuffer, uint16_t width, uint16_t height, int16_t x, int16_t y, const char* text,
+                   bool black = true) const {
+    return drawText(frameBuffer, width, height, x, y, text, strlen(text), black);
+  }
+  // Advance of a UTF-8 string with kerning, what drawText() would move x by
+  int16_t getTextWidth(const char* text, size_t length) const;
+  int16_t getTextWidth(const char* text) const { return getTextWidth(text, strlen(text)); }
+
+  // Decodes the UTF-8 character at `text`, `length` gets its size. Malformed bytes decode as themselves.
+  static uint32_t decodeUtf8(const char* text, size_t available, size_t& length);
+
+ private:
+  static constexpr uint16_t NO_GLYPH = 0xFFFF;
+
+  uint16_t findGlyph(uint32_t codepoint) const;
+  void readGlyph(uint16_t index, Glyph& glyph) const;
+
+  const uint8_t* data = nullptr;
+  const uint8_t* glyphs = nullptr;
+  const uint8_t* kerning = nullptr;
+  const uint8_t* bitmaps = nullptr;
+  uint16_t glyphCount = 0;
+  uint16_t kerningCount = 0;
+  uint8_t lineHeight = 0;
+  uint8_t ascent = 0;
+  uint8_t descent = 0;
+  uint32_t id = 0;
+  uint16_t fallback = NO_GLYPH;
+  // Glyph indexes of U+0020 to U+007E, skipping the binary search for ASCII text
+  uint16_t ascii[95];
+};
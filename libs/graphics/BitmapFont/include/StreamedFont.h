@@ -0,0 +1,119 @@
+#pragma once
+
+#include <BlockCache.h>
+
+#include "BitmapFont.h"
+
+/**
+ * Bitmap font read from the SD card on demand, for fonts too large for flash such as CJK faces with 20k+ glyphs.
+ * Written by tools/assets/fontconvert.py --streamed. Layout, little-endian:
+ *
+ *   Header     32 bytes    "XBS1", glyph count u32, line height u8, ascent u8, descent u8, flags u8, font id u32,
+ *                          largest bitmap u16, page count u16, directory offset u32, pages offset u32,
+ *                          bitmaps offset u32
+ *   Directory  4352 x u16  Page index of codepoints [hi * 256, hi * 256 + 255] for hi up to U+10FFFF, 0xFFFF for
+ *                          blocks without glyphs
+ *   Pages      256 x 8     Per codepoint: bitmap offset u24 (0xFFFFFF if missing), advance u8, width u8, height u8,
+ *                          left i8, top i8
+ *   Bitmaps                As in BitmapFont, row-packed and cropped to the ink
+ *
+ * A lookup reads the directory through the shared BlockCache and the glyph entry and bitmap straight from the file:
+ * the directory is small and hot, while consecutive CJK lookups rarely land on the same 4 KB of entries or bitmaps, so
+ * caching those pages costs more card time than it saves. Glyphs are kept in a fixed LRU cache, so a page of text
+ * reads each distinct glyph from the card once as long as the cache holds a page's worth; layout measuring a page and
+ * then drawing it hits the cache for the second pass.
+ */
+class StreamedFont {
+ public:
+  struct Stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+  };
+
+  explicit StreamedFont(BlockCache& cache = BlockCache::getInstance()) : file(cache) {}
+  ~StreamedFont() { end(); }
+
+  StreamedFont(const StreamedFont&) = delete;
+  StreamedFont& operator=(const StreamedFont&) = delete;
+
+  // Opens the font and allocates a cache of `cacheGlyphs` glyphs, each as large as the font's largest bitmap
+  bool begin(const char* path, size_t cacheGlyphs = 256, SDCardManager& sd = SdMan);
+  void end();
+  bool isOpen() const { return file.isOpen(); }
+
+  // Missing glyphs fall back to U+FFFD or '?'. The bitmap stays valid until `cacheGlyphs` other glyphs were looked
+  // up, in particular across drawing the glyph just looked up.
+  bool getGlyph(uint32_t codepoint, BitmapFont::Glyph& glyph);
+  // Whether the font has the glyph itself, without falling back
+  bool hasGlyph(uint32_t codepoint);
+  uint8_t getAdvance(uint32_t codepoint);
+
+  uint8_t getLineHeight() const { return lineHeight; }
+  uint8_t getAscent() const { return ascent; }
+  uint8_t getDescent() const { return descent; }
+  uint32_t getId() const { return id; }
+  uint32_t getGlyphCount() const { return glyphCount; }
+
+  // Same as BitmapFont's, without kerning
+  int16_t drawText(uint8_t* frameBuffer, uint16_t width, uint16_t height, int16_t x, int16_t y, const char* text,
+                   size_t length, bool black = true);
+  int16_t getTextWidth(const char* text, size_t length);
+
+  const Stats& getStats() const { return stats; }
+  // Hits per 1000 lookups since the last resetStats()
+  uint16_t getHitRatePermille() const;
+  void resetStats() { stats = {}; }
+
+ private:
+  static constexpr uint16_t NONE = 0xFFFF;
+  static constexpr uint32_t DIRECTORY_ENTRIES = 0x1100;
+
+  struct Slot {
+    uint32_t codepoint;
+    uint16_t previous;  // LRU list, most recent first
+    uint16_t next;
+    uint16_t chain;  // Next slot in the same hash bucket
+    bool present;    // False caches that the font has no glyph
+    uint8_t advance;
+    uint8_t width;
+    uint8_t height;
+    int8_t left;
+    int8_t top;
+  };
+
+  uint16_t lookup(uint32_t codepoint);
+  bool load(uint32_t codepoint, Slot& slot, uint8_t* bitmap);
+  uint16_t bucketOf(uint32_t codepoint) const { return (codepoint * 2654435761u) >> 16 & (bucketCount - 1); }
+  void unlink(uint16_t index);
+  void pushFront(uint16_t index);
+  void removeFromBucket(uint16_t index);
+
+  CachedFile file;
+  FsFile bitmapFile;
+  uint32_t glyphCount = 0;
+  uint8_t lineHeight = 0;
+  uint8_t ascent = 0;
+  uint8_t descent = 0;
+  uint32_t id = 0;
+  uint16_t maxBitmap = 0;
+  uint16_t pageCount = 0;
+  uint32_t directoryOffset = 0;
+  uint32_t pagesOffset = 0;
+  uint32_t bitmapsOffset = 0;
+
+  // Directory entry of the last lookup, runs of text mostly stay within one 256 codepoint block
+  int32_t lastBlock = -1;
+  uint16_t lastPage = NONE;
+
+  Slot* slots = nullptr;
+  uint8_t* bitmaps = nullptr;
+  uint16_t* buckets = nullptr;
+  uint16_t slotCount = 0;
+  uint16_t bucketCount = 0;
+  uint16_t used = 0;
+  uint16_t head = NONE;
+  uint16_t tail = NONE;
+  uint32_t fallback = 0;
+  Stats stats = {};
+};
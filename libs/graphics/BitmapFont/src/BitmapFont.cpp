@@ -0,0 +1,272 @@
+#include "BitmapFont.h"
+
+#include <cstring>
+
+namespace {
+constexpr uint8_t MAGIC[4] = {'X', 'B', 'F', '1'};
+constexpr uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+uint16_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+uint32_t get24(const uint8_t* p) { return p[0] | (p[1] << 8) | (static_cast<uint32_t>(p[2]) << 16); }
+uint32_t get32(const uint8_t* p) { return get24(p) | (static_cast<uint32_t>(p[3]) << 24); }
+}  // namespace
+
+uint32_t BitmapFont::decodeUtf8(const char* text, const size_t available, size_t& length) {
+  const uint8_t b = text[0];
+  size_t expected = 1;
+  uint32_t codepoint = b;
+  if (b >= 0xF0) {
+    expected = 4;
+    codepoint = b & 0x07;
+  } else if (b >= 0xE0) {
+    expected = 3;
+    codepoint = b & 0x0F;
+  } else if (b >= 0xC0) {
+    expected = 2;
+    codepoint = b & 0x1F;
+  }
+  if (expected > available) {
+    length = 1;
+    return b;
+  }
+  for (size_t i = 1; i < expected; i++) {
+    const uint8_t c = text[i];
+    if ((c & 0xC0) != 0x80) {
+      length = 1;
+      return b;
+    }
+    codepoint = (codepoint << 6) | (c & 0x3F);
+  }
+  length = expected;
+  return codepoint;
+}
+
+bool BitmapFont::begin(const uint8_t* fontData, const size_t size) {
+  data = nullptr;
+  if (!fontData || size < HEADER_SIZE || memcmp(fontData, MAGIC, sizeof(MAGIC)) != 0) {
+    if (Serial) Serial.printf("[%lu] [FNT] Not a bitmap font\n", millis());
+    return false;
+  }
+  glyphCount = get16(fontData + 4);
+  kerningCount = get16(fontData + 6);
+  lineHeight = fontData[8];
+  ascent = fontData[9];
+  descent = fontData[10];
+  id = get32(fontData + 12);
+
+  const size_t tables = HEADER_SIZE + glyphCount * GLYPH_SIZE + kerningCount * KERNING_SIZE;
+  if (glyphCount == 0 || tables > size) {
+    if (Serial) Serial.printf("[%lu] [FNT] Truncated font tables\n", millis());
+    return false;
+  }
+  glyphs = fontData + HEADER_SIZE;
+  kerning = glyphs + glyphCount * GLYPH_SIZE;
+  bitmaps = fontData + tables;
+
+  // Every bitmap has to lie within the data, so drawing never needs to check
+  const size_t bitmapSize = size - tables;
+  for (uint16_t i = 0; i < glyphCount; i++) {
+    const uint8_t* record = glyphs + i * GLYPH_SIZE;
+    const size_t end = get24(record + 4) + ((record[8] + 7) / 8) * record[9];
+    if (end > bitmapSize) {
+      if (Serial) Serial.printf("[%lu] [FNT] Glyph %u outside the font data\n", millis(), i);
+      return false;
+    }
+  }
+  data = fontData;
+
+  for (uint16_t c = 0; c < 95; c++) {
+    ascii[c] = NO_GLYPH;
+  }
+  for (uint16_t i = 0; i < glyphCount; i++) {
+    const uint32_t codepoint = get32(glyphs + i * GLYPH_SIZE);
+    if (codepoint >= 0x20 && codepoint <= 0x7E) {
+      ascii[codepoint - 0x20] = i;
+    }
+  }
+  fallback = findGlyph(REPLACEMENT_CHARACTER);
+  if (fallback == NO_GLYPH) {
+    fallback = findGlyph('?');
+  }
+  return true;
+}
+
+uint16_t BitmapFont::findGlyph(const uint32_t codepoint) const {
+  if (codepoint >= 0x20 && codepoint <= 0x7E) {
+    return ascii[codepoint - 0x20];
+  }
+  uint16_t low = 0;
+  uint16_t high = glyphCount;
+  while (low < high) {
+    const uint16_t mid = low + (high - low) / 2;
+    const uint32_t value = get32(glyphs + mid * GLYPH_SIZE);
+    if (value == codepoint) {
+      return mid;
+    }
+    if (value < codepoint) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return NO_GLYPH;
+}
+
+void BitmapFont::readGlyph(const uint16_t index, Glyph& glyph) const {
+  const uint8_t* record = glyphs + index * GLYPH_SIZE;
+  glyph.bitmap = bitmaps + get24(record + 4);
+  glyph.index = index;
+  glyph.advance = record[7];
+  glyph.width = record[8];
+  glyph.height = record[9];
+  glyph.left = static_cast<int8_t>(record[10]);
+  glyph.top = static_cast<int8_t>(record[11]);
+}
+
+bool BitmapFont::getGlyph(const uint32_t codepoint, Glyph& glyph) const {
+  if (!data) {
+    return false;
+  }
+  uint16_t index = findGlyph(codepoint);
+  if (index == NO_GLYPH) {
+    index = fallback;
+    if (index == NO_GLYPH) {
+      return false;
+    }
+  }
+  readGlyph(index, glyph);
+  return true;
+}
+
+int8_t BitmapFont::getKerning(const uint16_t leftIndex, const uint16_t rightIndex) const {
+  const uint32_t key = (static_cast<uint32_t>(leftIndex) << 16) | rightIndex;
+  uint16_t low = 0;
+  uint16_t high = kerningCount;
+  while (low < high) {
+    const uint16_t mid = low + (high - low) / 2;
+    const uint8_t* pair = kerning + mid * KERNING_SIZE;
+    const uint32_t value = (static_cast<uint32_t>(get16(pair)) << 16) | get16(pair + 2);
+    if (value == key) {
+      return static_cast<int8_t>(pair[4]);
+    }
+    if (value < key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return 0;
+}
+
+uint8_t BitmapFont::getAdvance(const uint32_t codepoint) const {
+  Glyph glyph;
+  return getGlyph(codepoint, glyph) ? glyph.advance : 0;
+}
+
+void BitmapFont::drawGlyph(uint8_t* frameBuffer, const uint16_t width, const uint16_t height, const int16_t x,
+                           const int16_t y, const Glyph& glyph, const bool black) {
+  const int16_t left = x + glyph.left;
+  const int16_t top = y - glyph.top;
+  const uint8_t rowBytes = (glyph.width + 7) / 8;
+  const uint16_t stride = width / 8;
+
+  // Rows inside the buffer
+  const int16_t firstRow = top < 0 ? -top : 0;
+  const int16_t lastRow = top + glyph.height > height ? height - top : glyph.height;
+  if (firstRow >= lastRow || glyph.width == 0 || left >= static_cast<int16_t>(width) || left + glyph.width <= 0) {
+    return;
+  }
+  const uint8_t* source = glyph.bitmap + firstRow * rowBytes;
+  uint8_t* row = frameBuffer + static_cast<uint32_t>(top + firstRow) * stride;
+
+  if (left >= 0 && left + glyph.width <= width) {
+    // Unclipped: each source byte lands on two frame buffer bytes. Unused source bits are 0, so the spill into the
+    // byte after the glyph's last column only happens when ink reaches it, and that byte is then inside the row.
+    const uint8_t shift = left & 7;
+    row += left >> 3;
+    for (int16_t r = firstRow; r < lastRow; r++) {
+      uint8_t carry = 0;
+      for (uint8_t b = 0; b < rowBytes; b++) {
+        const uint8_t bits = source[b];
+        const uint8_t ink = carry | (bits >> shift);
+        carry = shift ? static_cast<uint8_t>(bits << (8 - shift)) : 0;
+        if (black) {
+          row[b] &= ~ink;
+        } else {
+          row[b] |= ink;
+        }
+      }
+      if (carry) {
+        if (black) {
+          row[rowBytes] &= ~carry;
+        } else {
+          row[rowBytes] |= carry;
+        }
+      }
+      source += rowBytes;
+      row += stride;
+    }
+    return;
+  }
+
+  // Clipped at the left or right edge: pixel by pixel over the visible columns
+  const int16_t firstColumn = left < 0 ? -left : 0;
+  const int16_t lastColumn = left + glyph.width > width ? width - left : glyph.width;
+  for (int16_t r = firstRow; r < lastRow; r++) {
+    for (int16_t c = firstColumn; c < lastColumn; c++) {
+      if (source[c >> 3] & (0x80 >> (c & 7))) {
+        const int16_t px = left + c;
+        if (black) {
+          row[px >> 3] &= ~(0x80 >> (px & 7));
+        } else {
+          row[px >> 3] |= 0x80 >> (px & 7);
+        }
+      }
+    }
+    source += rowBytes;
+    row += stride;
+  }
+}
+
+int16_t BitmapFont::drawText(uint8_t* frameBuffer, const uint16_t width, const uint16_t height, int16_t x,
+                             const int16_t y, const char* text, const size_t length, const bool black) const {
+  uint16_t previous = NO_GLYPH;
+  size_t i = 0;
+  while (i < length) {
+    size_t size;
+    const uint32_t codepoint = decodeUtf8(text + i, length - i, size);
+    i += size;
+    Glyph glyph;
+    if (!getGlyph(codepoint, glyph)) {
+      continue;
+    }
+    if (previous != NO_GLYPH && kerningCount > 0) {
+      x += getKerning(previous, glyph.index);
+    }
+    drawGlyph(frameBuffer, width, height, x, y, glyph, black);
+    x += glyph.advance;
+    previous = glyph.index;
+  }
+  return x;
+}
+
+int16_t BitmapFont::getTextWidth(const char* text, const size_t length) const {
+  int16_t x = 0;
+  uint16_t previous = NO_GLYPH;
+  size_t i = 0;
+  while (i < length) {
+    size_t size;
+    const uint32_t codepoint = decodeUtf8(text + i, length - i, size);
+    i += size;
+    Glyph glyph;
+    if (!getGlyph(codepoint, glyph)) {
+      continue;
+    }
+    if (previous != NO_GLYPH && kerningCount > 0) {
+      x += getKerning(previous, glyph.index);
+    }
+    x += glyph.advance;
+    previous = glyph.index;
+  }
+  return x;
+}
@@ -0,0 +1,287 @@
+#include "StreamedFont.h"
+
+#include <cstring>
+
+namespace {
+constexpr uint8_t MAGIC[4] = {'X', 'B', 'S', '1'};
+constexpr size_t HEADER_SIZE = 32;
+constexpr size_t ENTRY_SIZE = 8;
+constexpr uint32_t MISSING = 0xFFFFFF;
+
+uint16_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+uint32_t get24(const uint8_t* p) { return p[0] | (p[1] << 8) | (static_cast<uint32_t>(p[2]) << 16); }
+uint32_t get32(const uint8_t* p) { return get24(p) | (static_cast<uint32_t>(p[3]) << 24); }
+}  // namespace
+
+bool StreamedFont::begin(const char* path, size_t cacheGlyphs, SDCardManager& sd) {
+  end();
+  if (!file.open(path, sd)) {
+    if (Serial) Serial.printf("[%lu] [SFN] Failed to open %s\n", millis(), path);
+    return false;
+  }
+  uint8_t header[HEADER_SIZE];
+  if (file.pread(header, HEADER_SIZE, 0) != HEADER_SIZE || memcmp(header, MAGIC, sizeof(MAGIC)) != 0) {
+    if (Serial) Serial.printf("[%lu] [SFN] Not a streamed font: %s\n", millis(), path);
+    file.close();
+    return false;
+  }
+  glyphCount = get32(header + 4);
+  lineHeight = header[8];
+  ascent = header[9];
+  descent = header[10];
+  id = get32(header + 12);
+  maxBitmap = get16(header + 16);
+  pageCount = get16(header + 18);
+  directoryOffset = get32(header + 20);
+  pagesOffset = get32(header + 24);
+  bitmapsOffset = get32(header + 28);
+  if (maxBitmap == 0 || directoryOffset < HEADER_SIZE || directoryOffset + DIRECTORY_ENTRIES * 2 > pagesOffset ||
+      pagesOffset + static_cast<uint64_t>(pageCount) * 256 * ENTRY_SIZE > bitmapsOffset ||
+      bitmapsOffset > file.size()) {
+    if (Serial) Serial.printf("[%lu] [SFN] Corrupt font tables in %s\n", millis(), path);
+    file.close();
+    return false;
+  }
+  bitmapFile = sd.open(path);
+  if (!bitmapFile) {
+    if (Serial) Serial.printf("[%lu] [SFN] Failed to open %s\n", millis(), path);
+    file.close();
+    return false;
+  }
+
+  if (cacheGlyphs < 8) {
+    cacheGlyphs = 8;
+  } else if (cacheGlyphs > 4096) {
+    cacheGlyphs = 4096;
+  }
+  slotCount = cacheGlyphs;
+  bucketCount = 16;
+  while (bucketCount < slotCount) {
+    bucketCount <<= 1;
+  }
+  slots = static_cast<Slot*>(malloc(slotCount * sizeof(Slot)));
+  bitmaps = static_cast<uint8_t*>(malloc(static_cast<size_t>(slotCount) * maxBitmap));
+  buckets = static_cast<uint16_t*>(malloc(bucketCount * sizeof(uint16_t)));
+  if (!slots || !bitmaps || !buckets) {
+    if (Serial) Serial.printf("[%lu] [SFN] Failed to allocate a cache of %u glyphs\n", millis(), slotCount);
+    end();
+    return false;
+  }
+  for (uint16_t i = 0; i < bucketCount; i++) {
+    buckets[i] = NONE;
+  }
+  used = 0;
+  head = tail = NONE;
+  lastBlock = -1;
+  stats = {};
+
+  fallback = 0;
+  if (hasGlyph(0xFFFD)) {
+    fallback = 0xFFFD;
+  } else if (hasGlyph('?')) {
+    fallback = '?';
+  }
+  stats = {};
+  return true;
+}
+
+void StreamedFont::end() {
+  file.close();
+  if (bitmapFile) {
+    bitmapFile.close();
+  }
+  free(slots);
+  free(bitmaps);
+  free(buckets);
+  slots = nullptr;
+  bitmaps = nullptr;
+  buckets = nullptr;
+  slotCount = 0;
+  used = 0;
+  head = tail = NONE;
+}
+
+bool StreamedFont::load(const uint32_t codepoint, Slot& slot, uint8_t* bitmap) {
+  slot.present = false;
+  const uint32_t block = codepoint >> 8;
+  if (block >= DIRECTORY_ENTRIES) {
+    return true;
+  }
+  if (static_cast<int32_t>(block) != lastBlock) {
+    uint8_t entry[2];
+    if (file.pread(entry, sizeof(entry), directoryOffset + block * 2) != sizeof(entry)) {
+      return false;
+    }
+    lastBlock = block;
+    lastPage = get16(entry);
+  }
+  if (lastPage == NONE || lastPage >= pageCount) {
+    return true;
+  }
+
+  uint8_t entry[ENTRY_SIZE];
+  const uint64_t at = pagesOffset + (static_cast<uint64_t>(lastPage) * 256 + (codepoint & 0xFF)) * ENTRY_SIZE;
+  if (!bitmapFile.seekSet(at) || bitmapFile.read(entry, ENTRY_SIZE) != static_cast<int>(ENTRY_SIZE)) {
+    return false;
+  }
+  const uint32_t offset = get24(entry);
+  if (offset == MISSING) {
+    return true;
+  }
+  slot.advance = entry[3];
+  slot.width = entry[4];
+  slot.height = entry[5];
+  slot.left = static_cast<int8_t>(entry[6]);
+  slot.top = static_cast<int8_t>(entry[7]);
+  const size_t size = ((slot.width + 7) / 8) * slot.height;
+  if (size > maxBitmap) {
+    if (Serial) Serial.printf("[%lu] [SFN] Glyph U+%04lX larger than the font allows\n", millis(),
+                              static_cast<unsigned long>(codepoint));
+    return false;
+  }
+  if (size > 0 && (!bitmapFile.seekSet(static_cast<uint64_t>(bitmapsOffset) + offset) ||
+                   bitmapFile.read(bitmap, size) != static_cast<int>(size))) {
+    return false;
+  }
+  slot.present = true;
+  return true;
+}
+
+uint16_t StreamedFont::lookup(const uint32_t codepoint) {
+  for (uint16_t i = buckets[bucketOf(codepoint)]; i != NONE; i = slots[i].chain) {
+    if (slots[i].codepoint == codepoint) {
+      stats.hits++;
+      if (i != head) {
+        unlink(i);
+        pushFront(i);
+      }
+      return i;
+    }
+  }
+
+  stats.misses++;
+  uint16_t index;
+  if (used < slotCount) {
+    index = used++;
+  } else {
+    index = tail;
+    unlink(index);
+    removeFromBucket(index);
+    stats.evictions++;
+  }
+  Slot& slot = slots[index];
+  slot.codepoint = codepoint;
+  if (!load(codepoint, slot, bitmaps + static_cast<size_t>(index) * maxBitmap)) {
+    // Not cached, the next lookup tries the card again
+    if (Serial) Serial.printf("[%lu] [SFN] Failed to read glyph U+%04lX\n", millis(),
+                              static_cast<unsigned long>(codepoint));
+    slot.codepoint = UINT32_MAX;
+  }
+  uint16_t& chain = buckets[bucketOf(slot.codepoint)];
+  slot.chain = chain;
+  chain = index;
+  pushFront(index);
+  return index;
+}
+
+void StreamedFont::unlink(const uint16_t index) {
+  Slot& slot = slots[index];
+  if (slot.previous != NONE) {
+    slots[slot.previous].next = slot.next;
+  } else {
+    head = slot.next;
+  }
+  if (slot.next != NONE) {
+    slots[slot.next].previous = slot.previous;
+  } else {
+    tail = slot.previous;
+  }
+}
+
+void StreamedFont::pushFront(const uint16_t index) {
+  Slot& slot = slots[index];
+  slot.previous = NONE;
+  slot.next = head;
+  if (head != NONE) {
+    slots[head].previous = index;
+  }
+  head = index;
+  if (tail == NONE) {
+    tail = index;
+  }
+}
+
+void StreamedFont::removeFromBucket(const uint16_t index) {
+  uint16_t* link = &buckets[bucketOf(slots[index].codepoint)];
+  while (*link != NONE) {
+    if (*link == index) {
+      *link = slots[index].chain;
+      return;
+    }
+    link = &slots[*link].chain;
+  }
+}
+
+bool StreamedFont::hasGlyph(const uint32_t codepoint) {
+  return slots && slots[lookup(codepoint)].present;
+}
+
+bool StreamedFont::getGlyph(const uint32_t codepoint, BitmapFont::Glyph& glyph) {
+  if (!slots) {
+    return false;
+  }
+  uint16_t index = lookup(codepoint);
+  if (!slots[index].present) {
+    if (fallback == 0 || codepoint == fallback) {
+      return false;
+    }
+    index = lookup(fallback);
+  }
+  const Slot& slot = slots[index];
+  glyph.bitmap = bitmaps + static_cast<size_t>(index) * maxBitmap;
+  glyph.index = index;
+  glyph.advance = slot.advance;
+  glyph.width = slot.width;
+  glyph.height = slot.height;
+  glyph.left = slot.left;
+  glyph.top = slot.top;
+  return true;
+}
+
+uint8_t StreamedFont::getAdvance(const uint32_t codepoint) {
+  BitmapFont::Glyph glyph;
+  return getGlyph(codepoint, glyph) ? glyph.advance : 0;
+}
+
+int16_t StreamedFont::drawText(uint8_t* frameBuffer, const uint16_t width, const uint16_t height, int16_t x,
+                               const int16_t y, const char* text, const size_t length, const bool black) {
+  size_t i = 0;
+  while (i < length) {
+    size_t size;
+    const uint32_t codepoint = BitmapFont::decodeUtf8(text + i, length - i, size);
+    i += size;
+    BitmapFont::Glyph glyph;
+    if (getGlyph(codepoint, glyph)) {
+      BitmapFont::drawGlyph(frameBuffer, width, height, x, y, glyph, black);
+      x += glyph.advance;
+    }
+  }
+  return x;
+}
+
+int16_t StreamedFont::getTextWidth(const char* text, const size_t length) {
+  int16_t x = 0;
+  size_t i = 0;
+  while (i < length) {
+    size_t size;
+    const uint32_t codepoint = BitmapFont::decodeUtf8(text + i, length - i, size);
+    i += size;
+    x += getAdvance(codepoint);
+  }
+  return x;
+}
+
+uint16_t StreamedFont::getHitRatePermille() const {
+  const uint32_t lookups = stats.hits + stats.misses;
+  return lookups ? static_cast<uint16_t>(static_cast<uint64_t>(stats.hits) * 1000 / lookups) : 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <EInkDisplay.h>
+#include <ImageDecoder.h>
+#include <SDCardManager.h>
+
+/**
+ * Thumbnails of cover images, decoded and scaled once and kept on the SD card in the panel's own plane format.
+ *
+ * A thumbnail is the image fitted into a box by ImageDecoder (area averaged and dithered), stored as packed planes
+ * whose width is rounded up to a multiple of 8 so they go straight through EInkDisplay::drawImage(): the BW plane, plus
+ * the LSB and MSB planes for DEPTH_GRAY. Drawing a cached thumbnail reads one plane and copies it, nothing is decoded.
+ *
+ * Entries are named by the image path, box and options, and carry the image's size and modification time; a thumbnail
+ * whose image changed is rebuilt on the next get(), so the cache never needs to be cleared by hand.
+ */
+class CoverCache {
+ public:
+  static constexpr const char* DEFAULT_DIRECTORY = "/.sdcache/covers";
+  static constexpr size_t MAX_THUMBNAIL_PATH = 64;
+
+  enum Depth : uint8_t {
+    DEPTH_BW = 1,    // BW plane only
+    DEPTH_GRAY = 2,  // BW plane plus LSB and MSB planes for four levels
+  };
+
+  struct Thumbnail {
+    char path[MAX_THUMBNAIL_PATH];  // Cache file
+    uint16_t width;                 // Multiple of 8, the image is centred in it on white
+    uint16_t height;
+    Depth depth;
+  };
+
+  // `directory` is kept as a pointer and must outlive the cache
+  explicit CoverCache(SDCardManager& sd = SdMan, const char* directory = DEFAULT_DIRECTORY);
+
+  CoverCache(const CoverCache&) = delete;
+  CoverCache& operator=(const CoverCache&) = delete;
+
+  // Part of every entry's key, changing them makes get() build new thumbnails
+  void setDither(GrayScaler::Dither dither) { this->dither = dither; }
+  void setUpscale(bool upscale) { this->upscale = upscale; }
+
+  /**
+   * Finds the thumbnail of `imagePath` fitted into `boxWidth` x `boxHeight`, decoding the image and storing the
+   * thumbnail first if there is none or the image changed since.
+   *
+   * @return false if the image cannot be decoded or the thumbnail cannot be written
+   */
+  bool get(const char* imagePath, uint16_t boxWidth, uint16_t boxHeight, Depth depth, Thumbnail& thumbnail);
+
+  // Copies the BW plane into the frame buffer at `x`, `y` with drawImage(). `x` must be a multiple of 8.
+  bool draw(EInkDisplay& display, const Thumbnail& thumbnail, uint16_t x, uint16_t y);
+  // get() at DEPTH_BW and draw() centred in the box, as close to the centre as byte alignment allows
+  bool draw(EInkDisplay& display, const char* imagePath, uint16_t x, uint16_t y, uint16_t boxWidth,
+            uint16_t boxHeight);
+
+  // Reads a DEPTH_GRAY thumbnail's gray planes, (width / 8) x height each, laid out for displayGrayWindow()
+  bool readGrayPlanes(const Thumbnail& thumbnail, uint8_t* lsb, uint8_t* msb);
+
+  // Removes every thumbnail
+  bool clear();
+  // Frees the decoder's memory kept between images
+  void end() { decoder.end(); }
+
+  uint32_t getHits() const { return hits; }
+  uint32_t getMisses() const { return misses; }
+
+ private:
+  bool build(FsFile& image, uint16_t boxWidth, uint16_t boxHeight, uint8_t* header, Thumbnail& thumbnail);
+  // Reads `count` consecutive planes starting at plane `first` (0 BW, 1 LSB, 2 MSB)
+  bool readPlanes(const Thumbnail& thumbnail, uint8_t first, uint8_t* const* planes, uint8_t count);
+
+  SDCardManager& sd;
+  const char* directory;
+  ImageDecoder decoder;
+  GrayScaler::Dither dither = GrayScaler::DITHER_DIFFUSION;
+  bool upscale = true;
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+};
@@ -0,0 +1,217 @@
+#include "CoverCache.h"
+
+#include <BinaryIO.h>
+#include <BufferedWriter.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+// Thumbnail file: the header, then the BW plane and for DEPTH_GRAY the LSB and MSB planes
+constexpr uint8_t MAGIC[4] = {'C', 'V', 'R', '1'};
+constexpr size_t HEADER_SIZE = 32;
+// Header: magic, image size u32, image date u16, image time u16, path hash u32, box width u16, box height u16, depth
+// u8, dither u8, upscale u8, reserved u8, then the thumbnail's width u16 and height u16. Everything up to the
+// thumbnail's size has to match for a hit.
+constexpr size_t KEY_END = 24;
+
+using BinaryIO::fnv1a;
+using BinaryIO::get16;
+using BinaryIO::put16;
+using BinaryIO::put32;
+
+size_t planeSize(const uint16_t width, const uint16_t height) { return static_cast<size_t>(width / 8) * height; }
+uint8_t planeCount(const CoverCache::Depth depth) { return depth == CoverCache::DEPTH_GRAY ? 3 : 1; }
+}  // namespace
+
+CoverCache::CoverCache(SDCardManager& sd, const char* directory) : sd(sd), directory(directory) {}
+
+bool CoverCache::get(const char* imagePath, const uint16_t boxWidth, const uint16_t boxHeight, const Depth depth,
+                     Thumbnail& thumbnail) {
+  if (boxWidth == 0 || boxHeight == 0 || (depth != DEPTH_BW && depth != DEPTH_GRAY)) {
+    if (Serial) Serial.printf("[%lu] [CVR] Invalid thumbnail box %ux%u\n", millis(), boxWidth, boxHeight);
+    return false;
+  }
+  FsFile image;
+  if (!sd.openFileForRead("CVR", imagePath, image)) {
+    return false;
+  }
+  uint16_t date = 0;
+  uint16_t time = 0;
+  image.getModifyDateTime(&date, &time);
+
+  uint8_t header[HEADER_SIZE] = {};
+  memcpy(header, MAGIC, sizeof(MAGIC));
+  put32(header + 4, static_cast<uint32_t>(image.fileSize()));
+  put16(header + 8, date);
+  put16(header + 10, time);
+  const uint32_t pathHash = fnv1a(imagePath, strlen(imagePath));
+  put32(header + 12, pathHash);
+  put16(header + 16, boxWidth);
+  put16(header + 18, boxHeight);
+  header[20] = depth;
+  header[21] = dither;
+  header[22] = upscale ? 1 : 0;
+
+  // One file per image, box and options; the image's size and time are checked, not named, so a changed image
+  // replaces its old thumbnail instead of leaving it behind
+  const uint32_t key = fnv1a(header + 16, KEY_END - 16, pathHash);
+  const int length = snprintf(thumbnail.path, sizeof(thumbnail.path), "%s/%08lx.thm", directory,
+                              static_cast<unsigned long>(key));
+  if (length < 0 || static_cast<size_t>(length) >= sizeof(thumbnail.path)) {
+    if (Serial) Serial.printf("[%lu] [CVR] Cache directory name too long: %s\n", millis(), directory);
+    image.close();
+    return false;
+  }
+  thumbnail.depth = depth;
+
+  if (sd.exists(thumbnail.path)) {
+    FsFile cached = sd.open(thumbnail.path);
+    uint8_t stored[HEADER_SIZE];
+    if (cached && cached.read(stored, HEADER_SIZE) == static_cast<int>(HEADER_SIZE) &&
+        memcmp(stored, header, KEY_END) == 0) {
+      const uint16_t width = get16(stored + 24);
+      const uint16_t height = get16(stored + 26);
+      if (width > 0 && width % 8 == 0 && height > 0 &&
+          cached.fileSize() == HEADER_SIZE + planeSize(width, height) * planeCount(depth)) {
+        cached.close();
+        image.close();
+        thumbnail.width = width;
+        thumbnail.height = height;
+        hits++;
+        return true;
+      }
+    }
+    if (cached) {
+      cached.close();
+    }
+  }
+
+  misses++;
+  const bool ok = build(image, boxWidth, boxHeight, header, thumbnail);
+  image.close();
+  return ok;
+}
+
+bool CoverCache::build(FsFile& image, const uint16_t boxWidth, const uint16_t boxHeight, uint8_t* header,
+                       Thumbnail& thumbnail) {
+  const unsigned long startMs = millis();
+  ImageDecoder::Info info;
+  if (!decoder.readInfo(image, info)) {
+    return false;
+  }
+  uint16_t fittedWidth;
+  uint16_t fittedHeight;
+  GrayScaler::fit(info.width, info.height, boxWidth, boxHeight, upscale, fittedWidth, fittedHeight);
+  const uint16_t width = (fittedWidth + 7) & ~7;
+  const size_t bytes = planeSize(width, fittedHeight);
+  const uint8_t planes = planeCount(thumbnail.depth);
+
+  auto* data = static_cast<uint8_t*>(malloc(bytes * planes));
+  if (!data) {
+    if (Serial) Serial.printf("[%lu] [CVR] Not enough memory for a %ux%u thumbnail\n", millis(), width, fittedHeight);
+    return false;
+  }
+  memset(data, 0xFF, bytes);
+  memset(data + bytes, 0, bytes * (planes - 1));
+
+  ImageDecoder::Target target;
+  target.bw = data;
+  if (planes == 3) {
+    target.lsb = data + bytes;
+    target.msb = data + 2 * bytes;
+  }
+  target.stride = width / 8;
+  target.planeHeight = fittedHeight;
+  target.x = (width - fittedWidth) / 2;
+  target.width = fittedWidth;
+  target.height = fittedHeight;
+  target.dither = dither;
+  target.upscale = upscale;
+  // A partly decoded image is not cached, the next visit tries again
+  if (!decoder.decode(image, target) || !sd.ensureDirectoryExists(directory)) {
+    free(data);
+    return false;
+  }
+
+  put16(header + 24, width);
+  put16(header + 26, fittedHeight);
+  BufferedWriter writer;
+  bool ok = writer.open(thumbnail.path, HEADER_SIZE + bytes * planes, sd);
+  if (ok) {
+    writer.write(header, HEADER_SIZE);
+    writer.write(data, bytes * planes);
+    ok = writer.commit();
+  }
+  free(data);
+  if (!ok) {
+    if (Serial) Serial.printf("[%lu] [CVR] Failed to write %s\n", millis(), thumbnail.path);
+    return false;
+  }
+
+  thumbnail.width = width;
+  thumbnail.height = fittedHeight;
+  if (Serial)
+    Serial.printf("[%lu] [CVR] Built %ux%u thumbnail of a %ux%u image in %lu ms\n", millis(), width, fittedHeight,
+                  info.width, info.height, millis() - startMs);
+  return true;
+}
+
+bool CoverCache::readPlanes(const Thumbnail& thumbnail, const uint8_t first, uint8_t* const* planes,
+                            const uint8_t count) {
+  FsFile file;
+  if (!sd.openFileForRead("CVR", thumbnail.path, file)) {
+    return false;
+  }
+  const size_t bytes = planeSize(thumbnail.width, thumbnail.height);
+  bool ok = file.seekSet(HEADER_SIZE + bytes * first);
+  for (uint8_t i = 0; ok && i < count; i++) {
+    ok = file.read(planes[i], bytes) == static_cast<int>(bytes);
+  }
+  file.close();
+  if (!ok) {
+    if (Serial) Serial.printf("[%lu] [CVR] Failed to read %s\n", millis(), thumbnail.path);
+  }
+  return ok;
+}
+
+bool CoverCache::draw(EInkDisplay& display, const Thumbnail& thumbnail, const uint16_t x, const uint16_t y) {
+  if (x % 8 != 0) {
+    if (Serial) Serial.printf("[%lu] [CVR] Thumbnail x %u is not a multiple of 8\n", millis(), x);
+    return false;
+  }
+  auto* data = static_cast<uint8_t*>(malloc(planeSize(thumbnail.width, thumbnail.height)));
+  if (!data) {
+    if (Serial) Serial.printf("[%lu] [CVR] Not enough memory to draw %s\n", millis(), thumbnail.path);
+    return false;
+  }
+  const bool ok = readPlanes(thumbnail, 0, &data, 1);
+  if (ok) {
+    display.drawImage(data, x, y, thumbnail.width, thumbnail.height);
+  }
+  free(data);
+  return ok;
+}
+
+bool CoverCache::draw(EInkDisplay& display, const char* imagePath, const uint16_t x, const uint16_t y,
+                      const uint16_t boxWidth, const uint16_t boxHeight) {
+  Thumbnail thumbnail;
+  if (!get(imagePath, boxWidth, boxHeight, DEPTH_BW, thumbnail)) {
+    return false;
+  }
+  // Rounding the width up to whole bytes can make the thumbnail a few pixels wider than the box
+  const uint16_t left = thumbnail.width < boxWidth ? ((boxWidth - thumbnail.width) / 2) & ~7 : 0;
+  const uint16_t top = thumbnail.height < boxHeight ? (boxHeight - thumbnail.height) / 2 : 0;
+  return draw(display, thumbnail, x + left, y + top);
+}
+
+bool CoverCache::readGrayPlanes(const Thumbnail& thumbnail, uint8_t* lsb, uint8_t* msb) {
+  if (thumbnail.depth != DEPTH_GRAY) {
+    if (Serial) Serial.printf("[%lu] [CVR] %s has no gray planes\n", millis(), thumbnail.path);
+    return false;
+  }
+  uint8_t* const planes[2] = {lsb, msb};
+  return readPlanes(thumbnail, 1, planes, 2);
+}
+
+bool CoverCache::clear() { return !sd.exists(directory) || sd.removeDir(directory); }
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Output stage shared by the image decoders: takes 8-bit luminance rows in source order, scales them to fit a box and
+ * writes them dithered into packed display planes (rows of `stride` bytes, MSB first, like EInkDisplay's buffers).
+ *
+ * Downscaling is an exact area average in integer math: each output pixel is the mean of the source area it covers,
+ * with source pixels on a boundary split between their neighbours by overlap. Rows are reduced horizontally as they
+ * arrive (to 8.8 fixed point) and summed vertically, so only one output row is ever held: 6 bytes per output column (10
+ * with error diffusion) no matter the source size, and a decoder can hand rows over as it produces them. Upscaling,
+ * when allowed, repeats source pixels.
+ *
+ * With only the BW plane the output has two levels, 1 bits white. With a gray plane it has four, written the way
+ * copyGrayscaleBuffers() and displayGrayWindow() expect: LSB 1 for dark gray, MSB 1 for light and dark gray, and in the
+ * BW plane every gray pixel black.
+ */
+class GrayScaler {
+ public:
+  enum Dither : uint8_t {
+    DITHER_NONE,       // Nearest level, for line art
+    DITHER_ORDERED,    // 8x8 Bayer matrix, stable under partial redraws
+    DITHER_DIFFUSION,  // Floyd-Steinberg, best for photos
+  };
+
+  struct Target {
+    uint8_t* bw = nullptr;   // 1 white; nullptr to write only the gray planes
+    uint8_t* lsb = nullptr;  // 1 dark gray
+    uint8_t* msb = nullptr;  // 1 light or dark gray
+    uint16_t stride = 0;     // Bytes per plane row
+    uint16_t planeHeight = 0;
+    // Box the image is fitted into, keeping its aspect ratio, and centred in. Pixels outside the planes are clipped.
+    int16_t x = 0;
+    int16_t y = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    Dither dither = DITHER_DIFFUSION;
+    bool upscale = false;  // Whether images smaller than the box are enlarged
+  };
+
+  GrayScaler() = default;
+  ~GrayScaler() { end(); }
+
+  GrayScaler(const GrayScaler&) = delete;
+  GrayScaler& operator=(const GrayScaler&) = delete;
+
+  // Size of a `sourceWidth` x `sourceHeight` image fitted into a `boxWidth` x `boxHeight` box, at least 1 x 1
+  static void fit(uint16_t sourceWidth, uint16_t sourceHeight, uint16_t boxWidth, uint16_t boxHeight, bool upscale,
+                  uint16_t& width, uint16_t& height);
+
+  // Expects `sourceHeight` rows of `sourceWidth` pixels. `bottomUp` takes them last row first, as BMP stores them.
+  bool begin(uint16_t sourceWidth, uint16_t sourceHeight, const Target& target, bool bottomUp = false);
+  void end();
+
+  // Next source row, `sourceWidth` values from 0 black to 255 white
+  void pushRow(const uint8_t* row);
+
+  // Placement of the output image in the planes
+  int16_t getX() const { return outX; }
+  int16_t getY() const { return outY; }
+  uint16_t getWidth() const { return outWidth; }
+  uint16_t getHeight() const { return outHeight; }
+
+ private:
+  void emitRow(uint16_t index);
+
+  Target target;
+  uint16_t sourceWidth = 0;
+  uint16_t sourceHeight = 0;
+  uint16_t outWidth = 0;
+  uint16_t outHeight = 0;
+  int16_t outX = 0;
+  int16_t outY = 0;
+  uint8_t steps = 1;  // Levels minus one
+  bool bottomUp = false;
+
+  uint16_t sourceRow = 0;
+  uint16_t nextOut = 0;
+  uint32_t reciprocal = 0;  // 2^24 / sourceWidth, turns a row sum of sourceWidth weights into 8.8 fixed point
+  uint32_t divisor = 0;     // Of the vertical sums, 256 times their total weight
+  uint16_t* line = nullptr;  // The current source row reduced to the output width, 8.8 fixed point
+  uint32_t* sums = nullptr;
+  int16_t* errorRows = nullptr;  // Two rows of outWidth + 2 for error diffusion
+  int16_t* errors = nullptr;     // The row being written and the one below it
+  int16_t* nextErrors = nullptr;
+};
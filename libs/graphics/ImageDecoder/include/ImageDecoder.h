@@ -0,0 +1,82 @@
+#pragma once
+
+#include <BufferedReader.h>
+#include <Inflater.h>
+
+#include "GrayScaler.h"
+
+/**
+ * Streaming PNG, baseline JPEG and BMP decoder that writes straight into display planes.
+ *
+ * Images are read front to back from an open FsFile and handed to a GrayScaler a row (PNG, BMP) or a row of JPEG
+ * blocks at a time, so nothing the size of the image is ever held. Working memory depends only on the image width and
+ * the output size, and images whose rows would need more than the limits below are refused:
+ *
+ *   PNG   two rows of raw pixel data, each at most MAX_PNG_ROW_BYTES, plus the inflater's 32 KB window, which is kept
+ *         between images until end()
+ *   JPEG  about 7 KB of tables plus one row of 8 (16 for 4:2:0) pixel rows at the reduced size. Large images are
+ *         decoded at 1/2, 1/4 or 1/8 size straight out of the DCT, the smallest that still covers the output; at 1/8
+ *         only the DC coefficients are used, and chroma is always entropy decoded and dropped.
+ *   BMP   one row of file data
+ *
+ * plus the luminance row handed to the scaler, at most MAX_SOURCE_WIDTH pixels.
+ *
+ * Supported: PNG of any colour type and bit depth, not interlaced, with transparency composited over white; baseline
+ * and extended sequential Huffman JPEG, grayscale or YCbCr; BMP with 1, 4, 8, 16, 24 or 32 bits per pixel, uncompressed
+ * or bit fields. Everything is converted to luminance, decoding never uses floating point.
+ */
+class ImageDecoder {
+ public:
+  static constexpr uint16_t MAX_SOURCE_WIDTH = 4096;
+  static constexpr size_t MAX_PNG_ROW_BYTES = 16384;
+  static constexpr size_t MAX_JPEG_STRIPE_BYTES = 32768;
+
+  enum Format : uint8_t { FORMAT_UNKNOWN, FORMAT_PNG, FORMAT_JPEG, FORMAT_BMP };
+
+  struct Info {
+    Format format;
+    uint16_t width;
+    uint16_t height;
+  };
+
+  // Where a decoded image landed in the planes
+  struct Placement {
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+  };
+
+  using Target = GrayScaler::Target;
+
+  ImageDecoder() = default;
+  ~ImageDecoder() { end(); }
+
+  ImageDecoder(const ImageDecoder&) = delete;
+  ImageDecoder& operator=(const ImageDecoder&) = delete;
+
+  // Format and size from the file header, reading only the first few hundred bytes for most files
+  bool readInfo(FsFile& file, Info& info);
+  bool readInfo(const char* path, Info& info, SDCardManager& sd = SdMan);
+
+  /**
+   * Decodes the image into `target`, fitted into its box and centred.
+   *
+   * @param placed receives where the image landed in the planes, optional
+   * @return false if the file is not a supported image or is corrupt; rows decoded before the error stay in the planes
+   */
+  bool decode(FsFile& file, const Target& target, Placement* placed = nullptr);
+  bool decode(const char* path, const Target& target, Placement* placed = nullptr, SDCardManager& sd = SdMan);
+
+  // Frees the memory kept between images
+  void end();
+
+ private:
+  bool readHeader(Info& info);
+  bool decodePng(const Info& info, const Target& target, GrayScaler& scaler);
+  bool decodeJpeg(const Info& info, const Target& target, GrayScaler& scaler);
+  bool decodeBmp(const Info& info, const Target& target, GrayScaler& scaler);
+
+  BufferedReader reader;
+  Inflater inflater;
+};
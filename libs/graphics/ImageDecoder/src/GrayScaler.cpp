@@ -0,0 +1,237 @@
+#include "GrayScaler.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr uint8_t BAYER[8][8] = {
+    {0, 32, 8, 40, 2, 34, 10, 42},  {48, 16, 56, 24, 50, 18, 58, 26}, {12, 44, 4, 36, 14, 46, 6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22}, {3, 35, 11, 43, 1, 33, 9, 41},   {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47, 7, 39, 13, 45, 5, 37},  {63, 31, 55, 23, 61, 29, 53, 21},
+};
+}  // namespace
+
+void GrayScaler::fit(const uint16_t sourceWidth, const uint16_t sourceHeight, const uint16_t boxWidth,
+                     const uint16_t boxHeight, const bool upscale, uint16_t& width, uint16_t& height) {
+  if (!upscale && sourceWidth <= boxWidth && sourceHeight <= boxHeight) {
+    width = sourceWidth;
+    height = sourceHeight;
+  } else if (static_cast<uint32_t>(sourceWidth) * boxHeight >= static_cast<uint32_t>(sourceHeight) * boxWidth) {
+    width = boxWidth;
+    height = (static_cast<uint32_t>(sourceHeight) * boxWidth + sourceWidth / 2) / sourceWidth;
+  } else {
+    height = boxHeight;
+    width = (static_cast<uint32_t>(sourceWidth) * boxHeight + sourceHeight / 2) / sourceHeight;
+  }
+  // Rounding never exceeds the box, only very thin images can round to nothing
+  width = max(width, static_cast<uint16_t>(1));
+  height = max(height, static_cast<uint16_t>(1));
+}
+
+bool GrayScaler::begin(const uint16_t width, const uint16_t height, const Target& t, const bool fromBottom) {
+  end();
+  if (width == 0 || height == 0 || t.width == 0 || t.height == 0 || t.stride == 0 || (!t.bw && !t.lsb && !t.msb)) {
+    if (Serial) Serial.printf("[%lu] [GRS] Invalid scaler target\n", millis());
+    return false;
+  }
+  target = t;
+  sourceWidth = width;
+  sourceHeight = height;
+  bottomUp = fromBottom;
+  steps = t.lsb || t.msb ? 3 : 1;
+  fit(width, height, t.width, t.height, t.upscale, outWidth, outHeight);
+  outX = t.x + (t.width - outWidth) / 2;
+  outY = t.y + (t.height - outHeight) / 2;
+
+  line = static_cast<uint16_t*>(malloc(outWidth * sizeof(uint16_t)));
+  sums = static_cast<uint32_t*>(malloc(outWidth * sizeof(uint32_t)));
+  if (t.dither == DITHER_DIFFUSION) {
+    errorRows = static_cast<int16_t*>(malloc(2 * (outWidth + 2) * sizeof(int16_t)));
+  }
+  if (!line || !sums || (t.dither == DITHER_DIFFUSION && !errorRows)) {
+    if (Serial) Serial.printf("[%lu] [GRS] Failed to allocate buffers for %u columns\n", millis(), outWidth);
+    end();
+    return false;
+  }
+  memset(sums, 0, outWidth * sizeof(uint32_t));
+  if (errorRows) {
+    errors = errorRows;
+    nextErrors = errorRows + outWidth + 2;
+    memset(errorRows, 0, 2 * (outWidth + 2) * sizeof(int16_t));
+  }
+
+  // A row sum is at most 255 * sourceWidth, so the product stays below 255 << 24 and fits in 32 bits
+  reciprocal = (1UL << 24) / sourceWidth;
+  divisor = outHeight < sourceHeight ? static_cast<uint32_t>(sourceHeight) << 8 : 256;
+  sourceRow = 0;
+  nextOut = 0;
+  return true;
+}
+
+void GrayScaler::end() {
+  free(line);
+  free(sums);
+  free(errorRows);
+  line = nullptr;
+  sums = nullptr;
+  errorRows = nullptr;
+  errors = nullptr;
+  nextErrors = nullptr;
+}
+
+void GrayScaler::pushRow(const uint8_t* row) {
+  if (!sums || sourceRow >= sourceHeight) {
+    return;
+  }
+
+  // Horizontally, in units of 1 / (sourceWidth * outWidth): source pixel x spans [x * outWidth, (x + 1) * outWidth)
+  // and output column o ends at (o + 1) * sourceWidth
+  if (outWidth == sourceWidth) {
+    for (uint16_t x = 0; x < sourceWidth; x++) {
+      line[x] = row[x] << 8;
+    }
+  } else if (outWidth < sourceWidth) {
+    // Whole pixels are summed as they are and weighted once per column
+    uint16_t* out = line;
+    uint32_t whole = 0;
+    uint32_t carry = 0;  // Part of the previous column's last pixel
+    uint32_t position = 0;
+    uint32_t boundary = sourceWidth;
+    for (uint16_t x = 0; x < sourceWidth; x++) {
+      position += outWidth;
+      if (position <= boundary) {
+        whole += row[x];
+        continue;
+      }
+      // Straddles the boundary, the part past it starts the next column
+      const uint32_t after = position - boundary;
+      *out++ = ((carry + whole * outWidth + row[x] * (outWidth - after)) * reciprocal) >> 16;
+      carry = row[x] * after;
+      whole = 0;
+      boundary += sourceWidth;
+    }
+    *out = ((carry + whole * outWidth) * reciprocal) >> 16;
+  } else {
+    uint16_t x = 0;
+    uint32_t error = 0;
+    for (uint16_t o = 0; o < outWidth; o++) {
+      line[o] = row[x] << 8;
+      error += sourceWidth;
+      if (error >= outWidth) {
+        error -= outWidth;
+        x++;
+      }
+    }
+  }
+
+  if (outHeight < sourceHeight) {
+    // The same vertically, a source row adds to at most two output rows
+    const uint32_t position = static_cast<uint32_t>(sourceRow + 1) * outHeight;
+    const uint32_t boundary = static_cast<uint32_t>(nextOut + 1) * sourceHeight;
+    if (position <= boundary) {
+      for (uint16_t o = 0; o < outWidth; o++) {
+        sums[o] += line[o] * outHeight;
+      }
+      if (position == boundary) {
+        emitRow(nextOut++);
+        memset(sums, 0, outWidth * sizeof(uint32_t));
+      }
+    } else {
+      const uint32_t after = position - boundary;
+      const uint32_t before = outHeight - after;
+      for (uint16_t o = 0; o < outWidth; o++) {
+        sums[o] += line[o] * before;
+      }
+      emitRow(nextOut++);
+      for (uint16_t o = 0; o < outWidth; o++) {
+        sums[o] = line[o] * after;
+      }
+    }
+    sourceRow++;
+    return;
+  }
+
+  // Not reduced vertically: every output row whose share of the source is this row
+  sourceRow++;
+  for (uint16_t o = 0; o < outWidth; o++) {
+    sums[o] = line[o];
+  }
+  while (nextOut < outHeight &&
+         static_cast<uint32_t>(nextOut + 1) * sourceHeight <= static_cast<uint32_t>(sourceRow) * outHeight) {
+    emitRow(nextOut++);
+  }
+}
+
+void GrayScaler::emitRow(const uint16_t index) {
+  // Rows outside the planes are still dithered so the error carried into the visible rows stays the same
+  const int16_t py = outY + (bottomUp ? outHeight - 1 - index : index);
+  const bool visible = py >= 0 && py < static_cast<int16_t>(target.planeHeight);
+  const size_t rowOffset = visible ? static_cast<size_t>(py) * target.stride : 0;
+  const int16_t planeWidth = target.stride * 8;
+  const uint8_t* bayer = BAYER[py & 7];
+
+  for (uint16_t i = 0; i < outWidth; i++) {
+    const int value = (sums[i] + divisor / 2) / divisor;
+
+    uint8_t level;
+    switch (target.dither) {
+      case DITHER_DIFFUSION: {
+        // Errors are kept in sixteenths, spread 7/16 right, 3/16 down left, 5/16 down and 1/16 down right
+        const int v = value + ((errors[i + 1] + 8) >> 4);
+        level = v <= 0 ? 0 : min(static_cast<int>(steps), (v * steps + 127) / 255);
+        const int error = v - level * 255 / steps;
+        errors[i + 2] += error * 7;
+        nextErrors[i] += error * 3;
+        nextErrors[i + 1] += error * 5;
+        nextErrors[i + 2] += error;
+        break;
+      }
+      case DITHER_ORDERED: {
+        // The fraction between the two nearest levels against the threshold at this pixel
+        const int scaled = value * steps;
+        const int base = scaled / 255;
+        const int fraction = scaled - base * 255;
+        level = base + (fraction * 128 > (2 * bayer[(outX + i) & 7] + 1) * 255 ? 1 : 0);
+        break;
+      }
+      default:
+        level = (value * steps + 127) / 255;
+        break;
+    }
+
+    const int16_t px = outX + i;
+    if (!visible || px < 0 || px >= planeWidth) {
+      continue;
+    }
+    const size_t byte = rowOffset + (px >> 3);
+    const uint8_t mask = 0x80 >> (px & 7);
+    if (target.bw) {
+      if (level == steps) {
+        target.bw[byte] |= mask;
+      } else {
+        target.bw[byte] &= ~mask;
+      }
+    }
+    if (target.lsb) {
+      if (level == 1) {
+        target.lsb[byte] |= mask;
+      } else {
+        target.lsb[byte] &= ~mask;
+      }
+    }
+    if (target.msb) {
+      if (level == 1 || level == 2) {
+        target.msb[byte] |= mask;
+      } else {
+        target.msb[byte] &= ~mask;
+      }
+    }
+  }
+
+  if (errorRows) {
+    int16_t* swap = errors;
+    errors = nextErrors;
+    nextErrors = swap;
+    memset(nextErrors, 0, (outWidth + 2) * sizeof(int16_t));
+  }
+}
@@ -0,0 +1,314 @@
+#include "ImageDecoder.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+constexpr size_t BMP_FILE_HEADER_SIZE = 14;
+constexpr size_t BMP_MAX_INFO_SIZE = 124;
+
+uint16_t le16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+uint32_t le32(const uint8_t* p) { return le16(p) | (static_cast<uint32_t>(le16(p + 2)) << 16); }
+uint16_t be16(const uint8_t* p) { return (p[0] << 8) | p[1]; }
+uint32_t be32(const uint8_t* p) { return (static_cast<uint32_t>(be16(p)) << 16) | be16(p + 2); }
+
+// Position and width of a BMP bit field, to scale the channel to 8 bits
+struct Channel {
+  uint32_t mask;
+  uint8_t shift;
+  uint8_t bits;
+};
+
+Channel makeChannel(const uint32_t mask) {
+  Channel c = {mask, 0, 0};
+  if (mask == 0) {
+    return c;
+  }
+  while (!(mask >> c.shift & 1)) {
+    c.shift++;
+  }
+  while (c.shift + c.bits < 32 && (mask >> (c.shift + c.bits) & 1)) {
+    c.bits++;
+  }
+  return c;
+}
+
+uint8_t channelValue(const Channel& c, const uint32_t pixel) {
+  if (c.bits == 0) {
+    return 0;
+  }
+  const uint32_t v = (pixel & c.mask) >> c.shift;
+  return c.bits >= 8 ? v >> (c.bits - 8) : v * 255 / ((1u << c.bits) - 1);
+}
+
+uint8_t luminance(const uint8_t r, const uint8_t g, const uint8_t b) { return (r * 77 + g * 150 + b * 29) >> 8; }
+}  // namespace
+
+bool ImageDecoder::readInfo(FsFile& file, Info& info) {
+  if (!file.seekSet(0) || !reader.attach(file)) {
+    return false;
+  }
+  const bool ok = readHeader(info);
+  reader.close();
+  return ok;
+}
+
+bool ImageDecoder::readInfo(const char* path, Info& info, SDCardManager& sd) {
+  FsFile file = sd.open(path);
+  if (!file) {
+    if (Serial) Serial.printf("[%lu] [IMG] Failed to open %s\n", millis(), path);
+    return false;
+  }
+  const bool ok = readInfo(file, info);
+  file.close();
+  return ok;
+}
+
+bool ImageDecoder::readHeader(Info& info) {
+  info = {FORMAT_UNKNOWN, 0, 0};
+  uint8_t header[26];
+  if (reader.read(header, 2) != 2) {
+    return false;
+  }
+
+  if (header[0] == PNG_SIGNATURE[0] && header[1] == PNG_SIGNATURE[1]) {
+    // Signature, then IHDR has to be the first chunk
+    if (reader.read(header + 2, 22) != 22 || memcmp(header, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) != 0 ||
+        memcmp(header + 12, "IHDR", 4) != 0) {
+      if (Serial) Serial.printf("[%lu] [IMG] Corrupt PNG header\n", millis());
+      return false;
+    }
+    const uint32_t width = be32(header + 16);
+    const uint32_t height = be32(header + 20);
+    if (width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF) {
+      if (Serial) Serial.printf("[%lu] [IMG] Unsupported PNG size\n", millis());
+      return false;
+    }
+    info = {FORMAT_PNG, static_cast<uint16_t>(width), static_cast<uint16_t>(height)};
+    return true;
+  }
+
+  if (header[0] == 'B' && header[1] == 'M') {
+    if (reader.read(header + 2, 24) != 24) {
+      if (Serial) Serial.printf("[%lu] [IMG] Corrupt BMP header\n", millis());
+      return false;
+    }
+    int32_t width;
+    int32_t height;
+    if (le32(header + 14) == 12) {
+      width = le16(header + 18);
+      height = le16(header + 20);
+    } else {
+      width = static_cast<int32_t>(le32(header + 18));
+      height = static_cast<int32_t>(le32(header + 22));
+      if (height < 0) {
+        height = -height;
+      }
+    }
+    if (width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF) {
+      if (Serial) Serial.printf("[%lu] [IMG] Unsupported BMP size\n", millis());
+      return false;
+    }
+    info = {FORMAT_BMP, static_cast<uint16_t>(width), static_cast<uint16_t>(height)};
+    return true;
+  }
+
+  if (header[0] == 0xFF && header[1] == 0xD8) {
+    // Markers up to the first frame header
+    while (true) {
+      int b = reader.read();
+      while (b >= 0 && b != 0xFF) {
+        b = reader.read();
+      }
+      while (b == 0xFF) {
+        b = reader.read();
+      }
+      if (b < 0 || b == 0xD9 || b == 0xDA) {
+        break;
+      }
+      if (b == 0x01 || (b >= 0xD0 && b <= 0xD7)) {
+        continue;
+      }
+      uint8_t length[2];
+      if (reader.read(length, 2) != 2 || be16(length) < 2) {
+        break;
+      }
+      if (b >= 0xC0 && b <= 0xCF && b != 0xC4 && b != 0xC8 && b != 0xCC) {
+        uint8_t frame[5];
+        if (reader.read(frame, 5) != 5 || be16(frame + 1) == 0 || be16(frame + 3) == 0) {
+          break;
+        }
+        info = {FORMAT_JPEG, be16(frame + 3), be16(frame + 1)};
+        return true;
+      }
+      reader.skip(be16(length) - 2);
+    }
+    if (Serial) Serial.printf("[%lu] [IMG] No JPEG frame header\n", millis());
+    return false;
+  }
+
+  if (Serial) Serial.printf("[%lu] [IMG] Unknown image format\n", millis());
+  return false;
+}
+
+bool ImageDecoder::decode(FsFile& file, const Target& target, Placement* placed) {
+  if (!file.seekSet(0) || !reader.attach(file)) {
+    return false;
+  }
+  Info info;
+  GrayScaler scaler;
+  bool ok = readHeader(info) && reader.seek(0);
+  if (ok) {
+    switch (info.format) {
+      case FORMAT_PNG:
+        ok = decodePng(info, target, scaler);
+        break;
+      case FORMAT_JPEG:
+        ok = decodeJpeg(info, target, scaler);
+        break;
+      default:
+        ok = decodeBmp(info, target, scaler);
+        break;
+    }
+  }
+  reader.close();
+  if (placed) {
+    *placed = {scaler.getX(), scaler.getY(), scaler.getWidth(), scaler.getHeight()};
+  }
+  return ok;
+}
+
+bool ImageDecoder::decode(const char* path, const Target& target, Placement* placed, SDCardManager& sd) {
+  FsFile file = sd.open(path);
+  if (!file) {
+    if (Serial) Serial.printf("[%lu] [IMG] Failed to open %s\n", millis(), path);
+    return false;
+  }
+  const bool ok = decode(file, target, placed);
+  file.close();
+  return ok;
+}
+
+void ImageDecoder::end() {
+  inflater.end();
+  reader.close();
+}
+
+bool ImageDecoder::decodeBmp(const Info& info, const Target& target, GrayScaler& scaler) {
+  uint8_t header[BMP_FILE_HEADER_SIZE + BMP_MAX_INFO_SIZE + 12] = {};
+  if (reader.read(header, BMP_FILE_HEADER_SIZE + 4) != BMP_FILE_HEADER_SIZE + 4) {
+    return false;
+  }
+  const uint32_t dataOffset = le32(header + 10);
+  const uint32_t infoSize = le32(header + 14);
+  const size_t infoRead = min(infoSize, static_cast<uint32_t>(BMP_MAX_INFO_SIZE)) - 4;
+  if (infoSize < 12 || reader.read(header + BMP_FILE_HEADER_SIZE + 4, infoRead) != infoRead) {
+    if (Serial) Serial.printf("[%lu] [IMG] Corrupt BMP header\n", millis());
+    return false;
+  }
+  const uint8_t* dib = header + BMP_FILE_HEADER_SIZE;
+
+  const bool core = infoSize == 12;
+  const uint16_t bitsPerPixel = core ? le16(dib + 10) : le16(dib + 14);
+  const uint32_t compression = core ? 0 : le32(dib + 16);
+  const bool topDown = !core && static_cast<int32_t>(le32(dib + 8)) < 0;
+  uint32_t paletteOffset = BMP_FILE_HEADER_SIZE + infoSize;
+
+  Channel red = makeChannel(bitsPerPixel == 16 ? 0x7C00 : 0xFF0000);
+  Channel green = makeChannel(bitsPerPixel == 16 ? 0x03E0 : 0x00FF00);
+  Channel blue = makeChannel(bitsPerPixel == 16 ? 0x001F : 0x0000FF);
+  if (compression == 3 && (bitsPerPixel == 16 || bitsPerPixel == 32)) {
+    // Bit fields are part of the larger headers, and follow the 40 byte one
+    if (infoSize < 52) {
+      if (reader.read(header + BMP_FILE_HEADER_SIZE + 40, 12) != 12) {
+        return false;
+      }
+      paletteOffset += 12;
+    }
+    red = makeChannel(le32(dib + 40));
+    green = makeChannel(le32(dib + 44));
+    blue = makeChannel(le32(dib + 48));
+  } else if (compression != 0 || (bitsPerPixel != 1 && bitsPerPixel != 4 && bitsPerPixel != 8 &&
+                                  bitsPerPixel != 16 && bitsPerPixel != 24 && bitsPerPixel != 32)) {
+    if (Serial)
+      Serial.printf("[%lu] [IMG] Unsupported BMP: %u bits per pixel, compression %lu\n", millis(), bitsPerPixel,
+                    static_cast<unsigned long>(compression));
+    return false;
+  }
+  if (info.width > MAX_SOURCE_WIDTH) {
+    if (Serial) Serial.printf("[%lu] [IMG] BMP wider than %u pixels\n", millis(), MAX_SOURCE_WIDTH);
+    return false;
+  }
+
+  // Palette straight to luminance
+  uint8_t palette[256];
+  if (bitsPerPixel <= 8) {
+    const uint32_t colorsUsed = core ? 0 : le32(dib + 32);
+    const uint16_t count = colorsUsed > 0 && colorsUsed < (1u << bitsPerPixel) ? colorsUsed : 1u << bitsPerPixel;
+    const uint8_t entrySize = core ? 3 : 4;
+    memset(palette, 0, sizeof(palette));
+    if (!reader.seek(paletteOffset)) {
+      return false;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+      uint8_t entry[4];
+      if (reader.read(entry, entrySize) != entrySize) {
+        if (Serial) Serial.printf("[%lu] [IMG] Truncated BMP palette\n", millis());
+        return false;
+      }
+      palette[i] = luminance(entry[2], entry[1], entry[0]);
+    }
+  }
+
+  const size_t rowBytes = ((static_cast<size_t>(info.width) * bitsPerPixel + 31) / 32) * 4;
+  uint8_t* row = static_cast<uint8_t*>(malloc(rowBytes));
+  uint8_t* gray = static_cast<uint8_t*>(malloc(info.width));
+  if (!row || !gray) {
+    if (Serial) Serial.printf("[%lu] [IMG] Failed to allocate BMP row buffers\n", millis());
+    free(row);
+    free(gray);
+    return false;
+  }
+
+  bool ok = reader.seek(dataOffset) && scaler.begin(info.width, info.height, target, !topDown);
+  for (uint16_t y = 0; ok && y < info.height; y++) {
+    if (reader.read(row, rowBytes) != rowBytes) {
+      if (Serial) Serial.printf("[%lu] [IMG] Truncated BMP at row %u\n", millis(), y);
+      ok = false;
+      break;
+    }
+    switch (bitsPerPixel) {
+      case 1:
+      case 4:
+      case 8: {
+        const uint8_t mask = (1 << bitsPerPixel) - 1;
+        for (uint16_t x = 0; x < info.width; x++) {
+          const uint32_t bit = static_cast<uint32_t>(x) * bitsPerPixel;
+          gray[x] = palette[(row[bit >> 3] >> (8 - bitsPerPixel - (bit & 7))) & mask];
+        }
+        break;
+      }
+      case 24:
+        for (uint16_t x = 0; x < info.width; x++) {
+          const uint8_t* p = row + x * 3;
+          gray[x] = luminance(p[2], p[1], p[0]);
+        }
+        break;
+      default: {
+        const uint8_t bytes = bitsPerPixel / 8;
+        for (uint16_t x = 0; x < info.width; x++) {
+          const uint8_t* p = row + x * bytes;
+          const uint32_t pixel = bytes == 2 ? le16(p) : le32(p);
+          gray[x] = luminance(channelValue(red, pixel), channelValue(green, pixel), channelValue(blue, pixel));
+        }
+        break;
+      }
+    }
+    scaler.pushRow(gray);
+  }
+
+  free(row);
+  free(gray);
+  return ok;
+}
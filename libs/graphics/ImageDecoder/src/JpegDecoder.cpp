@@ -0,0 +1,621 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "ImageDecoder.h"
+
+namespace {
+constexpr uint8_t FAST_BITS = 9;
+constexpr uint8_t MAX_COMPONENTS = 3;
+constexpr uint8_t MAX_TABLES = 2;  // Baseline allows two DC and two AC tables; extended files rarely use more
+
+// Zigzag position to natural (row major) position
+constexpr uint8_t ZIGZAG[64] = {0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+                                12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+                                35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+                                58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+uint16_t be16(const uint8_t* p) { return (p[0] << 8) | p[1]; }
+
+uint8_t clamp8(const int v) { return v < 0 ? 0 : v > 255 ? 255 : v; }
+
+// Canonical Huffman code. `fast` maps the next FAST_BITS input bits to (length << 8) | symbol, 0 for longer codes.
+struct Huffman {
+  uint16_t fast[1 << FAST_BITS];
+  int32_t maxCode[17];      // Largest code of each length, -1 if there is none
+  int32_t valueOffset[17];  // Index into `values` minus the first code of each length
+  uint8_t values[256];
+  bool defined;
+};
+
+struct Component {
+  uint8_t id;
+  uint8_t h;
+  uint8_t v;
+  uint8_t quant;
+  uint8_t dcTable;
+  uint8_t acTable;
+  int dcPredictor;
+};
+
+// Everything the decoder needs besides the stripe, allocated once per image
+struct JpegState {
+  Huffman dc[MAX_TABLES];
+  Huffman ac[MAX_TABLES];
+  uint16_t quant[4][64];  // In zigzag order
+  Component components[MAX_COMPONENTS];
+  uint8_t componentCount;
+  uint16_t restartInterval;
+  int block[64];
+  int columns[64];
+};
+
+bool buildHuffman(Huffman& h, const uint8_t* counts, const uint8_t* values, const uint16_t total) {
+  memset(h.fast, 0, sizeof(h.fast));
+  memcpy(h.values, values, total);
+  int32_t code = 0;
+  uint16_t index = 0;
+  for (uint8_t length = 1; length <= 16; length++) {
+    const uint8_t count = counts[length - 1];
+    h.valueOffset[length] = index - code;
+    h.maxCode[length] = count ? code + count - 1 : -1;
+    if (length <= FAST_BITS) {
+      for (uint8_t i = 0; i < count; i++) {
+        const uint16_t first = (code + i) << (FAST_BITS - length);
+        for (uint16_t k = 0; k < (1u << (FAST_BITS - length)); k++) {
+          h.fast[first + k] = (length << 8) | values[index + i];
+        }
+      }
+    }
+    code += count;
+    index += count;
+    if (code > (1 << length)) {
+      return false;
+    }
+    code <<= 1;
+  }
+  h.defined = true;
+  return true;
+}
+
+// Entropy coded data, MSB first, with stuffed zero bytes removed. A marker ends the data: from then on zero bits are
+// returned and `marker` holds it, which is how restart markers are found. Reading into those zero bits means the data
+// was cut short, see overrun().
+class BitReader {
+ public:
+  explicit BitReader(BufferedReader& input) : input(input) {}
+
+  void reset() {
+    buffer = 0;
+    count = 0;
+    padBits = 0;
+    marker = 0;
+  }
+
+  // True once bits past the end of the segment were consumed
+  bool overrun() const { return count < padBits; }
+
+  int decode(const Huffman& h) {
+    if (count < 16) {
+      fill();
+    }
+    const uint16_t entry = h.fast[buffer >> (32 - FAST_BITS)];
+    if (entry != 0) {
+      consume(entry >> 8);
+      return entry & 0xFF;
+    }
+    for (uint8_t length = FAST_BITS + 1; length <= 16; length++) {
+      const int32_t code = buffer >> (32 - length);
+      if (code <= h.maxCode[length]) {
+        consume(length);
+        return h.values[h.valueOffset[length] + code];
+      }
+    }
+    return -1;
+  }
+
+  // The next `n` bits as a signed coefficient, in JPEG's one's complement like coding
+  int receive(const uint8_t n) {
+    if (n == 0) {
+      return 0;
+    }
+    if (count < n) {
+      fill();
+    }
+    int v = buffer >> (32 - n);
+    consume(n);
+    if (v < (1 << (n - 1))) {
+      v -= (1 << n) - 1;
+    }
+    return v;
+  }
+
+  void skip(const uint8_t n) {
+    if (count < n) {
+      fill();
+    }
+    consume(n);
+  }
+
+  // Drops the rest of the current segment and the restart marker that ends it
+  void restart() {
+    while (marker == 0) {
+      int b = input.read();
+      if (b < 0) {
+        break;
+      }
+      if (b == 0xFF) {
+        do {
+          b = input.read();
+        } while (b == 0xFF);
+        if (b != 0) {
+          marker = b < 0 ? 0xD9 : b;
+        }
+      }
+    }
+    const bool wasRestart = marker >= 0xD0 && marker <= 0xD7;
+    reset();
+    if (!wasRestart) {
+      // Anything else ends the scan, leave it to pad with zeros
+      marker = 0xD9;
+    }
+  }
+
+  uint8_t marker = 0;
+
+ private:
+  void fill() {
+    while (count <= 24) {
+      int b = marker == 0 ? input.read() : 0;
+      if (b == 0xFF) {
+        int next = input.read();
+        while (next == 0xFF) {
+          next = input.read();
+        }
+        if (next != 0) {
+          marker = next < 0 ? 0xD9 : next;
+        }
+      } else if (b < 0) {
+        marker = 0xD9;
+      }
+      if (marker != 0) {
+        b = 0;
+        // Saturates rather than wraps, so overrun() stays true however long a broken scan keeps reading
+        if (padBits < 0xF8) {
+          padBits += 8;
+        }
+      }
+      buffer |= static_cast<uint32_t>(b) << (24 - count);
+      count += 8;
+    }
+  }
+
+  void consume(const uint8_t n) {
+    buffer <<= n;
+    count -= n;
+  }
+
+  BufferedReader& input;
+  uint32_t buffer = 0;
+  uint8_t count = 0;
+  uint8_t padBits = 0;  // Zero bits at the end of `buffer` that are not part of the data
+};
+
+/**
+ * Decodes one block. With `block` the dequantized coefficients are stored in natural order (`block` must be zeroed),
+ * with `dcOnly` only the DC one; without `block` the block is decoded and dropped.
+ *
+ * @return one past the last coefficient that was stored, so 1 means the block is flat, -1 on corrupt data
+ */
+int decodeBlock(BitReader& bits, const Huffman& dc, const Huffman& ac, int& predictor, const uint16_t* quant,
+                int* block, const bool dcOnly) {
+  const int size = bits.decode(dc);
+  if (size < 0 || size > 11) {
+    return -1;
+  }
+  predictor += bits.receive(size);
+  if (block) {
+    block[0] = predictor * quant[0];
+  }
+
+  const bool store = block && !dcOnly;
+  int end = 1;
+  for (uint8_t k = 1; k < 64;) {
+    const int rs = bits.decode(ac);
+    if (rs < 0) {
+      return -1;
+    }
+    const uint8_t run = rs >> 4;
+    const uint8_t s = rs & 0x0F;
+    if (s == 0) {
+      if (run != 15) {
+        break;  // End of block
+      }
+      k += 16;
+      continue;
+    }
+    k += run;
+    if (k > 63) {
+      return -1;
+    }
+    if (store) {
+      block[ZIGZAG[k]] = bits.receive(s) * quant[k];
+      end = k + 1;
+    } else {
+      bits.skip(s);
+    }
+    k++;
+  }
+  return end;
+}
+
+// Separable integer IDCT in 12-bit fixed point, the factorisation of libjpeg's islow IDCT
+constexpr int fixed(const double x) { return static_cast<int>(x * 4096 + 0.5); }
+
+// One dimension of it: output i is x[i] + t[3 - i] and output 7 - i is x[i] - t[3 - i]
+struct Idct1d {
+  int x[4];
+  int t[4];
+};
+
+inline void idct1d(const int s0, const int s1, const int s2, const int s3, const int s4, const int s5, const int s6,
+                   const int s7, Idct1d& r) {
+  // Even part
+  const int p1 = (s2 + s6) * fixed(0.5411961);
+  const int t2 = p1 + s6 * fixed(-1.847759065);
+  const int t3 = p1 + s2 * fixed(0.765366865);
+  const int t0 = (s0 + s4) * 4096;
+  const int t1 = (s0 - s4) * 4096;
+  r.x[0] = t0 + t3;
+  r.x[3] = t0 - t3;
+  r.x[1] = t1 + t2;
+  r.x[2] = t1 - t2;
+
+  // Odd part
+  const int p5 = (s7 + s3 + s5 + s1) * fixed(1.175875602);
+  const int q1 = p5 + (s7 + s1) * fixed(-0.899976223);
+  const int q2 = p5 + (s5 + s3) * fixed(-2.562915447);
+  const int q3 = (s7 + s3) * fixed(-1.961570560);
+  const int q4 = (s5 + s1) * fixed(-0.390180644);
+  r.t[0] = s7 * fixed(0.298631336) + q1 + q3;
+  r.t[1] = s5 * fixed(2.053119869) + q2 + q4;
+  r.t[2] = s3 * fixed(3.072711026) + q2 + q3;
+  r.t[3] = s1 * fixed(1.501321110) + q1 + q4;
+}
+
+void idct(const int* in, int* columns, uint8_t* out, const size_t stride) {
+  Idct1d r;
+  for (uint8_t i = 0; i < 8; i++) {
+    const int* d = in + i;
+    int* v = columns + i;
+    if (d[8] == 0 && d[16] == 0 && d[24] == 0 && d[32] == 0 && d[40] == 0 && d[48] == 0 && d[56] == 0) {
+      const int dc = d[0] * 4;
+      for (uint8_t k = 0; k < 64; k += 8) {
+        v[k] = dc;
+      }
+      continue;
+    }
+    idct1d(d[0], d[8], d[16], d[24], d[32], d[40], d[48], d[56], r);
+    // Back down from 12 fraction bits, keeping 2 for the second pass
+    for (uint8_t k = 0; k < 4; k++) {
+      const int x = r.x[k] + 512;
+      v[k * 8] = (x + r.t[3 - k]) >> 10;
+      v[(7 - k) * 8] = (x - r.t[3 - k]) >> 10;
+    }
+  }
+
+  // 12 fraction bits, the 2 kept above and 3 from both passes scaling by sqrt(8), rounded, plus the level shift
+  constexpr int bias = 65536 + (128 << 17);
+  for (uint8_t i = 0; i < 8; i++, out += stride) {
+    const int* v = columns + i * 8;
+    idct1d(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], r);
+    for (uint8_t k = 0; k < 4; k++) {
+      const int x = r.x[k] + bias;
+      out[k] = clamp8((x + r.t[3 - k]) >> 17);
+      out[7 - k] = clamp8((x - r.t[3 - k]) >> 17);
+    }
+  }
+}
+
+// Reads up to the next marker, skipping entropy coded data and restart markers. Returns the marker, -1 at the end.
+int nextMarker(BufferedReader& input) {
+  while (true) {
+    int b = input.read();
+    while (b >= 0 && b != 0xFF) {
+      b = input.read();
+    }
+    while (b == 0xFF) {
+      b = input.read();
+    }
+    if (b < 0) {
+      return -1;
+    }
+    if (b != 0 && (b < 0xD0 || b > 0xD7)) {
+      return b;
+    }
+  }
+}
+}  // namespace
+
+bool ImageDecoder::decodeJpeg(const Info& info, const Target& target, GrayScaler& scaler) {
+  JpegState* state = static_cast<JpegState*>(calloc(1, sizeof(JpegState)));
+  if (!state) {
+    if (Serial) Serial.printf("[%lu] [IMG] Failed to allocate JPEG tables\n", millis());
+    return false;
+  }
+  uint8_t* stripe = nullptr;
+  bool ok = false;
+  bool framed = false;
+  uint8_t maxH = 1;
+  uint8_t maxV = 1;
+
+  reader.skip(2);  // SOI
+  int marker;
+  while ((marker = nextMarker(reader)) >= 0) {
+    if (marker == 0xD9) {
+      break;
+    }
+    uint8_t lengthBytes[2];
+    if (reader.read(lengthBytes, 2) != 2 || be16(lengthBytes) < 2) {
+      break;
+    }
+    uint16_t length = be16(lengthBytes) - 2;
+
+    if (marker == 0xDB) {
+      // Quantization tables
+      while (length > 0) {
+        const int pq = reader.read();
+        const uint8_t precision = pq >> 4;
+        const uint8_t id = pq & 0x0F;
+        const uint16_t size = precision ? 129 : 65;
+        if (pq < 0 || id > 3 || length < size) {
+          length = 0xFFFF;
+          break;
+        }
+        for (uint8_t k = 0; k < 64; k++) {
+          uint8_t q[2] = {0, 0};
+          reader.read(q + (precision ? 0 : 1), precision ? 2 : 1);
+          state->quant[id][k] = be16(q);
+        }
+        length -= size;
+      }
+      if (length != 0) {
+        if (Serial) Serial.printf("[%lu] [IMG] Corrupt JPEG quantization table\n", millis());
+        break;
+      }
+    } else if (marker == 0xC4) {
+      // Huffman tables
+      while (length > 17) {
+        uint8_t header[17];
+        reader.read(header, 17);
+        uint16_t total = 0;
+        for (uint8_t i = 1; i < 17; i++) {
+          total += header[i];
+        }
+        const uint8_t tableClass = header[0] >> 4;
+        const uint8_t id = header[0] & 0x0F;
+        uint8_t values[256];
+        if (total > 256 || 17u + total > length || tableClass > 1 || id >= MAX_TABLES ||
+            reader.read(values, total) != total ||
+            !buildHuffman(tableClass ? state->ac[id] : state->dc[id], header + 1, values, total)) {
+          length = 0xFFFF;
+          break;
+        }
+        length -= 17 + total;
+      }
+      if (length != 0) {
+        if (Serial) Serial.printf("[%lu] [IMG] Unsupported or corrupt JPEG Huffman table\n", millis());
+        break;
+      }
+    } else if (marker == 0xDD && length == 2) {
+      uint8_t interval[2];
+      reader.read(interval, 2);
+      state->restartInterval = be16(interval);
+    } else if (marker == 0xC0 || marker == 0xC1) {
+      // Baseline or extended sequential frame, Huffman coded
+      uint8_t frame[6 + 3 * MAX_COMPONENTS];
+      if (length < 6 || reader.read(frame, 6) != 6) {
+        break;
+      }
+      state->componentCount = frame[5];
+      if (frame[0] != 8 || (state->componentCount != 1 && state->componentCount != 3) ||
+          length != 6 + 3 * state->componentCount ||
+          reader.read(frame + 6, 3 * state->componentCount) != 3u * state->componentCount) {
+        if (Serial)
+          Serial.printf("[%lu] [IMG] Unsupported JPEG: %u bit, %u components\n", millis(), frame[0], frame[5]);
+        break;
+      }
+      for (uint8_t i = 0; i < state->componentCount; i++) {
+        Component& c = state->components[i];
+        c.id = frame[6 + i * 3];
+        c.h = frame[7 + i * 3] >> 4;
+        c.v = frame[7 + i * 3] & 0x0F;
+        c.quant = frame[8 + i * 3] & 3;
+        maxH = max(maxH, c.h);
+        maxV = max(maxV, c.v);
+      }
+      // Luminance is the first component and has to be at full resolution
+      const Component& y = state->components[0];
+      if (y.h != maxH || y.v != maxV || y.h == 0 || y.v == 0 || y.h > 4 || y.v > 4) {
+        if (Serial) Serial.printf("[%lu] [IMG] Unsupported JPEG sampling %ux%u\n", millis(), y.h, y.v);
+        break;
+      }
+      framed = true;
+    } else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      if (Serial)
+        Serial.printf("[%lu] [IMG] Unsupported JPEG process (SOF%u), only baseline is decoded\n", millis(),
+                      marker - 0xC0);
+      break;
+    } else if (marker == 0xDA) {
+      uint8_t count[1];
+      if (!framed || reader.read(count, 1) != 1 || count[0] == 0 || count[0] > MAX_COMPONENTS ||
+          length != 4 + 2 * count[0]) {
+        if (Serial) Serial.printf("[%lu] [IMG] Corrupt JPEG scan header\n", millis());
+        break;
+      }
+      Component* scan[MAX_COMPONENTS];
+      bool hasLuminance = false;
+      bool valid = true;
+      for (uint8_t i = 0; i < count[0]; i++) {
+        uint8_t selector[2];
+        reader.read(selector, 2);
+        scan[i] = nullptr;
+        for (uint8_t c = 0; c < state->componentCount; c++) {
+          if (state->components[c].id == selector[0]) {
+            scan[i] = &state->components[c];
+          }
+        }
+        if (!scan[i] || (selector[1] >> 4) >= MAX_TABLES || (selector[1] & 0x0F) >= MAX_TABLES ||
+            !state->dc[selector[1] >> 4].defined || !state->ac[selector[1] & 0x0F].defined) {
+          valid = false;
+          break;
+        }
+        scan[i]->dcTable = selector[1] >> 4;
+        scan[i]->acTable = selector[1] & 0x0F;
+        scan[i]->dcPredictor = 0;
+        hasLuminance |= scan[i] == &state->components[0];
+      }
+      reader.skip(3);  // Spectral selection and approximation, fixed for sequential scans
+      if (!valid) {
+        if (Serial) Serial.printf("[%lu] [IMG] JPEG scan uses an undefined table\n", millis());
+        break;
+      }
+      if (!hasLuminance) {
+        // A chroma only scan of a non-interleaved file, its data is skipped by nextMarker()
+        continue;
+      }
+
+      // Scale from the DCT: the smallest of 1/8, 1/4, 1/2 that still covers the output box
+      uint16_t outWidth;
+      uint16_t outHeight;
+      GrayScaler::fit(info.width, info.height, target.width, target.height, target.upscale, outWidth, outHeight);
+      uint8_t shift = 3;
+      while (shift > 0 && (((info.width + (1 << shift) - 1) >> shift) < outWidth ||
+                           ((info.height + (1 << shift) - 1) >> shift) < outHeight)) {
+        shift--;
+      }
+      const uint8_t blockSize = 8 >> shift;
+      const uint16_t scaledWidth = (info.width + (1 << shift) - 1) >> shift;
+      const uint16_t scaledHeight = (info.height + (1 << shift) - 1) >> shift;
+
+      // One MCU row. A single component scan is a grid of single blocks of that component.
+      const bool interleaved = count[0] > 1;
+      const uint8_t unitH = interleaved ? maxH : 1;
+      const uint8_t unitV = interleaved ? maxV : 1;
+      const uint16_t mcusX = (info.width + 8 * unitH - 1) / (8 * unitH);
+      const uint16_t mcusY = (info.height + 8 * unitV - 1) / (8 * unitV);
+      const size_t stripeWidth = static_cast<size_t>(mcusX) * unitH * blockSize;
+      const uint8_t stripeRows = unitV * blockSize;
+      if (scaledWidth > MAX_SOURCE_WIDTH || stripeWidth * stripeRows > MAX_JPEG_STRIPE_BYTES) {
+        if (Serial) Serial.printf("[%lu] [IMG] JPEG too wide: %u pixels\n", millis(), info.width);
+        break;
+      }
+      stripe = static_cast<uint8_t*>(malloc(stripeWidth * stripeRows));
+      if (!stripe || !scaler.begin(scaledWidth, scaledHeight, target)) {
+        if (Serial) Serial.printf("[%lu] [IMG] Failed to allocate a %u byte JPEG stripe\n", millis(),
+                                  static_cast<unsigned>(stripeWidth * stripeRows));
+        break;
+      }
+
+      BitReader bits(reader);
+      bits.reset();
+      uint8_t pixels[64];
+      uint16_t rowsOut = 0;
+      uint16_t untilRestart = state->restartInterval;
+      valid = true;
+      for (uint16_t my = 0; valid && my < mcusY; my++) {
+        for (uint16_t mx = 0; valid && mx < mcusX; mx++) {
+          if (state->restartInterval) {
+            if (untilRestart == 0) {
+              bits.restart();
+              for (uint8_t i = 0; i < count[0]; i++) {
+                scan[i]->dcPredictor = 0;
+              }
+              untilRestart = state->restartInterval;
+            }
+            untilRestart--;
+          }
+
+          for (uint8_t i = 0; valid && i < count[0]; i++) {
+            Component& c = *scan[i];
+            const bool luminance = &c == &state->components[0];
+            const uint8_t blocksH = interleaved ? c.h : 1;
+            const uint8_t blocksV = interleaved ? c.v : 1;
+            for (uint8_t by = 0; valid && by < blocksV; by++) {
+              for (uint8_t bx = 0; bx < blocksH; bx++) {
+                if (!luminance) {
+                  if (decodeBlock(bits, state->dc[c.dcTable], state->ac[c.acTable], c.dcPredictor, nullptr,
+                                  nullptr, false) < 0) {
+                    valid = false;
+                    break;
+                  }
+                  continue;
+                }
+
+                int* block = state->block;
+                memset(block, 0, sizeof(state->block));
+                const int end = decodeBlock(bits, state->dc[c.dcTable], state->ac[c.acTable], c.dcPredictor,
+                                            state->quant[c.quant], block, shift == 3);
+                if (end < 0) {
+                  valid = false;
+                  break;
+                }
+                uint8_t* out = stripe + static_cast<size_t>(by) * blockSize * stripeWidth +
+                               (static_cast<size_t>(mx) * unitH + bx) * blockSize;
+                if (end <= 1) {
+                  // Flat block, the DC term alone
+                  const uint8_t value = clamp8(128 + ((block[0] + 4) >> 3));
+                  for (uint8_t r = 0; r < blockSize; r++) {
+                    memset(out + r * stripeWidth, value, blockSize);
+                  }
+                  continue;
+                }
+                if (shift == 0) {
+                  idct(block, state->columns, out, stripeWidth);
+                  continue;
+                }
+                // Averaged down to 4x4 or 2x2
+                idct(block, state->columns, pixels, 8);
+                const uint8_t factor = 1 << shift;
+                for (uint8_t r = 0; r < blockSize; r++) {
+                  for (uint8_t col = 0; col < blockSize; col++) {
+                    uint16_t sum = 0;
+                    for (uint8_t dy = 0; dy < factor; dy++) {
+                      for (uint8_t dx = 0; dx < factor; dx++) {
+                        sum += pixels[(r * factor + dy) * 8 + col * factor + dx];
+                      }
+                    }
+                    out[r * stripeWidth + col] = (sum + factor * factor / 2) >> (2 * shift);
+                  }
+                }
+              }
+            }
+          }
+        }
+        if (bits.overrun()) {
+          if (Serial) Serial.printf("[%lu] [IMG] JPEG data ends in block row %u\n", millis(), my);
+          valid = false;
+          break;
+        }
+        if (!valid) {
+          if (Serial) Serial.printf("[%lu] [IMG] Corrupt JPEG data in block row %u\n", millis(), my);
+          break;
+        }
+        for (uint8_t r = 0; r < stripeRows && rowsOut < scaledHeight; r++, rowsOut++) {
+          scaler.pushRow(stripe + r * stripeWidth);
+        }
+      }
+      // Luminance is all that is needed, later scans only carry chroma
+      ok = valid;
+      break;
+    } else {
+      reader.skip(length);
+    }
+  }
+
+  if (!ok && marker < 0) {
+    if (Serial) Serial.printf("[%lu] [IMG] JPEG ended before the image data\n", millis());
+  }
+  free(stripe);
+  free(state);
+  return ok;
+}
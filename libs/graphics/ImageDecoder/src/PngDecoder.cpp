@@ -0,0 +1,270 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "ImageDecoder.h"
+
+namespace {
+constexpr size_t SIGNATURE_SIZE = 8;
+constexpr uint8_t COLOR_GRAY = 0;
+constexpr uint8_t COLOR_RGB = 2;
+constexpr uint8_t COLOR_PALETTE = 3;
+constexpr uint8_t COLOR_GRAY_ALPHA = 4;
+constexpr uint8_t COLOR_RGB_ALPHA = 6;
+
+uint16_t be16(const uint8_t* p) { return (p[0] << 8) | p[1]; }
+uint32_t be32(const uint8_t* p) { return (static_cast<uint32_t>(be16(p)) << 16) | be16(p + 2); }
+
+uint8_t luminance(const uint8_t r, const uint8_t g, const uint8_t b) { return (r * 77 + g * 150 + b * 29) >> 8; }
+
+// Composited over white
+uint8_t overWhite(const uint8_t gray, const uint8_t alpha) { return 255 - ((255 - gray) * alpha + 127) / 255; }
+
+// Feeds the inflater the contents of consecutive IDAT chunks, skipping their CRCs and headers in between
+struct IdatSource {
+  BufferedReader* reader;
+  uint32_t remaining;
+  bool ended;
+};
+
+int readIdat(void* context) {
+  IdatSource& source = *static_cast<IdatSource*>(context);
+  while (source.remaining == 0) {
+    uint8_t next[12];
+    if (source.ended || source.reader->read(next, sizeof(next)) != sizeof(next) || memcmp(next + 8, "IDAT", 4) != 0) {
+      source.ended = true;
+      return -1;
+    }
+    source.remaining = be32(next + 4);
+  }
+  source.remaining--;
+  return source.reader->read();
+}
+
+uint8_t paeth(const int a, const int b, const int c) {
+  const int p = a + b - c;
+  const int pa = abs(p - a);
+  const int pb = abs(p - b);
+  const int pc = abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return a;
+  }
+  return pb <= pc ? b : c;
+}
+
+// Undoes the row filter in place. `previous` is the unfiltered row above, all zero for the first row.
+bool unfilter(const uint8_t type, uint8_t* row, const uint8_t* previous, const size_t length, const uint8_t bpp) {
+  switch (type) {
+    case 0:
+      break;
+    case 1:
+      for (size_t i = bpp; i < length; i++) {
+        row[i] += row[i - bpp];
+      }
+      break;
+    case 2:
+      for (size_t i = 0; i < length; i++) {
+        row[i] += previous[i];
+      }
+      break;
+    case 3:
+      for (size_t i = 0; i < length; i++) {
+        row[i] += ((i >= bpp ? row[i - bpp] : 0) + previous[i]) >> 1;
+      }
+      break;
+    case 4:
+      for (size_t i = 0; i < length; i++) {
+        row[i] += i >= bpp ? paeth(row[i - bpp], previous[i], previous[i - bpp]) : paeth(0, previous[i], 0);
+      }
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+}  // namespace
+
+bool ImageDecoder::decodePng(const Info& info, const Target& target, GrayScaler& scaler) {
+  uint8_t depth = 0;
+  uint8_t colorType = 0;
+  uint8_t palette[256];
+  uint8_t paletteAlpha[256];
+  uint16_t paletteSize = 0;
+  bool hasKey = false;
+  uint16_t key[3] = {};
+
+  // Chunks up to the first IDAT
+  reader.skip(SIGNATURE_SIZE);
+  IdatSource source = {&reader, 0, false};
+  while (true) {
+    uint8_t chunk[13];
+    if (reader.read(chunk, 8) != 8) {
+      if (Serial) Serial.printf("[%lu] [IMG] PNG without image data\n", millis());
+      return false;
+    }
+    const uint32_t length = be32(chunk);
+    if (memcmp(chunk + 4, "IDAT", 4) == 0) {
+      source.remaining = length;
+      break;
+    }
+    if (memcmp(chunk + 4, "IHDR", 4) == 0 && length == 13) {
+      reader.read(chunk, 13);
+      depth = chunk[8];
+      colorType = chunk[9];
+      if (chunk[12] != 0) {
+        if (Serial) Serial.printf("[%lu] [IMG] Interlaced PNG not supported\n", millis());
+        return false;
+      }
+      if (chunk[10] != 0 || chunk[11] != 0) {
+        if (Serial) Serial.printf("[%lu] [IMG] Unknown PNG compression or filter method\n", millis());
+        return false;
+      }
+    } else if (memcmp(chunk + 4, "PLTE", 4) == 0 && length <= 768) {
+      paletteSize = length / 3;
+      for (uint16_t i = 0; i < paletteSize; i++) {
+        uint8_t rgb[3];
+        reader.read(rgb, 3);
+        palette[i] = luminance(rgb[0], rgb[1], rgb[2]);
+        paletteAlpha[i] = 255;
+      }
+      reader.skip(length - paletteSize * 3);
+    } else if (memcmp(chunk + 4, "tRNS", 4) == 0 && length <= 256) {
+      uint8_t values[256];
+      reader.read(values, length);
+      if (colorType == COLOR_PALETTE) {
+        for (uint16_t i = 0; i < length && i < paletteSize; i++) {
+          paletteAlpha[i] = values[i];
+        }
+      } else if ((colorType == COLOR_GRAY && length == 2) || (colorType == COLOR_RGB && length == 6)) {
+        hasKey = true;
+        for (uint8_t i = 0; i < length / 2; i++) {
+          key[i] = be16(values + i * 2);
+        }
+      }
+    } else {
+      reader.skip(length);
+    }
+    reader.skip(4);  // CRC
+  }
+
+  uint8_t channels;
+  switch (colorType) {
+    case COLOR_GRAY:
+    case COLOR_PALETTE:
+      channels = 1;
+      break;
+    case COLOR_GRAY_ALPHA:
+      channels = 2;
+      break;
+    case COLOR_RGB:
+      channels = 3;
+      break;
+    case COLOR_RGB_ALPHA:
+      channels = 4;
+      break;
+    default:
+      channels = 0;
+      break;
+  }
+  const bool packed = depth == 1 || depth == 2 || depth == 4;
+  const bool validDepth = colorType == COLOR_GRAY      ? packed || depth == 8 || depth == 16
+                          : colorType == COLOR_PALETTE ? packed || depth == 8
+                                                       : depth == 8 || depth == 16;
+  if (channels == 0 || !validDepth || (colorType == COLOR_PALETTE && paletteSize == 0)) {
+    if (Serial) Serial.printf("[%lu] [IMG] Unsupported PNG: color type %u, depth %u\n", millis(), colorType, depth);
+    return false;
+  }
+  const size_t rowBytes = (static_cast<size_t>(info.width) * channels * depth + 7) / 8;
+  if (info.width > MAX_SOURCE_WIDTH || rowBytes > MAX_PNG_ROW_BYTES) {
+    if (Serial) Serial.printf("[%lu] [IMG] PNG too wide: %u pixels\n", millis(), info.width);
+    return false;
+  }
+  if (colorType == COLOR_PALETTE) {
+    for (uint16_t i = 0; i < paletteSize; i++) {
+      palette[i] = overWhite(palette[i], paletteAlpha[i]);
+    }
+    // Out of range indexes show as white rather than reading past the palette
+    memset(palette + paletteSize, 255, 256 - paletteSize);
+  }
+
+  // zlib header: deflate, no preset dictionary
+  const int cmf = readIdat(&source);
+  const int flags = readIdat(&source);
+  if (cmf < 0 || flags < 0 || (cmf & 0x0F) != 8 || ((cmf << 8) | flags) % 31 != 0 || (flags & 0x20)) {
+    if (Serial) Serial.printf("[%lu] [IMG] Invalid zlib header in PNG\n", millis());
+    return false;
+  }
+  if (!inflater.begin(readIdat, &source)) {
+    return false;
+  }
+
+  // Filter type byte plus the row, for the current and the previous row
+  uint8_t* rows = static_cast<uint8_t*>(malloc(2 * (rowBytes + 1)));
+  uint8_t* gray = static_cast<uint8_t*>(malloc(info.width));
+  if (!rows || !gray) {
+    if (Serial) Serial.printf("[%lu] [IMG] Failed to allocate PNG row buffers\n", millis());
+    free(rows);
+    free(gray);
+    return false;
+  }
+  uint8_t* current = rows;
+  uint8_t* previous = rows + rowBytes + 1;
+  memset(previous, 0, rowBytes + 1);
+  const uint8_t bpp = max(1, channels * depth / 8);
+  const uint8_t step = depth == 16 ? 2 : 1;  // Of 16-bit samples only the high byte is used
+
+  bool ok = scaler.begin(info.width, info.height, target);
+  for (uint16_t y = 0; ok && y < info.height; y++) {
+    if (inflater.read(current, rowBytes + 1) != rowBytes + 1 ||
+        !unfilter(current[0], current + 1, previous + 1, rowBytes, bpp)) {
+      if (Serial) Serial.printf("[%lu] [IMG] Corrupt PNG data at row %u\n", millis(), y);
+      ok = false;
+      break;
+    }
+    const uint8_t* p = current + 1;
+    if (colorType == COLOR_GRAY && depth >= 8) {
+      for (uint16_t x = 0; x < info.width; x++, p += step) {
+        const uint16_t sample = depth == 16 ? be16(p) : *p;
+        gray[x] = hasKey && sample == key[0] ? 255 : *p;
+      }
+    } else if (colorType == COLOR_GRAY || colorType == COLOR_PALETTE) {
+      // Packed samples, most significant first
+      const uint8_t mask = (1 << depth) - 1;
+      const uint8_t scale = 255 / mask;
+      for (uint16_t x = 0; x < info.width; x++) {
+        const uint32_t bit = static_cast<uint32_t>(x) * depth;
+        const uint8_t sample = (p[bit >> 3] >> (8 - depth - (bit & 7))) & mask;
+        if (colorType == COLOR_PALETTE) {
+          gray[x] = palette[sample];
+        } else {
+          gray[x] = hasKey && sample == key[0] ? 255 : sample * scale;
+        }
+      }
+    } else if (colorType == COLOR_GRAY_ALPHA) {
+      for (uint16_t x = 0; x < info.width; x++, p += 2 * step) {
+        gray[x] = overWhite(p[0], p[step]);
+      }
+    } else if (colorType == COLOR_RGB) {
+      for (uint16_t x = 0; x < info.width; x++, p += 3 * step) {
+        if (hasKey && (depth == 16 ? be16(p) == key[0] && be16(p + 2) == key[1] && be16(p + 4) == key[2]
+                                   : p[0] == key[0] && p[1] == key[1] && p[2] == key[2])) {
+          gray[x] = 255;
+        } else {
+          gray[x] = luminance(p[0], p[step], p[2 * step]);
+        }
+      }
+    } else {
+      for (uint16_t x = 0; x < info.width; x++, p += 4 * step) {
+        gray[x] = overWhite(luminance(p[0], p[step], p[2 * step]), p[3 * step]);
+      }
+    }
+    scaler.pushRow(gray);
+
+    uint8_t* swap = previous;
+    previous = current;
+    current = swap;
+  }
+
+  free(rows);
+  free(gray);
+  return ok;
+}
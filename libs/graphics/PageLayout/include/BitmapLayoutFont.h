@@ -0,0 +1,42 @@
+#pragma once
+
+#include <BitmapFont.h>
+#include <StreamedFont.h>
+
+#include "LayoutFont.h"
+
+/**
+ * LayoutFont over packed BitmapFont faces. Bold and italic runs use their own faces when given; bold without a bold
+ * face is emboldened by drawing the regular glyph twice, one pixel apart.
+ *
+ * Codepoints missing from the faces can come from a StreamedFont, e.g. a CJK font on the SD card next to a Latin font
+ * in flash.
+ */
+class BitmapLayoutFont : public LayoutFont {
+ public:
+  explicit BitmapLayoutFont(const BitmapFont& regular, const BitmapFont* bold = nullptr,
+                            const BitmapFont* italic = nullptr, const BitmapFont* boldItalic = nullptr);
+
+  // Set before handing the font to a Paginator, the fallback is part of the font id
+  void setFallback(StreamedFont* font);
+
+  uint16_t getAdvance(uint32_t codepoint, uint16_t style) override;
+  int8_t getKerning(uint32_t left, uint32_t right, uint16_t style) override;
+  uint16_t getLineHeight() const override { return regular.getLineHeight(); }
+  uint16_t getAscent() const override { return regular.getAscent(); }
+  void drawGlyph(uint8_t* frameBuffer, uint16_t width, uint16_t height, int16_t x, int16_t y, uint32_t codepoint,
+                 uint16_t style) override;
+  uint32_t getId() const override { return id; }
+
+ private:
+  const BitmapFont& face(uint16_t style, bool& emboldened) const;
+  bool glyphFor(uint32_t codepoint, uint16_t style, BitmapFont::Glyph& glyph, bool& emboldened);
+  uint32_t computeId() const;
+
+  const BitmapFont& regular;
+  const BitmapFont* bold;
+  const BitmapFont* italic;
+  const BitmapFont* boldItalic;
+  StreamedFont* fallback = nullptr;
+  uint32_t id;
+};
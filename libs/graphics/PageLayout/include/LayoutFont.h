@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * What the layout needs from a font: advance widths for line breaking and a way to draw a glyph into the 1bpp frame
+ * buffer. `style` carries XhtmlStyle flags, so an implementation can map bold and italic runs to other faces.
+ */
+class LayoutFont {
+ public:
+  virtual ~LayoutFont() = default;
+
+  // Distance from this glyph's origin to the next one, in pixels
+  virtual uint16_t getAdvance(uint32_t codepoint, uint16_t style) = 0;
+  // Adjustment added to the advance of `left` when `right` follows it
+  virtual int8_t getKerning(uint32_t /*left*/, uint32_t /*right*/, uint16_t /*style*/) { return 0; }
+  // Baseline to baseline distance, and the part of it above the baseline
+  virtual uint16_t getLineHeight() const = 0;
+  virtual uint16_t getAscent() const = 0;
+
+  // Draws one glyph with its origin on the baseline at (x, y), clipped to a `width` x `height` frame buffer laid out
+  // like EInkDisplay's (rows of width / 8 bytes, 0 bits black)
+  virtual void drawGlyph(uint8_t* frameBuffer, uint16_t width, uint16_t height, int16_t x, int16_t y,
+                         uint32_t codepoint, uint16_t style) = 0;
+
+  // Changes with anything that affects metrics (face, size), saved page indexes are rebuilt when it does
+  virtual uint32_t getId() const = 0;
+};
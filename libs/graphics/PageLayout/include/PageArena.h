@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Bump allocator for the data of one page. Allocation is a pointer increment and everything is freed at once with
+ * reset() when the next page is laid out, so a page turn never touches the heap.
+ */
+class PageArena {
+ public:
+  PageArena() = default;
+  ~PageArena() { end(); }
+
+  PageArena(const PageArena&) = delete;
+  PageArena& operator=(const PageArena&) = delete;
+
+  // Allocates the backing buffer once
+  bool begin(size_t capacity);
+  void end();
+
+  // Returns nullptr when the arena is full
+  void* allocate(size_t size, size_t alignment = 4);
+  void reset() { used = 0; }
+
+  // Position to roll back to with release(), dropping everything allocated after it
+  size_t mark() const { return used; }
+  void release(size_t position) { used = position; }
+
+  uint8_t* data() { return buffer; }
+  size_t getUsed() const { return used; }
+  size_t getCapacity() const { return capacity; }
+  // Most bytes ever in use, for sizing the arena
+  size_t getHighWater() const { return highWater; }
+
+ private:
+  uint8_t* buffer = nullptr;
+  size_t capacity = 0;
+  size_t used = 0;
+  size_t highWater = 0;
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <EInkDisplay.h>
+#include <SDCardManager.h>
+#include <XhtmlTokenizer.h>
+
+#include "LayoutFont.h"
+#include "PageArena.h"
+
+/**
+ * Lays out a book of XHTML chapters into pages and draws them into the display's frame buffer.
+ *
+ * Where every page starts is kept in a per-book index under /.sdcache/layout: the chapter, the tokenizer's resume state
+ * at the block the page starts in, and how many lines of that block the previous page already showed. Showing any
+ * indexed page costs one page of layout plus re-breaking the lines of its first block, never a reflow from the start
+ * of the chapter. The tokenizer splits blocks at XhtmlTokenizer::MAX_BLOCK_TEXT, so that is at most 8 KB of text even
+ * in a chapter that is one huge paragraph; the limitation is a line break wherever such a block was split. Laying out a
+ * page also yields where the next one starts, so the index grows as the book is read; paginateAhead() extends it in
+ * idle time so page counts and far jumps become available.
+ *
+ * The index is keyed by the font id, page size and Settings and is rebuilt when any of them changes, or when the book
+ * passed to open() has another id or path.
+ *
+ * The text of the page being laid out is kept in a PageArena, so a page needs no heap allocation.
+ */
+class Paginator {
+ public:
+  static constexpr size_t DEFAULT_ARENA_SIZE = 8192;
+  static constexpr size_t MAX_LINES = 96;
+
+  struct Settings {
+    uint16_t marginTop = 24;
+    uint16_t marginRight = 24;
+    uint16_t marginBottom = 24;
+    uint16_t marginLeft = 24;
+    uint8_t lineSpacing = 100;     // Percent of the font's line height
+    uint8_t paragraphSpacing = 0;  // Extra pixels between blocks
+    uint8_t firstLineIndent = 24;
+    uint8_t indentStep = 24;  // Per nested list or quote
+    bool justify = true;      // Default alignment of paragraphs without text-align
+  };
+
+  // Reads up to `length` bytes of chapter `chapter` starting at byte `offset`, returns the bytes read (0 at the end).
+  // Reads are sequential except where a page starts, e.g. a ZipEntryReader that seeks when `offset` is not its
+  // position.
+  typedef size_t (*ChapterSource)(uint16_t chapter, uint32_t offset, uint8_t* buffer, size_t length, void* context);
+  // Called when layout moves to another chapter, after the stylesheet rules were cleared. Feeds the chapter's linked
+  // stylesheets to `tokenizer.writeStylesheet()`.
+  typedef void (*StylesheetLoader)(uint16_t chapter, XhtmlTokenizer& tokenizer, void* context);
+  // Size of an image at its natural scale, false to leave the image out
+  typedef bool (*ImageMeasure)(const char* src, size_t length, uint16_t& width, uint16_t& height, void* context);
+  // Draws an image scaled into the given box of the frame buffer
+  typedef void (*ImageRenderer)(uint8_t* frameBuffer, int16_t x, int16_t y, uint16_t width, uint16_t height,
+                                const char* src, size_t length, void* context);
+
+  explicit Paginator(SDCardManager& sd = SdMan);
+  ~Paginator();
+
+  Paginator(const Paginator&) = delete;
+  Paginator& operator=(const Paginator&) = delete;
+
+  // Pages get the display's size. The arena holds the text of one page, about 10 bytes per word.
+  bool begin(EInkDisplay& display, LayoutFont& font, size_t arenaSize = DEFAULT_ARENA_SIZE);
+
+  // Changing the font or settings while a book is open throws its page index away
+  void setFont(LayoutFont& font);
+  void setSettings(const Settings& settings);
+  const Settings& getSettings() const { return settings; }
+  void setStylesheetLoader(StylesheetLoader loader, void* context);
+  void setImageHandler(ImageMeasure measure, ImageRenderer renderer, void* context);
+
+  // Opens the book's page index. `bookPath` names the index file; `bookId` has to change whenever the book does, e.g.
+  // ZipArchive::getIdentity(), or the page index of the old book would be reused.
+  bool open(const char* bookPath, uint32_t bookId, uint16_t chapterCount, ChapterSource source, void* context);
+  void close();
+
+  // Clears nothing: draws page `page` over what is in the frame buffer. Pages past the index are laid out first, which
+  // takes as long as paginating up to them. Returns false past the end of the book or on a read error.
+  bool renderPage(uint32_t page);
+
+  // Extends the index page by page until `budgetMs` is used up. Returns true while pages remain.
+  bool paginateAhead(uint32_t budgetMs);
+
+  // Pages known so far, the page count of the book once isComplete()
+  uint32_t getPageCount() const { return pageCount; }
+  bool isComplete() const { return complete; }
+
+  // Where a page starts: the offset of its first block in the chapter and the lines of that block on earlier pages.
+  // Unlike the page number this survives relayout with other settings, e.g. to save reading progress.
+  bool getPagePosition(uint32_t page, uint16_t& chapter, uint32_t& offset, uint16_t& line);
+  // Indexed page that shows a position from getPagePosition(), or the page that shows the start of the block at
+  // `offset`. Returns false if the index does not reach that far yet.
+  bool findPage(uint16_t chapter, uint32_t offset, uint16_t line, uint32_t& page);
+
+  // Bytes of the arena the busiest page needed
+  size_t getArenaHighWater() const { return arena.getHighWater(); }
+
+ private:
+  struct PageStart {
+    uint16_t chapter;
+    uint16_t skipLines;  // Lines of the first block shown on the previous page
+    XhtmlTokenizer::ResumeState state;
+  };
+
+  enum LineType : uint8_t { LINE_TEXT, LINE_RULE, LINE_IMAGE };
+
+  struct Line {
+    uint32_t first;  // Arena offset of the first fragment, or of the image source
+    uint16_t count;  // Fragments, or image source length
+    int16_t x;
+    int16_t y;  // Top
+    uint16_t width;
+    uint16_t height;
+    LineType type;
+    bool bullet;
+  };
+
+  static void onEvent(const XhtmlEvent& event, void* context);
+  void handleEvent(const XhtmlEvent& event);
+
+  bool layoutPage(uint32_t page, bool draw);
+  bool layoutFrom(const PageStart& start, bool& bookEnd);
+  bool prepareChapter(uint16_t chapter, bool fromStart);
+  bool feedChapter(uint16_t chapter, uint32_t offset);
+  void drawPage();
+
+  void startBlock(const XhtmlEvent& event);
+  void addText(const char* text, size_t length, uint16_t style);
+  void addCodepoint(uint32_t codepoint, const char* bytes, size_t length, uint16_t style);
+  void endWord();
+  void finishLine(bool lastOfBlock);
+  void dropLine();
+  void addImage(const char* src, size_t length);
+  void addRule();
+  bool reserve(uint16_t height);
+  void pageFull();
+  uint16_t lineWidth() const;
+  uint16_t lineHeight() const;
+
+  bool readRecord(uint32_t page, PageStart& start);
+  bool appendRecord(const PageStart& start);
+  bool writeHeader();
+  void resetIndex();
+  uint32_t computeLayoutKey() const;
+
+  SDCardManager& sd;
+  EInkDisplay* display = nullptr;
+  LayoutFont* font = nullptr;
+  Settings settings;
+  XhtmlTokenizer tokenizer;
+  PageArena arena;
+
+  ChapterSource source = nullptr;
+  void* sourceContext = nullptr;
+  StylesheetLoader stylesheetLoader = nullptr;
+  void* stylesheetContext = nullptr;
+  ImageMeasure imageMeasure = nullptr;
+  ImageRenderer imageRenderer = nullptr;
+  void* imageContext = nullptr;
+
+  // Page index
+  FsFile index;
+  char indexPath[40] = {};
+  uint16_t chapterCount = 0;
+  uint32_t bookId = 0;
+  uint64_t bookPathHash = 0;
+  uint32_t layoutKey = 0;
+  uint32_t pageCount = 0;
+  bool complete = false;
+  uint8_t unsyncedRecords = 0;
+
+  // Chapter whose stylesheet rules the tokenizer holds, -1 for none
+  int32_t styledChapter = -1;
+  bool headScanned = false;
+  bool scanningHead = false;
+
+  // Page being laid out
+  Line lines[MAX_LINES];
+  size_t lineCount = 0;
+  int16_t y = 0;
+  bool full = false;
+  PageStart next = {};
+  uint16_t currentChapter = 0;
+  uint16_t skipRemaining = 0;
+
+  // Block being laid out
+  XhtmlTokenizer::ResumeState blockState = {};
+  XhtmlBlockKind blockKind = XHTML_PARAGRAPH;
+  XhtmlAlign blockAlign = XHTML_ALIGN_DEFAULT;
+  uint16_t blockIndent = 0;
+  uint16_t linesInBlock = 0;
+  bool firstLineOfBlock = false;
+  uint16_t spacingBefore = 0;
+
+  // Line being built: fragments [lineStart, wordStart) are whole words, [wordStart, arena end) the current word
+  uint32_t lineStart = 0;
+  uint16_t lineFragments = 0;
+  uint16_t lineNaturalWidth = 0;
+  uint32_t wordStart = 0;
+  uint16_t wordFragments = 0;
+  uint16_t wordWidth = 0;
+  bool wordSpaceBefore = false;
+  bool spacePending = false;
+  uint32_t fragment = 0;  // Arena offset of the fragment being extended
+  bool fragmentOpen = false;
+  uint32_t previousCodepoint = 0;
+
+  uint8_t readBuffer[512];
+};
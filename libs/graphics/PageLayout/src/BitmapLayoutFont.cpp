@@ -0,0 +1,85 @@
+#include "BitmapLayoutFont.h"
+
+#include <XhtmlTokenizer.h>
+
+BitmapLayoutFont::BitmapLayoutFont(const BitmapFont& regular, const BitmapFont* bold, const BitmapFont* italic,
+                                   const BitmapFont* boldItalic)
+    : regular(regular), bold(bold), italic(italic), boldItalic(boldItalic) {
+  id = computeId();
+}
+
+void BitmapLayoutFont::setFallback(StreamedFont* font) {
+  fallback = font;
+  id = computeId();
+}
+
+uint32_t BitmapLayoutFont::computeId() const {
+  // Which faces are present changes advances as much as the faces themselves
+  const BitmapFont* faces[] = {&regular, bold, italic, boldItalic};
+  uint32_t hash = 2166136261u;
+  for (const BitmapFont* font : faces) {
+    hash = (hash ^ (font ? font->getId() : 0)) * 16777619u;
+  }
+  return (hash ^ (fallback ? fallback->getId() : 0)) * 16777619u;
+}
+
+const BitmapFont& BitmapLayoutFont::face(const uint16_t style, bool& emboldened) const {
+  emboldened = false;
+  const bool wantBold = style & XHTML_BOLD;
+  const bool wantItalic = style & XHTML_ITALIC;
+  if (wantBold && wantItalic && boldItalic) {
+    return *boldItalic;
+  }
+  if (wantBold && bold) {
+    return *bold;
+  }
+  const BitmapFont& base = wantItalic && italic ? *italic : regular;
+  emboldened = wantBold;
+  return base;
+}
+
+bool BitmapLayoutFont::glyphFor(const uint32_t codepoint, const uint16_t style, BitmapFont::Glyph& glyph,
+                                bool& emboldened) {
+  const BitmapFont& font = face(style, emboldened);
+  if (fallback && !font.hasGlyph(codepoint)) {
+    emboldened = false;
+    return fallback->getGlyph(codepoint, glyph);
+  }
+  return font.getGlyph(codepoint, glyph);
+}
+
+uint16_t BitmapLayoutFont::getAdvance(const uint32_t codepoint, const uint16_t style) {
+  bool emboldened;
+  BitmapFont::Glyph glyph;
+  if (!glyphFor(codepoint, style, glyph, emboldened)) {
+    return 0;
+  }
+  return glyph.advance + (emboldened ? 1 : 0);
+}
+
+int8_t BitmapLayoutFont::getKerning(const uint32_t left, const uint32_t right, const uint16_t style) {
+  bool emboldened;
+  const BitmapFont& font = face(style, emboldened);
+  if (fallback && (!font.hasGlyph(left) || !font.hasGlyph(right))) {
+    return 0;
+  }
+  BitmapFont::Glyph leftGlyph;
+  BitmapFont::Glyph rightGlyph;
+  if (!font.getGlyph(left, leftGlyph) || !font.getGlyph(right, rightGlyph)) {
+    return 0;
+  }
+  return font.getKerning(leftGlyph.index, rightGlyph.index);
+}
+
+void BitmapLayoutFont::drawGlyph(uint8_t* frameBuffer, const uint16_t width, const uint16_t height, const int16_t x,
+                                 const int16_t y, const uint32_t codepoint, const uint16_t style) {
+  bool emboldened;
+  BitmapFont::Glyph glyph;
+  if (!glyphFor(codepoint, style, glyph, emboldened)) {
+    return;
+  }
+  BitmapFont::drawGlyph(frameBuffer, width, height, x, y, glyph);
+  if (emboldened) {
+    BitmapFont::drawGlyph(frameBuffer, width, height, x + 1, y, glyph);
+  }
+}
@@ -0,0 +1,35 @@
+#include "PageArena.h"
+
+#include <cstdlib>
+
+bool PageArena::begin(const size_t size) {
+  end();
+  buffer = static_cast<uint8_t*>(malloc(size));
+  if (!buffer) {
+    if (Serial) Serial.printf("[%lu] [ARN] Failed to allocate %u bytes\n", millis(), static_cast<unsigned>(size));
+    return false;
+  }
+  capacity = size;
+  used = 0;
+  highWater = 0;
+  return true;
+}
+
+void PageArena::end() {
+  free(buffer);
+  buffer = nullptr;
+  capacity = 0;
+  used = 0;
+}
+
+void* PageArena::allocate(const size_t size, const size_t alignment) {
+  const size_t start = (used + alignment - 1) & ~(alignment - 1);
+  if (!buffer || start + size > capacity) {
+    return nullptr;
+  }
+  used = start + size;
+  if (used > highWater) {
+    highWater = used;
+  }
+  return buffer + start;
+}
@@ -0,0 +1,893 @@
+#include "Paginator.h"
+
+#include <BinaryIO.h>
+#include <BitmapFont.h>
+
+#include <cstring>
+
+namespace {
+constexpr const char* CACHE_DIR = "/.sdcache/layout";
+
+// Index file: header, then one record per page
+// Header: magic, layout key u32, chapter count u16, complete u8, pad, book id u32, book path hash u64
+constexpr uint8_t INDEX_MAGIC[4] = {'P', 'G', 'X', '2'};
+constexpr size_t HEADER_SIZE = 32;
+// Record: chapter u16, skip lines u16, resume offset u32, resume depth u8, resume frames, continued u8
+constexpr size_t RECORD_SIZE = 64;
+constexpr size_t RECORD_CONTINUED = 9 + sizeof(XhtmlTokenizer::ResumeState::frames);
+constexpr uint8_t SYNC_EVERY = 16;
+// Bumped whenever a change to the layout rules moves page breaks
+constexpr uint32_t LAYOUT_VERSION = 2;
+
+constexpr uint32_t BULLET = 0x2022;
+
+// A run of text in one style within a line, followed by its UTF-8 bytes
+struct Fragment {
+  int16_t x;
+  uint16_t width;
+  uint16_t style;
+  uint8_t length;
+  uint8_t flags;
+};
+constexpr uint8_t FRAGMENT_SPACE_BEFORE = 0x01;
+
+size_t fragmentSize(const Fragment* fragment) { return (sizeof(Fragment) + fragment->length + 1) & ~size_t(1); }
+
+using BinaryIO::fnv1a;
+using BinaryIO::fnv1a64;
+using BinaryIO::get16;
+using BinaryIO::get32;
+using BinaryIO::get64;
+using BinaryIO::put16;
+using BinaryIO::put32;
+using BinaryIO::put64;
+
+// Scripts written without spaces, where a line may break between any two characters
+bool breaksAnywhere(const uint32_t codepoint) {
+  return (codepoint >= 0x2E80 && codepoint <= 0x9FFF) || (codepoint >= 0xF900 && codepoint <= 0xFAFF) ||
+         (codepoint >= 0xFF00 && codepoint <= 0xFFEF) || (codepoint >= 0x20000 && codepoint <= 0x2FFFF);
+}
+
+void drawHorizontalLine(uint8_t* frameBuffer, const uint16_t width, const uint16_t height, int16_t x0, int16_t x1,
+                        const int16_t y) {
+  if (y < 0 || y >= height) {
+    return;
+  }
+  if (x0 < 0) {
+    x0 = 0;
+  }
+  if (x1 > width) {
+    x1 = width;
+  }
+  uint8_t* row = frameBuffer + static_cast<uint32_t>(y) * (width / 8);
+  for (int16_t x = x0; x < x1; x++) {
+    row[x >> 3] &= ~(0x80 >> (x & 7));
+  }
+}
+}  // namespace
+
+Paginator::Paginator(SDCardManager& sd) : sd(sd), tokenizer(onEvent, this) {}
+
+Paginator::~Paginator() { close(); }
+
+bool Paginator::begin(EInkDisplay& targetDisplay, LayoutFont& layoutFont, size_t arenaSize) {
+  display = &targetDisplay;
+  font = &layoutFont;
+  // One full line of the smallest glyphs has to fit
+  if (arenaSize < 1024) {
+    arenaSize = 1024;
+  }
+  return arena.begin(arenaSize);
+}
+
+void Paginator::setFont(LayoutFont& layoutFont) {
+  font = &layoutFont;
+  if (index && computeLayoutKey() != layoutKey) {
+    resetIndex();
+  }
+}
+
+void Paginator::setSettings(const Settings& newSettings) {
+  settings = newSettings;
+  if (index && computeLayoutKey() != layoutKey) {
+    resetIndex();
+  }
+}
+
+void Paginator::setStylesheetLoader(const StylesheetLoader loader, void* context) {
+  stylesheetLoader = loader;
+  stylesheetContext = context;
+  styledChapter = -1;
+}
+
+void Paginator::setImageHandler(const ImageMeasure measure, const ImageRenderer renderer, void* context) {
+  imageMeasure = measure;
+  imageRenderer = renderer;
+  imageContext = context;
+}
+
+bool Paginator::open(const char* bookPath, const uint32_t id, const uint16_t chapters,
+                     const ChapterSource chapterSource, void* context) {
+  close();
+  if (!display || !font || !arena.data() || chapters == 0 || !chapterSource) {
+    if (Serial) Serial.printf("[%lu] [PAG] Not ready to open %s\n", millis(), bookPath);
+    return false;
+  }
+  chapterCount = chapters;
+  bookId = id;
+  // Tells apart books whose paths share the 32-bit hash naming the index file
+  bookPathHash = fnv1a64(bookPath, strlen(bookPath));
+  source = chapterSource;
+  sourceContext = context;
+  styledChapter = -1;
+
+  if (!sd.ensureDirectoryExists(CACHE_DIR)) {
+    return false;
+  }
+  snprintf(indexPath, sizeof(indexPath), "%s/%08lx.idx", CACHE_DIR,
+           static_cast<unsigned long>(fnv1a(bookPath, strlen(bookPath))));
+  index = sd.open(indexPath, O_RDWR | O_CREAT);
+  if (!index) {
+    if (Serial) Serial.printf("[%lu] [PAG] Failed to open page index %s\n", millis(), indexPath);
+    return false;
+  }
+
+  layoutKey = computeLayoutKey();
+  uint8_t header[HEADER_SIZE];
+  const uint64_t size = index.fileSize();
+  if (size >= HEADER_SIZE + RECORD_SIZE && index.seekSet(0) && index.read(header, HEADER_SIZE) == HEADER_SIZE &&
+      memcmp(header, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 && get32(header + 4) == layoutKey &&
+      get16(header + 8) == chapterCount && get32(header + 12) == bookId && get64(header + 16) == bookPathHash) {
+    // A torn last record is overwritten by the next append
+    pageCount = (size - HEADER_SIZE) / RECORD_SIZE;
+    complete = header[10] != 0;
+  } else {
+    resetIndex();
+  }
+  return pageCount > 0;
+}
+
+void Paginator::close() {
+  if (index) {
+    index.sync();
+    index.close();
+  }
+  pageCount = 0;
+  complete = false;
+  unsyncedRecords = 0;
+  source = nullptr;
+}
+
+bool Paginator::renderPage(const uint32_t page) {
+  if (!index) {
+    return false;
+  }
+  while (page >= pageCount) {
+    if (complete || !layoutPage(pageCount - 1, false)) {
+      return false;
+    }
+  }
+  return layoutPage(page, true);
+}
+
+bool Paginator::paginateAhead(const uint32_t budgetMs) {
+  if (!index) {
+    return false;
+  }
+  const unsigned long started = millis();
+  while (!complete && millis() - started < budgetMs) {
+    if (!layoutPage(pageCount - 1, false)) {
+      return false;
+    }
+  }
+  if (unsyncedRecords > 0) {
+    index.sync();
+    unsyncedRecords = 0;
+  }
+  return !complete;
+}
+
+bool Paginator::getPagePosition(const uint32_t page, uint16_t& chapter, uint32_t& offset, uint16_t& line) {
+  PageStart start;
+  if (page >= pageCount || !readRecord(page, start)) {
+    return false;
+  }
+  chapter = start.chapter;
+  offset = start.state.offset;
+  line = start.skipLines;
+  return true;
+}
+
+bool Paginator::findPage(const uint16_t chapter, const uint32_t offset, const uint16_t line, uint32_t& page) {
+  // Last page starting at or before the position; records are in reading order
+  auto before = [&](const PageStart& start) {
+    if (start.chapter != chapter) {
+      return start.chapter < chapter;
+    }
+    if (start.state.offset != offset) {
+      return start.state.offset < offset;
+    }
+    return start.skipLines <= line;
+  };
+  PageStart start;
+  uint32_t low = 0;
+  uint32_t high = pageCount;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    if (!readRecord(mid, start)) {
+      return false;
+    }
+    if (before(start)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low == 0) {
+    return false;
+  }
+  // Past the last indexed page start the position may still be on a page that is not indexed yet
+  if (low == pageCount && !complete) {
+    return false;
+  }
+  page = low - 1;
+  return true;
+}
+
+void Paginator::onEvent(const XhtmlEvent& event, void* context) {
+  static_cast<Paginator*>(context)->handleEvent(event);
+}
+
+void Paginator::handleEvent(const XhtmlEvent& event) {
+  if (scanningHead) {
+    // The first event means the <head> with its <style> elements is done
+    scanningHead = false;
+    tokenizer.pause();
+    return;
+  }
+  if (full) {
+    return;
+  }
+  switch (event.type) {
+    case XHTML_BLOCK_START:
+      startBlock(event);
+      break;
+    case XHTML_TEXT:
+      addText(event.text, event.length, event.style);
+      break;
+    case XHTML_LINE_BREAK:
+      endWord();
+      finishLine(true);
+      break;
+    case XHTML_BLOCK_END:
+      endWord();
+      if (lineFragments > 0) {
+        finishLine(true);
+      }
+      skipRemaining = 0;
+      break;
+    case XHTML_IMAGE:
+      addImage(event.text, event.length);
+      break;
+    case XHTML_ANCHOR:
+      break;
+  }
+}
+
+bool Paginator::layoutPage(const uint32_t page, const bool draw) {
+  PageStart start;
+  if (!readRecord(page, start)) {
+    return false;
+  }
+  bool bookEnd = false;
+  if (!layoutFrom(start, bookEnd)) {
+    return false;
+  }
+  if (page + 1 == pageCount) {
+    if (bookEnd) {
+      complete = true;
+      if (!writeHeader()) {
+        return false;
+      }
+      index.sync();
+      unsyncedRecords = 0;
+    } else if (next.chapter == start.chapter && next.state.offset == start.state.offset &&
+               next.skipLines <= start.skipLines) {
+      if (Serial) Serial.printf("[%lu] [PAG] No progress on page %lu\n", millis(), static_cast<unsigned long>(page));
+      return false;
+    } else if (!appendRecord(next)) {
+      return false;
+    }
+  }
+  if (draw) {
+    drawPage();
+  }
+  return true;
+}
+
+bool Paginator::layoutFrom(const PageStart& start, bool& bookEnd) {
+  arena.reset();
+  lineCount = 0;
+  y = settings.marginTop;
+  full = false;
+  skipRemaining = start.skipLines;
+  lineFragments = 0;
+  wordFragments = 0;
+  fragmentOpen = false;
+  spacePending = false;
+  firstLineOfBlock = false;
+  blockState = start.state;
+  linesInBlock = 0;
+
+  uint16_t chapter = start.chapter;
+  const bool fromStart = start.state.offset == 0;
+  if (!prepareChapter(chapter, fromStart)) {
+    return false;
+  }
+  if (fromStart) {
+    tokenizer.reset();
+  } else {
+    tokenizer.resume(start.state);
+  }
+  currentChapter = chapter;
+  uint32_t offset = start.state.offset;
+
+  for (;;) {
+    if (!feedChapter(chapter, offset)) {
+      return true;
+    }
+    tokenizer.finish();
+    if (full) {
+      return true;
+    }
+    if (chapter + 1 >= chapterCount) {
+      bookEnd = true;
+      return true;
+    }
+    // Every chapter starts on a new page, unless nothing of the previous one made it onto this page
+    chapter++;
+    next = {};
+    next.chapter = chapter;
+    if (lineCount > 0) {
+      return true;
+    }
+    if (!prepareChapter(chapter, true)) {
+      return false;
+    }
+    tokenizer.reset();
+    currentChapter = chapter;
+    skipRemaining = 0;
+    offset = 0;
+  }
+}
+
+bool Paginator::prepareChapter(const uint16_t chapter, const bool fromStart) {
+  if (fromStart || styledChapter != chapter) {
+    tokenizer.clearStyles();
+    if (stylesheetLoader) {
+      stylesheetLoader(chapter, tokenizer, stylesheetContext);
+    }
+    styledChapter = chapter;
+    headScanned = false;
+  }
+  // From the start the <head> is tokenized on the way
+  if (fromStart || headScanned) {
+    headScanned = true;
+    return true;
+  }
+
+  // Resuming mid-chapter skips the <style> elements, so run the head through the tokenizer first
+  tokenizer.reset();
+  scanningHead = true;
+  uint32_t offset = 0;
+  while (scanningHead) {
+    const size_t n = source(chapter, offset, readBuffer, sizeof(readBuffer), sourceContext);
+    if (n == 0) {
+      break;
+    }
+    tokenizer.write(readBuffer, n);
+    offset += n;
+  }
+  scanningHead = false;
+  headScanned = true;
+  return true;
+}
+
+bool Paginator::feedChapter(const uint16_t chapter, const uint32_t offset) {
+  uint32_t position = offset;
+  while (!full) {
+    const size_t n = source(chapter, position, readBuffer, sizeof(readBuffer), sourceContext);
+    if (n == 0) {
+      return true;
+    }
+    tokenizer.write(readBuffer, n);
+    position += n;
+  }
+  return false;
+}
+
+void Paginator::startBlock(const XhtmlEvent& event) {
+  blockState = tokenizer.getBlockState();
+  linesInBlock = 0;
+  lineFragments = 0;
+  lineNaturalWidth = 0;
+  wordFragments = 0;
+  wordWidth = 0;
+  fragmentOpen = false;
+  spacePending = false;
+  // The rest of a block split by the tokenizer goes on where it was cut
+  spacingBefore = event.continued ? 0 : settings.paragraphSpacing;
+
+  // A forced break at the top of a page is already satisfied
+  if (event.pageBreakBefore && lineCount > 0 && skipRemaining == 0) {
+    pageFull();
+    return;
+  }
+  if (event.block == XHTML_RULE) {
+    addRule();
+    return;
+  }
+
+  blockKind = event.block;
+  const uint16_t contentWidth = display->getDisplayWidth() - settings.marginLeft - settings.marginRight;
+  blockIndent = event.indent * settings.indentStep;
+  if (blockIndent > contentWidth / 2) {
+    blockIndent = contentWidth / 2;
+  }
+  blockAlign = event.align;
+  if (blockAlign == XHTML_ALIGN_DEFAULT) {
+    const bool body = blockKind != XHTML_HEADING && blockKind != XHTML_PREFORMATTED;
+    blockAlign = body && settings.justify ? XHTML_ALIGN_JUSTIFY : XHTML_ALIGN_LEFT;
+  }
+  if (blockKind == XHTML_HEADING && !event.continued) {
+    spacingBefore += lineHeight() / 2;
+  }
+  firstLineOfBlock = !event.continued;
+}
+
+void Paginator::addText(const char* text, const size_t length, const uint16_t style) {
+  size_t i = 0;
+  while (i < length && !full) {
+    size_t size;
+    const uint32_t codepoint = BitmapFont::decodeUtf8(text + i, length - i, size);
+    if (codepoint == ' ') {
+      endWord();
+      spacePending = true;
+    } else if (breaksAnywhere(codepoint)) {
+      endWord();
+      addCodepoint(codepoint, text + i, size, style);
+      endWord();
+    } else {
+      addCodepoint(codepoint, text + i, size, style);
+    }
+    i += size;
+  }
+}
+
+void Paginator::addCodepoint(const uint32_t codepoint, const char* bytes, const size_t length, const uint16_t style) {
+  if (wordFragments == 0) {
+    wordSpaceBefore = spacePending && lineFragments > 0;
+    spacePending = false;
+  }
+  Fragment* current = fragmentOpen ? reinterpret_cast<Fragment*>(arena.data() + fragment) : nullptr;
+  const bool extend = current && current->style == style && current->length + length <= 255;
+  int16_t advance = font->getAdvance(codepoint, style);
+  if (extend) {
+    advance += font->getKerning(previousCodepoint, codepoint, style);
+  }
+
+  const uint16_t space = wordSpaceBefore ? font->getAdvance(' ', style) : 0;
+  if (lineNaturalWidth + space + wordWidth + advance > lineWidth()) {
+    if (lineFragments > 0) {
+      // Wrap before this word, which moves to the next line as it is
+      finishLine(false);
+      if (full) {
+        return;
+      }
+      if (wordFragments > 0) {
+        reinterpret_cast<Fragment*>(arena.data() + wordStart)->flags &= ~FRAGMENT_SPACE_BEFORE;
+      }
+      wordSpaceBefore = false;
+      // The word may still be too long for a line of its own
+      return addCodepoint(codepoint, bytes, length, style);
+    } else if (wordFragments > 0) {
+      // A word wider than the line is broken where it overflows
+      lineStart = wordStart;
+      lineFragments = wordFragments;
+      lineNaturalWidth = wordWidth;
+      wordFragments = 0;
+      wordWidth = 0;
+      fragmentOpen = false;
+      finishLine(false);
+      if (full) {
+        return;
+      }
+      wordSpaceBefore = false;
+      return addCodepoint(codepoint, bytes, length, style);
+    }
+  }
+
+  if (!extend || !fragmentOpen) {
+    Fragment* created = static_cast<Fragment*>(arena.allocate(sizeof(Fragment), 2));
+    if (!created) {
+      if (Serial) Serial.printf("[%lu] [PAG] Page arena full, ending the page early\n", millis());
+      pageFull();
+      return;
+    }
+    created->x = 0;
+    created->width = 0;
+    created->style = style;
+    created->length = 0;
+    created->flags = wordFragments == 0 && wordSpaceBefore ? FRAGMENT_SPACE_BEFORE : 0;
+    fragment = reinterpret_cast<uint8_t*>(created) - arena.data();
+    fragmentOpen = true;
+    if (wordFragments == 0) {
+      wordStart = fragment;
+    }
+    wordFragments++;
+  }
+  char* text = static_cast<char*>(arena.allocate(length, 1));
+  if (!text) {
+    if (Serial) Serial.printf("[%lu] [PAG] Page arena full, ending the page early\n", millis());
+    pageFull();
+    return;
+  }
+  memcpy(text, bytes, length);
+  Fragment* target = reinterpret_cast<Fragment*>(arena.data() + fragment);
+  target->length += length;
+  target->width += advance;
+  wordWidth += advance;
+  previousCodepoint = codepoint;
+}
+
+void Paginator::endWord() {
+  fragmentOpen = false;
+  previousCodepoint = 0;
+  if (wordFragments == 0) {
+    return;
+  }
+  if (lineFragments == 0) {
+    lineStart = wordStart;
+  }
+  const Fragment* first = reinterpret_cast<const Fragment*>(arena.data() + wordStart);
+  lineNaturalWidth += (wordSpaceBefore ? font->getAdvance(' ', first->style) : 0) + wordWidth;
+  lineFragments += wordFragments;
+  wordFragments = 0;
+  wordWidth = 0;
+}
+
+void Paginator::finishLine(const bool lastOfBlock) {
+  if (skipRemaining > 0) {
+    // Shown on the previous page
+    skipRemaining--;
+    linesInBlock++;
+    firstLineOfBlock = false;
+    dropLine();
+    return;
+  }
+
+  const uint16_t height = lineHeight();
+  if (!reserve(height)) {
+    return;
+  }
+  const uint16_t available = lineWidth();
+  int16_t x = settings.marginLeft + blockIndent + (display->getDisplayWidth() - settings.marginLeft -
+                                                   settings.marginRight - blockIndent - available);
+  const uint16_t extra = available > lineNaturalWidth ? available - lineNaturalWidth : 0;
+  uint16_t gaps = 0;
+  uint32_t position = lineStart;
+  for (uint16_t i = 0; i < lineFragments; i++) {
+    const Fragment* f = reinterpret_cast<const Fragment*>(arena.data() + position);
+    if (i > 0 && (f->flags & FRAGMENT_SPACE_BEFORE)) {
+      gaps++;
+    }
+    position += fragmentSize(f);
+  }
+  const bool justify = blockAlign == XHTML_ALIGN_JUSTIFY && !lastOfBlock && gaps > 0;
+  if (blockAlign == XHTML_ALIGN_CENTER) {
+    x += extra / 2;
+  } else if (blockAlign == XHTML_ALIGN_RIGHT) {
+    x += extra;
+  }
+
+  Line& line = lines[lineCount++];
+  line = {lineStart, lineFragments, x, y, available, height, LINE_TEXT,
+          firstLineOfBlock && blockKind == XHTML_LIST_ITEM};
+
+  // Justified lines spread the slack over the gaps, the first `extra % gaps` gaps get one pixel more
+  position = lineStart;
+  uint16_t gap = 0;
+  for (uint16_t i = 0; i < lineFragments; i++) {
+    Fragment* f = reinterpret_cast<Fragment*>(arena.data() + position);
+    if (i > 0 && (f->flags & FRAGMENT_SPACE_BEFORE)) {
+      x += font->getAdvance(' ', f->style);
+      if (justify) {
+        x += extra / gaps + (gap < extra % gaps ? 1 : 0);
+      }
+      gap++;
+    }
+    f->x = x;
+    x += f->width;
+    position += fragmentSize(f);
+  }
+
+  y += height;
+  linesInBlock++;
+  firstLineOfBlock = false;
+  lineFragments = 0;
+  lineNaturalWidth = 0;
+}
+
+void Paginator::dropLine() {
+  if (lineFragments > 0) {
+    if (wordFragments > 0) {
+      // Keep the word that wrapped, moving it down over the dropped line
+      const uint32_t delta = wordStart - lineStart;
+      memmove(arena.data() + lineStart, arena.data() + wordStart, arena.mark() - wordStart);
+      arena.release(arena.mark() - delta);
+      wordStart -= delta;
+      fragment -= delta;
+    } else {
+      arena.release(lineStart);
+    }
+  }
+  lineFragments = 0;
+  lineNaturalWidth = 0;
+}
+
+void Paginator::addImage(const char* src, const size_t length) {
+  endWord();
+  if (lineFragments > 0) {
+    finishLine(true);
+  }
+  uint16_t width;
+  uint16_t height;
+  if (full || !imageMeasure || !imageMeasure(src, length, width, height, imageContext) || width == 0 ||
+      height == 0) {
+    return;
+  }
+
+  // Scale down to fit the text column and the page
+  const uint16_t maxWidth =
+      display->getDisplayWidth() - settings.marginLeft - settings.marginRight - blockIndent;
+  const uint16_t maxHeight = display->getDisplayHeight() - settings.marginTop - settings.marginBottom;
+  if (width > maxWidth) {
+    height = static_cast<uint32_t>(height) * maxWidth / width;
+    width = maxWidth;
+  }
+  if (height > maxHeight) {
+    width = static_cast<uint32_t>(width) * maxHeight / height;
+    height = maxHeight;
+  }
+  if (width == 0 || height == 0) {
+    return;
+  }
+
+  firstLineOfBlock = false;
+  if (skipRemaining > 0) {
+    skipRemaining--;
+    linesInBlock++;
+    return;
+  }
+  if (!reserve(height)) {
+    return;
+  }
+  char* copy = static_cast<char*>(arena.allocate(length, 1));
+  if (!copy) {
+    pageFull();
+    return;
+  }
+  memcpy(copy, src, length);
+  const int16_t x = settings.marginLeft + blockIndent + (maxWidth - width) / 2;
+  lines[lineCount++] = {static_cast<uint32_t>(copy - reinterpret_cast<char*>(arena.data())),
+                        static_cast<uint16_t>(length), x, y, width, height, LINE_IMAGE, false};
+  y += height;
+  linesInBlock++;
+}
+
+void Paginator::addRule() {
+  const uint16_t height = lineHeight();
+  if (!reserve(height)) {
+    return;
+  }
+  const uint16_t contentWidth = display->getDisplayWidth() - settings.marginLeft - settings.marginRight;
+  lines[lineCount++] = {0, 0, static_cast<int16_t>(settings.marginLeft + contentWidth / 4), y,
+                        static_cast<uint16_t>(contentWidth / 2), height, LINE_RULE, false};
+  y += height;
+}
+
+bool Paginator::reserve(const uint16_t height) {
+  if (lineCount == MAX_LINES) {
+    pageFull();
+    return false;
+  }
+  const uint16_t spacing = lineCount > 0 ? spacingBefore : 0;
+  const int16_t bottom = display->getDisplayHeight() - settings.marginBottom;
+  // An empty page takes whatever comes, so every page makes progress
+  if (lineCount > 0 && y + spacing + height > bottom) {
+    pageFull();
+    return false;
+  }
+  y += spacing;
+  spacingBefore = 0;
+  return true;
+}
+
+void Paginator::pageFull() {
+  full = true;
+  next.chapter = currentChapter;
+  next.skipLines = linesInBlock;
+  next.state = blockState;
+  tokenizer.pause();
+}
+
+uint16_t Paginator::lineWidth() const {
+  const uint16_t contentWidth = display->getDisplayWidth() - settings.marginLeft - settings.marginRight;
+  uint16_t width = contentWidth - blockIndent;
+  const bool indentFirst = blockKind == XHTML_PARAGRAPH &&
+                           (blockAlign == XHTML_ALIGN_JUSTIFY || blockAlign == XHTML_ALIGN_LEFT);
+  if (firstLineOfBlock && indentFirst && width > settings.firstLineIndent) {
+    width -= settings.firstLineIndent;
+  }
+  return width;
+}
+
+uint16_t Paginator::lineHeight() const {
+  return static_cast<uint32_t>(font->getLineHeight()) * settings.lineSpacing / 100;
+}
+
+void Paginator::drawPage() {
+  uint8_t* frameBuffer = display->getFrameBuffer();
+  const uint16_t width = display->getDisplayWidth();
+  const uint16_t height = display->getDisplayHeight();
+  const uint16_t ascent = font->getAscent();
+
+  for (size_t i = 0; i < lineCount; i++) {
+    const Line& line = lines[i];
+    if (line.type == LINE_RULE) {
+      drawHorizontalLine(frameBuffer, width, height, line.x, line.x + line.width, line.y + line.height / 2);
+      continue;
+    }
+    if (line.type == LINE_IMAGE) {
+      if (imageRenderer) {
+        imageRenderer(frameBuffer, line.x, line.y, line.width, line.height,
+                      reinterpret_cast<const char*>(arena.data() + line.first), line.count, imageContext);
+      }
+      continue;
+    }
+
+    // Extra line spacing is split above and below the text
+    const int16_t baseline = line.y + (line.height - static_cast<int16_t>(font->getLineHeight())) / 2 + ascent;
+    uint32_t position = line.first;
+    for (uint16_t f = 0; f < line.count; f++) {
+      const Fragment* fragment = reinterpret_cast<const Fragment*>(arena.data() + position);
+      const char* text = reinterpret_cast<const char*>(fragment) + sizeof(Fragment);
+      if (f == 0 && line.bullet) {
+        const int16_t bulletX = fragment->x - font->getAdvance(BULLET, fragment->style) -
+                                font->getAdvance(' ', fragment->style);
+        font->drawGlyph(frameBuffer, width, height, bulletX, baseline, BULLET, fragment->style);
+      }
+
+      int16_t glyphY = baseline;
+      if (fragment->style & XHTML_SUPERSCRIPT) {
+        glyphY -= ascent / 3;
+      } else if (fragment->style & XHTML_SUBSCRIPT) {
+        glyphY += ascent / 4;
+      }
+      int16_t x = fragment->x;
+      uint32_t previous = 0;
+      size_t k = 0;
+      while (k < fragment->length) {
+        size_t size;
+        const uint32_t codepoint = BitmapFont::decodeUtf8(text + k, fragment->length - k, size);
+        if (previous) {
+          x += font->getKerning(previous, codepoint, fragment->style);
+        }
+        font->drawGlyph(frameBuffer, width, height, x, glyphY, codepoint, fragment->style);
+        x += font->getAdvance(codepoint, fragment->style);
+        previous = codepoint;
+        k += size;
+      }
+      if (fragment->style & XHTML_UNDERLINE) {
+        drawHorizontalLine(frameBuffer, width, height, fragment->x, fragment->x + fragment->width, glyphY + 2);
+      }
+      if (fragment->style & XHTML_STRIKE) {
+        drawHorizontalLine(frameBuffer, width, height, fragment->x, fragment->x + fragment->width,
+                           glyphY - ascent / 3);
+      }
+      position += fragmentSize(fragment);
+    }
+  }
+}
+
+bool Paginator::readRecord(const uint32_t page, PageStart& start) {
+  uint8_t record[RECORD_SIZE];
+  if (page >= pageCount || !index.seekSet(HEADER_SIZE + static_cast<uint64_t>(page) * RECORD_SIZE) ||
+      index.read(record, RECORD_SIZE) != static_cast<int>(RECORD_SIZE)) {
+    if (Serial) Serial.printf("[%lu] [PAG] Failed to read page %lu\n", millis(), static_cast<unsigned long>(page));
+    return false;
+  }
+  start.chapter = get16(record);
+  start.skipLines = get16(record + 2);
+  start.state.offset = get32(record + 4);
+  start.state.depth = record[8];
+  memcpy(start.state.frames, record + 9, sizeof(start.state.frames));
+  start.state.continued = record[RECORD_CONTINUED];
+  if (start.chapter >= chapterCount || start.state.depth > XhtmlTokenizer::RESUME_FRAMES) {
+    if (Serial) Serial.printf("[%lu] [PAG] Corrupt record for page %lu\n", millis(), static_cast<unsigned long>(page));
+    return false;
+  }
+  return true;
+}
+
+bool Paginator::appendRecord(const PageStart& start) {
+  static_assert(RECORD_CONTINUED < RECORD_SIZE, "record too small");
+  uint8_t record[RECORD_SIZE] = {};
+  put16(record, start.chapter);
+  put16(record + 2, start.skipLines);
+  put32(record + 4, start.state.offset);
+  record[8] = start.state.depth;
+  memcpy(record + 9, start.state.frames, sizeof(start.state.frames));
+  record[RECORD_CONTINUED] = start.state.continued;
+  if (!index.seekSet(HEADER_SIZE + static_cast<uint64_t>(pageCount) * RECORD_SIZE) ||
+      index.write(record, RECORD_SIZE) != RECORD_SIZE) {
+    if (Serial) Serial.printf("[%lu] [PAG] Failed to append to page index\n", millis());
+    return false;
+  }
+  pageCount++;
+  if (++unsyncedRecords >= SYNC_EVERY) {
+    index.sync();
+    unsyncedRecords = 0;
+  }
+  return true;
+}
+
+bool Paginator::writeHeader() {
+  uint8_t header[HEADER_SIZE] = {};
+  memcpy(header, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  put32(header + 4, layoutKey);
+  put16(header + 8, chapterCount);
+  header[10] = complete ? 1 : 0;
+  put32(header + 12, bookId);
+  put64(header + 16, bookPathHash);
+  if (!index.seekSet(0) || index.write(header, HEADER_SIZE) != HEADER_SIZE) {
+    if (Serial) Serial.printf("[%lu] [PAG] Failed to write page index header\n", millis());
+    return false;
+  }
+  return true;
+}
+
+void Paginator::resetIndex() {
+  layoutKey = computeLayoutKey();
+  pageCount = 0;
+  complete = false;
+  unsyncedRecords = 0;
+  // Page 0 starts at the top of the first chapter
+  const PageStart first = {};
+  if (!index.truncate(0) || !writeHeader() || !appendRecord(first)) {
+    if (Serial) Serial.printf("[%lu] [PAG] Failed to reset page index %s\n", millis(), indexPath);
+    pageCount = 0;
+    return;
+  }
+  index.sync();
+  unsyncedRecords = 0;
+}
+
+uint32_t Paginator::computeLayoutKey() const {
+  uint8_t key[28];
+  put32(key, LAYOUT_VERSION);
+  put32(key + 4, font ? font->getId() : 0);
+  put16(key + 8, display ? display->getDisplayWidth() : 0);
+  put16(key + 10, display ? display->getDisplayHeight() : 0);
+  put16(key + 12, settings.marginTop);
+  put16(key + 14, settings.marginRight);
+  put16(key + 16, settings.marginBottom);
+  put16(key + 18, settings.marginLeft);
+  key[20] = settings.lineSpacing;
+  key[21] = settings.paragraphSpacing;
+  key[22] = settings.firstLineIndent;
+  key[23] = settings.indentStep;
+  key[24] = settings.justify ? 1 : 0;
+  key[25] = key[26] = key[27] = 0;
+  return fnv1a(key, sizeof(key));
+}
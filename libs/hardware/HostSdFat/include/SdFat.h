@@ -0,0 +1,164 @@
+#pragma once
+
+/**
+ * Host stand-in for the subset of SdFat used by SDCardManager and the libraries built on it, for native builds.
+ *
+ * The "card" is a directory on the host (see HostSd::setRoot()). Every operation is charged against a simple card
+ * model, so benchmarks are reproducible regardless of the host's disk and page cache:
+ *  - like SdFat, partial sector accesses go through a one sector cache, whole sectors are transferred directly
+ *  - every card command costs `commandMicros`, every sector moved costs `sectorMicros`
+ *  - opening a path reads one directory sector per path component
+ * The modelled time accumulates in HostSd::stats(); with `sleep` set the time is also spent for real.
+ */
+
+#include <fcntl.h>
+
+// Like the real SdFat, pull in the Arduino core (here the host's stand-in) when one is available
+#if __has_include(<Arduino.h>)
+#include <Arduino.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef int oflag_t;
+#ifndef O_AT_END
+#define O_AT_END O_APPEND
+#endif
+
+#define SHARED_SPI 0
+#define DEDICATED_SPI 1
+#define SD_SCK_MHZ(maxMhz) (1000000UL * (maxMhz))
+
+#define FS_DATE_YEAR(d) (1980 + ((d) >> 9))
+#define FS_DATE_MONTH(d) (((d) >> 5) & 0XF)
+#define FS_DATE_DAY(d) ((d) & 0X1F)
+#define FS_TIME_HOUR(t) ((t) >> 11)
+#define FS_TIME_MINUTE(t) (((t) >> 5) & 0X3F)
+#define FS_TIME_SECOND(t) (2 * ((t) & 0X1F))
+
+namespace HostSd {
+struct Latency {
+  uint32_t commandMicros = 0;  // Fixed cost of each card command
+  uint32_t sectorMicros = 0;   // Cost of each 512 byte sector transferred
+  bool sleep = false;          // Also spend the modelled time for real
+};
+
+struct Stats {
+  uint64_t commands = 0;
+  uint64_t sectorsRead = 0;
+  uint64_t sectorsWritten = 0;
+  uint64_t bytesRead = 0;  // As requested by the caller
+  uint64_t bytesWritten = 0;
+  uint64_t opens = 0;
+  uint64_t simulatedMicros = 0;
+};
+
+// Directory that stands in for the card root, must exist before SdFat::begin()
+void setRoot(const char* directory);
+const char* getRoot();
+void setLatency(const Latency& latency);
+void setBytesPerCluster(uint32_t bytes);
+const Stats& stats();
+void resetStats();
+}  // namespace HostSd
+
+struct SdSpiConfig {
+  SdSpiConfig(uint8_t cs, uint8_t options, uint32_t maxSck, void* spi = nullptr) : csPin(cs), maxSck(maxSck) {
+    (void)options;
+    (void)spi;
+  }
+  uint8_t csPin;
+  uint32_t maxSck;
+};
+
+class FsFile {
+ public:
+  FsFile() = default;
+  FsFile(const FsFile& other);
+  FsFile& operator=(const FsFile& other);
+  ~FsFile();
+
+  explicit operator bool() const { return isOpen(); }
+  bool isOpen() const { return fd >= 0 || directory; }
+  bool isDirectory() const { return directory; }
+  bool isDir() const { return directory; }
+  bool isFile() const { return fd >= 0; }
+  bool isHidden() const;
+
+  bool open(const char* path, oflag_t oflag = O_RDONLY);
+  bool open(FsFile* dir, const char* path, oflag_t oflag = O_RDONLY);
+  bool open(FsFile* dir, uint32_t index, oflag_t oflag = O_RDONLY);
+  bool openNext(FsFile* dir, oflag_t oflag = O_RDONLY);
+  FsFile openNextFile(oflag_t oflag = O_RDONLY);
+  bool close();
+
+  size_t getName(char* name, size_t size);
+  uint32_t dirIndex() const { return index; }
+  // The host inode stands in for the first cluster, a file replaced by a rename gets a new one
+  uint32_t firstSector() const { return static_cast<uint32_t>(fileId); }
+  bool getModifyDateTime(uint16_t* pdate, uint16_t* ptime);
+  bool getCreateDateTime(uint16_t* pdate, uint16_t* ptime) { return getModifyDateTime(pdate, ptime); }
+
+  int read();
+  int read(void* buf, size_t count);
+  int peek();
+  int available();
+  size_t write(uint8_t b) { return write(&b, 1); }
+  size_t write(const void* buf, size_t count);
+  size_t write(const char* str);
+
+  bool seek(uint64_t pos) { return seekSet(pos); }
+  bool seekSet(uint64_t pos);
+  bool seekCur(int64_t offset) { return seekSet(curPosition() + offset); }
+  bool seekEnd(int64_t offset = 0) { return seekSet(fileSize() + offset); }
+  void rewind() { seekSet(0); }
+  bool rewindDirectory() { return directory && seekSet(0); }
+  uint64_t curPosition() const { return pos; }
+  uint64_t position() const { return pos; }
+  uint64_t fileSize() const;
+  uint64_t size() const { return fileSize(); }
+
+  bool sync();
+  bool flush() { return sync(); }
+  bool preAllocate(uint64_t length);
+  bool truncate();
+  bool truncate(uint64_t length);
+  bool rename(const char* newPath);
+  bool remove();
+  bool rmdir();
+  bool isBusy() { return false; }
+
+ private:
+  friend class SdFat;
+
+  bool openHost(const std::string& hostPath, oflag_t oflag);
+  void loadEntries();
+
+  int fd = -1;
+  uint64_t fileId = 0;  // Host inode, identifies the file in the modelled sector cache
+  bool directory = false;
+  bool writable = false;
+  bool entryDirty = false;  // Size or data changed, sync() rewrites the directory entry
+  std::string hostPath;
+  uint64_t pos = 0;
+  uint32_t index = 0;                // Slot of this entry in its parent's listing
+  std::vector<std::string> entries;  // Directory listing, snapshot taken on open
+};
+
+class SdFat {
+ public:
+  bool begin(uint8_t csPin = 0, uint32_t maxSck = 0);
+  bool begin(SdSpiConfig config) { return begin(config.csPin, config.maxSck); }
+  void end() {}
+
+  FsFile open(const char* path, oflag_t oflag = O_RDONLY);
+  bool exists(const char* path);
+  bool mkdir(const char* path, bool pFlag = true);
+  bool remove(const char* path);
+  bool rmdir(const char* path);
+  bool rename(const char* oldPath, const char* newPath);
+  uint32_t bytesPerCluster() const;
+};
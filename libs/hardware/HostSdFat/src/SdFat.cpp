@@ -0,0 +1,529 @@
+#include "SdFat.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <ctime>
+
+namespace {
+constexpr uint64_t SECTOR_SIZE = 512;
+constexpr uint64_t DIR_ENTRY_SIZE = 32;
+constexpr uint64_t ENTRIES_PER_SECTOR = SECTOR_SIZE / DIR_ENTRY_SIZE;
+constexpr uint64_t NO_FILE = UINT64_MAX;
+
+std::string root = ".";
+HostSd::Latency latency;
+HostSd::Stats counters;
+uint32_t clusterBytes = 32768;
+
+// SdFat keeps one sector cached for partial sector accesses
+struct SectorCache {
+  uint64_t file = NO_FILE;
+  uint64_t sector = 0;
+  bool dirty = false;
+} cache;
+
+void charge(const uint64_t commands, const uint64_t sectorsRead, const uint64_t sectorsWritten) {
+  counters.commands += commands;
+  counters.sectorsRead += sectorsRead;
+  counters.sectorsWritten += sectorsWritten;
+  const uint64_t micros = commands * latency.commandMicros + (sectorsRead + sectorsWritten) * latency.sectorMicros;
+  counters.simulatedMicros += micros;
+  if (latency.sleep && micros > 0) {
+    usleep(static_cast<useconds_t>(micros));
+  }
+}
+
+void flushCache() {
+  if (cache.dirty) {
+    charge(1, 0, 1);
+    cache.dirty = false;
+  }
+}
+
+void dropCache(const uint64_t file) {
+  if (cache.file == file) {
+    flushCache();
+    cache.file = NO_FILE;
+  }
+}
+
+void cachedSector(const uint64_t file, const uint64_t sector, const bool write) {
+  if (cache.file != file || cache.sector != sector) {
+    flushCache();
+    charge(1, 1, 0);
+    cache.file = file;
+    cache.sector = sector;
+  }
+  if (write) {
+    cache.dirty = true;
+  }
+}
+
+// Charges a data transfer the way SdFat performs it: whole aligned sectors in one multi-sector command, partial
+// sectors through the cache
+void transfer(const uint64_t file, uint64_t pos, const uint64_t length, const bool write) {
+  const uint64_t end = pos + length;
+  while (pos < end) {
+    const uint64_t sector = pos / SECTOR_SIZE;
+    const uint64_t offset = pos % SECTOR_SIZE;
+    if (offset == 0 && end - pos >= SECTOR_SIZE) {
+      const uint64_t whole = (end - pos) / SECTOR_SIZE;
+      if (cache.file == file && cache.sector >= sector && cache.sector < sector + whole) {
+        // The cached copy is overwritten (write) or must reach the card first (read)
+        if (write) {
+          cache.dirty = false;
+        }
+        dropCache(file);
+      }
+      charge(1, write ? 0 : whole, write ? whole : 0);
+      pos += whole * SECTOR_SIZE;
+    } else {
+      cachedSector(file, sector, write);
+      pos += std::min(SECTOR_SIZE - offset, end - pos);
+    }
+  }
+}
+
+// Looking up a path reads one directory sector per component
+void chargePathWalk(const char* path) {
+  uint64_t components = 0;
+  bool inName = false;
+  for (const char* p = path; *p; p++) {
+    if (*p != '/' && !inName) {
+      components++;
+    }
+    inName = *p != '/';
+  }
+  charge(components, components, 0);
+}
+
+std::string hostPathFor(const char* path) {
+  std::string hostPath = root;
+  if (path[0] != '/') {
+    hostPath += '/';
+  }
+  hostPath += path;
+  while (hostPath.size() > root.size() + 1 && hostPath.back() == '/') {
+    hostPath.pop_back();
+  }
+  return hostPath;
+}
+
+bool hostExists(const std::string& hostPath, struct stat* st = nullptr) {
+  struct stat local;
+  return stat(hostPath.c_str(), st ? st : &local) == 0;
+}
+}  // namespace
+
+namespace HostSd {
+void setRoot(const char* directory) {
+  root = directory;
+  while (root.size() > 1 && root.back() == '/') {
+    root.pop_back();
+  }
+}
+const char* getRoot() { return root.c_str(); }
+void setLatency(const Latency& value) { latency = value; }
+void setBytesPerCluster(const uint32_t bytes) { clusterBytes = bytes; }
+const Stats& stats() { return counters; }
+void resetStats() { counters = {}; }
+}  // namespace HostSd
+
+FsFile::FsFile(const FsFile& other) { *this = other; }
+
+FsFile& FsFile::operator=(const FsFile& other) {
+  if (this == &other) {
+    return *this;
+  }
+  close();
+  fd = other.fd >= 0 ? dup(other.fd) : -1;
+  fileId = other.fileId;
+  directory = other.directory;
+  writable = other.writable;
+  entryDirty = false;
+  hostPath = other.hostPath;
+  pos = other.pos;
+  index = other.index;
+  entries = other.entries;
+  return *this;
+}
+
+FsFile::~FsFile() { close(); }
+
+bool FsFile::isHidden() const {
+  const size_t slash = hostPath.find_last_of('/');
+  return slash != std::string::npos && slash + 1 < hostPath.size() && hostPath[slash + 1] == '.';
+}
+
+bool FsFile::openHost(const std::string& path, const oflag_t oflag) {
+  close();
+  const int access = oflag & O_ACCMODE;
+  struct stat st;
+  const bool existed = hostExists(path, &st);
+
+  if (existed && S_ISDIR(st.st_mode)) {
+    // Like SdFat, directories can only be opened for reading
+    if (access != O_RDONLY) {
+      return false;
+    }
+    directory = true;
+    hostPath = path;
+    fileId = st.st_ino;
+    loadEntries();
+  } else {
+    // Writes always go to pos, so O_APPEND must not reach the host
+    const int flags = oflag & (O_ACCMODE | O_CREAT | O_TRUNC | O_EXCL);
+    fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+      return false;
+    }
+    fstat(fd, &st);
+    hostPath = path;
+    fileId = st.st_ino;
+    writable = access != O_RDONLY;
+    pos = (oflag & O_AT_END) ? static_cast<uint64_t>(st.st_size) : 0;
+    if (!existed || (oflag & O_TRUNC)) {
+      dropCache(fileId);
+      charge(1, 0, 1);  // New or truncated directory entry
+    }
+  }
+
+  counters.opens++;
+  return true;
+}
+
+// Snapshot of the directory in a stable order. Entries removed later are skipped by openNext().
+void FsFile::loadEntries() {
+  entries.clear();
+  DIR* dir = opendir(hostPath.c_str());
+  if (!dir) {
+    return;
+  }
+  while (const dirent* entry = readdir(dir)) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      entries.emplace_back(entry->d_name);
+    }
+  }
+  closedir(dir);
+  std::sort(entries.begin(), entries.end());
+}
+
+bool FsFile::open(const char* path, const oflag_t oflag) {
+  chargePathWalk(path);
+  return openHost(hostPathFor(path), oflag);
+}
+
+bool FsFile::open(FsFile* dir, const char* path, const oflag_t oflag) {
+  if (!dir || !dir->directory) {
+    return false;
+  }
+  chargePathWalk(path);
+  return openHost(dir->hostPath + "/" + path, oflag);
+}
+
+bool FsFile::open(FsFile* dir, const uint32_t entryIndex, const oflag_t oflag) {
+  if (!dir || !dir->directory || entryIndex >= dir->entries.size()) {
+    return false;
+  }
+  charge(1, 1, 0);
+  if (!openHost(dir->hostPath + "/" + dir->entries[entryIndex], oflag)) {
+    return false;
+  }
+  index = entryIndex;
+  return true;
+}
+
+bool FsFile::openNext(FsFile* dir, const oflag_t oflag) {
+  if (!dir || !dir->directory) {
+    return false;
+  }
+  close();
+  while (dir->pos / DIR_ENTRY_SIZE < dir->entries.size()) {
+    const uint32_t slot = static_cast<uint32_t>(dir->pos / DIR_ENTRY_SIZE);
+    dir->pos += DIR_ENTRY_SIZE;
+    if (slot % ENTRIES_PER_SECTOR == 0) {
+      charge(1, 1, 0);
+    }
+    const std::string path = dir->hostPath + "/" + dir->entries[slot];
+    if (hostExists(path) && openHost(path, oflag)) {
+      index = slot;
+      return true;
+    }
+  }
+  return false;
+}
+
+FsFile FsFile::openNextFile(const oflag_t oflag) {
+  FsFile next;
+  next.openNext(this, oflag);
+  return next;
+}
+
+bool FsFile::close() {
+  if (!isOpen()) {
+    return false;
+  }
+  if (writable) {
+    sync();
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  fd = -1;
+  directory = false;
+  writable = false;
+  entryDirty = false;
+  pos = 0;
+  entries.clear();
+  return true;
+}
+
+size_t FsFile::getName(char* name, const size_t size) {
+  if (!isOpen() || size == 0) {
+    return 0;
+  }
+  const size_t slash = hostPath.find_last_of('/');
+  const std::string base = hostPath == root ? "/" : hostPath.substr(slash + 1);
+  const size_t length = std::min(base.size(), size - 1);
+  memcpy(name, base.data(), length);
+  name[length] = '\0';
+  return length;
+}
+
+bool FsFile::getModifyDateTime(uint16_t* pdate, uint16_t* ptime) {
+  struct stat st;
+  if (!isOpen() || stat(hostPath.c_str(), &st) != 0) {
+    return false;
+  }
+  struct tm local;
+  localtime_r(&st.st_mtime, &local);
+  *pdate = static_cast<uint16_t>(((local.tm_year - 80) << 9) | ((local.tm_mon + 1) << 5) | local.tm_mday);
+  *ptime = static_cast<uint16_t>((local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2));
+  return true;
+}
+
+int FsFile::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int FsFile::read(void* buf, size_t count) {
+  if (fd < 0) {
+    return -1;
+  }
+  const uint64_t size = fileSize();
+  if (pos >= size) {
+    return 0;
+  }
+  count = static_cast<size_t>(std::min<uint64_t>(count, size - pos));
+  count = std::min<size_t>(count, INT_MAX);
+  const ssize_t r = pread(fd, buf, count, static_cast<off_t>(pos));
+  if (r < 0) {
+    return -1;
+  }
+  transfer(fileId, pos, static_cast<uint64_t>(r), false);
+  counters.bytesRead += r;
+  pos += r;
+  return static_cast<int>(r);
+}
+
+int FsFile::peek() {
+  const uint64_t start = pos;
+  const int b = read();
+  pos = start;
+  return b;
+}
+
+int FsFile::available() {
+  if (fd < 0) {
+    return 0;
+  }
+  const uint64_t size = fileSize();
+  return pos >= size ? 0 : static_cast<int>(std::min<uint64_t>(size - pos, INT_MAX));
+}
+
+size_t FsFile::write(const void* buf, const size_t count) {
+  if (fd < 0 || !writable) {
+    return 0;
+  }
+  const ssize_t r = pwrite(fd, buf, count, static_cast<off_t>(pos));
+  if (r < 0) {
+    return 0;
+  }
+  transfer(fileId, pos, static_cast<uint64_t>(r), true);
+  counters.bytesWritten += r;
+  pos += r;
+  entryDirty = true;
+  return static_cast<size_t>(r);
+}
+
+size_t FsFile::write(const char* str) { return write(str, strlen(str)); }
+
+bool FsFile::seekSet(const uint64_t newPos) {
+  if (directory) {
+    pos = newPos;
+    return true;
+  }
+  // SdFat cannot seek past the end of a file
+  if (fd < 0 || newPos > fileSize()) {
+    return false;
+  }
+  pos = newPos;
+  return true;
+}
+
+uint64_t FsFile::fileSize() const {
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(st.st_size);
+}
+
+bool FsFile::sync() {
+  if (fd < 0) {
+    return false;
+  }
+  if (cache.file == fileId) {
+    flushCache();
+  }
+  if (entryDirty) {
+    charge(1, 0, 1);
+    entryDirty = false;
+  }
+  return true;
+}
+
+bool FsFile::preAllocate(const uint64_t length) {
+  // Only an empty file can be preallocated, its size then covers the whole allocation
+  if (fd < 0 || !writable || fileSize() != 0 || ftruncate(fd, static_cast<off_t>(length)) != 0) {
+    return false;
+  }
+  const uint64_t clusters = (length + clusterBytes - 1) / clusterBytes;
+  charge(1, 0, (clusters * 4 + SECTOR_SIZE - 1) / SECTOR_SIZE);  // FAT chain
+  entryDirty = true;
+  return true;
+}
+
+bool FsFile::truncate() { return truncate(pos); }
+
+bool FsFile::truncate(const uint64_t length) {
+  if (fd < 0 || !writable || ftruncate(fd, static_cast<off_t>(length)) != 0) {
+    return false;
+  }
+  pos = std::min(pos, length);
+  dropCache(fileId);
+  charge(1, 0, 1);
+  entryDirty = true;
+  return true;
+}
+
+bool FsFile::rename(const char* newPath) {
+  const std::string target = hostPathFor(newPath);
+  chargePathWalk(newPath);
+  if (!isOpen() || hostExists(target) || ::rename(hostPath.c_str(), target.c_str()) != 0) {
+    return false;
+  }
+  charge(1, 0, 2);
+  hostPath = target;
+  return true;
+}
+
+bool FsFile::remove() {
+  if (fd < 0 || !writable || unlink(hostPath.c_str()) != 0) {
+    return false;
+  }
+  dropCache(fileId);
+  charge(1, 0, 1);
+  entryDirty = false;
+  close();
+  return true;
+}
+
+bool FsFile::rmdir() {
+  if (!directory || ::rmdir(hostPath.c_str()) != 0) {
+    return false;
+  }
+  charge(1, 0, 1);
+  close();
+  return true;
+}
+
+bool SdFat::begin(uint8_t, uint32_t) {
+  struct stat st;
+  return stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+FsFile SdFat::open(const char* path, const oflag_t oflag) {
+  FsFile file;
+  file.open(path, oflag);
+  return file;
+}
+
+bool SdFat::exists(const char* path) {
+  chargePathWalk(path);
+  return hostExists(hostPathFor(path));
+}
+
+bool SdFat::mkdir(const char* path, const bool pFlag) {
+  chargePathWalk(path);
+  const std::string target = hostPathFor(path);
+  if (pFlag) {
+    // Create missing parents first, like SdFat with pFlag
+    for (size_t slash = target.find('/', root.size() + 1); slash != std::string::npos;
+         slash = target.find('/', slash + 1)) {
+      const std::string parent = target.substr(0, slash);
+      if (!hostExists(parent)) {
+        if (::mkdir(parent.c_str(), 0755) != 0) {
+          return false;
+        }
+        charge(1, 0, 2);
+      }
+    }
+  }
+  if (::mkdir(target.c_str(), 0755) != 0) {
+    return false;
+  }
+  charge(1, 0, 2);  // Parent entry and the new directory's first sector
+  return true;
+}
+
+bool SdFat::remove(const char* path) {
+  chargePathWalk(path);
+  struct stat st;
+  const std::string target = hostPathFor(path);
+  if (!hostExists(target, &st) || S_ISDIR(st.st_mode) || unlink(target.c_str()) != 0) {
+    return false;
+  }
+  dropCache(st.st_ino);
+  charge(1, 0, 1);
+  return true;
+}
+
+bool SdFat::rmdir(const char* path) {
+  chargePathWalk(path);
+  if (::rmdir(hostPathFor(path).c_str()) != 0) {
+    return false;
+  }
+  charge(1, 0, 1);
+  return true;
+}
+
+bool SdFat::rename(const char* oldPath, const char* newPath) {
+  chargePathWalk(oldPath);
+  chargePathWalk(newPath);
+  // SdFat refuses to replace an existing file
+  const std::string target = hostPathFor(newPath);
+  if (hostExists(target) || ::rename(hostPathFor(oldPath).c_str(), target.c_str()) != 0) {
+    return false;
+  }
+  charge(1, 0, 2);
+  return true;
+}
+
+uint32_t SdFat::bytesPerCluster() const { return clusterBytes; }
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Field helpers for the files the libraries keep on the card (indexes, caches, logs) and the formats they read.
+ *
+ * Fields are stored in the CPU's byte order, little-endian on the ESP32 and on hosts the tests run on. FNV-1a keys
+ * cache files and entries; CRC-32 is the IEEE one used by ZIP, so it also checks inflated entries.
+ */
+namespace BinaryIO {
+constexpr uint32_t FNV_OFFSET = 2166136261u;
+constexpr uint64_t FNV64_OFFSET = 14695981039346656037ull;
+constexpr uint32_t CRC_INIT = 0xFFFFFFFF;
+
+inline void put16(uint8_t* p, const uint16_t v) { memcpy(p, &v, sizeof(v)); }
+inline void put32(uint8_t* p, const uint32_t v) { memcpy(p, &v, sizeof(v)); }
+inline void put64(uint8_t* p, const uint64_t v) { memcpy(p, &v, sizeof(v)); }
+inline uint16_t get16(const uint8_t* p) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+inline uint32_t get32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+inline uint64_t get64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Pass the previous result as `hash` to hash several fields as one
+inline uint32_t fnv1a(const void* data, const size_t length, uint32_t hash = FNV_OFFSET) {
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+inline uint64_t fnv1a64(const void* data, const size_t length, uint64_t hash = FNV64_OFFSET) {
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// Start from CRC_INIT and xor the result with CRC_INIT. One nibble at a time keeps the table at 64 bytes.
+inline uint32_t crc32(uint32_t crc, const void* data, const size_t length) {
+  static constexpr uint32_t TABLE[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+                                         0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+                                         0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < length; i++) {
+    crc = TABLE[(crc ^ bytes[i]) & 0x0F] ^ (crc >> 4);
+    crc = TABLE[(crc ^ (bytes[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return crc;
+}
+}  // namespace BinaryIO
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <SDCardManager.h>
+
+// Default number of 4 KB pages, override with a build flag to trade RAM for fewer card reads
+#ifndef SD_BLOCK_CACHE_PAGES
+#define SD_BLOCK_CACHE_PAGES 8
+#endif
+
+/**
+ * Fixed pool of 4 KB pages caching file contents for scattered random reads (font glyphs, ZIP central directories,
+ * dictionary indexes). Pages are keyed by file and offset and evicted least recently used first.
+ *
+ * Files are identified by path, size, modify time and first cluster. The device has no clock, so every file it writes
+ * gets the same time; a file rewritten through SDCardManager (writeFile(), BufferedWriter, open for writing, remove,
+ * rename) therefore also drops its pages by path. Files changed behind the manager's back need invalidatePath().
+ * The cache is not thread safe; use it from one task, or from the I/O worker only.
+ */
+class BlockCache {
+ public:
+  static constexpr size_t PAGE_SIZE = 4096;
+
+  BlockCache() = default;
+  ~BlockCache();
+
+  BlockCache(const BlockCache&) = delete;
+  BlockCache& operator=(const BlockCache&) = delete;
+
+  // Allocates the page pool, returns false if the allocation failed
+  bool begin(size_t pageCount = SD_BLOCK_CACHE_PAGES);
+  void end();
+
+  /**
+   * Reads `length` bytes at `offset` of `file` through the cache.
+   *
+   * @param file the open file, its position is changed on a miss
+   * @param fileKey identifies the file, see CachedFile
+   * @return bytes read, short at the end of the file
+   */
+  size_t read(FsFile& file, uint64_t fileKey, uint64_t offset, void* out, size_t length);
+
+  // Drops all pages of one file
+  void invalidate(uint64_t fileKey);
+  // Drops the pages of every version of the file at `path`
+  void invalidatePath(const char* path);
+  void clear();
+
+  size_t getPageCount() const { return pageCount; }
+  uint32_t getHits() const { return hits; }
+  uint32_t getMisses() const { return misses; }
+  void resetStats() { hits = misses = 0; }
+
+  static BlockCache& getInstance() { return instance; }
+
+ private:
+  struct Page {
+    uint64_t fileKey;
+    uint32_t index;  // Page number within the file
+    uint32_t lastUse;
+    uint16_t length;  // Short for the last page of a file
+    bool valid;
+  };
+
+  static BlockCache instance;
+
+  friend class CachedFile;
+  // The upper half of a file key is the hash of its path
+  static uint32_t pathHash(const char* path);
+
+  const uint8_t* page(FsFile& file, uint64_t fileKey, uint32_t index, uint16_t& length);
+
+  uint8_t* pool = nullptr;
+  Page* pages = nullptr;
+  size_t pageCount = 0;
+  uint32_t clock = 0;
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+};
+
+/**
+ * Read-only file with pread-style access through a BlockCache.
+ */
+class CachedFile {
+ public:
+  explicit CachedFile(BlockCache& cache = BlockCache::getInstance()) : cache(cache) {}
+  ~CachedFile() { close(); }
+
+  CachedFile(const CachedFile&) = delete;
+  CachedFile& operator=(const CachedFile&) = delete;
+
+  bool open(const char* path, SDCardManager& sd = SdMan);
+  void close();
+  bool isOpen() const { return static_cast<bool>(file); }
+
+  // Reads up to `length` bytes at `offset` without moving the sequential position
+  size_t pread(void* out, size_t length, uint64_t offset);
+  // Sequential read from the current position
+  size_t read(void* out, size_t length);
+  bool seek(uint64_t position);
+  uint64_t position() const { return pos; }
+  uint64_t size() const { return fileSize; }
+
+ private:
+  BlockCache& cache;
+  FsFile file;
+  uint64_t fileKey = 0;
+  uint64_t fileSize = 0;
+  uint64_t pos = 0;
+};
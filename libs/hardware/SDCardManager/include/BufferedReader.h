@@ -0,0 +1,73 @@
+#pragma once
+
+#include <SDCardManager.h>
+
+/**
+ * Buffered sequential reader for files on the SD card.
+ *
+ * All card reads start on a sector boundary and cover whole sectors, so SdFat can transfer them straight into the
+ * buffer (or the caller's memory for large reads) without going through its own sector cache. The read-ahead window
+ * starts at one sector and doubles with every sequential refill up to `maxSectors`; a seek drops it back to one sector
+ * so random access does not pay for data it throws away.
+ *
+ * read()/peek() on buffered data are inline and never touch the file.
+ */
+class BufferedReader {
+ public:
+  static constexpr size_t SECTOR_SIZE = 512;
+  static constexpr size_t DEFAULT_MAX_SECTORS = 8;
+
+  explicit BufferedReader(size_t maxSectors = DEFAULT_MAX_SECTORS);
+  ~BufferedReader();
+
+  BufferedReader(const BufferedReader&) = delete;
+  BufferedReader& operator=(const BufferedReader&) = delete;
+
+  // Opens `path` for reading, the reader owns the file until close()
+  bool open(const char* path, SDCardManager& sd = SdMan);
+  // Reads from an already open file, which must stay open while in use. Reading starts at the file's current position.
+  bool attach(FsFile& file);
+  void close();
+  bool isOpen() const { return file != nullptr; }
+
+  // Next byte, or -1 at the end of the file
+  int read() { return pos < len ? buffer[pos++] : refillAndRead(); }
+  // Next byte without consuming it, or -1 at the end of the file
+  int peek() { return pos < len ? buffer[pos] : refillAndPeek(); }
+  // Reads up to `length` bytes, returns the number of bytes read
+  size_t read(void* out, size_t length);
+
+  /**
+   * Reads one line, without the line ending ("\n" or "\r\n"). A line longer than `lineSize - 1` is truncated and the
+   * rest of it is skipped.
+   *
+   * @param line receives the null-terminated line
+   * @param lineSize size of `line` in bytes
+   * @return the stored line length, or -1 at the end of the file
+   */
+  int readLine(char* line, size_t lineSize);
+
+  // Skips `length` bytes, returns the number of bytes actually skipped
+  size_t skip(size_t length);
+
+  bool seek(uint64_t position);
+  uint64_t position() const { return bufferStart + pos; }
+  uint64_t size() const { return fileSize; }
+  bool eof() { return peek() < 0; }
+
+ private:
+  bool refill();
+  int refillAndRead();
+  int refillAndPeek();
+
+  FsFile ownFile;
+  FsFile* file = nullptr;
+  uint64_t fileSize = 0;
+
+  uint8_t* buffer = nullptr;
+  size_t maxSectors;
+  size_t windowSectors = 1;
+  uint64_t bufferStart = 0;  // File offset of buffer[0], always sector aligned
+  size_t pos = 0;
+  size_t len = 0;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <SDCardManager.h>
+
+#include <string>
+
+/**
+ * Buffered writer that replaces a file atomically.
+ *
+ * Data goes to "<path>.tmp" and is only moved over `path` by commit(), so a crash or power loss leaves either the old
+ * or the new file, never a truncated one. Writes are collected into whole sectors and flushed in large chunks; with an
+ * expected size the temp file is preallocated so it gets contiguous clusters and is not extended cluster by cluster.
+ *
+ * SdFat cannot rename over an existing file, so commit() moves the old file to "<path>.bak" first and removes it once
+ * the new file is in place. recover() finishes a commit() that was interrupted in between; SDCardManager's
+ * openFileForRead() (and so readFile()) runs it when the file turns out to be missing, code opening the file by other
+ * means should run it at startup.
+ *
+ * Writes are synchronous, on the caller's task. Write-behind through IoWorker is not implemented: its IO_WRITE syncs
+ * every request and reopens the file by path whenever reads of other files come in between, which would cost more card
+ * commands than the buffered writes here, and it has no rename for commit().
+ */
+class BufferedWriter : public Print {
+ public:
+  static constexpr size_t SECTOR_SIZE = 512;
+  static constexpr size_t DEFAULT_BUFFER_SECTORS = 8;
+
+  explicit BufferedWriter(size_t bufferSectors = DEFAULT_BUFFER_SECTORS);
+  ~BufferedWriter() override;
+
+  BufferedWriter(const BufferedWriter&) = delete;
+  BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+  /**
+   * Starts writing a new version of `path`.
+   *
+   * @param path the file to replace
+   * @param expectedSize bytes to preallocate, 0 to grow the file as needed
+   * @return true if the temp file is ready for writing
+   */
+  bool open(const char* path, uint64_t expectedSize = 0, SDCardManager& sd = SdMan);
+
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* data, size_t length) override;
+  using Print::write;
+
+  // Flushes, syncs and moves the temp file over the target. The writer is closed afterwards either way.
+  bool commit();
+  // Drops everything written since open() and leaves the target untouched
+  void abort();
+
+  bool isOpen() const { return static_cast<bool>(file); }
+  // True once any write failed, commit() will then refuse to replace the target
+  bool hasError() const { return failed; }
+  uint64_t bytesWritten() const { return written; }
+
+  // Completes or rolls back an interrupted commit() for `path`, removing stale temp files
+  static void recover(const char* path, SDCardManager& sd = SdMan);
+
+ private:
+  bool flushBuffer();
+
+  SDCardManager* sd = nullptr;
+  FsFile file;
+  std::string targetPath;
+  std::string tempPath;
+  bool preallocated = false;
+  bool failed = false;
+  uint64_t written = 0;
+
+  uint8_t* buffer = nullptr;
+  size_t capacity;
+  size_t len = 0;
+};
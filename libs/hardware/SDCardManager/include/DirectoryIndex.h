@@ -0,0 +1,90 @@
+#pragma once
+
+#include <SDCardManager.h>
+
+/**
+ * Persistent, sorted index of one directory, kept on the card under /.sdcache/dirindex.
+ *
+ * Opening a directory through the index costs one sequential read of a compact file instead of a FAT walk plus an
+ * in-RAM sort. open() still walks the entries, without reading names or sorting, and rebuilds the index only if their
+ * count or metadata (size, modify time, directory slot) changed. That catches entries added, removed, renamed or
+ * rewritten by any FAT driver. Rebuilding uses an external merge sort with a fixed RAM budget, so it scales to tens of
+ * thousands of entries.
+ *
+ * Limitation: an entry renamed in place by another FAT driver, keeping its slot, only shows up when open() is called
+ * with `fullCheck`, which also hashes the names.
+ *
+ * Order: directories first, then case-insensitive by name.
+ */
+class DirectoryIndex {
+ public:
+  static constexpr size_t DEFAULT_SORT_BUFFER_SIZE = 16384;
+
+  explicit DirectoryIndex(SDCardManager& sd = SdMan, size_t sortBufferSize = DEFAULT_SORT_BUFFER_SIZE);
+  ~DirectoryIndex();
+
+  DirectoryIndex(const DirectoryIndex&) = delete;
+  DirectoryIndex& operator=(const DirectoryIndex&) = delete;
+
+  /**
+   * Opens the index for `path`, rebuilding it first if it is missing or stale.
+   *
+   * @param path the directory to index
+   * @param fullCheck also compare entry names, for entries another FAT driver may have renamed in place
+   * @return true if the index is ready to be read
+   */
+  bool open(const char* path, bool fullCheck = false);
+  void close();
+
+  // Forces a rebuild of the index for `path`, the index is left closed
+  bool rebuild(const char* path);
+
+  // Number of entries in the open index
+  uint32_t size() const { return entryCount; }
+  // True if the last open() had to rebuild the index
+  bool wasRebuilt() const { return rebuilt; }
+
+  // Positions the reader at entry `index` (0 based) in sorted order
+  bool seek(uint32_t index);
+
+  /**
+   * Reads the next entry in sorted order.
+   *
+   * @param entry filled with the entry's name and metadata
+   * @return false at the end of the index or on a read error
+   */
+  bool next(SDCardManager::DirEntry& entry);
+
+ private:
+  struct Signature {
+    uint32_t count;
+    uint32_t hash;
+    uint32_t nameHash;
+  };
+
+  bool openDirectory(const char* path, FsFile& dir);
+  static void hashEntries(FsFile& dir, Signature& signature, bool withNames);
+  bool readHeader(const char* path, Signature& stored);
+  bool build(const char* path, const Signature& signature);
+  bool buildRuns(const char* path, uint16_t& runCount, uint32_t& totalEntries);
+  bool mergeRuns(uint16_t first, uint16_t count, const char* outPath, bool finalPass, const char* dirPath,
+                 const Signature& signature, uint32_t totalEntries);
+  static void indexPathFor(const char* path, char* out, size_t outSize);
+  static void runPath(uint16_t run, char* out, size_t outSize);
+  bool readBytes(void* out, size_t length);
+
+  SDCardManager& sd;
+  size_t sortBufferSize;
+
+  FsFile file;
+  uint32_t entryCount = 0;
+  uint32_t position = 0;
+  uint32_t recordsOffset = 0;
+  uint32_t tableOffset = 0;
+  bool rebuilt = false;
+
+  // Read buffer for next()
+  uint8_t buffer[512];
+  uint16_t bufferPos = 0;
+  uint16_t bufferLen = 0;
+};
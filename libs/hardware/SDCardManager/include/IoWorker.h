@@ -0,0 +1,111 @@
+#pragma once
+
+#include <SDCardManager.h>
+
+#include <atomic>
+
+/**
+ * Background task that performs SD card reads and writes on behalf of other tasks.
+ *
+ * Callers describe an operation in an IoRequest they own (no allocation per request) and submit it; the worker fills
+ * or drains the caller's buffer, runs the request's callback and then marks it done. Foreground requests are always
+ * served before prefetches, and a queued request can be cancelled once it is no longer wanted: it is marked done with
+ * ok false and its callback does not run.
+ *
+ * While the worker runs it owns the card: other tasks must not use SDCardManager directly at the same time.
+ *
+ * On the device the worker is a FreeRTOS task and wait() blocks on the calling task's notification value; host builds
+ * (without ARDUINO) use a std::thread and a condition variable instead.
+ */
+class IoWorker {
+ public:
+  enum Operation : uint8_t { IO_READ, IO_WRITE };
+  enum Priority : uint8_t { PRIORITY_FOREGROUND, PRIORITY_PREFETCH };
+
+  struct IoRequest;
+  // Runs on the worker task once the operation finished, before the request is marked done
+  typedef void (*IoCallback)(IoRequest& request, void* context);
+
+  struct IoRequest {
+    // Filled by the caller
+    Operation operation = IO_READ;
+    Priority priority = PRIORITY_FOREGROUND;
+    const char* path = nullptr;  // Must stay valid until the request is done
+    uint64_t offset = 0;
+    uint8_t* buffer = nullptr;
+    size_t length = 0;
+    IoCallback callback = nullptr;
+    void* context = nullptr;
+
+    // Filled by the worker. `done` is stored with release order after everything else, so a task that reads it
+    // true with acquire order (as wait() does) also sees the result, the buffer contents and the callback's effects.
+    size_t result = 0;  // Bytes read or written
+    bool ok = false;
+    std::atomic<bool> done{false};
+
+    // Owned by the worker
+    IoRequest* next = nullptr;  // Queue link
+    void* waiter = nullptr;     // Task blocked in wait() on the device
+  };
+
+  explicit IoWorker(SDCardManager& sd = SdMan);
+  ~IoWorker();
+
+  IoWorker(const IoWorker&) = delete;
+  IoWorker& operator=(const IoWorker&) = delete;
+
+  /**
+   * Starts the worker task.
+   *
+   * @param taskPriority FreeRTOS priority of the worker, ignored on the host
+   * @param core core to pin the worker to, -1 for no affinity (ignored on the host)
+   */
+  bool begin(uint8_t taskPriority = 1, int8_t core = -1);
+  // Finishes the queued requests and stops the worker. Safe to call while other tasks submit, their requests are either
+  // served first or refused. The worker must not be destroyed while other tasks may still call into it.
+  void end();
+
+  /**
+   * Queues `request`. It must not be modified or destroyed until it is done.
+   *
+   * @return false if the worker is not running or the request is already queued
+   */
+  bool submit(IoRequest& request);
+  // Removes `request` if it has not started yet and marks it done with ok false, returns true if it was removed
+  bool cancel(IoRequest& request);
+  // Cancels every queued prefetch the same way, e.g. after the reader jumped somewhere else
+  void cancelPrefetches();
+
+  // Blocks until `request` is done, returns request.ok. One task at a time may wait for a given request.
+  bool wait(IoRequest& request);
+  // Queues `request` and waits for it
+  bool run(IoRequest& request);
+
+  size_t pending() const;
+
+ private:
+  struct Platform;
+
+  static void taskEntry(void* arg);
+  void loop();
+  IoRequest* take();
+  void execute(IoRequest& request);
+  bool openFor(const IoRequest& request);
+  static bool unlink(IoRequest*& head, IoRequest*& tail, IoRequest& request);
+  void finishCancelled(IoRequest& request);
+
+  SDCardManager& sd;
+  Platform* platform = nullptr;
+  std::atomic<bool> running{false};
+
+  IoRequest* foregroundHead = nullptr;
+  IoRequest* foregroundTail = nullptr;
+  IoRequest* prefetchHead = nullptr;
+  IoRequest* prefetchTail = nullptr;
+  size_t queued = 0;
+
+  // The last file used stays open so runs of requests on one file skip the open
+  FsFile file;
+  char filePath[SDCardManager::MAX_PATH_LENGTH] = {};
+  bool fileWritable = false;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <SDCardManager.h>
+
+#include <cstring>
+
+/**
+ * Small persistent key-value store for settings and reading progress, kept as an append-only log on the card.
+ *
+ * put() and remove() append a checksummed record to a sector sized RAM buffer; flush() writes everything pending with
+ * a single write and sync, so saving progress costs one small append instead of rewriting a file. Values stay on the
+ * card; RAM only holds a hash index of where each key's latest record is, rebuilt by scanning the log on open().
+ *
+ * A torn or corrupt record at the end of the log (power lost during an append) and everything after it is dropped on
+ * open(). Superseded records pile up until compact() rewrites the live records into a fresh log, atomically through
+ * BufferedWriter; needsCompaction() says when that is worth it, e.g. to do it while the device is idle.
+ *
+ * Keys are up to 255 bytes, values up to 65535 bytes. The store is not thread safe.
+ */
+class KvStore {
+ public:
+  static constexpr size_t SECTOR_SIZE = 512;
+  static constexpr size_t MAX_KEY_LENGTH = 255;
+  static constexpr size_t MAX_VALUE_LENGTH = 0xFFFF;
+  // needsCompaction() once the log is this large and more than half of it is superseded records
+  static constexpr uint32_t COMPACT_MIN_SIZE = 16384;
+
+  explicit KvStore(size_t bufferSectors = 1);
+  ~KvStore();
+
+  KvStore(const KvStore&) = delete;
+  KvStore& operator=(const KvStore&) = delete;
+
+  // Opens or creates the log at `path` and rebuilds the index, dropping a torn tail
+  bool open(const char* path, SDCardManager& sd = SdMan);
+  // Flushes pending records and closes the log
+  void close();
+  bool isOpen() const { return static_cast<bool>(file); }
+
+  bool put(const char* key, const void* value, size_t length);
+  bool putString(const char* key, const char* value) { return put(key, value, strlen(value)); }
+  bool putUint32(const char* key, uint32_t value) { return put(key, &value, sizeof(value)); }
+  bool remove(const char* key);
+
+  /**
+   * Reads the value of `key`.
+   *
+   * @param out receives at most `outSize` bytes of the value
+   * @return the full value length, or -1 if the key is missing or its record could not be read
+   */
+  int get(const char* key, void* out, size_t outSize);
+  String getString(const char* key, const char* defaultValue = "");
+  uint32_t getUint32(const char* key, uint32_t defaultValue = 0);
+  bool contains(const char* key) const { return findSlot(hashKey(key, strlen(key))) >= 0; }
+
+  // Writes pending records and syncs the log
+  bool flush();
+
+  // Rewrites the log with only the live records
+  bool compact();
+  bool needsCompaction() const { return logSize >= COMPACT_MIN_SIZE && logSize > 2 * liveBytes; }
+
+  uint32_t size() const { return count; }
+  uint32_t getLogSize() const { return logSize; }
+  uint32_t getLiveBytes() const { return liveBytes; }
+
+ private:
+  struct Slot {
+    uint64_t hash;  // 0 marks an empty slot
+    uint32_t offset;
+    uint32_t length;  // Whole record
+  };
+
+  static uint64_t hashKey(const char* key, size_t length);
+  int32_t findSlot(uint64_t hash) const;
+  bool indexRecord(uint64_t hash, uint32_t offset, uint32_t length);
+  void unindex(uint64_t hash);
+  bool growIndex();
+
+  bool append(uint8_t type, const char* key, const void* value, size_t length);
+  bool flushPending();
+  bool readAt(uint32_t offset, void* out, size_t length);
+  bool load();
+
+  SDCardManager* sd = nullptr;
+  FsFile file;
+  char path[SDCardManager::MAX_NAME_LENGTH] = {};
+
+  Slot* slots = nullptr;
+  uint32_t slotCount = 0;  // Power of two
+  uint32_t count = 0;
+
+  uint32_t logSize = 0;      // Including pending records
+  uint32_t flushedSize = 0;  // Bytes on the card
+  uint32_t liveBytes = 0;    // Header plus the latest record of each key
+
+  uint8_t* pending = nullptr;
+  size_t capacity;
+  size_t pendingLen = 0;
+};
@@ -7,46 +7,128 @@
 
 class SDCardManager {
  public:
+  static constexpr size_t MAX_NAME_LENGTH = 256;
+
+  // One directory entry as delivered by listDirectory(), valid only during the callback
+  struct DirEntry {
+    char name[MAX_NAME_LENGTH];
+    uint64_t size;
+    uint16_t modifyDate;  // FAT packed date, see FS_DATE_YEAR() etc.
+    uint16_t modifyTime;  // FAT packed time, see FS_TIME_HOUR() etc.
+    bool isDirectory;
+    bool isHidden;
+  };
+
+  // Opaque resume point for listDirectory(), start with a default constructed one
+  struct DirCursor {
+    uint64_t position = 0;
+    bool done = false;
+  };
+
+  // Return false to stop the listing early
+  typedef bool (*DirEntryCallback)(const DirEntry& entry, void* context);
+
+  static constexpr size_t MAX_PATH_LENGTH = 512;
+  static constexpr uint8_t MAX_TREE_DEPTH = 16;
+
+  // Running totals of a removeDir(), copyTree() or diskUsage() walk
+  struct TreeStats {
+    uint32_t files = 0;
+    uint32_t directories = 0;
+    uint64_t bytes = 0;
+    uint64_t allocatedBytes = 0;  // Rounded up to whole clusters
+  };
+
+  // Called after each entry with the totals so far and the entry's path. Return false to cancel the walk.
+  typedef bool (*TreeProgressCallback)(const TreeStats& stats, const char* path, void* context);
+
   SDCardManager();
   bool begin();
   bool ready() const;
   std::vector<String> listFiles(const char* path = "/", int maxFiles = 200);
-  // Read the entire file at `path` into a String. Returns empty string on failure.
+  // Stream the entries of `path` with their metadata to `callback` without allocating. With a `cursor` the listing
+  // resumes where the previous call stopped, so a UI can page through large folders `maxEntries` at a time
+  // (0 = no limit). Returns the number of entries delivered.
+  size_t listDirectory(const char* path, DirEntryCallback callback, void* context = nullptr, DirCursor* cursor = nullptr,
+                       size_t maxEntries = 0);
+  // Read the entire file at `path` into a String (up to 50KB). Returns empty string on failure.
   String readFile(const char* path);
+  // Read the file into `out`, sized once from the file size and capped to `maxBytes` (0 = no cap).
+  // Returns false on failure.
+  bool readFile(const char* path, std::string& out, size_t maxBytes = 50000);
+  // Read up to `bufferSize` bytes of the file into caller-owned memory. Returns bytes read.
+  size_t readFile(const char* path, uint8_t* buffer, size_t bufferSize);
   // Low-memory helpers:
   // Stream the file contents to a `Print` (e.g. `Serial`, or any `Print`-derived object).
   // Returns true on success, false on failure.
-  bool readFileToStream(const char* path, Print& out, size_t chunkSize = 256);
+  bool readFileToStream(const char* path, Print& out, size_t chunkSize = 512);
   // Read up to `bufferSize-1` bytes into `buffer`, null-terminating it. Returns bytes read.
   size_t readFileToBuffer(const char* path, char* buffer, size_t bufferSize, size_t maxBytes = 0);
-  // Write a string to `path` on the SD card. Overwrites existing file.
+  // Write a string to `path` on the SD card. Replaces an existing file atomically, see BufferedWriter.
   // Returns true on success.
   bool writeFile(const char* path, const String& content);
   // Ensure a directory exists, creating it if necessary. Returns true on success.
   bool ensureDirectoryExists(const char* path);
 
-  FsFile open(const char* path, const oflag_t oflag = O_RDONLY) { return sd.open(path, oflag); }
+  // Opening for writing, removing and renaming through these drops the affected paths from the handle cache
+  FsFile open(const char* path, oflag_t oflag = O_RDONLY);
   bool mkdir(const char* path, const bool pFlag = true) { return sd.mkdir(path, pFlag); }
   bool exists(const char* path) { return sd.exists(path); }
-  bool remove(const char* path) { return sd.remove(path); }
-  bool rmdir(const char* path) { return sd.rmdir(path); }
-  bool rename(const char* path, const char* newPath) { return sd.rename(path, newPath); }
+  bool remove(const char* path);
+  bool rmdir(const char* path);
+  bool rename(const char* path, const char* newPath);
 
+  // A missing file whose BufferedWriter commit was cut short by a power loss is recovered first, so readFile() and
+  // friends see the old or the new version
   bool openFileForRead(const char* moduleName, const char* path, FsFile& file);
   bool openFileForRead(const char* moduleName, const std::string& path, FsFile& file);
   bool openFileForRead(const char* moduleName, const String& path, FsFile& file);
   bool openFileForWrite(const char* moduleName, const char* path, FsFile& file);
   bool openFileForWrite(const char* moduleName, const std::string& path, FsFile& file);
   bool openFileForWrite(const char* moduleName, const String& path, FsFile& file);
-  bool removeDir(const char* path);
+  // Tree operations walk iteratively with one fixed path buffer and one open handle per level (up to MAX_TREE_DEPTH),
+  // so deep trees cannot exhaust the stack. Files are removed through their parent's handle without a path lookup.
+  // A cancelled or failed walk leaves whatever it has not reached yet in place.
+  bool removeDir(const char* path, TreeProgressCallback progress = nullptr, void* context = nullptr);
+  // Copy a file or a whole directory tree to `to`, which must not be inside `from`
+  bool copyTree(const char* from, const char* to, TreeProgressCallback progress = nullptr, void* context = nullptr);
+  // Count the files, directories and bytes of a file or tree
+  bool diskUsage(const char* path, TreeStats& usage, TreeProgressCallback progress = nullptr, void* context = nullptr);
+
+  // Keep up to `maxHandles` files that were opened for reading open, keyed by path, so openFileForRead() can hand out
+  // a copy of the handle instead of walking the path again. 0 (the default) disables the cache.
+  void setHandleCacheSize(size_t maxHandles);
+  // Drops cached handles for `path` and everything below it, and the BlockCache pages of `path`. Needed after changing
+  // files behind the manager's back.
+  void invalidateHandles(const char* path);
+  uint32_t getHandleCacheHits() const { return handleHits; }
+  uint32_t getHandleCacheMisses() const { return handleMisses; }
 
  static SDCardManager& getInstance() { return instance; }
 
  private:
   static SDCardManager instance;
 
+  enum TreeOperation : uint8_t { TREE_REMOVE, TREE_COPY, TREE_USAGE };
+
+  bool walkTree(TreeOperation operation, const char* from, const char* to, TreeStats& stats,
+                TreeProgressCallback progress, void* context);
+  bool copyFileContents(FsFile& source, const char* to, uint8_t* buffer, size_t bufferSize);
+
+  struct CachedHandle {
+    std::string path;
+    FsFile file;
+    uint32_t lastUse;
+  };
+
   bool initialized = false;
   SdFat sd;
+
+  std::vector<CachedHandle> handleCache;
+  size_t maxCachedHandles = 0;
+  uint32_t handleClock = 0;
+  uint32_t handleHits = 0;
+  uint32_t handleMisses = 0;
 };
 
 #define SdMan SDCardManager::getInstance()
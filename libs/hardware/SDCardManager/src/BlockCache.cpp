@@ -0,0 +1,194 @@
+#include "BlockCache.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "BinaryIO.h"
+
+BlockCache BlockCache::instance;
+
+BlockCache::~BlockCache() { end(); }
+
+bool BlockCache::begin(const size_t count) {
+  end();
+  if (count == 0) {
+    return true;
+  }
+
+  pool = static_cast<uint8_t*>(malloc(count * PAGE_SIZE));
+  pages = static_cast<Page*>(calloc(count, sizeof(Page)));
+  if (!pool || !pages) {
+    if (Serial) Serial.printf("[%lu] [BLK] Failed to allocate %u cache pages\n", millis(), count);
+    end();
+    return false;
+  }
+
+  pageCount = count;
+  return true;
+}
+
+void BlockCache::end() {
+  free(pool);
+  free(pages);
+  pool = nullptr;
+  pages = nullptr;
+  pageCount = 0;
+}
+
+void BlockCache::invalidate(const uint64_t fileKey) {
+  for (size_t i = 0; i < pageCount; i++) {
+    if (pages[i].fileKey == fileKey) {
+      pages[i].valid = false;
+    }
+  }
+}
+
+void BlockCache::invalidatePath(const char* path) {
+  const uint32_t hash = pathHash(path);
+  for (size_t i = 0; i < pageCount; i++) {
+    if (static_cast<uint32_t>(pages[i].fileKey >> 32) == hash) {
+      pages[i].valid = false;
+    }
+  }
+}
+
+uint32_t BlockCache::pathHash(const char* path) { return BinaryIO::fnv1a(path, strlen(path)); }
+
+void BlockCache::clear() {
+  for (size_t i = 0; i < pageCount; i++) {
+    pages[i].valid = false;
+  }
+}
+
+// Returns the cached page, loading it into the least recently used slot on a miss. The pool is small, so a linear scan
+// is cheaper than keeping a hash table in sync.
+const uint8_t* BlockCache::page(FsFile& file, const uint64_t fileKey, const uint32_t index, uint16_t& length) {
+  size_t victim = 0;
+  for (size_t i = 0; i < pageCount; i++) {
+    Page& p = pages[i];
+    if (p.valid && p.fileKey == fileKey && p.index == index) {
+      p.lastUse = ++clock;
+      length = p.length;
+      hits++;
+      return pool + i * PAGE_SIZE;
+    }
+    if (!p.valid) {
+      if (pages[victim].valid) {
+        victim = i;
+      }
+    } else if (pages[victim].valid && p.lastUse < pages[victim].lastUse) {
+      victim = i;
+    }
+  }
+
+  misses++;
+  Page& p = pages[victim];
+  uint8_t* data = pool + victim * PAGE_SIZE;
+  p.valid = false;
+  if (!file.seekSet(static_cast<uint64_t>(index) * PAGE_SIZE)) {
+    return nullptr;
+  }
+  const int r = file.read(data, PAGE_SIZE);
+  if (r <= 0) {
+    return nullptr;
+  }
+
+  p.fileKey = fileKey;
+  p.index = index;
+  p.length = static_cast<uint16_t>(r);
+  p.lastUse = ++clock;
+  p.valid = true;
+  length = p.length;
+  return data;
+}
+
+size_t BlockCache::read(FsFile& file, const uint64_t fileKey, uint64_t offset, void* out, size_t length) {
+  auto* dst = static_cast<uint8_t*>(out);
+
+  // Without a pool every read goes straight to the card
+  if (pageCount == 0) {
+    misses++;
+    if (!file.seekSet(offset)) {
+      return 0;
+    }
+    const int r = file.read(dst, length);
+    return r > 0 ? static_cast<size_t>(r) : 0;
+  }
+
+  size_t total = 0;
+  while (length > 0) {
+    const uint32_t index = static_cast<uint32_t>(offset / PAGE_SIZE);
+    const size_t inPage = static_cast<size_t>(offset % PAGE_SIZE);
+    uint16_t pageLength = 0;
+    const uint8_t* data = page(file, fileKey, index, pageLength);
+    if (!data || inPage >= pageLength) {
+      break;
+    }
+
+    const size_t n = min(length, pageLength - inPage);
+    memcpy(dst, data + inPage, n);
+    dst += n;
+    total += n;
+    offset += n;
+    length -= n;
+    if (pageLength < PAGE_SIZE) {
+      break;  // Last page of the file
+    }
+  }
+  return total;
+}
+
+bool CachedFile::open(const char* path, SDCardManager& sd) {
+  close();
+  if (!sd.openFileForRead("BLK", path, file)) {
+    return false;
+  }
+
+  // Size, modify time and first cluster are part of the key, so pages of an older version of the file are rarely
+  // matched; the path in the upper half lets SDCardManager drop them outright when it changes the file
+  uint16_t date = 0;
+  uint16_t time = 0;
+  file.getModifyDateTime(&date, &time);
+  fileSize = file.fileSize();
+  const uint32_t sector = file.firstSector();
+  const uint32_t hash = BlockCache::pathHash(path);
+
+  uint8_t stamp[16];
+  BinaryIO::put64(stamp, fileSize);
+  BinaryIO::put16(stamp + 8, date);
+  BinaryIO::put16(stamp + 10, time);
+  BinaryIO::put32(stamp + 12, sector);
+  const uint32_t version = BinaryIO::fnv1a(stamp, sizeof(stamp), hash);
+  fileKey = static_cast<uint64_t>(hash) << 32 | version;
+  pos = 0;
+  return true;
+}
+
+void CachedFile::close() {
+  if (file) {
+    file.close();
+  }
+  fileSize = 0;
+  pos = 0;
+}
+
+size_t CachedFile::pread(void* out, const size_t length, const uint64_t offset) {
+  if (!file || offset >= fileSize) {
+    return 0;
+  }
+  return cache.read(file, fileKey, offset, out, min<uint64_t>(length, fileSize - offset));
+}
+
+size_t CachedFile::read(void* out, const size_t length) {
+  const size_t n = pread(out, length, pos);
+  pos += n;
+  return n;
+}
+
+bool CachedFile::seek(const uint64_t position) {
+  if (!file || position > fileSize) {
+    return false;
+  }
+  pos = position;
+  return true;
+}
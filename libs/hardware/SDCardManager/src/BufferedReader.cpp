@@ -0,0 +1,198 @@
+#include "BufferedReader.h"
+
+#include <cstdlib>
+#include <cstring>
+
+BufferedReader::BufferedReader(const size_t maxSectors) : maxSectors(maxSectors > 0 ? maxSectors : 1) {}
+
+BufferedReader::~BufferedReader() {
+  close();
+  free(buffer);
+}
+
+bool BufferedReader::open(const char* path, SDCardManager& sd) {
+  close();
+  if (!sd.openFileForRead("BRD", path, ownFile)) {
+    return false;
+  }
+  if (!attach(ownFile)) {
+    ownFile.close();
+    return false;
+  }
+  return true;
+}
+
+bool BufferedReader::attach(FsFile& f) {
+  if (&f != &ownFile) {
+    close();
+  }
+  if (!buffer) {
+    buffer = static_cast<uint8_t*>(malloc(maxSectors * SECTOR_SIZE));
+    if (!buffer) {
+      if (Serial) Serial.printf("[%lu] [BRD] Failed to allocate %u byte read buffer\n", millis(), maxSectors * SECTOR_SIZE);
+      return false;
+    }
+  }
+
+  file = &f;
+  fileSize = f.fileSize();
+  return seek(f.curPosition());
+}
+
+void BufferedReader::close() {
+  if (ownFile) {
+    ownFile.close();
+  }
+  file = nullptr;
+  fileSize = 0;
+  bufferStart = 0;
+  pos = len = 0;
+  windowSectors = 1;
+}
+
+bool BufferedReader::seek(const uint64_t position) {
+  if (!file || position > fileSize) {
+    return false;
+  }
+
+  // Stay in the buffer if we can, otherwise restart from the enclosing sector with a small window
+  if (position >= bufferStart && position <= bufferStart + len) {
+    pos = static_cast<size_t>(position - bufferStart);
+    return true;
+  }
+
+  const uint64_t sectorStart = position & ~static_cast<uint64_t>(SECTOR_SIZE - 1);
+  if (!file->seekSet(sectorStart)) {
+    return false;
+  }
+  bufferStart = sectorStart;
+  pos = len = 0;
+  windowSectors = 1;
+  if (!refill()) {
+    return position == sectorStart;
+  }
+  pos = static_cast<size_t>(position - sectorStart);
+  return true;
+}
+
+// Loads the window that follows the current buffer, growing the window on sequential reads
+bool BufferedReader::refill() {
+  if (!file) {
+    return false;
+  }
+
+  const bool sequential = len > 0;
+  bufferStart += len;
+  pos = len = 0;
+  if (sequential && windowSectors < maxSectors) {
+    windowSectors = min(windowSectors * 2, maxSectors);
+  }
+
+  const int r = file->read(buffer, windowSectors * SECTOR_SIZE);
+  if (r <= 0) {
+    return false;
+  }
+  len = static_cast<size_t>(r);
+  return true;
+}
+
+int BufferedReader::refillAndRead() { return refill() ? buffer[pos++] : -1; }
+
+int BufferedReader::refillAndPeek() { return refill() ? buffer[pos] : -1; }
+
+size_t BufferedReader::read(void* out, size_t length) {
+  auto* dst = static_cast<uint8_t*>(out);
+  size_t total = 0;
+
+  while (length > 0) {
+    if (pos == len) {
+      // Whole sectors go straight into the caller's memory, the buffer only takes the tail
+      const uint64_t next = bufferStart + len;
+      if (length >= SECTOR_SIZE && next % SECTOR_SIZE == 0 && file) {
+        const size_t direct = length & ~(SECTOR_SIZE - 1);
+        const int r = file->read(dst, direct);
+        if (r <= 0) {
+          break;
+        }
+        bufferStart = next + r;
+        pos = len = 0;
+        dst += r;
+        total += r;
+        length -= r;
+        if (static_cast<size_t>(r) < direct) {
+          break;
+        }
+        continue;
+      }
+      if (!refill()) {
+        break;
+      }
+    }
+
+    const size_t n = min(length, len - pos);
+    memcpy(dst, buffer + pos, n);
+    pos += n;
+    dst += n;
+    total += n;
+    length -= n;
+  }
+  return total;
+}
+
+int BufferedReader::readLine(char* line, const size_t lineSize) {
+  if (!line || lineSize == 0) {
+    return -1;
+  }
+
+  size_t stored = 0;
+  size_t lineLength = 0;
+  bool found = false;
+  while (!found) {
+    if (pos == len && !refill()) {
+      if (lineLength == 0) {
+        line[0] = '\0';
+        return -1;
+      }
+      break;
+    }
+
+    const uint8_t* start = buffer + pos;
+    const auto* newline = static_cast<const uint8_t*>(memchr(start, '\n', len - pos));
+    const size_t chunk = newline ? static_cast<size_t>(newline - start) : len - pos;
+    const size_t n = min(chunk, lineSize - 1 - stored);
+    memcpy(line + stored, start, n);
+    stored += n;
+    lineLength += chunk;
+    pos += chunk;
+    if (newline) {
+      pos++;
+      found = true;
+    }
+  }
+
+  // Only strip the '\r' of a "\r\n" ending, not one that happens to sit at the truncation point
+  if (stored > 0 && stored == lineLength && line[stored - 1] == '\r') {
+    stored--;
+  }
+  line[stored] = '\0';
+  return static_cast<int>(stored);
+}
+
+size_t BufferedReader::skip(const size_t length) {
+  if (!file) {
+    return 0;
+  }
+
+  const size_t buffered = len - pos;
+  if (length <= buffered) {
+    pos += length;
+    return length;
+  }
+
+  const uint64_t from = position();
+  const uint64_t target = min<uint64_t>(from + length, fileSize);
+  if (!seek(target)) {
+    return 0;
+  }
+  return static_cast<size_t>(target - from);
+}
@@ -0,0 +1,154 @@
+#include "BufferedWriter.h"
+
+#include <cstdlib>
+#include <cstring>
+
+BufferedWriter::BufferedWriter(const size_t bufferSectors)
+    : capacity((bufferSectors > 0 ? bufferSectors : 1) * SECTOR_SIZE) {}
+
+BufferedWriter::~BufferedWriter() {
+  if (file) {
+    abort();
+  }
+  free(buffer);
+}
+
+bool BufferedWriter::open(const char* path, const uint64_t expectedSize, SDCardManager& sdManager) {
+  if (file) {
+    abort();
+  }
+
+  if (!buffer) {
+    buffer = static_cast<uint8_t*>(malloc(capacity));
+    if (!buffer) {
+      if (Serial) Serial.printf("[%lu] [BWR] Failed to allocate %u byte write buffer\n", millis(), capacity);
+      return false;
+    }
+  }
+
+  sd = &sdManager;
+  targetPath = path;
+  tempPath = targetPath + ".tmp";
+  failed = false;
+  written = 0;
+  len = 0;
+
+  // O_TRUNC also clears out a temp file left behind by an interrupted write
+  if (!sd->openFileForWrite("BWR", tempPath.c_str(), file)) {
+    return false;
+  }
+
+  preallocated = expectedSize > 0 && file.preAllocate(expectedSize);
+  return true;
+}
+
+size_t BufferedWriter::write(const uint8_t b) { return write(&b, 1); }
+
+size_t BufferedWriter::write(const uint8_t* data, size_t length) {
+  if (!file || failed) {
+    return 0;
+  }
+
+  const size_t total = length;
+  while (length > 0) {
+    // Whole buffers worth of data skip the copy when nothing is pending
+    if (len == 0 && length >= capacity) {
+      const size_t direct = length - length % capacity;
+      if (file.write(data, direct) != direct) {
+        failed = true;
+        return total - length;
+      }
+      data += direct;
+      length -= direct;
+      written += direct;
+      continue;
+    }
+
+    const size_t n = min(length, capacity - len);
+    memcpy(buffer + len, data, n);
+    len += n;
+    data += n;
+    length -= n;
+    written += n;
+    if (len == capacity && !flushBuffer()) {
+      return total - length;
+    }
+  }
+  return total;
+}
+
+bool BufferedWriter::flushBuffer() {
+  if (len > 0 && file.write(buffer, len) != len) {
+    failed = true;
+  }
+  len = 0;
+  return !failed;
+}
+
+bool BufferedWriter::commit() {
+  if (!file) {
+    return false;
+  }
+
+  // A preallocated file keeps its full allocated length until it is cut back to what was written
+  bool ok = flushBuffer() && (!preallocated || file.truncate(written)) && file.sync();
+  file.close();
+  if (!ok) {
+    if (Serial) Serial.printf("[%lu] [BWR] Write failed, keeping %s\n", millis(), targetPath.c_str());
+    sd->remove(tempPath.c_str());
+    return false;
+  }
+
+  const std::string backupPath = targetPath + ".bak";
+  bool hadTarget = sd->rename(targetPath.c_str(), backupPath.c_str());
+  if (!hadTarget && sd->exists(backupPath.c_str())) {
+    // Left over from an interrupted commit whose target has since been rewritten
+    sd->remove(backupPath.c_str());
+    hadTarget = sd->rename(targetPath.c_str(), backupPath.c_str());
+  }
+
+  if (!sd->rename(tempPath.c_str(), targetPath.c_str())) {
+    if (Serial) Serial.printf("[%lu] [BWR] Failed to move %s into place\n", millis(), tempPath.c_str());
+    if (hadTarget) {
+      sd->rename(backupPath.c_str(), targetPath.c_str());
+    }
+    sd->remove(tempPath.c_str());
+    return false;
+  }
+
+  if (hadTarget) {
+    sd->remove(backupPath.c_str());
+  }
+  return true;
+}
+
+void BufferedWriter::abort() {
+  if (!file) {
+    return;
+  }
+  file.close();
+  sd->remove(tempPath.c_str());
+  len = 0;
+}
+
+void BufferedWriter::recover(const char* path, SDCardManager& sd) {
+  const std::string target = path;
+  const std::string tempPath = target + ".tmp";
+  const std::string backupPath = target + ".bak";
+
+  // A backup without a target means commit() stopped between its two renames, so the temp file is complete
+  if (!sd.exists(path) && sd.exists(backupPath.c_str())) {
+    if (sd.exists(tempPath.c_str()) && sd.rename(tempPath.c_str(), path)) {
+      if (Serial) Serial.printf("[%lu] [BWR] Completed interrupted write of %s\n", millis(), path);
+    } else if (sd.rename(backupPath.c_str(), path)) {
+      if (Serial) Serial.printf("[%lu] [BWR] Restored backup of %s\n", millis(), path);
+    }
+  }
+
+  if (sd.exists(tempPath.c_str())) {
+    sd.remove(tempPath.c_str());
+  }
+  if (sd.exists(backupPath.c_str())) {
+    sd.remove(backupPath.c_str());
+  }
+}
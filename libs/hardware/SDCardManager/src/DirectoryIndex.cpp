@@ -0,0 +1,607 @@
+#include "DirectoryIndex.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "BinaryIO.h"
+
+namespace {
+constexpr const char* CACHE_DIR = "/.sdcache/dirindex";
+constexpr uint8_t MAGIC[4] = {'D', 'I', 'X', '2'};
+constexpr uint32_t HEADER_SIZE = 32;
+constexpr uint32_t TABLE_STRIDE = 64;  // One table offset every 64 records for seek()
+constexpr uint16_t MERGE_WAYS = 8;     // Runs merged per pass, each needs one 512 byte read buffer
+constexpr size_t MIN_SORT_BUFFER_SIZE = 1024;
+
+// Record: size u64, date u16, time u16, flags u8, name length u8, then the name without terminator
+constexpr size_t RECORD_HEADER_SIZE = 14;
+constexpr size_t MAX_RECORD_SIZE = RECORD_HEADER_SIZE + 255;
+constexpr uint8_t FLAG_DIRECTORY = 0x01;
+constexpr uint8_t FLAG_HIDDEN = 0x02;
+
+using BinaryIO::FNV_OFFSET;
+using BinaryIO::fnv1a;
+using BinaryIO::get16;
+using BinaryIO::get32;
+using BinaryIO::get64;
+using BinaryIO::put16;
+using BinaryIO::put32;
+using BinaryIO::put64;
+
+// "/books/" and "/books" share one index
+size_t trimmedLength(const char* path) {
+  size_t length = strlen(path);
+  while (length > 1 && path[length - 1] == '/') {
+    length--;
+  }
+  return length;
+}
+
+size_t recordSize(const uint8_t* record) { return RECORD_HEADER_SIZE + record[13]; }
+
+// Directories first, then case-insensitive by name, ties broken case-sensitively
+int compareRecords(const uint8_t* a, const uint8_t* b) {
+  const bool dirA = a[12] & FLAG_DIRECTORY;
+  const bool dirB = b[12] & FLAG_DIRECTORY;
+  if (dirA != dirB) {
+    return dirA ? -1 : 1;
+  }
+
+  const uint8_t lenA = a[13];
+  const uint8_t lenB = b[13];
+  const char* nameA = reinterpret_cast<const char*>(a + RECORD_HEADER_SIZE);
+  const char* nameB = reinterpret_cast<const char*>(b + RECORD_HEADER_SIZE);
+  const uint8_t common = min(lenA, lenB);
+  for (uint8_t i = 0; i < common; i++) {
+    const int ca = tolower(static_cast<unsigned char>(nameA[i]));
+    const int cb = tolower(static_cast<unsigned char>(nameB[i]));
+    if (ca != cb) {
+      return ca - cb;
+    }
+  }
+  if (lenA != lenB) {
+    return lenA < lenB ? -1 : 1;
+  }
+  return memcmp(nameA, nameB, lenA);
+}
+
+// Sequential writer with one sector of buffering
+class SectorWriter {
+ public:
+  explicit SectorWriter(FsFile& file) : file(file) {}
+
+  bool write(const void* data, size_t length) {
+    const auto* src = static_cast<const uint8_t*>(data);
+    while (length > 0) {
+      const size_t n = min(length, sizeof(buf) - len);
+      memcpy(buf + len, src, n);
+      len += n;
+      src += n;
+      length -= n;
+      written += n;
+      if (len == sizeof(buf) && !flush()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool flush() {
+    if (len > 0 && file.write(buf, len) != len) {
+      return false;
+    }
+    len = 0;
+    return true;
+  }
+
+  uint32_t bytesWritten() const { return written; }
+
+ private:
+  FsFile& file;
+  uint8_t buf[512];
+  size_t len = 0;
+  uint32_t written = 0;
+};
+
+// Sequential record reader with one sector of buffering
+class RunReader {
+ public:
+  bool open(SDCardManager& sd, const char* path) { return sd.openFileForRead("DIX", path, file); }
+
+  // Loads the next record into `record`, false at the end of the run
+  bool advance() {
+    if (!read(record, RECORD_HEADER_SIZE)) {
+      return false;
+    }
+    return read(record + RECORD_HEADER_SIZE, record[13]);
+  }
+
+  void close() { file.close(); }
+
+  uint8_t record[MAX_RECORD_SIZE];
+
+ private:
+  bool read(uint8_t* out, size_t length) {
+    while (length > 0) {
+      if (pos == len) {
+        const int r = file.read(buf, sizeof(buf));
+        if (r <= 0) {
+          return false;
+        }
+        len = static_cast<size_t>(r);
+        pos = 0;
+      }
+      const size_t n = min(length, len - pos);
+      memcpy(out, buf + pos, n);
+      pos += n;
+      out += n;
+      length -= n;
+    }
+    return true;
+  }
+
+  FsFile file;
+  uint8_t buf[512];
+  size_t pos = 0;
+  size_t len = 0;
+};
+
+// Collects directory entries into the sort buffer and spills sorted runs to the card
+struct RunBuilder {
+  SDCardManager* sd;
+  uint8_t* arena;
+  size_t arenaSize;
+  size_t used;          // Records grow up from the start of the arena
+  uint32_t* offsets;    // Record offsets grow down from the end of the arena
+  uint32_t count;
+  uint16_t runCount;
+  uint32_t totalEntries;
+  bool failed;
+
+  bool fits(size_t size) const {
+    const size_t offsetsBytes = (count + 1) * sizeof(uint32_t);
+    return used + size + offsetsBytes <= arenaSize;
+  }
+
+  bool spill(void (*runPath)(uint16_t, char*, size_t)) {
+    if (count == 0) {
+      return true;
+    }
+
+    uint32_t* first = offsets - count + 1;
+    const uint8_t* base = arena;
+    std::sort(first, offsets + 1,
+              [base](const uint32_t a, const uint32_t b) { return compareRecords(base + a, base + b) < 0; });
+
+    char path[64];
+    runPath(runCount, path, sizeof(path));
+    FsFile out;
+    if (!sd->openFileForWrite("DIX", path, out)) {
+      return false;
+    }
+    SectorWriter writer(out);
+    for (uint32_t* it = first; it <= offsets; it++) {
+      const uint8_t* record = arena + *it;
+      if (!writer.write(record, recordSize(record))) {
+        out.close();
+        return false;
+      }
+    }
+    const bool ok = writer.flush();
+    out.close();
+
+    runCount++;
+    used = 0;
+    count = 0;
+    return ok;
+  }
+};
+}  // namespace
+
+DirectoryIndex::DirectoryIndex(SDCardManager& sd, const size_t sortBufferSize)
+    : sd(sd), sortBufferSize(max(sortBufferSize, MIN_SORT_BUFFER_SIZE)) {}
+
+DirectoryIndex::~DirectoryIndex() { close(); }
+
+bool DirectoryIndex::open(const char* path, const bool fullCheck) {
+  close();
+  rebuilt = false;
+
+  FsFile dir;
+  if (!openDirectory(path, dir)) {
+    return false;
+  }
+
+  // Entry count and metadata are checked on every open, names only on a full check
+  Signature current{};
+  hashEntries(dir, current, fullCheck);
+  Signature stored{};
+  const bool fresh = readHeader(path, stored) && current.count == stored.count && current.hash == stored.hash &&
+                     (!fullCheck || current.nameHash == stored.nameHash);
+
+  if (!fresh) {
+    if (Serial) Serial.printf("[%lu] [DIX] Index for %s is missing or stale, rebuilding\n", millis(), path);
+    close();
+    if (!fullCheck) {
+      hashEntries(dir, current, true);
+    }
+    dir.close();
+    if (!build(path, current) || !readHeader(path, stored)) {
+      close();
+      return false;
+    }
+    rebuilt = true;
+  }
+  dir.close();
+
+  return seek(0);
+}
+
+void DirectoryIndex::close() {
+  if (file) {
+    file.close();
+  }
+  entryCount = 0;
+  position = 0;
+  bufferPos = bufferLen = 0;
+}
+
+bool DirectoryIndex::rebuild(const char* path) {
+  close();
+  FsFile dir;
+  if (!openDirectory(path, dir)) {
+    return false;
+  }
+  Signature signature{};
+  hashEntries(dir, signature, true);
+  dir.close();
+  return build(path, signature);
+}
+
+bool DirectoryIndex::seek(const uint32_t index) {
+  if (!file || index > entryCount) {
+    return false;
+  }
+
+  // Jump to the closest table entry before `index`, then skip forward record by record
+  const uint32_t slot = index / TABLE_STRIDE;
+  uint32_t offset = recordsOffset;
+  if (slot > 0) {
+    uint8_t raw[4];
+    if (!file.seekSet(tableOffset + slot * 4) || file.read(raw, 4) != 4) {
+      return false;
+    }
+    offset = get32(raw);
+  }
+
+  if (!file.seekSet(offset)) {
+    return false;
+  }
+  bufferPos = bufferLen = 0;
+  position = slot * TABLE_STRIDE;
+
+  uint8_t header[RECORD_HEADER_SIZE];
+  uint8_t skip[255];
+  while (position < index) {
+    if (!readBytes(header, RECORD_HEADER_SIZE) || !readBytes(skip, header[13])) {
+      return false;
+    }
+    position++;
+  }
+  return true;
+}
+
+bool DirectoryIndex::next(SDCardManager::DirEntry& entry) {
+  if (!file || position >= entryCount) {
+    return false;
+  }
+
+  uint8_t header[RECORD_HEADER_SIZE];
+  if (!readBytes(header, RECORD_HEADER_SIZE)) {
+    return false;
+  }
+  const uint8_t nameLength = header[13];
+  if (!readBytes(entry.name, nameLength)) {
+    return false;
+  }
+  entry.name[nameLength] = '\0';
+  entry.size = get64(header);
+  entry.modifyDate = get16(header + 8);
+  entry.modifyTime = get16(header + 10);
+  entry.isDirectory = header[12] & FLAG_DIRECTORY;
+  entry.isHidden = header[12] & FLAG_HIDDEN;
+  position++;
+  return true;
+}
+
+bool DirectoryIndex::readBytes(void* out, size_t length) {
+  auto* dst = static_cast<uint8_t*>(out);
+  while (length > 0) {
+    if (bufferPos == bufferLen) {
+      const int r = file.read(buffer, sizeof(buffer));
+      if (r <= 0) {
+        return false;
+      }
+      bufferLen = static_cast<uint16_t>(r);
+      bufferPos = 0;
+    }
+    const size_t n = min<size_t>(length, bufferLen - bufferPos);
+    memcpy(dst, buffer + bufferPos, n);
+    bufferPos += n;
+    dst += n;
+    length -= n;
+  }
+  return true;
+}
+
+bool DirectoryIndex::openDirectory(const char* path, FsFile& dir) {
+  dir = sd.open(path);
+  if (!dir || !dir.isDirectory()) {
+    if (Serial) Serial.printf("[%lu] [DIX] Not a directory: %s\n", millis(), path);
+    dir.close();
+    return false;
+  }
+  return true;
+}
+
+// Staleness check: walks the directory without sorting, hashing each entry's metadata and, if asked, its name
+void DirectoryIndex::hashEntries(FsFile& dir, Signature& signature, const bool withNames) {
+  dir.rewindDirectory();
+  signature = {};
+  uint32_t hash = FNV_OFFSET;
+  uint32_t nameHash = FNV_OFFSET;
+  char name[SDCardManager::MAX_NAME_LENGTH];
+  FsFile f;
+  while (f.openNext(&dir, O_RDONLY)) {
+    const uint64_t size = f.fileSize();
+    const uint64_t slot = dir.curPosition();  // Changes when entries are renamed or re-created
+    const uint8_t isDir = f.isDirectory() ? 1 : 0;
+    uint16_t date = 0, time = 0;
+    f.getModifyDateTime(&date, &time);
+    if (withNames) {
+      const size_t nameLength = f.getName(name, sizeof(name));
+      nameHash = fnv1a(name, nameLength + 1, nameHash);
+    }
+    f.close();
+
+    hash = fnv1a(&size, sizeof(size), hash);
+    hash = fnv1a(&slot, sizeof(slot), hash);
+    hash = fnv1a(&date, sizeof(date), hash);
+    hash = fnv1a(&time, sizeof(time), hash);
+    hash = fnv1a(&isDir, sizeof(isDir), hash);
+    signature.count++;
+  }
+  signature.hash = hash;
+  signature.nameHash = withNames ? nameHash : 0;
+}
+
+bool DirectoryIndex::readHeader(const char* path, Signature& stored) {
+  char indexPath[64];
+  indexPathFor(path, indexPath, sizeof(indexPath));
+  file = sd.open(indexPath, O_RDONLY);
+  if (!file) {
+    return false;
+  }
+
+  uint8_t header[HEADER_SIZE];
+  const size_t pathLength = trimmedLength(path);
+  if (file.read(header, HEADER_SIZE) != static_cast<int>(HEADER_SIZE) || memcmp(header, MAGIC, 4) != 0 ||
+      get16(header + 24) != pathLength || get16(header + 26) != TABLE_STRIDE) {
+    file.close();
+    return false;
+  }
+
+  // The file name is a hash of the path, make sure it is really this directory's index
+  char storedPath[SDCardManager::MAX_PATH_LENGTH];
+  if (pathLength >= sizeof(storedPath) || file.read(storedPath, pathLength) != static_cast<int>(pathLength) ||
+      memcmp(storedPath, path, pathLength) != 0) {
+    file.close();
+    return false;
+  }
+
+  stored.count = get32(header + 8);
+  stored.hash = get32(header + 12);
+  stored.nameHash = get32(header + 16);
+  entryCount = get32(header + 4);
+  tableOffset = get32(header + 20);
+  recordsOffset = HEADER_SIZE + pathLength;
+  return true;
+}
+
+bool DirectoryIndex::build(const char* path, const Signature& signature) {
+  const unsigned long start = millis();
+  if (!sd.ensureDirectoryExists(CACHE_DIR)) {
+    return false;
+  }
+
+  uint16_t runCount = 0;
+  uint32_t totalEntries = 0;
+  if (!buildRuns(path, runCount, totalEntries)) {
+    return false;
+  }
+
+  // Merge MERGE_WAYS runs at a time until a single final pass can produce the index
+  uint16_t first = 0;
+  uint16_t count = runCount;
+  uint16_t nextRun = runCount;
+  char outPath[64];
+  while (count > MERGE_WAYS) {
+    uint16_t produced = 0;
+    for (uint16_t group = 0; group < count; group += MERGE_WAYS) {
+      runPath(nextRun + produced, outPath, sizeof(outPath));
+      const uint16_t ways = min<uint16_t>(MERGE_WAYS, count - group);
+      if (!mergeRuns(first + group, ways, outPath, false, path, signature, totalEntries)) {
+        return false;
+      }
+      produced++;
+    }
+    first = nextRun;
+    count = produced;
+    nextRun += produced;
+  }
+
+  // Write next to the old index and swap, so a failed build never leaves a truncated index behind
+  char indexPath[64];
+  indexPathFor(path, indexPath, sizeof(indexPath));
+  snprintf(outPath, sizeof(outPath), "%s.tmp", indexPath);
+  if (!mergeRuns(first, count, outPath, true, path, signature, totalEntries)) {
+    return false;
+  }
+  sd.remove(indexPath);  // Nothing to remove on the first build
+  if (!sd.rename(outPath, indexPath)) {
+    return false;
+  }
+
+  if (Serial) {
+    Serial.printf("[%lu] [DIX] Indexed %s: %lu entries, %u runs (%lu ms)\n", millis(), path, totalEntries, runCount,
+                  millis() - start);
+  }
+  return true;
+}
+
+bool DirectoryIndex::buildRuns(const char* path, uint16_t& runCount, uint32_t& totalEntries) {
+  auto* arena = static_cast<uint8_t*>(malloc(sortBufferSize));
+  if (!arena) {
+    if (Serial) Serial.printf("[%lu] [DIX] Failed to allocate %u byte sort buffer\n", millis(), sortBufferSize);
+    return false;
+  }
+
+  RunBuilder builder{};
+  builder.sd = &sd;
+  builder.arena = arena;
+  builder.arenaSize = sortBufferSize & ~static_cast<size_t>(3);
+  builder.offsets = reinterpret_cast<uint32_t*>(arena + builder.arenaSize) - 1;
+
+  struct Context {
+    RunBuilder* builder;
+  } context{&builder};
+
+  sd.listDirectory(
+      path,
+      [](const SDCardManager::DirEntry& entry, void* ctx) {
+        RunBuilder& b = *static_cast<Context*>(ctx)->builder;
+        const size_t nameLength = min<size_t>(strlen(entry.name), 255);
+        const size_t size = RECORD_HEADER_SIZE + nameLength;
+        if (!b.fits(size) && !b.spill(&DirectoryIndex::runPath)) {
+          b.failed = true;
+          return false;
+        }
+
+        uint8_t* record = b.arena + b.used;
+        put64(record, entry.size);
+        put16(record + 8, entry.modifyDate);
+        put16(record + 10, entry.modifyTime);
+        record[12] = (entry.isDirectory ? FLAG_DIRECTORY : 0) | (entry.isHidden ? FLAG_HIDDEN : 0);
+        record[13] = static_cast<uint8_t>(nameLength);
+        memcpy(record + RECORD_HEADER_SIZE, entry.name, nameLength);
+
+        *(b.offsets - b.count) = static_cast<uint32_t>(b.used);
+        b.used += size;
+        b.count++;
+        b.totalEntries++;
+        return true;
+      },
+      &context);
+
+  const bool ok = !builder.failed && builder.spill(&DirectoryIndex::runPath);
+  free(arena);
+
+  runCount = builder.runCount;
+  totalEntries = builder.totalEntries;
+  return ok;
+}
+
+bool DirectoryIndex::mergeRuns(const uint16_t first, const uint16_t count, const char* outPath, const bool finalPass,
+                               const char* dirPath, const Signature& signature, const uint32_t totalEntries) {
+  std::vector<RunReader> readers(count);
+  std::vector<bool> active(count, false);
+  char path[64];
+  for (uint16_t i = 0; i < count; i++) {
+    runPath(first + i, path, sizeof(path));
+    if (!readers[i].open(sd, path)) {
+      return false;
+    }
+    active[i] = readers[i].advance();
+  }
+
+  FsFile out;
+  if (!sd.openFileForWrite("DIX", outPath, out)) {
+    return false;
+  }
+  SectorWriter writer(out);
+
+  const size_t pathLength = trimmedLength(dirPath);
+  std::vector<uint32_t> table;
+  bool ok = true;
+  if (finalPass) {
+    // Header is written last, once the table offset is known
+    uint8_t header[HEADER_SIZE] = {};
+    ok = writer.write(header, HEADER_SIZE) && writer.write(dirPath, pathLength);
+    table.reserve(totalEntries / TABLE_STRIDE + 1);
+  }
+
+  uint32_t written = 0;
+  while (ok) {
+    int best = -1;
+    for (uint16_t i = 0; i < count; i++) {
+      if (active[i] && (best < 0 || compareRecords(readers[i].record, readers[best].record) < 0)) {
+        best = i;
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+
+    if (finalPass && written % TABLE_STRIDE == 0) {
+      table.push_back(writer.bytesWritten());
+    }
+    ok = writer.write(readers[best].record, recordSize(readers[best].record));
+    written++;
+    active[best] = readers[best].advance();
+  }
+
+  uint32_t tableOffset = 0;
+  if (ok && finalPass) {
+    tableOffset = writer.bytesWritten();
+    for (const uint32_t offset : table) {
+      uint8_t raw[4];
+      put32(raw, offset);
+      ok = writer.write(raw, 4);
+      if (!ok) {
+        break;
+      }
+    }
+  }
+  ok = ok && writer.flush();
+
+  if (ok && finalPass) {
+    uint8_t header[HEADER_SIZE] = {};
+    memcpy(header, MAGIC, 4);
+    put32(header + 4, written);
+    put32(header + 8, signature.count);
+    put32(header + 12, signature.hash);
+    put32(header + 16, signature.nameHash);
+    put32(header + 20, tableOffset);
+    put16(header + 24, static_cast<uint16_t>(pathLength));
+    put16(header + 26, TABLE_STRIDE);
+    ok = out.seekSet(0) && out.write(header, HEADER_SIZE) == HEADER_SIZE;
+  }
+  out.close();
+
+  for (uint16_t i = 0; i < count; i++) {
+    readers[i].close();
+    runPath(first + i, path, sizeof(path));
+    sd.remove(path);
+  }
+  return ok;
+}
+
+void DirectoryIndex::indexPathFor(const char* path, char* out, const size_t outSize) {
+  snprintf(out, outSize, "%s/%08lx.idx", CACHE_DIR, static_cast<unsigned long>(fnv1a(path, trimmedLength(path))));
+}
+
+void DirectoryIndex::runPath(const uint16_t run, char* out, const size_t outSize) {
+  snprintf(out, outSize, "%s/run%u.tmp", CACHE_DIR, run);
+}
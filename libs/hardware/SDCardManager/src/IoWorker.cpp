@@ -0,0 +1,381 @@
+#include "IoWorker.h"
+
+#include <cstring>
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+struct IoWorker::Platform {
+  SemaphoreHandle_t lock = nullptr;
+  SemaphoreHandle_t work = nullptr;  // Counting, one give per submitted request
+  TaskHandle_t task = nullptr;
+  TaskHandle_t stopper = nullptr;  // Task waiting in stop()
+  std::atomic<bool> stopped{false};
+
+  // The semaphores outlive the task, so calls racing end() never find them deleted
+  ~Platform() {
+    if (work) {
+      vSemaphoreDelete(work);
+    }
+    if (lock) {
+      vSemaphoreDelete(lock);
+    }
+  }
+
+  bool start(IoWorker* worker, const uint8_t priority, const int8_t core) {
+    if (!lock) {
+      lock = xSemaphoreCreateMutex();
+    }
+    if (!work) {
+      work = xSemaphoreCreateCounting(0xFFFF, 0);
+    }
+    if (!lock || !work) {
+      return false;
+    }
+    stopped.store(false, std::memory_order_relaxed);
+    const BaseType_t affinity = core < 0 ? tskNO_AFFINITY : core;
+    return xTaskCreatePinnedToCore(&IoWorker::taskEntry, "sdio", 4096, worker, priority, &task, affinity) == pdPASS;
+  }
+  void stop() {
+    stopper = xTaskGetCurrentTaskHandle();
+    xSemaphoreGive(work);
+    while (!stopped.load(std::memory_order_acquire)) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+  }
+  void finished() {
+    stopped.store(true, std::memory_order_release);
+    xTaskNotifyGive(stopper);
+    vTaskDelete(nullptr);
+  }
+  void acquire() { xSemaphoreTake(lock, portMAX_DELAY); }
+  void release() { xSemaphoreGive(lock); }
+  void signal() { xSemaphoreGive(work); }
+  void waitForWork() { xSemaphoreTake(work, portMAX_DELAY); }
+  // The waiter registers under the lock, so either complete() sees it and notifies, or the waiter sees `done`. A
+  // notification that arrives early (or is left over) just costs one more check.
+  void waitForCompletion(IoRequest& request) {
+    acquire();
+    if (!request.done.load(std::memory_order_acquire)) {
+      request.waiter = xTaskGetCurrentTaskHandle();
+    }
+    release();
+    while (!request.done.load(std::memory_order_acquire)) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+  }
+  void complete(IoRequest& request) {
+    acquire();
+    TaskHandle_t waiter = static_cast<TaskHandle_t>(request.waiter);
+    request.waiter = nullptr;
+    request.done.store(true, std::memory_order_release);
+    release();
+    if (waiter) {
+      xTaskNotifyGive(waiter);
+    }
+  }
+};
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct IoWorker::Platform {
+  std::mutex mutex;
+  std::condition_variable workReady;
+  std::condition_variable requestDone;
+  std::thread thread;
+  size_t signals = 0;
+
+  bool start(IoWorker* worker, uint8_t, int8_t) {
+    thread = std::thread(&IoWorker::taskEntry, worker);
+    return true;
+  }
+  void stop() {
+    signal();
+    thread.join();
+  }
+  void finished() {}
+  void acquire() { mutex.lock(); }
+  void release() { mutex.unlock(); }
+  void signal() {
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      signals++;
+    }
+    workReady.notify_one();
+  }
+  void waitForWork() {
+    std::unique_lock<std::mutex> guard(mutex);
+    workReady.wait(guard, [this] { return signals > 0; });
+    signals--;
+  }
+  void waitForCompletion(IoRequest& request) {
+    std::unique_lock<std::mutex> guard(mutex);
+    requestDone.wait(guard, [&request] { return request.done.load(std::memory_order_acquire); });
+  }
+  void complete(IoRequest& request) {
+    // Setting `done` under the lock orders it against a waiter's check, so the notify cannot be missed
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      request.done.store(true, std::memory_order_release);
+    }
+    requestDone.notify_all();
+  }
+};
+#endif
+
+IoWorker::IoWorker(SDCardManager& sd) : sd(sd) {}
+
+IoWorker::~IoWorker() {
+  end();
+  delete platform;
+}
+
+bool IoWorker::begin(const uint8_t taskPriority, const int8_t core) {
+  if (running) {
+    return true;
+  }
+
+  // Kept until the worker is destroyed, see end()
+  if (!platform) {
+    platform = new Platform();
+  }
+  running = true;
+  if (!platform->start(this, taskPriority, core)) {
+    if (Serial) Serial.printf("[%lu] [SDIO] Failed to start I/O worker\n", millis());
+    running = false;
+    return false;
+  }
+  return true;
+}
+
+void IoWorker::end() {
+  if (!platform) {
+    return;
+  }
+
+  // Cleared under the lock, so a racing submit() either queued its request first, and the worker drains it, or sees
+  // the flag and fails. The platform is not deleted here, a task that read the flag a moment ago may still use it.
+  platform->acquire();
+  const bool wasRunning = running;
+  running = false;
+  platform->release();
+  if (wasRunning) {
+    platform->stop();
+  }
+}
+
+bool IoWorker::submit(IoRequest& request) {
+  if (!platform || !request.path) {
+    return false;
+  }
+
+  platform->acquire();
+  if (!running) {
+    platform->release();
+    return false;
+  }
+  for (const IoRequest* list : {foregroundHead, prefetchHead}) {
+    for (const IoRequest* r = list; r; r = r->next) {
+      if (r == &request) {
+        platform->release();
+        return false;
+      }
+    }
+  }
+
+  request.done.store(false, std::memory_order_relaxed);
+  request.ok = false;
+  request.result = 0;
+  request.next = nullptr;
+  request.waiter = nullptr;
+  IoRequest*& head = request.priority == PRIORITY_FOREGROUND ? foregroundHead : prefetchHead;
+  IoRequest*& tail = request.priority == PRIORITY_FOREGROUND ? foregroundTail : prefetchTail;
+  if (tail) {
+    tail->next = &request;
+  } else {
+    head = &request;
+  }
+  tail = &request;
+  queued++;
+  platform->release();
+
+  platform->signal();
+  return true;
+}
+
+bool IoWorker::unlink(IoRequest*& head, IoRequest*& tail, IoRequest& request) {
+  IoRequest* previous = nullptr;
+  for (IoRequest* r = head; r; previous = r, r = r->next) {
+    if (r != &request) {
+      continue;
+    }
+    (previous ? previous->next : head) = r->next;
+    if (tail == r) {
+      tail = previous;
+    }
+    r->next = nullptr;
+    return true;
+  }
+  return false;
+}
+
+void IoWorker::finishCancelled(IoRequest& request) {
+  request.result = 0;
+  request.ok = false;
+  platform->complete(request);
+}
+
+bool IoWorker::cancel(IoRequest& request) {
+  if (!platform) {
+    return false;
+  }
+
+  platform->acquire();
+  const bool removed =
+      unlink(foregroundHead, foregroundTail, request) || unlink(prefetchHead, prefetchTail, request);
+  if (removed) {
+    queued--;
+  }
+  platform->release();
+
+  if (removed) {
+    finishCancelled(request);
+  }
+  return removed;
+}
+
+void IoWorker::cancelPrefetches() {
+  if (!platform) {
+    return;
+  }
+
+  platform->acquire();
+  IoRequest* r = prefetchHead;
+  prefetchHead = nullptr;
+  prefetchTail = nullptr;
+  for (const IoRequest* c = r; c; c = c->next) {
+    queued--;
+  }
+  platform->release();
+
+  // Once done the owner may reuse a request, so step past it first
+  while (r) {
+    IoRequest* next = r->next;
+    r->next = nullptr;
+    finishCancelled(*r);
+    r = next;
+  }
+}
+
+bool IoWorker::wait(IoRequest& request) {
+  if (platform) {
+    platform->waitForCompletion(request);
+  }
+  return request.ok;
+}
+
+bool IoWorker::run(IoRequest& request) { return submit(request) && wait(request); }
+
+size_t IoWorker::pending() const {
+  if (!platform) {
+    return 0;
+  }
+  platform->acquire();
+  const size_t count = queued;
+  platform->release();
+  return count;
+}
+
+void IoWorker::taskEntry(void* arg) {
+  auto* worker = static_cast<IoWorker*>(arg);
+  worker->loop();
+  worker->platform->finished();
+}
+
+// Next request to run, foreground first
+IoWorker::IoRequest* IoWorker::take() {
+  platform->acquire();
+  IoRequest* request = foregroundHead ? foregroundHead : prefetchHead;
+  if (request) {
+    if (request == foregroundHead) {
+      unlink(foregroundHead, foregroundTail, *request);
+    } else {
+      unlink(prefetchHead, prefetchTail, *request);
+    }
+    queued--;
+  }
+  platform->release();
+  return request;
+}
+
+void IoWorker::loop() {
+  while (true) {
+    platform->waitForWork();
+
+    // Cancelled requests leave extra signals behind, so always drain whatever is queued
+    while (IoRequest* request = take()) {
+      execute(*request);
+      if (request->callback) {
+        request->callback(*request, request->context);
+      }
+      platform->complete(*request);
+    }
+
+    // A request queued just before end() cleared the flag must still be served, so check both under the lock
+    platform->acquire();
+    const bool stop = !running && !foregroundHead && !prefetchHead;
+    platform->release();
+    if (stop) {
+      break;
+    }
+  }
+
+  if (file) {
+    file.close();
+  }
+}
+
+bool IoWorker::openFor(const IoRequest& request) {
+  const bool writable = request.operation == IO_WRITE;
+  if (file && strcmp(filePath, request.path) == 0 && (fileWritable || !writable)) {
+    return true;
+  }
+  if (file) {
+    file.close();
+  }
+
+  filePath[0] = '\0';
+  if (writable) {
+    file = sd.open(request.path, O_RDWR | O_CREAT);
+    if (!file) {
+      if (Serial) Serial.printf("[%lu] [SDIO] Failed to open file for writing: %s\n", millis(), request.path);
+      return false;
+    }
+  } else if (!sd.openFileForRead("SDIO", request.path, file)) {
+    return false;
+  }
+
+  strncpy(filePath, request.path, sizeof(filePath) - 1);
+  filePath[sizeof(filePath) - 1] = '\0';
+  fileWritable = writable;
+  return true;
+}
+
+void IoWorker::execute(IoRequest& request) {
+  if (!openFor(request) || !file.seekSet(request.offset)) {
+    return;
+  }
+
+  if (request.operation == IO_READ) {
+    const int r = request.length > 0 ? file.read(request.buffer, request.length) : 0;
+    request.result = r > 0 ? static_cast<size_t>(r) : 0;
+    request.ok = r >= 0;
+  } else {
+    request.result = file.write(request.buffer, request.length);
+    request.ok = request.result == request.length && file.sync();
+  }
+}
@@ -0,0 +1,459 @@
+#include "KvStore.h"
+
+#include <cstdlib>
+
+#include "BinaryIO.h"
+#include "BufferedReader.h"
+#include "BufferedWriter.h"
+
+namespace {
+constexpr uint8_t MAGIC[4] = {'K', 'V', 'S', '1'};
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t HEADER_SIZE = 8;
+
+// Record: crc u32 over the rest of the record, type u8, key length u8, value length u16, key, value
+constexpr size_t RECORD_HEADER_SIZE = 8;
+constexpr uint8_t TYPE_PUT = 1;
+constexpr uint8_t TYPE_DELETE = 2;
+
+constexpr size_t COPY_CHUNK_SIZE = 256;
+
+using BinaryIO::CRC_INIT;
+using BinaryIO::crc32;
+using BinaryIO::get16;
+using BinaryIO::get32;
+using BinaryIO::put16;
+using BinaryIO::put32;
+}  // namespace
+
+KvStore::KvStore(const size_t bufferSectors) : capacity((bufferSectors > 0 ? bufferSectors : 1) * SECTOR_SIZE) {}
+
+KvStore::~KvStore() {
+  close();
+  free(pending);
+}
+
+bool KvStore::open(const char* logPath, SDCardManager& sdManager) {
+  close();
+  if (strlen(logPath) >= sizeof(path)) {
+    if (Serial) Serial.printf("[%lu] [KVS] Path too long: %s\n", millis(), logPath);
+    return false;
+  }
+  if (!pending) {
+    pending = static_cast<uint8_t*>(malloc(capacity));
+    if (!pending) {
+      if (Serial) Serial.printf("[%lu] [KVS] Failed to allocate %u byte append buffer\n", millis(), capacity);
+      return false;
+    }
+  }
+
+  sd = &sdManager;
+  strcpy(path, logPath);
+  // Finishes a compaction that was interrupted while swapping the logs
+  BufferedWriter::recover(path, *sd);
+
+  file = sd->open(path, O_RDWR | O_CREAT);
+  if (!file) {
+    if (Serial) Serial.printf("[%lu] [KVS] Failed to open %s\n", millis(), path);
+    return false;
+  }
+  if (!load()) {
+    file.close();
+    return false;
+  }
+  return true;
+}
+
+void KvStore::close() {
+  if (!file) {
+    return;
+  }
+  flush();
+  file.close();
+  free(slots);
+  slots = nullptr;
+  slotCount = count = 0;
+  logSize = flushedSize = liveBytes = 0;
+  pendingLen = 0;
+}
+
+// Scans the log and indexes the latest record of every key, cutting the log at the first invalid record
+bool KvStore::load() {
+  if (slots) {
+    memset(slots, 0, slotCount * sizeof(Slot));
+  }
+  count = 0;
+  pendingLen = 0;
+
+  const uint64_t size = file.fileSize();
+  uint8_t header[HEADER_SIZE];
+  if (size == 0) {
+    memcpy(header, MAGIC, sizeof(MAGIC));
+    put32(header + 4, VERSION);
+    if (file.write(header, HEADER_SIZE) != HEADER_SIZE || !file.sync()) {
+      if (Serial) Serial.printf("[%lu] [KVS] Failed to create %s\n", millis(), path);
+      return false;
+    }
+    logSize = flushedSize = liveBytes = HEADER_SIZE;
+    return true;
+  }
+
+  if (size > UINT32_MAX || size < HEADER_SIZE || !file.seekSet(0) || file.read(header, HEADER_SIZE) != HEADER_SIZE ||
+      memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || get32(header + 4) != VERSION) {
+    if (Serial) Serial.printf("[%lu] [KVS] %s is not a key-value log\n", millis(), path);
+    return false;
+  }
+
+  BufferedReader reader;
+  if (!reader.attach(file)) {
+    return false;
+  }
+
+  uint32_t end = HEADER_SIZE;
+  liveBytes = HEADER_SIZE;
+  uint8_t record[RECORD_HEADER_SIZE];
+  uint8_t chunk[COPY_CHUNK_SIZE];
+  while (end < size) {
+    if (reader.read(record, RECORD_HEADER_SIZE) != RECORD_HEADER_SIZE) {
+      break;
+    }
+    const uint8_t type = record[4];
+    const uint8_t keyLen = record[5];
+    const uint32_t length = RECORD_HEADER_SIZE + keyLen + get16(record + 6);
+    if ((type != TYPE_PUT && type != TYPE_DELETE) || keyLen == 0 || end + length > size) {
+      break;
+    }
+
+    uint32_t crc = crc32(CRC_INIT, record + 4, RECORD_HEADER_SIZE - 4);
+    if (reader.read(chunk, keyLen) != keyLen) {
+      break;
+    }
+    crc = crc32(crc, chunk, keyLen);
+    const uint64_t hash = hashKey(reinterpret_cast<const char*>(chunk), keyLen);
+
+    size_t remaining = length - RECORD_HEADER_SIZE - keyLen;
+    while (remaining > 0) {
+      const size_t n = reader.read(chunk, min(remaining, sizeof(chunk)));
+      if (n == 0) {
+        break;
+      }
+      crc = crc32(crc, chunk, n);
+      remaining -= n;
+    }
+    if (remaining > 0 || (crc ^ CRC_INIT) != get32(record)) {
+      break;
+    }
+
+    if (type == TYPE_PUT) {
+      if (!indexRecord(hash, end, length)) {
+        reader.close();
+        return false;
+      }
+    } else {
+      unindex(hash);
+    }
+    end += length;
+  }
+  reader.close();
+
+  if (end < size) {
+    if (Serial)
+      Serial.printf("[%lu] [KVS] Dropping %lu byte torn tail of %s\n", millis(), static_cast<unsigned long>(size - end),
+                    path);
+    if (!file.truncate(end) || !file.sync()) {
+      if (Serial) Serial.printf("[%lu] [KVS] Failed to truncate %s\n", millis(), path);
+      return false;
+    }
+  }
+  logSize = flushedSize = end;
+  return true;
+}
+
+uint64_t KvStore::hashKey(const char* key, const size_t length) {
+  // 64-bit FNV-1a, treated as the key's identity in the index. get() still compares the stored key.
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ static_cast<uint8_t>(key[i])) * 1099511628211ull;
+  }
+  return hash != 0 ? hash : 1;
+}
+
+int32_t KvStore::findSlot(const uint64_t hash) const {
+  if (slotCount == 0) {
+    return -1;
+  }
+  const uint32_t mask = slotCount - 1;
+  for (uint32_t i = hash & mask; slots[i].hash != 0; i = (i + 1) & mask) {
+    if (slots[i].hash == hash) {
+      return static_cast<int32_t>(i);
+    }
+  }
+  return -1;
+}
+
+bool KvStore::growIndex() {
+  const uint32_t newCount = slotCount > 0 ? slotCount * 2 : 16;
+  auto* newSlots = static_cast<Slot*>(calloc(newCount, sizeof(Slot)));
+  if (!newSlots) {
+    if (Serial)
+      Serial.printf("[%lu] [KVS] Failed to grow index to %lu slots\n", millis(), static_cast<unsigned long>(newCount));
+    return false;
+  }
+
+  const uint32_t mask = newCount - 1;
+  for (uint32_t i = 0; i < slotCount; i++) {
+    if (slots[i].hash == 0) {
+      continue;
+    }
+    uint32_t j = slots[i].hash & mask;
+    while (newSlots[j].hash != 0) {
+      j = (j + 1) & mask;
+    }
+    newSlots[j] = slots[i];
+  }
+  free(slots);
+  slots = newSlots;
+  slotCount = newCount;
+  return true;
+}
+
+bool KvStore::indexRecord(const uint64_t hash, const uint32_t offset, const uint32_t length) {
+  // Keep the load factor at or below 3/4
+  if ((count + 1) * 4 > slotCount * 3 && !growIndex()) {
+    return false;
+  }
+
+  const uint32_t mask = slotCount - 1;
+  uint32_t i = hash & mask;
+  while (slots[i].hash != 0 && slots[i].hash != hash) {
+    i = (i + 1) & mask;
+  }
+  if (slots[i].hash == hash) {
+    liveBytes -= slots[i].length;
+  } else {
+    count++;
+  }
+  slots[i] = {hash, offset, length};
+  liveBytes += length;
+  return true;
+}
+
+void KvStore::unindex(const uint64_t hash) {
+  const int32_t found = findSlot(hash);
+  if (found < 0) {
+    return;
+  }
+  uint32_t i = found;
+  liveBytes -= slots[i].length;
+  count--;
+
+  // Backward shift deletion: pull later entries of the probe run into the hole so lookups need no tombstones
+  const uint32_t mask = slotCount - 1;
+  for (uint32_t j = (i + 1) & mask; slots[j].hash != 0; j = (j + 1) & mask) {
+    const uint32_t home = slots[j].hash & mask;
+    const bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+    if (!stays) {
+      slots[i] = slots[j];
+      i = j;
+    }
+  }
+  slots[i].hash = 0;
+}
+
+bool KvStore::put(const char* key, const void* value, const size_t length) {
+  return append(TYPE_PUT, key, value, length);
+}
+
+bool KvStore::remove(const char* key) {
+  if (!contains(key)) {
+    return true;
+  }
+  return append(TYPE_DELETE, key, nullptr, 0);
+}
+
+bool KvStore::append(const uint8_t type, const char* key, const void* value, const size_t length) {
+  const size_t keyLen = strlen(key);
+  if (!file || keyLen == 0 || keyLen > MAX_KEY_LENGTH || length > MAX_VALUE_LENGTH) {
+    return false;
+  }
+
+  uint8_t header[RECORD_HEADER_SIZE];
+  header[4] = type;
+  header[5] = static_cast<uint8_t>(keyLen);
+  put16(header + 6, static_cast<uint16_t>(length));
+  uint32_t crc = crc32(CRC_INIT, header + 4, RECORD_HEADER_SIZE - 4);
+  crc = crc32(crc, key, keyLen);
+  crc = crc32(crc, value, length);
+  put32(header, crc ^ CRC_INIT);
+
+  const size_t recordLen = RECORD_HEADER_SIZE + keyLen + length;
+  if (pendingLen + recordLen > capacity && !flushPending()) {
+    return false;
+  }
+
+  if (recordLen > capacity) {
+    // Larger than the buffer, goes straight to the card behind the already flushed records
+    if (!file.seekSet(flushedSize) || file.write(header, RECORD_HEADER_SIZE) != RECORD_HEADER_SIZE ||
+        file.write(key, keyLen) != keyLen || file.write(value, length) != length) {
+      if (Serial) Serial.printf("[%lu] [KVS] Failed to append to %s\n", millis(), path);
+      return false;
+    }
+    flushedSize += recordLen;
+  } else {
+    memcpy(pending + pendingLen, header, RECORD_HEADER_SIZE);
+    memcpy(pending + pendingLen + RECORD_HEADER_SIZE, key, keyLen);
+    if (length > 0) {
+      memcpy(pending + pendingLen + RECORD_HEADER_SIZE + keyLen, value, length);
+    }
+    pendingLen += recordLen;
+  }
+
+  const uint32_t offset = logSize;
+  logSize += recordLen;
+  const uint64_t hash = hashKey(key, keyLen);
+  if (type == TYPE_PUT) {
+    return indexRecord(hash, offset, recordLen);
+  }
+  unindex(hash);
+  return true;
+}
+
+bool KvStore::flushPending() {
+  if (pendingLen == 0) {
+    return true;
+  }
+  if (!file.seekSet(flushedSize) || file.write(pending, pendingLen) != pendingLen) {
+    if (Serial) Serial.printf("[%lu] [KVS] Failed to append to %s\n", millis(), path);
+    return false;
+  }
+  flushedSize += pendingLen;
+  pendingLen = 0;
+  return true;
+}
+
+bool KvStore::flush() { return file && flushPending() && file.sync(); }
+
+// Reads log bytes, from the card or from records still pending in RAM
+bool KvStore::readAt(const uint32_t offset, void* out, const size_t length) {
+  if (offset + length > logSize) {
+    return false;
+  }
+  auto* bytes = static_cast<uint8_t*>(out);
+  size_t fromCard = 0;
+  if (offset < flushedSize) {
+    fromCard = min(length, static_cast<size_t>(flushedSize - offset));
+    if (!file.seekSet(offset) || file.read(bytes, fromCard) != static_cast<int>(fromCard)) {
+      return false;
+    }
+  }
+  if (fromCard < length) {
+    memcpy(bytes + fromCard, pending + (offset + fromCard - flushedSize), length - fromCard);
+  }
+  return true;
+}
+
+int KvStore::get(const char* key, void* out, const size_t outSize) {
+  const size_t keyLen = strlen(key);
+  const int32_t i = findSlot(hashKey(key, keyLen));
+  if (i < 0) {
+    return -1;
+  }
+
+  const Slot& slot = slots[i];
+  uint8_t record[RECORD_HEADER_SIZE + MAX_KEY_LENGTH];
+  if (!readAt(slot.offset, record, RECORD_HEADER_SIZE + keyLen)) {
+    if (Serial) Serial.printf("[%lu] [KVS] Failed to read %s from %s\n", millis(), key, path);
+    return -1;
+  }
+  if (record[5] != keyLen || memcmp(record + RECORD_HEADER_SIZE, key, keyLen) != 0) {
+    return -1;
+  }
+
+  const uint16_t valueLen = get16(record + 6);
+  const size_t n = min(outSize, static_cast<size_t>(valueLen));
+  if (n > 0 && !readAt(slot.offset + RECORD_HEADER_SIZE + keyLen, out, n)) {
+    if (Serial) Serial.printf("[%lu] [KVS] Failed to read %s from %s\n", millis(), key, path);
+    return -1;
+  }
+  return valueLen;
+}
+
+String KvStore::getString(const char* key, const char* defaultValue) {
+  const int length = get(key, nullptr, 0);
+  if (length < 0) {
+    return {defaultValue};
+  }
+
+  auto* buffer = static_cast<char*>(malloc(length + 1));
+  if (!buffer) {
+    return {defaultValue};
+  }
+  String value = "";
+  if (get(key, buffer, length) == length) {
+    buffer[length] = '\0';
+    value = buffer;
+  } else {
+    value = defaultValue;
+  }
+  free(buffer);
+  return value;
+}
+
+uint32_t KvStore::getUint32(const char* key, const uint32_t defaultValue) {
+  uint32_t value;
+  return get(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+bool KvStore::compact() {
+  if (!file || !flushPending()) {
+    return false;
+  }
+
+  BufferedWriter writer;
+  if (!writer.open(path, liveBytes, *sd)) {
+    return false;
+  }
+
+  uint8_t header[HEADER_SIZE];
+  memcpy(header, MAGIC, sizeof(MAGIC));
+  put32(header + 4, VERSION);
+  writer.write(header, HEADER_SIZE);
+
+  uint8_t chunk[COPY_CHUNK_SIZE];
+  for (uint32_t i = 0; i < slotCount && !writer.hasError(); i++) {
+    if (slots[i].hash == 0) {
+      continue;
+    }
+    for (uint32_t copied = 0; copied < slots[i].length;) {
+      const size_t n = min(static_cast<size_t>(slots[i].length - copied), sizeof(chunk));
+      if (!readAt(slots[i].offset + copied, chunk, n)) {
+        writer.abort();
+        if (Serial) Serial.printf("[%lu] [KVS] Compaction of %s failed while reading\n", millis(), path);
+        return false;
+      }
+      writer.write(chunk, n);
+      copied += n;
+    }
+  }
+  if (writer.hasError()) {
+    writer.abort();
+    return false;
+  }
+
+  // The log must be closed before commit() renames it
+  const uint32_t before = logSize;
+  file.close();
+  const bool committed = writer.commit();
+  file = sd->open(path, O_RDWR);
+  if (!file || !load()) {
+    if (Serial) Serial.printf("[%lu] [KVS] Failed to reopen %s after compaction\n", millis(), path);
+    file.close();
+    return false;
+  }
+  if (committed) {
+    if (Serial)
+      Serial.printf("[%lu] [KVS] Compacted %s from %lu to %lu bytes\n", millis(), path,
+                    static_cast<unsigned long>(before), static_cast<unsigned long>(logSize));
+  }
+  return committed;
+}
@@ -1,8 +1,23 @@
 #include "SDCardManager.h"
 
+#include <cstdlib>
+
+#include "BlockCache.h"
+#include "BufferedWriter.h"
+
 namespace {
 constexpr uint8_t SD_CS = 12;
 constexpr uint32_t SPI_FQ = 40000000;
+constexpr size_t SECTOR_SIZE = 512;
+constexpr size_t READ_FILE_MAX_SIZE = 50000;  // Limit for the String variant of readFile
+
+// Bytes to read for a file of `fileSize`, capped to `maxBytes` (0 = no cap)
+size_t cappedReadSize(const uint64_t fileSize, const size_t maxBytes) {
+  if (maxBytes != 0 && fileSize > maxBytes) {
+    return maxBytes;
+  }
+  return static_cast<size_t>(fileSize);
+}
 }
 
 SDCardManager SDCardManager::instance;
@@ -26,37 +41,94 @@ bool SDCardManager::ready() const {
 }
 
 std::vector<String> SDCardManager::listFiles(const char* path, const int maxFiles) {
-  std::vector<String> ret;
+  struct Collector {
+    std::vector<String> files;
+    int maxFiles;
+  } collector{{}, maxFiles};
+
+  listDirectory(
+      path,
+      [](const DirEntry& entry, void* context) {
+        auto* c = static_cast<Collector*>(context);
+        if (static_cast<int>(c->files.size()) >= c->maxFiles) {
+          return false;
+        }
+        if (!entry.isDirectory) {
+          c->files.emplace_back(entry.name);
+        }
+        return true;
+      },
+      &collector);
+  return collector.files;
+}
+
+size_t SDCardManager::listDirectory(const char* path, const DirEntryCallback callback, void* context,
+                                    DirCursor* cursor, const size_t maxEntries) {
   if (!initialized) {
     if (Serial) Serial.printf("[%lu] [SD] not initialized, returning empty list\n", millis());
-    return ret;
+    return 0;
+  }
+  if (!callback || (cursor && cursor->done)) {
+    return 0;
   }
 
-  auto root = sd.open(path);
+  FsFile root = sd.open(path);
   if (!root) {
     if (Serial) Serial.printf("[%lu] [SD] Failed to open directory\n", millis());
-    return ret;
+    return 0;
   }
   if (!root.isDirectory()) {
     if (Serial) Serial.printf("[%lu] [SD] Path is not a directory\n", millis());
     root.close();
-    return ret;
+    return 0;
   }
 
-  int count = 0;
-  char name[128];
-  for (auto f = root.openNextFile(); f && count < maxFiles; f = root.openNextFile()) {
-    if (f.isDirectory()) {
-      f.close();
-      continue;
+  // The cursor is the byte offset into the directory file, resuming skips straight to it
+  if (cursor && cursor->position > 0 && !root.seekSet(cursor->position)) {
+    root.close();
+    return 0;
+  }
+
+  DirEntry entry;
+  FsFile f;
+  size_t count = 0;
+  bool reachedEnd = true;
+  while (maxEntries == 0 || count < maxEntries) {
+    if (!f.openNext(&root, O_RDONLY)) {
+      break;
+    }
+
+    f.getName(entry.name, sizeof(entry.name));
+    entry.size = f.fileSize();
+    entry.isDirectory = f.isDirectory();
+    entry.isHidden = f.isHidden();
+    if (!f.getModifyDateTime(&entry.modifyDate, &entry.modifyTime)) {
+      entry.modifyDate = 0;
+      entry.modifyTime = 0;
     }
-    f.getName(name, sizeof(name));
-    ret.emplace_back(name);
     f.close();
+
     count++;
+    if (cursor) {
+      cursor->position = root.curPosition();
+    }
+    if (!callback(entry, context)) {
+      reachedEnd = false;
+      break;
+    }
   }
+
+  // Stopped by the page size: only done if nothing follows
+  if (maxEntries != 0 && count == maxEntries && reachedEnd) {
+    reachedEnd = !f.openNext(&root, O_RDONLY);
+    f.close();
+  }
+  if (cursor) {
+    cursor->done = reachedEnd;
+  }
+
   root.close();
-  return ret;
+  return count;
 }
 
 String SDCardManager::readFile(const char* path) {
@@ -70,18 +142,76 @@ String SDCardManager::readFile(const char* path) {
     return {""};
   }
 
+  // Size the String once, then read whole sectors instead of one byte per call
+  const size_t toRead = cappedReadSize(f.fileSize(), READ_FILE_MAX_SIZE);
   String content = "";
-  constexpr size_t maxSize = 50000;  // Limit to 50KB
+  if (!content.reserve(toRead)) {
+    if (Serial) Serial.printf("[%lu] [SD] Not enough memory to read %s (%u bytes)\n", millis(), path, toRead);
+    f.close();
+    return content;
+  }
+
+  char buf[SECTOR_SIZE];
   size_t readSize = 0;
-  while (f.available() && readSize < maxSize) {
-    const char c = static_cast<char>(f.read());
-    content += c;
-    readSize++;
+  while (readSize < toRead) {
+    const size_t want = min(toRead - readSize, SECTOR_SIZE);
+    const int r = f.read(buf, want);
+    if (r <= 0) {
+      break;
+    }
+    content.concat(buf, static_cast<unsigned int>(r));
+    readSize += static_cast<size_t>(r);
   }
   f.close();
   return content;
 }
 
+bool SDCardManager::readFile(const char* path, std::string& out, const size_t maxBytes) {
+  out.clear();
+  if (!initialized) {
+    if (Serial) Serial.printf("[%lu] [SD] not initialized; cannot read file\n", millis());
+    return false;
+  }
+
+  FsFile f;
+  if (!openFileForRead("SD", path, f)) {
+    return false;
+  }
+
+  // One allocation, one read call: SdFat moves whole sectors straight into the string
+  const size_t toRead = cappedReadSize(f.fileSize(), maxBytes);
+  out.resize(toRead);
+  const int r = toRead > 0 ? f.read(&out[0], toRead) : 0;
+  f.close();
+
+  if (r < 0) {
+    out.clear();
+    return false;
+  }
+  out.resize(static_cast<size_t>(r));
+  return true;
+}
+
+size_t SDCardManager::readFile(const char* path, uint8_t* buffer, const size_t bufferSize) {
+  if (!buffer || bufferSize == 0) {
+    return 0;
+  }
+  if (!initialized) {
+    if (Serial) Serial.printf("[%lu] [SD] not initialized; cannot read file\n", millis());
+    return 0;
+  }
+
+  FsFile f;
+  if (!openFileForRead("SD", path, f)) {
+    return 0;
+  }
+
+  const size_t toRead = cappedReadSize(f.fileSize(), bufferSize);
+  const int r = f.read(buffer, toRead);
+  f.close();
+  return r > 0 ? static_cast<size_t>(r) : 0;
+}
+
 bool SDCardManager::readFileToStream(const char* path, Print& out, const size_t chunkSize) {
   if (!initialized) {
     if (Serial) Serial.printf("[%lu] [SD] Path is not a directory\n", millis());
@@ -94,9 +224,9 @@ bool SDCardManager::readFileToStream(const char* path, Print& out, const size_t
     return false;
   }
 
-  constexpr size_t localBufSize = 256;
-  uint8_t buf[localBufSize];
-  const size_t toRead = (chunkSize == 0) ? localBufSize : (chunkSize < localBufSize ? chunkSize : localBufSize);
+  // Whole sectors let SdFat read straight into the buffer instead of going through its sector cache
+  uint8_t buf[SECTOR_SIZE];
+  const size_t toRead = (chunkSize == 0) ? SECTOR_SIZE : (chunkSize < SECTOR_SIZE ? chunkSize : SECTOR_SIZE);
 
   while (f.available()) {
     const int r = f.read(buf, toRead);
@@ -128,19 +258,15 @@ size_t SDCardManager::readFileToBuffer(const char* path, char* buffer, const siz
   }
 
   const size_t maxToRead = (maxBytes == 0) ? (bufferSize - 1) : min(maxBytes, bufferSize - 1);
-  size_t total = 0;
-
-  while (f.available() && total < maxToRead) {
-    constexpr size_t chunk = 64;
-    const size_t want = maxToRead - total;
-    const size_t readLen = (want < chunk) ? want : chunk;
-    const int r = f.read(buffer + total, readLen);
-    if (r > 0) {
-      total += static_cast<size_t>(r);
-    } else {
-      break;
-    }
+  // cappedReadSize() takes 0 as no limit, a one byte buffer only has room for the terminator
+  if (maxToRead == 0) {
+    buffer[0] = '\0';
+    f.close();
+    return 0;
   }
+  const size_t toRead = cappedReadSize(f.fileSize(), maxToRead);
+  const int r = toRead > 0 ? f.read(buffer, toRead) : 0;
+  const size_t total = r > 0 ? static_cast<size_t>(r) : 0;
 
   buffer[total] = '\0';
   f.close();
@@ -154,21 +280,15 @@ bool SDCardManager::writeFile(const char* path, const String& content) {
     return false;
   }
 
-  // Remove existing file so we perform an overwrite rather than append
-  if (sd.exists(path)) {
-    sd.remove(path);
-  }
-
-  FsFile f;
-  if (!openFileForWrite("SD", path, f)) {
-    if (Serial) Serial.printf("[%lu] [SD] Path is not a directory\n", millis());
+  // Written next to the old file and swapped in, so the file is never missing or half written
+  BufferedWriter writer;
+  if (!writer.open(path, content.length(), *this)) {
     if (Serial) Serial.printf("Failed to open file for write: %s\n", path);
     return false;
   }
 
-  const size_t written = f.print(content);
-  f.close();
-  return written == content.length();
+  const size_t written = writer.print(content);
+  return writer.commit() && written == content.length();
 }
 
 bool SDCardManager::ensureDirectoryExists(const char* path) {
@@ -203,16 +323,50 @@ bool SDCardManager::ensureDirectoryExists(const char* path) {
 }
 
 bool SDCardManager::openFileForRead(const char* moduleName, const char* path, FsFile& file) {
-  if (!sd.exists(path)) {
-    if (Serial) Serial.printf("[%lu] [%s] File does not exist: %s\n", millis(), moduleName, path);
-    return false;
+  if (maxCachedHandles > 0) {
+    for (auto& entry : handleCache) {
+      if (entry.path == path) {
+        // A copy is an independent handle on the same directory entry, no path walk needed
+        file = entry.file;
+        file.rewind();
+        entry.lastUse = ++handleClock;
+        handleHits++;
+        return true;
+      }
+    }
+    handleMisses++;
   }
 
+  // A failed open already tells us the file is missing, no separate exists() walk
   file = sd.open(path, O_RDONLY);
   if (!file) {
-    if (Serial) Serial.printf("[%lu] [%s] Failed to open file for reading: %s\n", millis(), moduleName, path);
+    // Power lost in the middle of a BufferedWriter commit leaves the old file as "<path>.bak" and the new one as
+    // "<path>.tmp", finish the commit and try again
+    char backupPath[MAX_PATH_LENGTH];
+    if (snprintf(backupPath, sizeof(backupPath), "%s.bak", path) < static_cast<int>(sizeof(backupPath)) &&
+        sd.exists(backupPath)) {
+      BufferedWriter::recover(path, *this);
+      file = sd.open(path, O_RDONLY);
+    }
+  }
+  if (!file) {
+    if (Serial) Serial.printf("[%lu] [%s] File does not exist or failed to open: %s\n", millis(), moduleName, path);
     return false;
   }
+
+  if (maxCachedHandles > 0 && !file.isDirectory()) {
+    if (handleCache.size() >= maxCachedHandles) {
+      auto oldest = handleCache.begin();
+      for (auto it = handleCache.begin(); it != handleCache.end(); ++it) {
+        if (it->lastUse < oldest->lastUse) {
+          oldest = it;
+        }
+      }
+      oldest->file.close();
+      handleCache.erase(oldest);
+    }
+    handleCache.push_back({path, file, ++handleClock});
+  }
   return true;
 }
 
@@ -225,6 +379,7 @@ bool SDCardManager::openFileForRead(const char* moduleName, const String& path,
 }
 
 bool SDCardManager::openFileForWrite(const char* moduleName, const char* path, FsFile& file) {
+  invalidateHandles(path);
   file = sd.open(path, O_RDWR | O_CREAT | O_TRUNC);
   if (!file) {
     if (Serial) Serial.printf("[%lu] [%s] Failed to open file for writing: %s\n", millis(), moduleName, path);
@@ -241,37 +396,276 @@ bool SDCardManager::openFileForWrite(const char* moduleName, const String& path,
   return openFileForWrite(moduleName, path.c_str(), file);
 }
 
-bool SDCardManager::removeDir(const char* path) {
-  // 1. Open the directory
-  auto dir = sd.open(path);
-  if (!dir) {
+bool SDCardManager::removeDir(const char* path, const TreeProgressCallback progress, void* context) {
+  invalidateHandles(path);
+  TreeStats stats;
+  return walkTree(TREE_REMOVE, path, nullptr, stats, progress, context);
+}
+
+bool SDCardManager::copyTree(const char* from, const char* to, const TreeProgressCallback progress, void* context) {
+  // Copying a directory into itself would never finish; "/a/" is the same directory as "/a"
+  size_t fromLength = strlen(from);
+  while (fromLength > 1 && from[fromLength - 1] == '/') {
+    fromLength--;
+  }
+  const bool root = fromLength == 1 && from[0] == '/';
+  if (strncmp(from, to, fromLength) == 0 && (root || to[fromLength] == '\0' || to[fromLength] == '/')) {
+    if (Serial) Serial.printf("[%lu] [SD] Cannot copy %s into itself\n", millis(), from);
     return false;
   }
-  if (!dir.isDirectory()) {
+
+  invalidateHandles(to);
+  TreeStats stats;
+  return walkTree(TREE_COPY, from, to, stats, progress, context);
+}
+
+bool SDCardManager::diskUsage(const char* path, TreeStats& usage, const TreeProgressCallback progress,
+                              void* context) {
+  usage = {};
+  return walkTree(TREE_USAGE, path, nullptr, usage, progress, context);
+}
+
+namespace {
+// Appends "/name" to `path` at `length`, returns the new length or 0 if it does not fit
+size_t appendPathComponent(char* path, size_t length, const char* name, const size_t maxLength) {
+  const size_t nameLength = strlen(name);
+  const bool needsSeparator = length == 0 || path[length - 1] != '/';
+  if (length + needsSeparator + nameLength >= maxLength) {
+    return 0;
+  }
+  if (needsSeparator) {
+    path[length++] = '/';
+  }
+  memcpy(path + length, name, nameLength + 1);
+  return length + nameLength;
+}
+}
+
+bool SDCardManager::walkTree(const TreeOperation operation, const char* from, const char* to, TreeStats& stats,
+                             const TreeProgressCallback progress, void* context) {
+  if (!initialized) {
+    if (Serial) Serial.printf("[%lu] [SD] not initialized, cannot walk %s\n", millis(), from);
+    return false;
+  }
+
+  char path[MAX_PATH_LENGTH];
+  char target[MAX_PATH_LENGTH];
+  size_t pathLength[MAX_TREE_DEPTH];
+  size_t targetLength[MAX_TREE_DEPTH];
+  FsFile dirs[MAX_TREE_DEPTH];
+
+  const size_t rootLength = strlen(from);
+  if (rootLength >= MAX_PATH_LENGTH || (to && strlen(to) >= MAX_PATH_LENGTH)) {
+    return false;
+  }
+  memcpy(path, from, rootLength + 1);
+  pathLength[0] = rootLength;
+  targetLength[0] = 0;
+  if (to) {
+    targetLength[0] = strlen(to);
+    memcpy(target, to, targetLength[0] + 1);
+  }
+
+  dirs[0] = sd.open(from);
+  if (!dirs[0]) {
+    if (Serial) Serial.printf("[%lu] [SD] Failed to open %s\n", millis(), from);
     return false;
   }
 
-  auto file = dir.openNextFile();
-  char name[128];
-  while (file) {
-    String filePath = path;
-    if (!filePath.endsWith("/")) {
-      filePath += "/";
+  const uint64_t clusterSize = max<uint64_t>(sd.bytesPerCluster(), 1);
+  const auto countFile = [&stats, clusterSize](const uint64_t size) {
+    stats.files++;
+    stats.bytes += size;
+    stats.allocatedBytes += (size + clusterSize - 1) / clusterSize * clusterSize;
+  };
+
+  // Copies stream through one sector-aligned buffer, shared by every file of the walk
+  constexpr size_t copyBufferSize = 8 * SECTOR_SIZE;
+  uint8_t* copyBuffer = nullptr;
+  if (operation == TREE_COPY) {
+    copyBuffer = static_cast<uint8_t*>(malloc(copyBufferSize));
+    if (!copyBuffer) {
+      dirs[0].close();
+      return false;
+    }
+  }
+
+  bool ok = true;
+  if (!dirs[0].isDirectory()) {
+    countFile(dirs[0].fileSize());
+    if (operation == TREE_REMOVE) {
+      if (Serial) Serial.printf("[%lu] [SD] Path is not a directory\n", millis());
+      ok = false;
+    } else if (operation == TREE_COPY) {
+      ok = copyFileContents(dirs[0], target, copyBuffer, copyBufferSize);
+    }
+    if (ok && progress) {
+      ok = progress(stats, path, context);
+    }
+    dirs[0].close();
+    free(copyBuffer);
+    return ok;
+  }
+
+  if (operation == TREE_COPY && !sd.exists(target) && !sd.mkdir(target)) {
+    ok = false;
+  }
+
+  int depth = 0;
+  char name[MAX_NAME_LENGTH];
+  while (ok && depth >= 0) {
+    FsFile child;
+    if (!child.openNext(&dirs[depth], O_RDONLY)) {
+      // Directory finished, leave it
+      if (operation == TREE_REMOVE && !dirs[depth].rmdir()) {
+        if (Serial) Serial.printf("[%lu] [SD] Failed to remove directory %s\n", millis(), path);
+        ok = false;
+      }
+      dirs[depth].close();
+      depth--;
+      if (depth >= 0) {
+        path[pathLength[depth]] = '\0';
+        target[targetLength[depth]] = '\0';
+      }
+      continue;
+    }
+
+    child.getName(name, sizeof(name));
+    const size_t childLength = appendPathComponent(path, pathLength[depth], name, MAX_PATH_LENGTH);
+    const size_t childTargetLength = to ? appendPathComponent(target, targetLength[depth], name, MAX_PATH_LENGTH) : 0;
+    if (childLength == 0 || (to && childTargetLength == 0)) {
+      if (Serial) Serial.printf("[%lu] [SD] Path too long below %s\n", millis(), from);
+      ok = false;
+      break;
     }
-    file.getName(name, sizeof(name));
-    filePath += name;
 
-    if (file.isDirectory()) {
-      if (!removeDir(filePath.c_str())) {
-        return false;
+    if (child.isDirectory()) {
+      if (depth + 1 >= MAX_TREE_DEPTH) {
+        if (Serial) Serial.printf("[%lu] [SD] Tree deeper than %u levels at %s\n", millis(), MAX_TREE_DEPTH, path);
+        ok = false;
+        break;
       }
+      stats.directories++;
+      if (operation == TREE_COPY && !sd.exists(target) && !sd.mkdir(target, false)) {
+        ok = false;
+        break;
+      }
+      depth++;
+      dirs[depth] = child;
+      pathLength[depth] = childLength;
+      targetLength[depth] = childTargetLength;
+      child.close();
     } else {
-      if (!sd.remove(filePath.c_str())) {
-        return false;
+      countFile(child.fileSize());
+      if (operation == TREE_REMOVE) {
+        // Reopen by directory index for writing, removing it through its parent skips the path walk
+        const uint32_t index = child.dirIndex();
+        child.close();
+        ok = child.open(&dirs[depth], index, O_WRONLY) && child.remove();
+        if (!ok && Serial) Serial.printf("[%lu] [SD] Failed to remove %s\n", millis(), path);
+      } else if (operation == TREE_COPY) {
+        ok = copyFileContents(child, target, copyBuffer, copyBufferSize);
       }
+      child.close();
+    }
+
+    if (ok && progress && !progress(stats, path, context)) {
+      if (Serial) Serial.printf("[%lu] [SD] Walk of %s cancelled\n", millis(), from);
+      ok = false;
     }
-    file = dir.openNextFile();
+
+    // Back to the current directory's path, already the case after entering a subdirectory
+    path[pathLength[depth]] = '\0';
+    target[targetLength[depth]] = '\0';
   }
 
+  // Cancelled or failed walks still release every level they had open
+  for (; depth >= 0; depth--) {
+    dirs[depth].close();
+  }
+  free(copyBuffer);
+  return ok;
+}
+
+bool SDCardManager::copyFileContents(FsFile& source, const char* to, uint8_t* buffer, const size_t bufferSize) {
+  FsFile out;
+  if (!openFileForWrite("SD", to, out)) {
+    return false;
+  }
+
+  const uint64_t size = source.fileSize();
+  if (size > 0) {
+    out.preAllocate(size);
+  }
+
+  bool ok = source.seekSet(0);
+  uint64_t copied = 0;
+  while (ok && copied < size) {
+    const int r = source.read(buffer, bufferSize);
+    if (r <= 0) {
+      ok = false;
+      break;
+    }
+    ok = out.write(buffer, r) == static_cast<size_t>(r);
+    copied += r;
+  }
+
+  // Preallocation leaves the file at its allocated length until truncated
+  ok = ok && out.truncate(copied) && out.sync();
+  out.close();
+  if (!ok && Serial) Serial.printf("[%lu] [SD] Failed to copy to %s\n", millis(), to);
+  return ok;
+}
+
+FsFile SDCardManager::open(const char* path, const oflag_t oflag) {
+  if (oflag & (O_WRONLY | O_RDWR)) {
+    invalidateHandles(path);
+  }
+  return sd.open(path, oflag);
+}
+
+bool SDCardManager::remove(const char* path) {
+  invalidateHandles(path);
+  return sd.remove(path);
+}
+
+bool SDCardManager::rmdir(const char* path) {
+  invalidateHandles(path);
   return sd.rmdir(path);
 }
+
+bool SDCardManager::rename(const char* path, const char* newPath) {
+  invalidateHandles(path);
+  invalidateHandles(newPath);
+  return sd.rename(path, newPath);
+}
+
+void SDCardManager::setHandleCacheSize(const size_t maxHandles) {
+  maxCachedHandles = maxHandles;
+  while (handleCache.size() > maxCachedHandles) {
+    handleCache.back().file.close();
+    handleCache.pop_back();
+  }
+}
+
+void SDCardManager::invalidateHandles(const char* path) {
+  // Pages are dropped for the file itself; files below a directory get new clusters, so their keys change
+  BlockCache::getInstance().invalidatePath(path);
+  if (handleCache.empty()) {
+    return;
+  }
+
+  // Matches `path` itself and, for directories, everything below it
+  const size_t length = strlen(path);
+  for (auto it = handleCache.begin(); it != handleCache.end();) {
+    const std::string& cached = it->path;
+    const bool match = cached.compare(0, length, path) == 0 &&
+                       (cached.size() == length || cached[length] == '/' || (length > 0 && path[length - 1] == '/'));
+    if (match) {
+      it->file.close();
+      it = handleCache.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
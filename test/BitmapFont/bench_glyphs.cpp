@@ -0,0 +1,129 @@
+// Text rendering throughput in glyphs per second, from flash (BitmapFont) and from the card (StreamedFont)
+// Usage: bench_glyphs <font.xbf> <streamed font>
+#include <BitmapFont.h>
+#include <HostTest.h>
+#include <StreamedFont.h>
+
+#include <vector>
+
+namespace {
+
+constexpr uint16_t WIDTH = 800;
+constexpr uint16_t HEIGHT = 480;
+constexpr size_t FRAME_SIZE = WIDTH / 8 * HEIGHT;
+
+const char TEXT[] = "The quick brown fox jumps over the lazy dog; pack my box with five dozen liquor jugs.";
+
+std::vector<uint8_t> slurp(const char* path) {
+  std::vector<uint8_t> data;
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    return data;
+  }
+  int c;
+  while ((c = fgetc(f)) != EOF) {
+    data.push_back(static_cast<uint8_t>(c));
+  }
+  fclose(f);
+  return data;
+}
+
+// Per-pixel reference for drawGlyph()
+void plotGlyph(uint8_t* frame, const int16_t x, const int16_t y, const BitmapFont::Glyph& glyph) {
+  const int rowBytes = (glyph.width + 7) / 8;
+  for (int row = 0; row < glyph.height; row++) {
+    for (int col = 0; col < glyph.width; col++) {
+      const int px = x + glyph.left + col;
+      const int py = y - glyph.top + row;
+      if (px < 0 || px >= WIDTH || py < 0 || py >= HEIGHT) continue;
+      if (glyph.bitmap[row * rowBytes + col / 8] & (0x80 >> (col & 7))) {
+        frame[py * (WIDTH / 8) + px / 8] &= ~(0x80 >> (px & 7));
+      }
+    }
+  }
+}
+
+// Fills the screen with lines of TEXT, returns the glyphs drawn
+template <typename Font>
+size_t drawPage(Font& font, uint8_t* frame) {
+  memset(frame, 0xFF, FRAME_SIZE);
+  size_t glyphs = 0;
+  for (int16_t y = font.getAscent(); y < HEIGHT; y += font.getLineHeight()) {
+    font.drawText(frame, WIDTH, HEIGHT, static_cast<int16_t>(3 + y % 8), y, TEXT, sizeof(TEXT) - 1);
+    glyphs += sizeof(TEXT) - 1;
+  }
+  return glyphs;
+}
+
+}  // namespace
+
+int main(const int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <font.xbf> <streamed font>\n", argv[0]);
+    return 2;
+  }
+  const std::vector<uint8_t> fontData = slurp(argv[1]);
+  const std::vector<uint8_t> streamedData = slurp(argv[2]);
+  CHECK(HostTest::freshCard("card"));
+  CHECK(HostTest::putHostFile("/font.sfn", streamedData.data(), streamedData.size()));
+
+  BitmapFont font;
+  CHECK(font.begin(fontData.data(), fontData.size()));
+  std::vector<uint8_t> frame(FRAME_SIZE), expected(FRAME_SIZE);
+
+  // The blitter matches the per-pixel reference at every bit offset and across the edges
+  const int16_t xs[] = {-6, -1, 0, 1, 2, 3, 4, 5, 6, 7, 9, 396, 399, 791, 795, 799, 803};
+  const int16_t ys[] = {-4, 2, 100, 478, 490};
+  for (uint32_t codepoint = 0x21; codepoint < 0x7F; codepoint++) {
+    BitmapFont::Glyph glyph;
+    CHECK(font.getGlyph(codepoint, glyph));
+    for (const int16_t x : xs) {
+      for (const int16_t y : ys) {
+        memset(frame.data(), 0xFF, FRAME_SIZE);
+        memset(expected.data(), 0xFF, FRAME_SIZE);
+        BitmapFont::drawGlyph(frame.data(), WIDTH, HEIGHT, x, y, glyph);
+        plotGlyph(expected.data(), x, y, glyph);
+        CHECK(frame == expected);
+      }
+    }
+  }
+
+  constexpr int PAGES = 200;
+  size_t glyphs = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int page = 0; page < PAGES; page++) {
+    glyphs += drawPage(font, frame.data());
+  }
+  double ms = HostTest::elapsedMs(start);
+  printf("BitmapFont::drawText   %6.2f M glyphs/s  %.3f ms per page\n", glyphs / ms / 1000, ms / PAGES);
+  const std::vector<uint8_t> page = frame;
+
+  glyphs = 0;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < 2000; round++) {
+    for (uint32_t codepoint = 0x21; codepoint < 0x7F; codepoint++) {
+      BitmapFont::Glyph glyph;
+      font.getGlyph(codepoint, glyph);
+      BitmapFont::drawGlyph(frame.data(), WIDTH, HEIGHT, static_cast<int16_t>((round * 7 + codepoint) % 790), 200, glyph);
+      glyphs++;
+    }
+  }
+  ms = HostTest::elapsedMs(start);
+  printf("getGlyph + drawGlyph   %6.2f M glyphs/s\n", glyphs / ms / 1000);
+
+  StreamedFont streamed;
+  CHECK(streamed.begin("/font.sfn"));
+  drawPage(streamed, frame.data());
+  CHECK(frame == page);
+  streamed.resetStats();
+  glyphs = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < PAGES; i++) {
+    glyphs += drawPage(streamed, frame.data());
+  }
+  ms = HostTest::elapsedMs(start);
+  printf("StreamedFont::drawText %6.2f M glyphs/s  %.3f ms per page, %u.%u%% glyph cache hits\n", glyphs / ms / 1000,
+         ms / PAGES, streamed.getHitRatePermille() / 10, streamed.getHitRatePermille() % 10);
+
+  return HostTest::result();
+}
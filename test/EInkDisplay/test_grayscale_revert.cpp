@@ -0,0 +1,149 @@
+// RAM and LUT sequencing when leaving a grayscale frame, with and without the fused revert
+#include <EInkDisplay.h>
+#include <HostTest.h>
+#include <PanelEmulator.h>
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr int8_t PIN_SCLK = 8, PIN_MOSI = 10, PIN_CS = 21, PIN_DC = 4, PIN_RST = 5, PIN_BUSY = 6;
+constexpr uint16_t W = PanelEmulator::WIDTH, H = PanelEmulator::HEIGHT, WB = PanelEmulator::WIDTH_BYTES;
+
+// First source voltage byte of groups 00, 01, 10 and 11, enough to tell the LUTs apart
+const uint8_t LUT_GRAY[4] = {0x00, 0x54, 0xAA, 0xA2};
+const uint8_t LUT_REVERT[4] = {0x00, 0x54, 0xA8, 0xFC};
+const uint8_t LUT_FUSED[4] = {0x54, 0xAA, 0x55, 0x00};
+
+constexpr uint8_t CTRL2_FAST_OTP = 0x1C;
+constexpr uint8_t CTRL2_FAST_CUSTOM = 0x0C;
+
+bool usesLut(const PanelEmulator::Refresh& refresh, const uint8_t (&groups)[4]) {
+  if (!refresh.customLut) {
+    return false;
+  }
+  for (uint8_t g = 0; g < 4; g++) {
+    if (refresh.lut[g * 10] != groups[g]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ramIs(const std::vector<uint8_t>& ram, const std::vector<uint8_t>& frame) { return ram == frame; }
+
+std::vector<uint8_t> frameWithBox(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h) {
+  std::vector<uint8_t> frame(WB * H, 0xFF);
+  for (uint16_t row = y; row < y + h; row++) {
+    memset(&frame[row * WB + x / 8], 0x00, w / 8);
+  }
+  return frame;
+}
+
+void draw(EInkDisplay& display, const std::vector<uint8_t>& frame) {
+  memcpy(display.getFrameBuffer(), frame.data(), frame.size());
+}
+
+// Shows `frame`, then a grayscale image over it, returns the number of refreshes that took
+size_t showGrayOver(EInkDisplay& display, PanelEmulator& panel, const std::vector<uint8_t>& frame,
+                    const std::vector<uint8_t>& lsb, const std::vector<uint8_t>& msb) {
+  draw(display, frame);
+  display.displayBuffer(EInkDisplay::FAST_REFRESH);
+  panel.clearHistory();
+  display.copyGrayscaleBuffers(lsb.data(), msb.data());
+  display.displayGrayBuffer();
+  return panel.refreshes().size();
+}
+
+}  // namespace
+
+int main() {
+  PanelEmulator panel(PIN_DC, PIN_CS);
+  std::unique_ptr<EInkDisplay> display(new EInkDisplay(PIN_SCLK, PIN_MOSI, PIN_CS, PIN_DC, PIN_RST, PIN_BUSY));
+  display->begin();
+
+  // Gray image in the black box of the base frame: light gray band (MSB only) and dark gray core (LSB and MSB)
+  const std::vector<uint8_t> base = frameWithBox(80, 40, 320, 240);
+  const std::vector<uint8_t> lsb = [] {
+    std::vector<uint8_t> plane(WB * H, 0x00);
+    for (uint16_t row = 100; row < 180; row++) memset(&plane[row * WB + 160 / 8], 0xFF, 160 / 8);
+    return plane;
+  }();
+  const std::vector<uint8_t> msb = [] {
+    std::vector<uint8_t> plane(WB * H, 0x00);
+    for (uint16_t row = 60; row < 260; row++) memset(&plane[row * WB + 120 / 8], 0xFF, 240 / 8);
+    return plane;
+  }();
+  const std::vector<uint8_t> next = frameWithBox(400, 200, 240, 160);
+  const std::vector<uint8_t> after = frameWithBox(0, 0, 160, 480);
+
+  // The first update with the screen off is a half refresh writing both RAMs
+  draw(*display, base);
+  display->displayBuffer(EInkDisplay::FAST_REFRESH);
+  CHECK(panel.refreshes().size() == 1);
+  CHECK(panel.lastRefresh().control1 == 0x40 && !panel.lastRefresh().customLut);
+  CHECK(ramIs(panel.lastRefresh().bw, base) && ramIs(panel.lastRefresh().red, base));
+
+  // Grayscale: BW RAM = LSB, RED RAM = MSB, one refresh with the grayscale LUT
+  panel.clearHistory();
+  display->copyGrayscaleBuffers(lsb.data(), msb.data());
+  display->displayGrayBuffer();
+  CHECK(panel.refreshes().size() == 1);
+  CHECK(usesLut(panel.lastRefresh(), LUT_GRAY) && panel.lastRefresh().control2 == CTRL2_FAST_CUSTOM);
+  CHECK(ramIs(panel.lastRefresh().bw, lsb) && ramIs(panel.lastRefresh().red, msb));
+
+  // Without fusing: a revert refresh on the planes, then the regular fast update against the base frame
+  panel.clearHistory();
+  draw(*display, next);
+  display->displayBuffer(EInkDisplay::FAST_REFRESH);
+  CHECK(panel.refreshes().size() == 2);
+  if (panel.refreshes().size() == 2) {
+    const PanelEmulator::Refresh& revert = panel.refreshes()[0];
+    const PanelEmulator::Refresh& update = panel.refreshes()[1];
+    CHECK(usesLut(revert, LUT_REVERT));
+    CHECK(ramIs(revert.bw, lsb) && ramIs(revert.red, msb));
+    CHECK(!update.customLut && update.control1 == 0x00 && update.control2 == CTRL2_FAST_OTP);
+    CHECK(ramIs(update.bw, next) && ramIs(update.red, base));
+  }
+
+  // Fused: one refresh with the fused LUT, BW RAM = next frame, RED RAM = the black/white frame under the grays
+  display->setFusedGrayscaleRevert(true);
+  CHECK(showGrayOver(*display, panel, base, lsb, msb) == 1);
+  panel.clearHistory();
+  draw(*display, next);
+  display->displayBuffer(EInkDisplay::FAST_REFRESH);
+  CHECK(panel.refreshes().size() == 1);
+  CHECK(usesLut(panel.lastRefresh(), LUT_FUSED) && panel.lastRefresh().control2 == CTRL2_FAST_CUSTOM);
+  CHECK(panel.lastRefresh().control1 == 0x00);
+  CHECK(ramIs(panel.lastRefresh().bw, next) && ramIs(panel.lastRefresh().red, base));
+  // Group 11 (white -> white) is the only one left alone
+  CHECK(panel.lastRefresh().drives(0) && panel.lastRefresh().drives(1) && panel.lastRefresh().drives(2));
+  CHECK(!panel.lastRefresh().drives(3));
+
+  // Back to the OTP waveform for the next update
+  panel.clearHistory();
+  draw(*display, after);
+  display->displayBuffer(EInkDisplay::FAST_REFRESH);
+  CHECK(panel.refreshes().size() == 1);
+  CHECK(!panel.lastRefresh().customLut && panel.lastRefresh().control2 == CTRL2_FAST_OTP);
+  CHECK(ramIs(panel.lastRefresh().bw, after) && ramIs(panel.lastRefresh().red, next));
+
+  // Full and half refreshes are not fused, they redraw everything anyway
+  CHECK(showGrayOver(*display, panel, base, lsb, msb) == 1);
+  panel.clearHistory();
+  draw(*display, next);
+  display->displayBuffer(EInkDisplay::HALF_REFRESH);
+  CHECK(panel.refreshes().size() == 2);
+  CHECK(usesLut(panel.refreshes()[0], LUT_REVERT) && panel.lastRefresh().control1 == 0x40);
+
+  // Turning the screen off in the same update keeps the fused LUT and adds the power-down bits
+  CHECK(showGrayOver(*display, panel, base, lsb, msb) == 1);
+  panel.clearHistory();
+  draw(*display, next);
+  display->displayBuffer(EInkDisplay::FAST_REFRESH, true);
+  CHECK(panel.refreshes().size() == 1);
+  CHECK(usesLut(panel.lastRefresh(), LUT_FUSED) && panel.lastRefresh().control2 == (CTRL2_FAST_CUSTOM | 0x03));
+
+  return HostTest::result();
+}
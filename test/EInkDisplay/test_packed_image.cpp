@@ -0,0 +1,115 @@
+// Packed images in the frame buffer and in controller RAM, and what a failed grayscale upload leaves behind
+#include <EInkDisplay.h>
+#include <HostTest.h>
+#include <PackedImage.h>
+#include <PanelEmulator.h>
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr int8_t PIN_SCLK = 8, PIN_MOSI = 10, PIN_CS = 21, PIN_DC = 4, PIN_RST = 5, PIN_BUSY = 6;
+constexpr uint16_t W = PanelEmulator::WIDTH, H = PanelEmulator::HEIGHT, WB = PanelEmulator::WIDTH_BYTES;
+constexpr uint8_t BAND_ROWS = 240;
+constexpr uint16_t BANDS = H / BAND_ROWS;
+
+typedef std::vector<uint8_t> Bytes;
+
+void put16(Bytes& out, const uint32_t v) {
+  out.push_back(v & 0xFF);
+  out.push_back(v >> 8 & 0xFF);
+}
+
+void put32(Bytes& out, const uint32_t v) {
+  put16(out, v & 0xFFFF);
+  put16(out, v >> 16);
+}
+
+// One row of `value` bytes: repeats of at most 65
+void codeRow(Bytes& code, const uint8_t value) {
+  for (uint16_t left = WB; left > 0;) {
+    const uint16_t count = left > 65 ? 65 : left;
+    code.push_back(0xC0 | (count - 2));
+    code.push_back(value);
+    left -= count;
+  }
+}
+
+// Full screen image of solid planes. Every band of a plane decodes the same code; a band offset past the code makes
+// that plane fail halfway down.
+Bytes solidImage(const std::vector<uint8_t>& planeValues, const bool corruptLastPlane) {
+  Bytes code;
+  std::vector<uint32_t> offsets;
+  for (const uint8_t value : planeValues) {
+    offsets.push_back(static_cast<uint32_t>(code.size()));
+    for (uint16_t row = 0; row < BAND_ROWS; row++) {
+      codeRow(code, value);
+    }
+  }
+
+  Bytes out = {'X', 'P', 'I', '1'};
+  put16(out, W);
+  put16(out, H);
+  out.push_back(static_cast<uint8_t>(planeValues.size()));
+  out.push_back(BAND_ROWS);
+  put16(out, 0);
+  put32(out, static_cast<uint32_t>(code.size()));
+  for (size_t plane = 0; plane < planeValues.size(); plane++) {
+    for (uint16_t band = 0; band < BANDS; band++) {
+      const bool corrupt = corruptLastPlane && plane + 1 == planeValues.size() && band == BANDS - 1;
+      put32(out, corrupt ? static_cast<uint32_t>(code.size()) : offsets[plane]);
+    }
+  }
+  out.insert(out.end(), code.begin(), code.end());
+  return out;
+}
+
+std::vector<uint8_t> frameWithBox(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h) {
+  std::vector<uint8_t> frame(WB * H, 0xFF);
+  for (uint16_t row = y; row < y + h; row++) {
+    memset(&frame[row * WB + x / 8], 0x00, w / 8);
+  }
+  return frame;
+}
+
+}  // namespace
+
+int main() {
+  PanelEmulator panel(PIN_DC, PIN_CS);
+  std::unique_ptr<EInkDisplay> display(new EInkDisplay(PIN_SCLK, PIN_MOSI, PIN_CS, PIN_DC, PIN_RST, PIN_BUSY));
+  display->begin();
+
+  const std::vector<uint8_t> base = frameWithBox(80, 40, 320, 240);
+  memcpy(display->getFrameBuffer(), base.data(), base.size());
+  display->displayBuffer(EInkDisplay::FAST_REFRESH);
+
+  // BW plane into the frame buffer, x must be byte-aligned
+  const Bytes black = solidImage({0x00}, false);
+  const PackedImage blackImage(black.data(), black.size());
+  CHECK(blackImage.isValid());
+  CHECK(!display->drawImage(blackImage, 3, 0));
+  CHECK(display->drawImage(blackImage, 0, 0));
+  const std::vector<uint8_t> blackFrame(WB * H, 0x00);
+  CHECK(memcmp(display->getFrameBuffer(), blackFrame.data(), blackFrame.size()) == 0);
+
+  // Gray planes that fail halfway: the frame on screen is put back in both RAMs, and no planes are left to show
+  const Bytes broken = solidImage({0xFF, 0x0F, 0xF0}, true);
+  const PackedImage brokenImage(broken.data(), broken.size());
+  CHECK(brokenImage.isValid() && brokenImage.hasGray());
+  panel.clearHistory();
+  CHECK(!display->copyGrayscaleBuffers(brokenImage));
+  CHECK(panel.bwMatches(base.data()) && panel.redMatches(base.data()));
+  CHECK(panel.refreshes().empty());
+
+  // The same planes intact
+  const Bytes gray = solidImage({0xFF, 0x0F, 0xF0}, false);
+  const PackedImage grayImage(gray.data(), gray.size());
+  CHECK(display->copyGrayscaleBuffers(grayImage));
+  CHECK(panel.bwMatches(std::vector<uint8_t>(WB * H, 0x0F).data()));
+  CHECK(panel.redMatches(std::vector<uint8_t>(WB * H, 0xF0).data()));
+  display->displayGrayBuffer();
+  CHECK(panel.refreshes().size() == 1 && panel.lastRefresh().customLut);
+
+  return HostTest::result();
+}
@@ -0,0 +1,195 @@
+// Windowed updates keep both controller RAMs in step with the screen and never swap the frame buffers
+#include <EInkDisplay.h>
+#include <HostTest.h>
+#include <PanelEmulator.h>
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr int8_t PIN_SCLK = 8, PIN_MOSI = 10, PIN_CS = 21, PIN_DC = 4, PIN_RST = 5, PIN_BUSY = 6;
+constexpr uint16_t H = PanelEmulator::HEIGHT, WB = PanelEmulator::WIDTH_BYTES;
+constexpr size_t FRAME_BYTES = static_cast<size_t>(WB) * H;
+
+typedef std::vector<uint8_t> Frame;
+
+void fillBox(Frame& frame, const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h,
+             const uint8_t value) {
+  for (uint16_t row = y; row < y + h; row++) {
+    memset(&frame[row * WB + x / 8], value, w / 8);
+  }
+}
+
+Frame frameWithBox(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h) {
+  Frame frame(FRAME_BYTES, 0xFF);
+  fillBox(frame, x, y, w, h, 0x00);
+  return frame;
+}
+
+void invertBox(Frame& frame, const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h) {
+  for (uint16_t row = y; row < y + h; row++) {
+    for (uint16_t col = x / 8; col < (x + w) / 8; col++) {
+      frame[row * WB + col] ^= 0xFF;
+    }
+  }
+}
+
+// Copies the window [x, x + w) x [y, y + h) of `from` into `to`
+void copyWindow(Frame& to, const uint8_t* from, const uint16_t x, const uint16_t y, const uint16_t w,
+                const uint16_t h) {
+  for (uint16_t row = y; row < y + h; row++) {
+    memcpy(&to[row * WB + x / 8], from + row * WB + x / 8, w / 8);
+  }
+}
+
+size_t imageSource(uint8_t* buffer, const uint32_t offset, const size_t length, void* context) {
+  memcpy(buffer, static_cast<const Frame*>(context)->data() + offset, length);
+  return length;
+}
+
+// One fast refresh of the window: BW RAM holds the new screen, RED RAM the old one, nothing outside is driven
+bool windowRefresh(const PanelEmulator& panel, const Frame& before, const Frame& after, const uint16_t x,
+                   const uint16_t y, const uint16_t w, const uint16_t h) {
+  if (panel.refreshes().size() != 1) {
+    return false;
+  }
+  const PanelEmulator::Refresh& refresh = panel.lastRefresh();
+  return refresh.bw == after && refresh.red == before && refresh.countDriven(x, y, w, h, false) == 0;
+}
+
+}  // namespace
+
+int main() {
+  PanelEmulator panel(PIN_DC, PIN_CS);
+  std::unique_ptr<EInkDisplay> display(new EInkDisplay(PIN_SCLK, PIN_MOSI, PIN_CS, PIN_DC, PIN_RST, PIN_BUSY));
+  display->begin();
+
+  const Frame first = frameWithBox(80, 40, 320, 240);
+  const Frame second = frameWithBox(400, 200, 240, 160);
+  memcpy(display->getFrameBuffer(), first.data(), FRAME_BYTES);
+  display->displayBuffer(EInkDisplay::FAST_REFRESH);
+  memcpy(display->getFrameBuffer(), second.data(), FRAME_BYTES);
+  display->displayBuffer(EInkDisplay::FAST_REFRESH);
+
+  // A window drawn into the frame buffer: only it changes, and the frame buffer is still the one drawn into
+  uint8_t* drawn = display->getFrameBuffer();
+  Frame drawnFrame = second;
+  fillBox(drawnFrame, 16, 400, 96, 40, 0x00);
+  memcpy(drawn, drawnFrame.data(), FRAME_BYTES);
+  Frame screen = second;
+  copyWindow(screen, drawn, 16, 400, 96, 40);
+  panel.clearHistory();
+  display->displayWindow(16, 400, 96, 40);
+  CHECK(windowRefresh(panel, second, screen, 16, 400, 96, 40));
+  // RED RAM only had to catch up where the last full update changed the screen
+  CHECK(panel.lastRefresh().redBytesWritten == (640 - 80) / 8 * (360 - 40));
+  CHECK(display->getFrameBuffer() == drawn);
+  CHECK(memcmp(drawn, drawnFrame.data(), FRAME_BYTES) == 0);
+
+  // A second window elsewhere: RED RAM caught up with the first one, only that window was written to it
+  fillBox(drawnFrame, 640, 16, 64, 64, 0x00);
+  memcpy(drawn, drawnFrame.data(), FRAME_BYTES);
+  Frame next = screen;
+  copyWindow(next, drawn, 640, 16, 64, 64);
+  panel.clearHistory();
+  display->displayWindow(640, 16, 64, 64);
+  CHECK(windowRefresh(panel, screen, next, 640, 16, 64, 64));
+  CHECK(panel.lastRefresh().redBytesWritten == 96 / 8 * 40);
+  CHECK(display->getFrameBuffer() == drawn);
+  screen = next;
+
+  // The next full fast update diffs against the screen with both windows
+  const Frame third = frameWithBox(0, 0, 160, 480);
+  memcpy(display->getFrameBuffer(), third.data(), FRAME_BYTES);
+  panel.clearHistory();
+  display->displayBuffer(EInkDisplay::FAST_REFRESH);
+  CHECK(panel.refreshes().size() == 1 && panel.lastRefresh().bw == third && panel.lastRefresh().red == screen);
+  screen = third;
+
+  // Overlays go over the frame on screen, not over what was drawn into the frame buffer since
+  memcpy(display->getFrameBuffer(), first.data(), FRAME_BYTES);
+  const int8_t cursor = display->addOverlay(320, 96, 64, 32);
+  next = screen;
+  invertBox(next, 320, 96, 64, 32);
+  panel.clearHistory();
+  CHECK(display->displayOverlays());
+  CHECK(windowRefresh(panel, screen, next, 320, 96, 64, 32));
+  CHECK(!display->displayOverlays());
+  screen = next;
+
+  // A window that does not hold the whole overlay change leaves it for the update that does
+  CHECK(display->moveOverlay(cursor, 320, 400));
+  next = screen;
+  copyWindow(next, display->getFrameBuffer(), 0, 0, 160, 64);
+  panel.clearHistory();
+  display->displayWindow(0, 0, 160, 64);
+  CHECK(windowRefresh(panel, screen, next, 0, 0, 160, 64));
+  screen = next;
+  invertBox(next, 320, 96, 64, 32);
+  invertBox(next, 320, 400, 64, 32);
+  panel.clearHistory();
+  CHECK(display->displayOverlays());
+  CHECK(windowRefresh(panel, screen, next, 320, 96, 64, 336));
+  display->removeOverlay(cursor);
+  CHECK(display->displayOverlays());
+
+  // Over a streamed image, which is in no frame buffer: the window goes over it and the rest stays
+  const Frame streamed = frameWithBox(240, 120, 320, 240);
+  Frame streamedContext = streamed;
+  CHECK(display->displayStream(imageSource, &streamedContext, EInkDisplay::FAST_REFRESH));
+  drawn = display->getFrameBuffer();
+  memcpy(drawn, third.data(), FRAME_BYTES);
+  screen = streamed;
+  copyWindow(screen, drawn, 0, 0, 160, 64);
+  panel.clearHistory();
+  display->displayWindow(0, 0, 160, 64);
+  CHECK(windowRefresh(panel, streamed, screen, 0, 0, 160, 64));
+  CHECK(panel.bwMatches(screen.data()) && panel.redMatches(screen.data()));
+  CHECK(display->getFrameBuffer() == drawn);
+  const int8_t overStream = display->addOverlay(0, 0, 64, 64);
+  CHECK(!display->displayOverlays());
+  display->removeOverlay(overStream);
+
+  // A window after leaving a full screen grayscale frame: the planes are replaced by the frame on screen first
+  memcpy(display->getFrameBuffer(), first.data(), FRAME_BYTES);
+  display->displayBuffer(EInkDisplay::FAST_REFRESH);
+  const Frame plane = frameWithBox(80, 40, 320, 240);
+  display->copyGrayscaleBuffers(plane.data(), plane.data());
+  display->displayGrayBuffer();
+  drawnFrame = first;
+  fillBox(drawnFrame, 480, 320, 80, 80, 0x00);
+  drawn = display->getFrameBuffer();
+  memcpy(drawn, drawnFrame.data(), FRAME_BYTES);
+  screen = first;
+  copyWindow(screen, drawn, 480, 320, 80, 80);
+  panel.clearHistory();
+  display->displayWindow(480, 320, 80, 80);
+  CHECK(panel.refreshes().size() == 2);  // Grayscale revert, then the window
+  if (panel.refreshes().size() == 2) {
+    const PanelEmulator::Refresh& refresh = panel.refreshes()[1];
+    CHECK(refresh.bw == screen && refresh.red == first && refresh.countDriven(480, 320, 80, 80, false) == 0);
+  }
+
+  // A grayscale window inside the black box: RED RAM only catches up where it lagged behind, nothing outside the
+  // window is driven, and both RAMs hold the frame on screen again afterwards
+  const Frame lsb(80 / 8 * 64, 0x00), msb(80 / 8 * 64, 0xFF);
+  panel.clearHistory();
+  display->displayGrayWindow(80, 40, 80, 64, lsb.data(), msb.data());
+  CHECK(panel.refreshes().size() == 1);
+  if (panel.refreshes().size() == 1) {
+    const PanelEmulator::Refresh& refresh = panel.lastRefresh();
+    CHECK(refresh.customLut && refresh.bwBytesWritten == 80 / 8 * 64);
+    CHECK(refresh.redBytesWritten == 80 / 8 * 80 + 80 / 8 * 64);
+    CHECK(refresh.countDriven(80, 40, 80, 64, false) == 0 && refresh.countDriven(80, 40, 80, 64, true) == 80 * 64);
+  }
+  CHECK(panel.bwMatches(screen.data()) && panel.redMatches(screen.data()));
+
+  // Not over a streamed image, whose pixels the window could not be restored from
+  CHECK(display->displayStream(imageSource, &streamedContext, EInkDisplay::FAST_REFRESH));
+  panel.clearHistory();
+  display->displayGrayWindow(80, 40, 80, 64, lsb.data(), msb.data());
+  CHECK(panel.refreshes().empty());
+
+  return HostTest::result();
+}
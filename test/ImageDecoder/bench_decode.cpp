@@ -0,0 +1,279 @@
+// Decoding speed in ms per source megapixel, for BMP always, PNG with zlib and JPEG with libjpeg available to write
+// the test images. Lossless formats must match GrayScaler fed with the source rows.
+#include <GrayScaler.h>
+#include <HostTest.h>
+#include <ImageDecoder.h>
+
+#include <string>
+#include <vector>
+
+#ifdef HOST_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HOST_HAVE_JPEG
+#include <jpeglib.h>
+#endif
+
+namespace {
+
+constexpr uint16_t SOURCE_WIDTH = 1200;
+constexpr uint16_t SOURCE_HEIGHT = 1600;
+
+typedef std::vector<uint8_t> Bytes;
+
+// Gray photo-like content: smooth shading, hard edges and some noise. Gray so every decoder's luma is exact.
+Bytes makeSource() {
+  Bytes gray(static_cast<size_t>(SOURCE_WIDTH) * SOURCE_HEIGHT);
+  uint32_t noise = 1;
+  for (uint16_t y = 0; y < SOURCE_HEIGHT; y++) {
+    for (uint16_t x = 0; x < SOURCE_WIDTH; x++) {
+      noise = noise * 1103515245 + 12345;
+      int v = (x * 255 / SOURCE_WIDTH + y * 255 / SOURCE_HEIGHT) / 2 + static_cast<int>(noise >> 28) - 8;
+      if ((x / 150 + y / 150) % 2 && y % 400 < 200) v = 255 - v;
+      const int dx = x - SOURCE_WIDTH / 2, dy = y - SOURCE_HEIGHT / 2;
+      if (dx * dx + dy * dy < 300 * 300) v = 40;
+      gray[static_cast<size_t>(y) * SOURCE_WIDTH + x] = static_cast<uint8_t>(v < 0 ? 0 : v > 255 ? 255 : v);
+    }
+  }
+  return gray;
+}
+
+void put16(Bytes& out, const uint32_t v) {
+  out.push_back(v & 0xFF);
+  out.push_back(v >> 8 & 0xFF);
+}
+
+void put32(Bytes& out, const uint32_t v) {
+  put16(out, v & 0xFFFF);
+  put16(out, v >> 16);
+}
+
+// 24-bit bottom-up BMP
+Bytes writeBmp(const Bytes& gray) {
+  const uint32_t rowBytes = (SOURCE_WIDTH * 3 + 3) & ~3u;
+  Bytes out = {'B', 'M'};
+  put32(out, 54 + rowBytes * SOURCE_HEIGHT);
+  put32(out, 0);
+  put32(out, 54);
+  put32(out, 40);
+  put32(out, SOURCE_WIDTH);
+  put32(out, SOURCE_HEIGHT);
+  put16(out, 1);
+  put16(out, 24);
+  put32(out, 0);
+  put32(out, rowBytes * SOURCE_HEIGHT);
+  put32(out, 2835);
+  put32(out, 2835);
+  put32(out, 0);
+  put32(out, 0);
+  for (int y = SOURCE_HEIGHT - 1; y >= 0; y--) {
+    const size_t start = out.size();
+    for (uint16_t x = 0; x < SOURCE_WIDTH; x++) {
+      const uint8_t v = gray[static_cast<size_t>(y) * SOURCE_WIDTH + x];
+      out.insert(out.end(), {v, v, v});
+    }
+    out.resize(start + rowBytes, 0);
+  }
+  return out;
+}
+
+#ifdef HOST_HAVE_ZLIB
+void putChunk(Bytes& out, const char* type, const Bytes& data) {
+  const uint32_t length = static_cast<uint32_t>(data.size());
+  out.insert(out.end(), {static_cast<uint8_t>(length >> 24), static_cast<uint8_t>(length >> 16),
+                         static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length)});
+  const size_t typeStart = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  const uint32_t crc = crc32(0, out.data() + typeStart, static_cast<uInt>(out.size() - typeStart));
+  out.insert(out.end(), {static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16),
+                         static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc)});
+}
+
+// 8-bit RGB PNG, alternating the None, Sub and Up row filters
+Bytes writePng(const Bytes& gray) {
+  const size_t rowBytes = SOURCE_WIDTH * 3;
+  Bytes raw;
+  raw.reserve((rowBytes + 1) * SOURCE_HEIGHT);
+  Bytes previous(rowBytes, 0), row(rowBytes);
+  for (uint16_t y = 0; y < SOURCE_HEIGHT; y++) {
+    for (uint16_t x = 0; x < SOURCE_WIDTH; x++) {
+      row[x * 3] = row[x * 3 + 1] = row[x * 3 + 2] = gray[static_cast<size_t>(y) * SOURCE_WIDTH + x];
+    }
+    const uint8_t filter = y % 3;
+    raw.push_back(filter);
+    for (size_t i = 0; i < rowBytes; i++) {
+      const uint8_t left = i >= 3 ? row[i - 3] : 0;
+      raw.push_back(static_cast<uint8_t>(row[i] - (filter == 1 ? left : filter == 2 ? previous[i] : 0)));
+    }
+    previous = row;
+  }
+
+  uLongf compressedSize = compressBound(static_cast<uLong>(raw.size()));
+  Bytes compressed(compressedSize);
+  compress2(compressed.data(), &compressedSize, raw.data(), static_cast<uLong>(raw.size()), 6);
+  compressed.resize(compressedSize);
+
+  Bytes out = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  const Bytes header = {0, 0, SOURCE_WIDTH >> 8, SOURCE_WIDTH & 0xFF, 0, 0, SOURCE_HEIGHT >> 8, SOURCE_HEIGHT & 0xFF,
+                        8, 2, 0, 0, 0};
+  putChunk(out, "IHDR", header);
+  putChunk(out, "IDAT", compressed);
+  putChunk(out, "IEND", Bytes());
+  return out;
+}
+#endif
+
+#ifdef HOST_HAVE_JPEG
+// Baseline 4:2:0 colour JPEG
+Bytes writeJpeg(const Bytes& gray) {
+  jpeg_compress_struct info;
+  jpeg_error_mgr error;
+  info.err = jpeg_std_error(&error);
+  jpeg_create_compress(&info);
+  unsigned char* buffer = nullptr;
+  unsigned long size = 0;
+  jpeg_mem_dest(&info, &buffer, &size);
+  info.image_width = SOURCE_WIDTH;
+  info.image_height = SOURCE_HEIGHT;
+  info.input_components = 3;
+  info.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&info);
+  jpeg_set_quality(&info, 85, TRUE);
+  jpeg_start_compress(&info, TRUE);
+  Bytes row(SOURCE_WIDTH * 3);
+  while (info.next_scanline < SOURCE_HEIGHT) {
+    for (uint16_t x = 0; x < SOURCE_WIDTH; x++) {
+      row[x * 3] = row[x * 3 + 1] = row[x * 3 + 2] = gray[static_cast<size_t>(info.next_scanline) * SOURCE_WIDTH + x];
+    }
+    JSAMPROW rows[1] = {row.data()};
+    jpeg_write_scanlines(&info, rows, 1);
+  }
+  jpeg_finish_compress(&info);
+  jpeg_destroy_compress(&info);
+  Bytes out(buffer, buffer + size);
+  free(buffer);
+  return out;
+}
+#endif
+
+struct Planes {
+  Bytes bw, lsb, msb;
+};
+
+GrayScaler::Target makeTarget(Planes& planes, const uint16_t width, const uint16_t height, const bool gray,
+                              const GrayScaler::Dither dither) {
+  const size_t size = static_cast<size_t>(width / 8) * height;
+  planes.bw.assign(size, 0xFF);
+  planes.lsb.assign(size, 0x00);
+  planes.msb.assign(size, 0x00);
+  GrayScaler::Target target;
+  target.bw = planes.bw.data();
+  if (gray) {
+    target.lsb = planes.lsb.data();
+    target.msb = planes.msb.data();
+  }
+  target.stride = width / 8;
+  target.planeHeight = height;
+  target.width = width;
+  target.height = height;
+  target.dither = dither;
+  return target;
+}
+
+// Share of plane bits that differ
+double differingPercent(const Planes& a, const Planes& b) {
+  size_t bits = 0;
+  for (size_t i = 0; i < a.bw.size(); i++) {
+    bits += __builtin_popcount((a.bw[i] ^ b.bw[i]) | (a.lsb[i] ^ b.lsb[i]) | (a.msb[i] ^ b.msb[i]));
+  }
+  return 100.0 * bits / (a.bw.size() * 8);
+}
+
+// Total ink: black pixels count 3, dark gray 2, light gray 1. Error diffusion turns small input differences into a
+// different pattern, but keeps the tone.
+uint64_t ink(const Planes& planes) {
+  uint64_t total = 0;
+  for (size_t i = 0; i < planes.bw.size(); i++) {
+    total += 3 * __builtin_popcount(static_cast<uint8_t>(~planes.bw[i])) + __builtin_popcount(planes.msb[i]) +
+             __builtin_popcount(planes.lsb[i]);
+  }
+  return total;
+}
+
+struct Case {
+  const char* name;
+  uint16_t width;
+  uint16_t height;
+  bool gray;
+  GrayScaler::Dither dither;
+};
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  const Bytes source = makeSource();
+
+  struct File {
+    const char* path;
+    Bytes data;
+    bool lossless;
+    bool bottomUp;
+  };
+  std::vector<File> files;
+  files.push_back({"/image.bmp", writeBmp(source), true, true});
+#ifdef HOST_HAVE_ZLIB
+  files.push_back({"/image.png", writePng(source), true, false});
+#endif
+#ifdef HOST_HAVE_JPEG
+  files.push_back({"/image.jpg", writeJpeg(source), false, false});
+#endif
+
+  const Case cases[] = {
+      {"1:1 2-bit none", SOURCE_WIDTH, SOURCE_HEIGHT, true, GrayScaler::DITHER_NONE},
+      {"480x800 2-bit diffusion", 480, 800, true, GrayScaler::DITHER_DIFFUSION},
+      {"480x800 1-bit ordered", 480, 800, false, GrayScaler::DITHER_ORDERED},
+  };
+
+  ImageDecoder decoder;
+  const double megapixels = SOURCE_WIDTH * SOURCE_HEIGHT / 1e6;
+  for (const File& file : files) {
+    CHECK(HostTest::putHostFile(file.path, file.data.data(), file.data.size()));
+    ImageDecoder::Info info;
+    CHECK(decoder.readInfo(file.path, info));
+    CHECK(info.width == SOURCE_WIDTH && info.height == SOURCE_HEIGHT);
+
+    for (const Case& c : cases) {
+      Planes decoded, reference;
+      const GrayScaler::Target target = makeTarget(decoded, c.width, c.height, c.gray, c.dither);
+      const auto start = std::chrono::steady_clock::now();
+      ImageDecoder::Placement placed{};
+      CHECK(decoder.decode(file.path, target, &placed));
+      const double ms = HostTest::elapsedMs(start);
+
+      GrayScaler scaler;
+      CHECK(scaler.begin(SOURCE_WIDTH, SOURCE_HEIGHT, makeTarget(reference, c.width, c.height, c.gray, c.dither),
+                         file.bottomUp));
+      for (uint16_t i = 0; i < SOURCE_HEIGHT; i++) {
+        const uint16_t y = file.bottomUp ? SOURCE_HEIGHT - 1 - i : i;
+        scaler.pushRow(&source[static_cast<size_t>(y) * SOURCE_WIDTH]);
+      }
+      const double difference = differingPercent(decoded, reference);
+      if (file.lossless) {
+        CHECK(difference == 0);
+      } else if (c.dither == GrayScaler::DITHER_DIFFUSION) {
+        const double a = static_cast<double>(ink(decoded)), b = static_cast<double>(ink(reference));
+        CHECK(a > b * 0.98 && a < b * 1.02);
+      } else {
+        CHECK(difference < 10);
+      }
+      CHECK(placed.width == scaler.getWidth() && placed.height == scaler.getHeight());
+
+      printf("%-11s %-24s %7.1f ms  %6.1f ms/MP  placed %ux%u at %d,%d  %.2f%% bits differ\n", file.path + 1, c.name,
+             ms, ms / megapixels, placed.width, placed.height, placed.x, placed.y, difference);
+    }
+  }
+
+  return HostTest::result();
+}
@@ -0,0 +1,84 @@
+// Page index reuse follows the book's identity, and a page deep inside a huge paragraph re-reads a bounded amount
+#include <EInkDisplay.h>
+#include <HostTest.h>
+#include <Paginator.h>
+#include <PanelEmulator.h>
+
+#include <memory>
+#include <string>
+
+namespace {
+
+constexpr int8_t PIN_SCLK = 8, PIN_MOSI = 10, PIN_CS = 21, PIN_DC = 4, PIN_RST = 5, PIN_BUSY = 6;
+
+// Every glyph 10 pixels wide, nothing drawn
+class FixedFont : public LayoutFont {
+ public:
+  uint16_t getAdvance(uint32_t /*codepoint*/, uint16_t /*style*/) override { return 10; }
+  uint16_t getLineHeight() const override { return 20; }
+  uint16_t getAscent() const override { return 15; }
+  void drawGlyph(uint8_t* /*frameBuffer*/, uint16_t /*width*/, uint16_t /*height*/, int16_t /*x*/, int16_t /*y*/,
+                 uint32_t /*codepoint*/, uint16_t /*style*/) override {}
+  uint32_t getId() const override { return 1; }
+};
+
+struct Book {
+  std::string chapter;
+  size_t bytesRead = 0;
+};
+
+size_t readChapter(uint16_t /*chapter*/, const uint32_t offset, uint8_t* buffer, const size_t length, void* context) {
+  Book& book = *static_cast<Book*>(context);
+  if (offset >= book.chapter.size()) {
+    return 0;
+  }
+  const size_t n = std::min(length, book.chapter.size() - offset);
+  memcpy(buffer, book.chapter.data() + offset, n);
+  book.bytesRead += n;
+  return n;
+}
+
+// One paragraph of about 100 KB
+std::string hugeParagraph() {
+  std::string html = "<html><head><title>One</title></head><body><p>";
+  for (int word = 0; html.size() < 100 * 1024; word++) {
+    html += "word" + std::to_string(word % 1000) + " ";
+  }
+  return html + "</p></body></html>";
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  PanelEmulator panel(PIN_DC, PIN_CS);
+  std::unique_ptr<EInkDisplay> display(new EInkDisplay(PIN_SCLK, PIN_MOSI, PIN_CS, PIN_DC, PIN_RST, PIN_BUSY));
+  display->begin();
+  FixedFont font;
+  Paginator paginator;
+  CHECK(paginator.begin(*display, font));
+
+  Book book;
+  book.chapter = hugeParagraph();
+  CHECK(paginator.open("/books/one.epub", 1, 1, readChapter, &book));
+  while (paginator.paginateAhead(60000)) {
+  }
+  CHECK(paginator.isComplete());
+  const uint32_t pages = paginator.getPageCount();
+  CHECK(pages > 20);
+
+  // Each page of the paragraph re-reads at most one split of it, not everything before it on the way
+  for (uint32_t page = pages / 2; page < pages / 2 + 4; page++) {
+    book.bytesRead = 0;
+    CHECK(paginator.renderPage(page));
+    CHECK(book.bytesRead < 16384);
+  }
+
+  // The same book reuses its index, a book replaced at the same path does not
+  CHECK(paginator.open("/books/one.epub", 1, 1, readChapter, &book));
+  CHECK(paginator.isComplete() && paginator.getPageCount() == pages);
+  CHECK(paginator.open("/books/one.epub", 2, 1, readChapter, &book));
+  CHECK(!paginator.isComplete() && paginator.getPageCount() == 1);
+
+  return HostTest::result();
+}
@@ -0,0 +1,124 @@
+// Line-by-line text parsing with BufferedReader against raw FsFile reads, in simulated card throughput
+#include <BufferedReader.h>
+#include <HostTest.h>
+
+#include <string>
+
+namespace {
+
+constexpr size_t FILE_SIZE = 512 * 1024;
+constexpr size_t LINE_SIZE = 256;
+
+struct Result {
+  uint64_t commands;
+  uint64_t micros;
+  double hostMs;
+  size_t lines;
+};
+
+template <typename Reader>
+Result measure(Reader reader) {
+  const HostSd::Stats before = HostSd::stats();
+  const auto start = std::chrono::steady_clock::now();
+  const size_t lines = reader();
+  const double hostMs = HostTest::elapsedMs(start);
+  const HostSd::Stats& after = HostSd::stats();
+  return {after.commands - before.commands, after.simulatedMicros - before.simulatedMicros, hostMs, lines};
+}
+
+void print(const char* name, const Result& result) {
+  const double seconds = result.micros / 1e6;
+  printf("%-26s %6llu cmds  %8.2f ms card  %6.2f MB/s  %7.2f ms host  %zu lines\n", name,
+         static_cast<unsigned long long>(result.commands), result.micros / 1000.0,
+         seconds > 0 ? FILE_SIZE / seconds / 1e6 : 0.0, result.hostMs, result.lines);
+}
+
+// One f.read() call per byte, like the parsers that used FsFile directly
+size_t linesBytewise() {
+  FsFile f;
+  if (!SdMan.openFileForRead("BENCH", "/chapter.txt", f)) {
+    return 0;
+  }
+  size_t lines = 0;
+  int c;
+  while ((c = f.read()) >= 0) {
+    lines += c == '\n';
+  }
+  f.close();
+  return lines;
+}
+
+// 64 byte reads, like readFileToBuffer() used to do
+size_t linesChunked() {
+  FsFile f;
+  if (!SdMan.openFileForRead("BENCH", "/chapter.txt", f)) {
+    return 0;
+  }
+  size_t lines = 0;
+  uint8_t chunk[64];
+  int n;
+  while ((n = f.read(chunk, sizeof(chunk))) > 0) {
+    for (int i = 0; i < n; i++) {
+      lines += chunk[i] == '\n';
+    }
+  }
+  f.close();
+  return lines;
+}
+
+size_t linesBuffered(const size_t maxSectors) {
+  BufferedReader reader(maxSectors);
+  if (!reader.open("/chapter.txt")) {
+    return 0;
+  }
+  size_t lines = 0;
+  char line[LINE_SIZE];
+  while (reader.readLine(line, sizeof(line)) >= 0) {
+    lines++;
+  }
+  return lines;
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  HostSd::Latency latency;
+  latency.commandMicros = 300;
+  latency.sectorMicros = 40;
+  HostSd::setLatency(latency);
+
+  std::string text;
+  size_t expectedLines = 0;
+  while (text.size() < FILE_SIZE) {
+    text += "Line " + std::to_string(expectedLines) + " of a chapter, long enough to wrap on the page once.";
+    text += expectedLines % 3 ? "\r\n" : "\n";
+    expectedLines++;
+  }
+  text.resize(FILE_SIZE);
+  expectedLines = 0;
+  for (const char c : text) {
+    expectedLines += c == '\n';
+  }
+  const size_t expectedReadLines = expectedLines + (text.back() != '\n');
+  CHECK(HostTest::putHostFile("/chapter.txt", text.data(), text.size()));
+
+  const Result bytewise = measure(linesBytewise);
+  const Result chunked = measure(linesChunked);
+  const Result single = measure([] { return linesBuffered(1); });
+  const Result readAhead = measure([] { return linesBuffered(BufferedReader::DEFAULT_MAX_SECTORS); });
+  const Result wide = measure([] { return linesBuffered(32); });
+
+  print("FsFile::read() per byte", bytewise);
+  print("FsFile::read() 64 bytes", chunked);
+  print("BufferedReader 1 sector", single);
+  print("BufferedReader 8 sectors", readAhead);
+  print("BufferedReader 32 sectors", wide);
+
+  CHECK(bytewise.lines == expectedLines && chunked.lines == expectedLines);
+  CHECK(single.lines == expectedReadLines && readAhead.lines == expectedReadLines && wide.lines == expectedReadLines);
+  CHECK(readAhead.commands < chunked.commands && readAhead.micros < chunked.micros);
+  CHECK(wide.commands <= readAhead.commands);
+
+  return HostTest::result();
+}
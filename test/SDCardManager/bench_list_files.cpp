@@ -0,0 +1,111 @@
+// Directory listing against the openNextFile() loop listFiles() used to be, and paging a large folder with a
+// DirCursor against re-listing it up to the page, in card commands, simulated card time and host time
+#include <HostTest.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int PAGE_SIZE = 20;
+
+struct Result {
+  uint64_t commands;
+  uint64_t micros;
+  double hostMs;
+};
+
+template <typename Lister>
+Result measure(Lister lister) {
+  const HostSd::Stats before = HostSd::stats();
+  const auto start = std::chrono::steady_clock::now();
+  lister();
+  const double hostMs = HostTest::elapsedMs(start);
+  const HostSd::Stats& after = HostSd::stats();
+  return {after.commands - before.commands, after.simulatedMicros - before.simulatedMicros, hostMs};
+}
+
+void print(const char* name, const Result& result) {
+  printf("  %-22s %7llu cmds %9.2f ms card %8.3f ms host\n", name, static_cast<unsigned long long>(result.commands),
+         result.micros / 1000.0, result.hostMs);
+}
+
+// What listFiles() did before: a new FsFile per entry from openNextFile(), names cut at 127 bytes
+std::vector<String> listFilesOld(const char* path, const int maxFiles) {
+  std::vector<String> ret;
+  FsFile root = SdMan.open(path);
+  if (!root || !root.isDirectory()) {
+    return ret;
+  }
+  int count = 0;
+  char name[128];
+  for (auto f = root.openNextFile(); f && count < maxFiles; f = root.openNextFile()) {
+    if (f.isDirectory()) {
+      f.close();
+      continue;
+    }
+    f.getName(name, sizeof(name));
+    ret.emplace_back(name);
+    f.close();
+    count++;
+  }
+  root.close();
+  return ret;
+}
+
+bool collectName(const SDCardManager::DirEntry& entry, void* context) {
+  static_cast<std::vector<String>*>(context)->emplace_back(entry.name);
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  HostSd::Latency latency;
+  latency.commandMicros = 300;
+  latency.sectorMicros = 40;
+  HostSd::setLatency(latency);
+
+  const int counts[] = {100, 1000};
+  for (const int count : counts) {
+    const std::string dir = "/list" + std::to_string(count);
+    for (int i = 0; i < count; i++) {
+      const std::string path = dir + "/book-with-a-long-file-name-" + std::to_string(1000 + i) + ".epub";
+      CHECK(HostTest::putHostFile(path.c_str(), "x", 1));
+    }
+    printf("%d files\n", count);
+
+    // Whole folder
+    std::vector<String> old, now;
+    const Result oldList = measure([&] { old = listFilesOld(dir.c_str(), count); });
+    const Result newList = measure([&] { now = SdMan.listFiles(dir.c_str(), count); });
+    CHECK(old.size() == static_cast<size_t>(count) && old == now);
+    CHECK(newList.commands <= oldList.commands);
+    print("listFiles before", oldList);
+    print("listFiles", newList);
+
+    // Every page of the folder in turn: without a cursor each page re-walks everything before it
+    std::vector<String> paged, resumed;
+    const Result relisted = measure([&] {
+      for (int shown = 0; shown < count; shown += PAGE_SIZE) {
+        const std::vector<String> upTo = listFilesOld(dir.c_str(), shown + PAGE_SIZE);
+        paged.insert(paged.end(), upTo.begin() + shown, upTo.end());
+      }
+    });
+    const Result cursor = measure([&] {
+      SDCardManager::DirCursor position;
+      while (!position.done) {
+        if (SdMan.listDirectory(dir.c_str(), collectName, &resumed, &position, PAGE_SIZE) == 0) {
+          break;
+        }
+      }
+    });
+    CHECK(paged == old && resumed == old);
+    CHECK(cursor.commands < relisted.commands);
+    print("pages re-listed", relisted);
+    print("pages with DirCursor", cursor);
+  }
+
+  return HostTest::result();
+}
@@ -0,0 +1,81 @@
+// readFile() against the per-character String append it replaced, in card commands, simulated card time and host time
+#include <HostTest.h>
+
+#include <string>
+
+namespace {
+
+// Card commands and simulated card time, plus host time for the per-call overhead the card model doesn't see
+struct Result {
+  uint64_t commands;
+  uint64_t micros;
+  double hostMs;
+};
+
+Result measure(const HostSd::Stats& before, const std::chrono::steady_clock::time_point start) {
+  const double hostMs = HostTest::elapsedMs(start);
+  const HostSd::Stats& after = HostSd::stats();
+  return {after.commands - before.commands, after.simulatedMicros - before.simulatedMicros, hostMs};
+}
+
+// What readFile() did before: one f.read() and one String append per byte
+String readBytewise(const char* path) {
+  FsFile f;
+  String content = "";
+  if (!SdMan.openFileForRead("BENCH", path, f)) {
+    return content;
+  }
+  size_t readSize = 0;
+  while (f.available() && readSize < 50000) {
+    content += static_cast<char>(f.read());
+    readSize++;
+  }
+  f.close();
+  return content;
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  HostSd::Latency latency;
+  latency.commandMicros = 300;
+  latency.sectorMicros = 40;
+  HostSd::setLatency(latency);
+
+  const size_t sizes[] = {2 * 1024, 16 * 1024, 48 * 1024};
+  for (const size_t size : sizes) {
+    std::string content(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+      content[i] = static_cast<char>(' ' + i % 90);
+    }
+    CHECK(HostTest::putHostFile("/file.txt", content.data(), content.size()));
+
+    HostSd::Stats before = HostSd::stats();
+    auto start = std::chrono::steady_clock::now();
+    const String old = readBytewise("/file.txt");
+    const Result bytewise = measure(before, start);
+
+    before = HostSd::stats();
+    start = std::chrono::steady_clock::now();
+    const String now = SdMan.readFile("/file.txt");
+    const Result bulk = measure(before, start);
+
+    std::string direct;
+    before = HostSd::stats();
+    start = std::chrono::steady_clock::now();
+    CHECK(SdMan.readFile("/file.txt", direct));
+    const Result toString = measure(before, start);
+
+    CHECK(old == content.c_str() && now == content.c_str() && direct == content);
+    CHECK(bulk.commands <= bytewise.commands && bulk.micros <= bytewise.micros);
+    CHECK(toString.commands <= bulk.commands);
+    printf("%2zu KB  bytewise: %4llu cmds %6.2f ms card %6.3f ms host | readFile: %4llu cmds %6.2f ms card %6.3f ms host"
+           " | std::string: %4llu cmds %6.2f ms card %6.3f ms host\n",
+           size / 1024, static_cast<unsigned long long>(bytewise.commands), bytewise.micros / 1000.0, bytewise.hostMs,
+           static_cast<unsigned long long>(bulk.commands), bulk.micros / 1000.0, bulk.hostMs,
+           static_cast<unsigned long long>(toString.commands), toString.micros / 1000.0, toString.hostMs);
+  }
+
+  return HostTest::result();
+}
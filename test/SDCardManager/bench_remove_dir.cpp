@@ -0,0 +1,97 @@
+// removeDir() against the recursive version it replaced, which removed every file by its full path, in card commands,
+// simulated card time and host time
+#include <HostTest.h>
+
+#include <string>
+
+namespace {
+
+constexpr int TOP_DIRS = 5;
+constexpr int SUB_DIRS = 4;
+constexpr int FILES = 20;
+
+struct Result {
+  uint64_t commands;
+  uint64_t opens;
+  uint64_t micros;
+  double hostMs;
+};
+
+template <typename Remover>
+Result measure(Remover remover) {
+  const HostSd::Stats before = HostSd::stats();
+  const auto start = std::chrono::steady_clock::now();
+  remover();
+  const double hostMs = HostTest::elapsedMs(start);
+  const HostSd::Stats& after = HostSd::stats();
+  return {after.commands - before.commands, after.opens - before.opens, after.simulatedMicros - before.simulatedMicros,
+          hostMs};
+}
+
+void print(const char* name, const Result& result) {
+  printf("%-18s %6llu cmds %6llu opens %9.2f ms card %8.3f ms host\n", name,
+         static_cast<unsigned long long>(result.commands), static_cast<unsigned long long>(result.opens),
+         result.micros / 1000.0, result.hostMs);
+}
+
+// A library-like tree: TOP_DIRS x SUB_DIRS folders of FILES books each
+void makeTree(const std::string& root) {
+  for (int a = 0; a < TOP_DIRS; a++) {
+    for (int b = 0; b < SUB_DIRS; b++) {
+      for (int f = 0; f < FILES; f++) {
+        const std::string path = root + "/author" + std::to_string(a) + "/series" + std::to_string(b) + "/book" +
+                                 std::to_string(f) + ".epub";
+        CHECK(HostTest::putHostFile(path.c_str(), "x", 1));
+      }
+    }
+  }
+}
+
+// What removeDir() did before: recursion per level, a String path and a path walk for every file
+bool removeDirOld(const char* path) {
+  FsFile dir = SdMan.open(path);
+  if (!dir || !dir.isDirectory()) {
+    return false;
+  }
+  FsFile file = dir.openNextFile();
+  char name[128];
+  while (file) {
+    String filePath = path;
+    if (!filePath.endsWith("/")) {
+      filePath += "/";
+    }
+    file.getName(name, sizeof(name));
+    filePath += name;
+    const bool isDirectory = file.isDirectory();
+    file.close();
+    if (isDirectory ? !removeDirOld(filePath.c_str()) : !SdMan.remove(filePath.c_str())) {
+      return false;
+    }
+    file = dir.openNextFile();
+  }
+  dir.close();
+  return SdMan.rmdir(path);
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  HostSd::Latency latency;
+  latency.commandMicros = 300;
+  latency.sectorMicros = 40;
+  HostSd::setLatency(latency);
+
+  makeTree("/old/library");
+  makeTree("/new/library");
+  printf("%d folders, %d files\n", TOP_DIRS * (SUB_DIRS + 1), TOP_DIRS * SUB_DIRS * FILES);
+
+  const Result old = measure([] { CHECK(removeDirOld("/old/library")); });
+  const Result now = measure([] { CHECK(SdMan.removeDir("/new/library")); });
+  CHECK(!SdMan.exists("/old/library") && !SdMan.exists("/new/library"));
+  CHECK(now.commands < old.commands && now.micros < old.micros);
+  print("recursive, paths", old);
+  print("removeDir", now);
+
+  return HostTest::result();
+}
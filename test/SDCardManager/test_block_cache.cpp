@@ -0,0 +1,63 @@
+// BlockCache hits, and no stale pages after a file is rewritten with the same size
+#include <BlockCache.h>
+#include <HostTest.h>
+
+#include <string>
+
+namespace {
+
+std::string readAt(const char* path, const uint64_t offset, const size_t length) {
+  CachedFile file;
+  std::string out(length, '\0');
+  if (!file.open(path)) {
+    return "";
+  }
+  out.resize(file.pread(&out[0], length, offset));
+  return out;
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  BlockCache& cache = BlockCache::getInstance();
+  CHECK(cache.begin(4));
+
+  std::string text(10000, 'a');
+  CHECK(SdMan.writeFile("/f.txt", String(text.c_str())));
+  CHECK(readAt("/f.txt", 4100, 4) == "aaaa");
+  cache.resetStats();
+  CHECK(readAt("/f.txt", 4200, 4) == "aaaa");
+  CHECK(cache.getHits() == 1 && cache.getMisses() == 0);
+
+  // Replaced through writeFile() (a new file renamed over the old one)
+  text.assign(text.size(), 'b');
+  CHECK(SdMan.writeFile("/f.txt", String(text.c_str())));
+  CHECK(readAt("/f.txt", 4100, 4) == "bbbb");
+
+  // Rewritten in place, same size
+  text.assign(text.size(), 'c');
+  FsFile f;
+  CHECK(SdMan.openFileForWrite("TEST", "/f.txt", f));
+  CHECK(f.write(text.data(), text.size()) == text.size());
+  f.close();
+  CHECK(readAt("/f.txt", 4100, 4) == "cccc");
+
+  // Removed and recreated
+  CHECK(SdMan.remove("/f.txt"));
+  text.assign(text.size(), 'd');
+  CHECK(SdMan.writeFile("/f.txt", String(text.c_str())));
+  CHECK(readAt("/f.txt", 4100, 4) == "dddd");
+
+  // Changed behind the manager's back, only invalidatePath() knows
+  CHECK(readAt("/f.txt", 0, 4) == "dddd");
+  text.assign(text.size(), 'e');
+  FILE* host = fopen((std::string(HostSd::getRoot()) + "/f.txt").c_str(), "r+b");
+  CHECK(host && fwrite(text.data(), 1, text.size(), host) == text.size());
+  if (host) fclose(host);
+  cache.invalidatePath("/f.txt");
+  CHECK(readAt("/f.txt", 0, 4) == "eeee");
+
+  cache.end();
+  return HostTest::result();
+}
@@ -0,0 +1,53 @@
+// A BufferedWriter commit cut short between its two renames is finished or rolled back by the next read
+#include <BufferedWriter.h>
+#include <HostTest.h>
+
+#include <filesystem>
+#include <string>
+
+namespace {
+
+bool exists(const char* path) { return std::filesystem::exists(std::filesystem::path(HostSd::getRoot()) / (path + 1)); }
+
+// Leaves the card as commit() does when power is lost after it moved the old file aside
+void interruptCommit(const char* path, const char* newContent) {
+  const std::filesystem::path root = HostSd::getRoot();
+  const std::string target = path + 1;
+  std::filesystem::rename(root / target, root / (target + ".bak"));
+  if (newContent) {
+    CHECK(HostTest::putHostFile((std::string(path) + ".tmp").c_str(), newContent, strlen(newContent)));
+  }
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+
+  // A normal commit leaves nothing behind
+  CHECK(SdMan.writeFile("/progress.txt", "old"));
+  CHECK(SdMan.readFile("/progress.txt") == "old");
+  CHECK(!exists("/progress.txt.bak") && !exists("/progress.txt.tmp"));
+
+  // The temp file was complete: the new version is moved into place
+  interruptCommit("/progress.txt", "new");
+  CHECK(SdMan.readFile("/progress.txt") == "new");
+  CHECK(!exists("/progress.txt.bak") && !exists("/progress.txt.tmp"));
+
+  // No temp file: the old version comes back
+  interruptCommit("/progress.txt", nullptr);
+  std::string content;
+  CHECK(SdMan.readFile("/progress.txt", content) && content == "new");
+  CHECK(!exists("/progress.txt.bak"));
+
+  // A write after an interrupted commit replaces the file and drops the backup
+  interruptCommit("/progress.txt", "newer");
+  CHECK(SdMan.writeFile("/progress.txt", "newest"));
+  CHECK(SdMan.readFile("/progress.txt") == "newest");
+  CHECK(!exists("/progress.txt.bak") && !exists("/progress.txt.tmp"));
+
+  // A file that was never written stays missing
+  CHECK(SdMan.readFile("/missing.txt").length() == 0);
+
+  return HostTest::result();
+}
@@ -0,0 +1,19 @@
+// copyTree refuses to copy a directory into itself however its path is written, and copies next to it
+#include <HostTest.h>
+#include <SDCardManager.h>
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  CHECK(HostTest::putHostFile("/a/f.txt", "abc", 3));
+
+  CHECK(!SdMan.copyTree("/a", "/a/b"));
+  CHECK(!SdMan.copyTree("/a/", "/a/b"));
+  CHECK(!SdMan.copyTree("/a//", "/a"));
+  CHECK(!SdMan.copyTree("/", "/a/b"));
+  CHECK(!SdMan.exists("/a/b"));
+
+  CHECK(SdMan.copyTree("/a/", "/ab"));
+  CHECK(SdMan.exists("/ab/f.txt"));
+
+  return HostTest::result();
+}
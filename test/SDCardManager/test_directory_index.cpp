@@ -0,0 +1,60 @@
+// DirectoryIndex is reused while the directory's entries are unchanged and rebuilt when any of them changes, whoever
+// changed it
+#include <DirectoryIndex.h>
+#include <HostTest.h>
+
+#include <string>
+
+namespace {
+
+constexpr uint32_t FILES = 40;
+
+std::string bookPath(const uint32_t i) { return "/books/book" + std::to_string(100 + i) + ".epub"; }
+
+// Reopens the index, true if it had to be rebuilt
+bool reopenRebuilds(DirectoryIndex& index, const char* path, const bool fullCheck = false) {
+  CHECK(index.open(path, fullCheck));
+  return index.wasRebuilt();
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  for (uint32_t i = 0; i < FILES; i++) {
+    CHECK(HostTest::putHostFile(bookPath(i).c_str(), "x", 1));
+  }
+
+  DirectoryIndex index;
+  CHECK(index.open("/books") && index.wasRebuilt() && index.size() == FILES);
+
+  // Unchanged: reused with and without the name check, "/books/" is the same directory
+  CHECK(!reopenRebuilds(index, "/books"));
+  CHECK(!reopenRebuilds(index, "/books/", true));
+
+  // Changed on the host, as another FAT driver would: the directory's own modify time is not relied on
+  CHECK(HostTest::putHostFile(bookPath(FILES).c_str(), "x", 1));
+  CHECK(reopenRebuilds(index, "/books") && index.size() == FILES + 1);
+  CHECK(HostTest::putHostFile(bookPath(0).c_str(), "longer", 6));
+  CHECK(reopenRebuilds(index, "/books") && index.size() == FILES + 1);
+  CHECK(!reopenRebuilds(index, "/books"));
+
+  // Changed through the manager
+  CHECK(SdMan.writeFile(bookPath(FILES + 1).c_str(), "x"));
+  CHECK(reopenRebuilds(index, "/books") && index.size() == FILES + 2);
+  CHECK(SdMan.rename(bookPath(FILES + 1).c_str(), "/books/aaa.epub"));
+  CHECK(reopenRebuilds(index, "/books") && index.size() == FILES + 2);
+
+  // The host lists entries in name order, so this rename keeps its slot like an in-place rename by another driver,
+  // which only the name check sees
+  CHECK(SdMan.rename("/books/aaa.epub", "/books/aab.epub"));
+  CHECK(!reopenRebuilds(index, "/books"));
+  CHECK(reopenRebuilds(index, "/books", true));
+  CHECK(SdMan.remove("/books/aab.epub"));
+  CHECK(reopenRebuilds(index, "/books") && index.size() == FILES + 1);
+
+  SDCardManager::DirEntry entry;
+  CHECK(index.seek(0) && index.next(entry) && entry.size == 6);
+
+  return HostTest::result();
+}
@@ -0,0 +1,234 @@
+// IoWorker on std::thread: ordering, cancellation, completion, several submitting threads and end() racing them
+#include <HostTest.h>
+#include <IoWorker.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t FILE_SIZE = 200000;
+constexpr size_t CHUNK = 4096;
+
+// Holds the worker inside a callback until released, so the test can line up the queue behind it
+struct Gate {
+  std::mutex mutex;
+  std::condition_variable changed;
+  bool entered = false;
+  bool open = false;
+
+  static void hold(IoWorker::IoRequest&, void* context) {
+    Gate& gate = *static_cast<Gate*>(context);
+    std::unique_lock<std::mutex> guard(gate.mutex);
+    gate.entered = true;
+    gate.changed.notify_all();
+    gate.changed.wait(guard, [&gate] { return gate.open; });
+  }
+  void waitEntered() {
+    std::unique_lock<std::mutex> guard(mutex);
+    changed.wait(guard, [this] { return entered; });
+  }
+  void release() {
+    std::lock_guard<std::mutex> guard(mutex);
+    open = true;
+    changed.notify_all();
+  }
+};
+
+// Order in which callbacks ran, identified by their context
+std::mutex orderMutex;
+std::vector<intptr_t> order;
+
+void record(IoWorker::IoRequest&, void* context) {
+  std::lock_guard<std::mutex> guard(orderMutex);
+  order.push_back(reinterpret_cast<intptr_t>(context));
+}
+
+void setRead(IoWorker::IoRequest& request, const uint64_t offset, uint8_t* buffer, const size_t length,
+             const IoWorker::Priority priority = IoWorker::PRIORITY_FOREGROUND) {
+  request.operation = IoWorker::IO_READ;
+  request.priority = priority;
+  request.path = "/data.bin";
+  request.offset = offset;
+  request.buffer = buffer;
+  request.length = length;
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  std::string data(FILE_SIZE, '\0');
+  for (size_t i = 0; i < FILE_SIZE; i++) {
+    data[i] = static_cast<char>('a' + i * 7 % 26);
+  }
+  CHECK(HostTest::putHostFile("/data.bin", data.data(), data.size()));
+
+  IoWorker worker;
+  IoWorker::IoRequest idle;
+  uint8_t scratch[16];
+  setRead(idle, 0, scratch, sizeof(scratch));
+  CHECK(!worker.submit(idle));
+  CHECK(worker.begin());
+
+  // Foreground before prefetch, each in submission order
+  Gate gate;
+  IoWorker::IoRequest blocker;
+  setRead(blocker, 0, scratch, sizeof(scratch));
+  blocker.callback = Gate::hold;
+  blocker.context = &gate;
+  CHECK(worker.submit(blocker));
+  gate.waitEntered();
+
+  constexpr int PREFETCHES = 8;
+  static uint8_t buffers[PREFETCHES + 2][CHUNK];
+  IoWorker::IoRequest prefetches[PREFETCHES];
+  for (int i = 0; i < PREFETCHES; i++) {
+    setRead(prefetches[i], i * 3000, buffers[i], CHUNK, IoWorker::PRIORITY_PREFETCH);
+    prefetches[i].callback = record;
+    prefetches[i].context = reinterpret_cast<void*>(static_cast<intptr_t>(i));
+    CHECK(worker.submit(prefetches[i]));
+  }
+  CHECK(!worker.submit(prefetches[3]));
+  IoWorker::IoRequest first, second;
+  setRead(first, 150000, buffers[PREFETCHES], CHUNK);
+  setRead(second, FILE_SIZE - 1000, buffers[PREFETCHES + 1], CHUNK);
+  first.callback = second.callback = record;
+  first.context = reinterpret_cast<void*>(100);
+  second.context = reinterpret_cast<void*>(101);
+  CHECK(worker.submit(first) && worker.submit(second));
+  CHECK(worker.pending() == PREFETCHES + 2);
+
+  // Cancelled requests are done at once with ok false, and their callbacks never run
+  CHECK(worker.cancel(prefetches[5]));
+  CHECK(prefetches[5].done && !prefetches[5].ok && prefetches[5].result == 0);
+  CHECK(!worker.wait(prefetches[5]));
+  CHECK(!worker.cancel(prefetches[5]));
+  CHECK(worker.pending() == PREFETCHES + 1);
+
+  gate.release();
+  CHECK(worker.wait(blocker));
+  CHECK(worker.wait(first) && first.result == CHUNK);
+  CHECK(memcmp(buffers[PREFETCHES], data.data() + 150000, CHUNK) == 0);
+  CHECK(worker.wait(second) && second.result == 1000);
+  CHECK(memcmp(buffers[PREFETCHES + 1], data.data() + FILE_SIZE - 1000, 1000) == 0);
+  for (int i = 0; i < PREFETCHES; i++) {
+    if (i != 5) {
+      CHECK(worker.wait(prefetches[i]) && prefetches[i].result == CHUNK);
+      CHECK(memcmp(buffers[i], data.data() + i * 3000, CHUNK) == 0);
+    }
+  }
+  {
+    const std::vector<intptr_t> expected = {100, 101, 0, 1, 2, 3, 4, 6, 7};
+    std::lock_guard<std::mutex> guard(orderMutex);
+    CHECK(order == expected);
+  }
+
+  // cancelPrefetches() finishes every queued prefetch, foreground requests still run
+  Gate secondGate;
+  blocker.context = &secondGate;
+  CHECK(worker.submit(blocker));
+  secondGate.waitEntered();
+  for (int i = 0; i < PREFETCHES; i++) {
+    CHECK(worker.submit(prefetches[i]));
+  }
+  CHECK(worker.submit(first));
+  worker.cancelPrefetches();
+  CHECK(worker.pending() == 1);
+  for (int i = 0; i < PREFETCHES; i++) {
+    CHECK(prefetches[i].done && !prefetches[i].ok);
+  }
+  secondGate.release();
+  CHECK(worker.wait(first));
+
+  // Writes, read back, and a missing file
+  const char message[] = "written by the worker";
+  IoWorker::IoRequest write;
+  write.operation = IoWorker::IO_WRITE;
+  write.path = "/out.bin";
+  write.buffer = reinterpret_cast<uint8_t*>(const_cast<char*>(message));
+  write.length = sizeof(message);
+  CHECK(worker.run(write) && write.result == sizeof(message));
+  char readBack[64] = {};
+  IoWorker::IoRequest read;
+  read.path = "/out.bin";
+  read.buffer = reinterpret_cast<uint8_t*>(readBack);
+  read.length = sizeof(readBack);
+  CHECK(worker.run(read) && read.result == sizeof(message) && strcmp(readBack, message) == 0);
+  IoWorker::IoRequest missing;
+  missing.path = "/missing.bin";
+  missing.buffer = scratch;
+  missing.length = sizeof(scratch);
+  CHECK(!worker.run(missing) && missing.done);
+
+  // Several tasks submitting and waiting at once
+  constexpr int THREADS = 4;
+  constexpr int REQUESTS = 200;
+  int mismatches[THREADS] = {};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([&, t] {
+      uint8_t buffer[512];
+      for (int i = 0; i < REQUESTS; i++) {
+        const uint64_t offset = (t * REQUESTS + i) * 211 % (FILE_SIZE - sizeof(buffer));
+        IoWorker::IoRequest request;
+        setRead(request, offset, buffer, sizeof(buffer),
+                i % 2 ? IoWorker::PRIORITY_PREFETCH : IoWorker::PRIORITY_FOREGROUND);
+        if (!worker.run(request) || request.result != sizeof(buffer) ||
+            memcmp(buffer, data.data() + offset, sizeof(buffer)) != 0) {
+          mismatches[t]++;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (const int count : mismatches) {
+    CHECK(count == 0);
+  }
+
+  // end() finishes what is still queued
+  for (int i = 0; i < PREFETCHES; i++) {
+    CHECK(worker.submit(prefetches[i]));
+  }
+  worker.end();
+  for (int i = 0; i < PREFETCHES; i++) {
+    CHECK(prefetches[i].done && prefetches[i].ok);
+  }
+  CHECK(!worker.submit(first));
+
+  // end() racing submitting tasks: every request accepted is served, later ones are refused, and the worker restarts
+  CHECK(worker.begin());
+  int unserved[THREADS] = {};
+  threads.clear();
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([&, t] {
+      uint8_t buffer[64];
+      IoWorker::IoRequest request;
+      setRead(request, t * 1000, buffer, sizeof(buffer));
+      while (worker.submit(request)) {
+        if (!worker.wait(request) || memcmp(buffer, data.data() + t * 1000, sizeof(buffer)) != 0) {
+          unserved[t]++;
+        }
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  worker.end();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (const int count : unserved) {
+    CHECK(count == 0);
+  }
+  CHECK(worker.pending() == 0);
+  CHECK(worker.begin() && worker.run(first) && first.result == CHUNK);
+  worker.end();
+
+  return HostTest::result();
+}
@@ -0,0 +1,56 @@
+// readFile() overloads and readFileToBuffer() bounds
+#include <HostTest.h>
+
+#include <string>
+
+namespace {
+
+std::string makeText(const size_t length) {
+  std::string text(length, '\0');
+  for (size_t i = 0; i < length; i++) {
+    text[i] = static_cast<char>('a' + i % 26);
+  }
+  return text;
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+
+  const std::string small = makeText(700);
+  const std::string large = makeText(60000);
+  CHECK(HostTest::putHostFile("/small.txt", small.data(), small.size()));
+  CHECK(HostTest::putHostFile("/large.txt", large.data(), large.size()));
+  CHECK(HostTest::putHostFile("/empty.txt", "", 0));
+
+  // String version, capped at 50 KB
+  CHECK(SdMan.readFile("/small.txt") == small.c_str());
+  CHECK(SdMan.readFile("/large.txt").length() == 50000);
+  CHECK(SdMan.readFile("/missing.txt").length() == 0);
+
+  std::string out;
+  CHECK(SdMan.readFile("/large.txt", out, 0) && out == large);
+  CHECK(SdMan.readFile("/large.txt", out, 1000) && out == large.substr(0, 1000));
+  CHECK(SdMan.readFile("/empty.txt", out) && out.empty());
+  CHECK(!SdMan.readFile("/missing.txt", out) && out.empty());
+
+  uint8_t bytes[800];
+  CHECK(SdMan.readFile("/small.txt", bytes, sizeof(bytes)) == small.size());
+  CHECK(memcmp(bytes, small.data(), small.size()) == 0);
+  CHECK(SdMan.readFile("/large.txt", bytes, 100) == 100);
+
+  // readFileToBuffer keeps a byte for the terminator, even in the smallest buffer
+  char text[16];
+  memset(text, 'x', sizeof(text));
+  CHECK(SdMan.readFileToBuffer("/small.txt", text, 1) == 0);
+  CHECK(text[0] == '\0' && text[1] == 'x');
+  CHECK(SdMan.readFileToBuffer("/small.txt", text, 2) == 1);
+  CHECK(strcmp(text, "a") == 0 && text[2] == 'x');
+  CHECK(SdMan.readFileToBuffer("/small.txt", text, sizeof(text), 5) == 5);
+  CHECK(strcmp(text, "abcde") == 0);
+  CHECK(SdMan.readFileToBuffer("/small.txt", text, sizeof(text)) == sizeof(text) - 1);
+  CHECK(text[sizeof(text) - 1] == '\0');
+
+  return HostTest::result();
+}
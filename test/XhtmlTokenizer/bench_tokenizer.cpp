@@ -0,0 +1,117 @@
+// Tokenizer throughput on generated chapters, in memory and streamed from the card
+#include <HostTest.h>
+#include <XhtmlTokenizer.h>
+
+#include <string>
+
+namespace {
+
+constexpr int CHAPTERS = 4;
+
+const char STYLESHEET[] =
+    "p { text-align: justify } .chapter { page-break-before: always; text-align: center }\n"
+    "span.sc { font-variant: small-caps } .note { font-size: small } .hidden { display: none }\n";
+
+struct Counts {
+  size_t events = 0;
+  size_t textBytes = 0;
+  size_t blocks = 0;
+  uint16_t styles = 0;
+};
+
+void count(const XhtmlEvent& event, void* context) {
+  Counts& counts = *static_cast<Counts*>(context);
+  counts.events++;
+  if (event.type == XHTML_TEXT) {
+    counts.textBytes += event.length;
+    counts.styles |= event.style;
+  } else if (event.type == XHTML_BLOCK_START) {
+    counts.blocks++;
+  }
+}
+
+// About 100 KB of typical novel markup: paragraphs with inline styles, entities, notes and the odd image
+std::string makeChapter(const int number) {
+  std::string html =
+      "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<!DOCTYPE html>\n"
+      "<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Chapter</title>"
+      "<link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\"/></head><body>\n";
+  html += "<h1 class=\"chapter\" id=\"ch" + std::to_string(number) + "\">Chapter " + std::to_string(number) + "</h1>\n";
+  for (int p = 0; html.size() < 100 * 1024; p++) {
+    html += "<p class=\"body\">It was the <i>best</i> of times, it was the <b>worst</b> of times &#8212; it was the age "
+            "of wisdom, it was the age of <span class=\"sc\">foolishness</span>, it was the epoch of belief&nbsp;"
+            "&amp; incredulity, \xE2\x80\x9Cit was the season of Light\xE2\x80\x9D";
+    if (p % 7 == 0) html += "<a href=\"#n1\"><sup>1</sup></a><span class=\"hidden\">not shown</span>";
+    html += ".</p>\n";
+    if (p % 40 == 39) html += "<p><img src=\"images/plate.png\" alt=\"\"/></p><hr/>\n";
+  }
+  html += "<p class=\"note\" id=\"n1\">1. A note.</p></body></html>\n";
+  return html;
+}
+
+Counts tokenize(const std::string& html) {
+  Counts counts;
+  XhtmlTokenizer tokenizer(count, &counts);
+  tokenizer.writeStylesheet(reinterpret_cast<const uint8_t*>(STYLESHEET), sizeof(STYLESHEET) - 1);
+  tokenizer.endStylesheet();
+  tokenizer.write(reinterpret_cast<const uint8_t*>(html.data()), html.size());
+  tokenizer.finish();
+  return counts;
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+
+  std::string chapters[CHAPTERS];
+  size_t totalBytes = 0;
+  for (int i = 0; i < CHAPTERS; i++) {
+    chapters[i] = makeChapter(i + 1);
+    totalBytes += chapters[i].size();
+    const std::string path = "/ch" + std::to_string(i) + ".xhtml";
+    CHECK(HostTest::putHostFile(path.c_str(), chapters[i].data(), chapters[i].size()));
+  }
+
+  // In memory: the tokenizer alone
+  Counts reference[CHAPTERS];
+  constexpr int ROUNDS = 5;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int i = 0; i < CHAPTERS; i++) {
+      reference[i] = tokenize(chapters[i]);
+    }
+  }
+  const double memoryMs = HostTest::elapsedMs(start) / ROUNDS;
+
+  size_t textBytes = 0, events = 0, blocks = 0;
+  for (const Counts& counts : reference) {
+    textBytes += counts.textBytes;
+    events += counts.events;
+    blocks += counts.blocks;
+    CHECK(counts.blocks > 300);
+    CHECK((counts.styles & (XHTML_BOLD | XHTML_ITALIC | XHTML_SMALL_CAPS | XHTML_SUPERSCRIPT)) ==
+          (XHTML_BOLD | XHTML_ITALIC | XHTML_SMALL_CAPS | XHTML_SUPERSCRIPT));
+  }
+
+  // Streamed from the card through readFileToStream(), the tokenizer is the Print
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < CHAPTERS; i++) {
+    Counts counts;
+    XhtmlTokenizer tokenizer(count, &counts);
+    tokenizer.writeStylesheet(reinterpret_cast<const uint8_t*>(STYLESHEET), sizeof(STYLESHEET) - 1);
+    tokenizer.endStylesheet();
+    const std::string path = "/ch" + std::to_string(i) + ".xhtml";
+    CHECK(SdMan.readFileToStream(path.c_str(), tokenizer));
+    tokenizer.finish();
+    CHECK(counts.events == reference[i].events && counts.textBytes == reference[i].textBytes);
+  }
+  const double streamedMs = HostTest::elapsedMs(start);
+
+  printf("%d chapters, %zu KB markup -> %zu KB text, %zu blocks, %zu events, tokenizer state %zu bytes\n", CHAPTERS,
+         totalBytes / 1024, textBytes / 1024, blocks, events, sizeof(XhtmlTokenizer));
+  printf("in memory: %.2f ms, %.1f MB/s\n", memoryMs, totalBytes / memoryMs / 1000);
+  printf("from card: %.2f ms, %.1f MB/s (host time, card latency off)\n", streamedMs, totalBytes / streamedMs / 1000);
+
+  return HostTest::result();
+}
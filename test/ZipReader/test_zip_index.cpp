@@ -0,0 +1,145 @@
+// The cached central directory index follows the archive: built once, reused, rebuilt after the archive changes
+#include <HostTest.h>
+#include <ZipReader.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::vector<std::pair<std::string, std::string>> Entries;
+
+uint32_t crc32(const std::string& data) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (const char c : data) {
+    crc ^= static_cast<uint8_t>(c);
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+void put16(Bytes& out, const uint32_t v) {
+  out.push_back(v & 0xFF);
+  out.push_back(v >> 8 & 0xFF);
+}
+
+void put32(Bytes& out, const uint32_t v) {
+  put16(out, v & 0xFFFF);
+  put16(out, v >> 16);
+}
+
+// Archive of stored entries
+Bytes makeZip(const Entries& entries) {
+  Bytes out, central;
+  for (const auto& entry : entries) {
+    const uint32_t offset = static_cast<uint32_t>(out.size());
+    const uint32_t crc = crc32(entry.second);
+    const uint32_t size = static_cast<uint32_t>(entry.second.size());
+    const uint16_t nameLength = static_cast<uint16_t>(entry.first.size());
+
+    put32(out, 0x04034b50);
+    put16(out, 10);
+    put16(out, 0);  // Flags
+    put16(out, 0);  // Stored
+    put32(out, 0);  // Time and date
+    put32(out, crc);
+    put32(out, size);
+    put32(out, size);
+    put16(out, nameLength);
+    put16(out, 0);
+    out.insert(out.end(), entry.first.begin(), entry.first.end());
+    out.insert(out.end(), entry.second.begin(), entry.second.end());
+
+    put32(central, 0x02014b50);
+    put16(central, 20);
+    put16(central, 10);
+    put16(central, 0);
+    put16(central, 0);
+    put32(central, 0);
+    put32(central, crc);
+    put32(central, size);
+    put32(central, size);
+    put16(central, nameLength);
+    put32(central, 0);  // Extra field and comment lengths
+    put32(central, 0);  // Disk number and internal attributes
+    put32(central, 0);  // External attributes
+    put32(central, offset);
+    central.insert(central.end(), entry.first.begin(), entry.first.end());
+  }
+
+  const uint32_t centralOffset = static_cast<uint32_t>(out.size());
+  out.insert(out.end(), central.begin(), central.end());
+  put32(out, 0x06054b50);
+  put32(out, 0);
+  put16(out, static_cast<uint16_t>(entries.size()));
+  put16(out, static_cast<uint16_t>(entries.size()));
+  put32(out, static_cast<uint32_t>(central.size()));
+  put32(out, centralOffset);
+  put16(out, 0);
+  return out;
+}
+
+std::string readEntry(ZipArchive& archive, const char* name) {
+  ZipEntryReader reader;
+  if (!reader.open(archive, name)) {
+    return "<missing>";
+  }
+  std::string out(reader.size(), '\0');
+  out.resize(reader.read(&out[0], out.size()));
+  return reader.hasError() ? "<error>" : out;
+}
+
+}  // namespace
+
+int main() {
+  CHECK(HostTest::freshCard("card"));
+  CHECK(BlockCache::getInstance().begin(8));
+
+  const Entries first = {{"mimetype", "application/epub+zip"},
+                         {"OEBPS/chapter1.xhtml", "<p>The first chapter.</p>"},
+                         {"OEBPS/chapter2.xhtml", "<p>The second chapter.</p>"}};
+  Bytes zip = makeZip(first);
+  CHECK(HostTest::putHostFile("/book.epub", zip.data(), zip.size()));
+
+  ZipArchive archive;
+  CHECK(archive.open("/book.epub") && archive.wasRebuilt());
+  CHECK(archive.size() == 3);
+  CHECK(readEntry(archive, "OEBPS/chapter2.xhtml") == "<p>The second chapter.</p>");
+  archive.close();
+
+  CHECK(archive.open("/book.epub") && !archive.wasRebuilt());
+  CHECK(readEntry(archive, "OEBPS/chapter1.xhtml") == "<p>The first chapter.</p>");
+  archive.close();
+
+  // Replaced through the manager, and again behind its back: each time the index is rebuilt, and nothing of the old
+  // index is served from the block cache
+  const Entries second = {{"mimetype", "application/epub+zip"},
+                          {"OEBPS/chapter1.xhtml", "<p>A rewritten first chapter, somewhat longer.</p>"},
+                          {"OEBPS/notes.xhtml", "<p>Notes.</p>"},
+                          {"OEBPS/chapter3.xhtml", "<p>The third chapter.</p>"}};
+  zip = makeZip(second);
+  FsFile out = SdMan.open("/book.epub", O_WRONLY | O_TRUNC);
+  CHECK(out.write(zip.data(), zip.size()) == zip.size());
+  out.close();
+  CHECK(archive.open("/book.epub") && archive.wasRebuilt());
+  CHECK(archive.size() == 4);
+  ZipArchive::Entry entry;
+  CHECK(!archive.find("OEBPS/chapter2.xhtml", entry));
+  CHECK(readEntry(archive, "OEBPS/chapter1.xhtml") == "<p>A rewritten first chapter, somewhat longer.</p>");
+  CHECK(readEntry(archive, "OEBPS/chapter3.xhtml") == "<p>The third chapter.</p>");
+  archive.close();
+
+  zip = makeZip({{"mimetype", "application/epub+zip"}, {"OEBPS/only.xhtml", "<p>Only one.</p>"}});
+  CHECK(HostTest::putHostFile("/book.epub", zip.data(), zip.size()));
+  CHECK(archive.open("/book.epub") && archive.wasRebuilt());
+  CHECK(archive.size() == 2);
+  CHECK(!archive.find("OEBPS/notes.xhtml", entry));
+  CHECK(readEntry(archive, "OEBPS/only.xhtml") == "<p>Only one.</p>");
+  archive.close();
+
+  return HostTest::result();
+}
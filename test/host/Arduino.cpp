@@ -0,0 +1,90 @@
+#include <Arduino.h>
+#include <SPI.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+
+HWCDC Serial;
+SPIClass SPI;
+
+namespace {
+
+const auto startTime = std::chrono::steady_clock::now();
+std::atomic<unsigned long> skippedMillis{0};
+std::atomic<bool> logging{getenv("HOST_LOG") != nullptr && strcmp(getenv("HOST_LOG"), "0") != 0};
+
+constexpr uint8_t PIN_COUNT = 64;
+uint8_t pinModes[PIN_COUNT];
+uint8_t outputLevels[PIN_COUNT];
+uint8_t inputLevels[PIN_COUNT];
+
+HostArduino::SpiListener spiListener = nullptr;
+void* spiContext = nullptr;
+
+}  // namespace
+
+unsigned long millis() { return static_cast<unsigned long>(micros() / 1000); }
+
+unsigned long micros() {
+  const auto elapsed = std::chrono::steady_clock::now() - startTime;
+  return static_cast<unsigned long>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() +
+                                    skippedMillis.load() * 1000ULL);
+}
+
+void delay(const unsigned long ms) { HostArduino::advanceClock(ms); }
+
+void pinMode(const uint8_t pin, const uint8_t mode) {
+  if (pin < PIN_COUNT) pinModes[pin] = mode;
+}
+
+void digitalWrite(const uint8_t pin, const uint8_t level) {
+  if (pin < PIN_COUNT) outputLevels[pin] = level ? HIGH : LOW;
+}
+
+int digitalRead(const uint8_t pin) {
+  if (pin >= PIN_COUNT) return LOW;
+  return pinModes[pin] == OUTPUT ? outputLevels[pin] : inputLevels[pin];
+}
+
+HWCDC::operator bool() const { return logging.load(); }
+
+int HWCDC::printf(const char* format, ...) {
+  if (!logging.load()) return 0;
+  va_list args;
+  va_start(args, format);
+  const int n = vfprintf(stderr, format, args);
+  va_end(args);
+  return n;
+}
+
+size_t HWCDC::println(const char* str) { return printf("%s\n", str); }
+
+size_t HWCDC::write(const uint8_t c) { return logging.load() ? fwrite(&c, 1, 1, stderr) : 1; }
+
+size_t HWCDC::write(const uint8_t* buffer, const size_t size) {
+  return logging.load() ? fwrite(buffer, 1, size, stderr) : size;
+}
+
+namespace HostArduino {
+
+void setLogging(const bool enabled) { logging = enabled; }
+
+void setInputLevel(const uint8_t pin, const uint8_t level) {
+  if (pin < PIN_COUNT) inputLevels[pin] = level ? HIGH : LOW;
+}
+
+uint8_t outputLevel(const uint8_t pin) { return pin < PIN_COUNT ? outputLevels[pin] : LOW; }
+
+void setSpiListener(const SpiListener listener, void* context) {
+  spiListener = listener;
+  spiContext = context;
+}
+
+void spiOut(const uint8_t byte) {
+  if (spiListener) spiListener(byte, spiContext);
+}
+
+void advanceClock(const unsigned long ms) { skippedMillis += ms; }
+
+}  // namespace HostArduino
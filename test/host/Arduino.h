@@ -0,0 +1,81 @@
+#pragma once
+// Arduino core stand-in for the host test build. Only covers what the SDK libraries use.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define PROGMEM
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+using std::max;
+using std::min;
+
+inline uint8_t pgm_read_byte(const void* address) { return *static_cast<const uint8_t*>(address); }
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+inline void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+
+#include "WString.h"
+
+class Print {
+ public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+      if (!write(*buffer++)) break;
+      n++;
+    }
+    return n;
+  }
+  size_t write(const char* str) { return str ? write(reinterpret_cast<const uint8_t*>(str), strlen(str)) : 0; }
+  size_t print(const char* str) { return write(str); }
+  size_t print(const String& str) { return write(reinterpret_cast<const uint8_t*>(str.c_str()), str.length()); }
+};
+
+// Goes to stderr while logging is on (HostArduino::setLogging or HOST_LOG=1), tests stay quiet otherwise
+class HWCDC : public Print {
+ public:
+  explicit operator bool() const;
+  int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  size_t println(const char* str = "");
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+};
+
+extern HWCDC Serial;
+
+// Hooks for tests, not part of the Arduino API
+namespace HostArduino {
+
+void setLogging(bool enabled);
+
+// Level digitalRead() returns for a pin that is an input, LOW until set
+void setInputLevel(uint8_t pin, uint8_t level);
+// Last level written to an output pin
+uint8_t outputLevel(uint8_t pin);
+
+// Receives every byte the SPI stand-in clocks out
+typedef void (*SpiListener)(uint8_t byte, void* context);
+void setSpiListener(SpiListener listener, void* context);
+void spiOut(uint8_t byte);
+
+// millis()/micros() run on the host clock plus everything passed to delay(), which returns at once
+void advanceClock(unsigned long ms);
+
+}  // namespace HostArduino
@@ -0,0 +1,62 @@
+#pragma once
+// Minimal checks and card helpers shared by the host tests. A test is a main() that returns HostTest::result().
+#include <SDCardManager.h>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+namespace HostTest {
+
+inline int& failures() {
+  static int count = 0;
+  return count;
+}
+
+inline bool check(const bool ok, const char* expression, const char* file, const int line) {
+  if (!ok) {
+    fprintf(stderr, "%s:%d: CHECK failed: %s\n", file, line, expression);
+    failures()++;
+  }
+  return ok;
+}
+
+inline int result() {
+  if (failures()) {
+    fprintf(stderr, "%d check(s) failed\n", failures());
+    return 1;
+  }
+  return 0;
+}
+
+// Empties <working directory>/<name>, makes it the card root and mounts it
+inline bool freshCard(const char* name) {
+  const std::filesystem::path root = std::filesystem::current_path() / name;
+  std::filesystem::remove_all(root);
+  std::filesystem::create_directories(root);
+  HostSd::setRoot(root.string().c_str());
+  HostSd::setLatency(HostSd::Latency());
+  HostSd::resetStats();
+  return SdMan.begin();
+}
+
+// Writes straight to the backing directory, behind the card model's back
+inline bool putHostFile(const char* path, const void* data, const size_t length) {
+  const std::filesystem::path hostPath = std::filesystem::path(HostSd::getRoot()) / (path[0] == '/' ? path + 1 : path);
+  std::filesystem::create_directories(hostPath.parent_path());
+  FILE* f = fopen(hostPath.string().c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  const bool ok = fwrite(data, 1, length, f) == length;
+  return fclose(f) == 0 && ok;
+}
+
+inline double elapsedMs(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace HostTest
+
+#define CHECK(expression) HostTest::check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
@@ -0,0 +1,204 @@
+#include "PanelEmulator.h"
+
+namespace {
+
+constexpr uint8_t CMD_DATA_ENTRY_MODE = 0x11;
+constexpr uint8_t CMD_MASTER_ACTIVATION = 0x20;
+constexpr uint8_t CMD_DISPLAY_UPDATE_CTRL1 = 0x21;
+constexpr uint8_t CMD_DISPLAY_UPDATE_CTRL2 = 0x22;
+constexpr uint8_t CMD_WRITE_RAM_BW = 0x24;
+constexpr uint8_t CMD_WRITE_RAM_RED = 0x26;
+constexpr uint8_t CMD_WRITE_LUT = 0x32;
+constexpr uint8_t CMD_SET_RAM_X_RANGE = 0x44;
+constexpr uint8_t CMD_SET_RAM_Y_RANGE = 0x45;
+constexpr uint8_t CMD_SET_RAM_X_COUNTER = 0x4E;
+constexpr uint8_t CMD_SET_RAM_Y_COUNTER = 0x4F;
+
+constexpr uint8_t CTRL1_BYPASS_RED = 0x40;
+constexpr uint8_t CTRL2_LOAD_LUT = 0x10;
+constexpr uint8_t CTRL2_DISPLAY = 0x04;
+
+}  // namespace
+
+PanelEmulator::PanelEmulator(const uint8_t dcPin, const uint8_t csPin)
+    : dc(dcPin), cs(csPin), bwRam(WIDTH_BYTES * HEIGHT, 0xFF), redRam(WIDTH_BYTES * HEIGHT, 0xFF) {
+  HostArduino::setSpiListener(onByte, this);
+}
+
+PanelEmulator::~PanelEmulator() { HostArduino::setSpiListener(nullptr, nullptr); }
+
+void PanelEmulator::onByte(const uint8_t byte, void* context) {
+  auto* panel = static_cast<PanelEmulator*>(context);
+  if (HostArduino::outputLevel(panel->cs) != LOW) {
+    return;
+  }
+  if (HostArduino::outputLevel(panel->dc) == LOW) {
+    panel->command(byte);
+  } else {
+    panel->data(byte);
+  }
+}
+
+void PanelEmulator::command(const uint8_t byte) {
+  currentCommand = byte;
+  dataIndex = 0;
+  if (byte != CMD_MASTER_ACTIVATION) {
+    return;
+  }
+
+  Refresh refresh;
+  refresh.control1 = control1;
+  refresh.control2 = control2;
+  refresh.customLut = !(control2 & CTRL2_LOAD_LUT);
+  memcpy(refresh.lut, lut, LUT_SIZE);
+  refresh.bw = bwRam;
+  refresh.red = redRam;
+  refresh.bwBytesWritten = bwBytes - bwBytesAtRefresh;
+  refresh.redBytesWritten = redBytes - redBytesAtRefresh;
+  bwBytesAtRefresh = bwBytes;
+  redBytesAtRefresh = redBytes;
+  history.push_back(std::move(refresh));
+}
+
+void PanelEmulator::data(const uint8_t byte) {
+  const size_t index = dataIndex++;
+  switch (currentCommand) {
+    case CMD_DATA_ENTRY_MODE:
+      entryMode = byte;
+      break;
+    case CMD_SET_RAM_X_RANGE:
+    case CMD_SET_RAM_Y_RANGE:
+      if (index < 4) {
+        params[index] = byte;
+      }
+      if (index == 3) {
+        const uint16_t start = params[0] | params[1] << 8;
+        const uint16_t end = params[2] | params[3] << 8;
+        if (currentCommand == CMD_SET_RAM_X_RANGE) {
+          xStart = start;
+          xEnd = end;
+        } else {
+          yStart = start;
+          yEnd = end;
+        }
+      }
+      break;
+    case CMD_SET_RAM_X_COUNTER:
+    case CMD_SET_RAM_Y_COUNTER:
+      if (index < 2) {
+        params[index] = byte;
+      }
+      if (index == 1) {
+        (currentCommand == CMD_SET_RAM_X_COUNTER ? xCounter : yCounter) = params[0] | params[1] << 8;
+      }
+      break;
+    case CMD_WRITE_RAM_BW:
+      writeRam(bwRam, byte);
+      bwBytes++;
+      break;
+    case CMD_WRITE_RAM_RED:
+      writeRam(redRam, byte);
+      redBytes++;
+      break;
+    case CMD_WRITE_LUT:
+      if (index < LUT_SIZE) {
+        lut[index] = byte;
+      }
+      break;
+    case CMD_DISPLAY_UPDATE_CTRL1:
+      if (index == 0) {
+        control1 = byte;
+      }
+      break;
+    case CMD_DISPLAY_UPDATE_CTRL2:
+      control2 = byte;
+      break;
+    default:
+      break;
+  }
+}
+
+// The counters address the controller's RAM; its row r is screen row HEIGHT - 1 - r, which is how RAM is kept here
+void PanelEmulator::writeRam(std::vector<uint8_t>& ram, const uint8_t byte) {
+  if (xCounter < WIDTH && yCounter < HEIGHT) {
+    ram[static_cast<size_t>(HEIGHT - 1 - yCounter) * WIDTH_BYTES + xCounter / 8] = byte;
+  }
+
+  const bool xIncrement = entryMode & 0x01;
+  const bool yIncrement = entryMode & 0x02;
+  const uint16_t xLow = min(xStart, xEnd), xHigh = max(xStart, xEnd);
+  const uint16_t yLow = min(yStart, yEnd), yHigh = max(yStart, yEnd);
+  const int nextX = xCounter + (xIncrement ? 8 : -8);
+  if (nextX >= xLow && nextX <= xHigh) {
+    xCounter = static_cast<uint16_t>(nextX);
+    return;
+  }
+  xCounter = xIncrement ? xLow : xHigh;
+  const int nextY = yCounter + (yIncrement ? 1 : -1);
+  yCounter = static_cast<uint16_t>(nextY < yLow ? yHigh : nextY > yHigh ? yLow : nextY);
+}
+
+bool PanelEmulator::pixel(const std::vector<uint8_t>& ram, const uint16_t x, const uint16_t y) {
+  return ram[static_cast<size_t>(y) * WIDTH_BYTES + x / 8] & (0x80 >> (x & 7));
+}
+
+bool PanelEmulator::matches(const std::vector<uint8_t>& ram, const uint8_t* frame, const uint16_t x, const uint16_t y,
+                            const uint16_t w, const uint16_t h) {
+  for (uint16_t row = y; row < y + h; row++) {
+    for (uint16_t col = x; col < x + w; col++) {
+      const bool want = frame[static_cast<size_t>(row) * WIDTH_BYTES + col / 8] & (0x80 >> (col & 7));
+      if (pixel(ram, col, row) != want) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool PanelEmulator::bwMatches(const uint8_t* frame, const uint16_t x, const uint16_t y, const uint16_t w,
+                              const uint16_t h) const {
+  return matches(bwRam, frame, x, y, w, h);
+}
+
+bool PanelEmulator::redMatches(const uint8_t* frame, const uint16_t x, const uint16_t y, const uint16_t w,
+                               const uint16_t h) const {
+  return matches(redRam, frame, x, y, w, h);
+}
+
+uint8_t PanelEmulator::Refresh::group(const uint16_t x, const uint16_t y) const {
+  return (pixel(red, x, y) ? 2 : 0) | (pixel(bw, x, y) ? 1 : 0);
+}
+
+// The first 50 LUT bytes are the source voltage selections, 10 per group (00, 01, 10, 11, VCOM)
+bool PanelEmulator::Refresh::drives(const uint8_t group) const {
+  for (uint8_t i = 0; i < 10; i++) {
+    if (lut[group * 10 + i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PanelEmulator::Refresh::driven(const uint16_t x, const uint16_t y) const {
+  if (!(control2 & CTRL2_DISPLAY)) {
+    return false;
+  }
+  if (customLut) {
+    return drives(group(x, y));
+  }
+  return (control1 & CTRL1_BYPASS_RED) || pixel(red, x, y) != pixel(bw, x, y);
+}
+
+size_t PanelEmulator::Refresh::countDriven(const uint16_t x, const uint16_t y, const uint16_t w, const uint16_t h,
+                                           const bool inside) const {
+  size_t count = 0;
+  for (uint16_t row = 0; row < HEIGHT; row++) {
+    for (uint16_t col = 0; col < WIDTH; col++) {
+      const bool in = col >= x && col < x + w && row >= y && row < y + h;
+      if (in == inside && driven(col, row)) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <Arduino.h>
+
+#include <vector>
+
+/**
+ * SSD1677 (X4 panel controller) model for host tests of EInkDisplay.
+ *
+ * Listens on the SPI stand-in and keeps what the controller would: BW and RED RAM with the data entry mode, RAM
+ * window and address counters, the LUT register and the update control bytes. Every master activation records a
+ * Refresh with both RAMs and the LUT as they were at that moment, so tests can check RAM and LUT sequencing.
+ * Optical behaviour is not modelled; driven() tells which pixels a refresh would have touched.
+ */
+class PanelEmulator {
+ public:
+  static constexpr uint16_t WIDTH = 800;
+  static constexpr uint16_t HEIGHT = 480;
+  static constexpr uint16_t WIDTH_BYTES = WIDTH / 8;
+  static constexpr uint16_t LUT_SIZE = 105;
+
+  struct Refresh {
+    uint8_t control1;  // 0x21, 0x40 = bypass RED RAM
+    uint8_t control2;  // 0x22, 0x10 = load the LUT from OTP, otherwise the LUT register is used
+    bool customLut;
+    uint8_t lut[LUT_SIZE];
+    std::vector<uint8_t> bw;   // Screen coordinates, row-major, 1 = white
+    std::vector<uint8_t> red;  // Screen coordinates
+    size_t bwBytesWritten;     // RAM bytes sent since the previous refresh
+    size_t redBytesWritten;
+
+    // LUT group of a pixel: RED bit << 1 | BW bit
+    uint8_t group(uint16_t x, uint16_t y) const;
+    // Whether the waveform of a group does anything
+    bool drives(uint8_t group) const;
+    // Whether the refresh changes the pixel: every pixel for a full update, RED != BW for OTP fast updates
+    bool driven(uint16_t x, uint16_t y) const;
+    // Pixels driven inside (or outside) a rectangle
+    size_t countDriven(uint16_t x, uint16_t y, uint16_t w, uint16_t h, bool inside) const;
+  };
+
+  // Listens on the SPI bus, the data/command and chip select pins must match the EInkDisplay's
+  PanelEmulator(uint8_t dcPin, uint8_t csPin);
+  ~PanelEmulator();
+
+  const std::vector<Refresh>& refreshes() const { return history; }
+  const Refresh& lastRefresh() const { return history.back(); }
+  void clearHistory() { history.clear(); }
+
+  // Current RAM contents in screen coordinates, 1 = white
+  bool bw(uint16_t x, uint16_t y) const { return pixel(bwRam, x, y); }
+  bool red(uint16_t x, uint16_t y) const { return pixel(redRam, x, y); }
+  // Compares a RAM against a frame buffer (row-major, WIDTH_BYTES per row) inside a rectangle
+  bool bwMatches(const uint8_t* frame, uint16_t x = 0, uint16_t y = 0, uint16_t w = WIDTH, uint16_t h = HEIGHT) const;
+  bool redMatches(const uint8_t* frame, uint16_t x = 0, uint16_t y = 0, uint16_t w = WIDTH, uint16_t h = HEIGHT) const;
+
+  size_t bwBytesWritten() const { return bwBytes; }
+  size_t redBytesWritten() const { return redBytes; }
+
+ private:
+  static void onByte(uint8_t byte, void* context);
+  void command(uint8_t byte);
+  void data(uint8_t byte);
+  void writeRam(std::vector<uint8_t>& ram, uint8_t byte);
+  static bool pixel(const std::vector<uint8_t>& ram, uint16_t x, uint16_t y);
+  static bool matches(const std::vector<uint8_t>& ram, const uint8_t* frame, uint16_t x, uint16_t y, uint16_t w,
+                      uint16_t h);
+
+  uint8_t dc;
+  uint8_t cs;
+  uint8_t currentCommand = 0;
+  size_t dataIndex = 0;
+
+  // RAM in screen coordinates, writes are mapped through the reversed gates
+  std::vector<uint8_t> bwRam;
+  std::vector<uint8_t> redRam;
+  uint8_t entryMode = 0x03;
+  uint16_t xStart = 0, xEnd = WIDTH - 1;
+  uint16_t yStart = 0, yEnd = HEIGHT - 1;
+  uint16_t xCounter = 0, yCounter = 0;
+  uint8_t params[4] = {};
+
+  uint8_t lut[LUT_SIZE] = {};
+  uint8_t control1 = 0;
+  uint8_t control2 = 0;
+
+  size_t bwBytes = 0;
+  size_t redBytes = 0;
+  size_t bwBytesAtRefresh = 0;
+  size_t redBytesAtRefresh = 0;
+  std::vector<Refresh> history;
+};
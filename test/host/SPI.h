@@ -0,0 +1,36 @@
+#pragma once
+#include <Arduino.h>
+
+// SPI stand-in, every byte written goes to HostArduino's SPI listener (e.g. PanelEmulator)
+class SPISettings {
+ public:
+  SPISettings() = default;
+  SPISettings(uint32_t /*clock*/, uint8_t /*bitOrder*/, uint8_t /*dataMode*/) {}
+};
+
+class SPIClass {
+ public:
+  void begin(int8_t /*sck*/ = -1, int8_t /*miso*/ = -1, int8_t /*mosi*/ = -1, int8_t /*ss*/ = -1) {}
+  void end() {}
+  void beginTransaction(const SPISettings& /*settings*/) {}
+  void endTransaction() {}
+  uint8_t transfer(uint8_t data) {
+    HostArduino::spiOut(data);
+    return 0xFF;
+  }
+  void writeBytes(const uint8_t* data, uint32_t size) {
+    while (size--) {
+      HostArduino::spiOut(*data++);
+    }
+  }
+  void transferBytes(const uint8_t* data, uint8_t* out, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+      HostArduino::spiOut(data ? data[i] : 0xFF);
+      if (out) {
+        out[i] = 0xFF;
+      }
+    }
+  }
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstring>
+#include <string>
+
+// Arduino String stand-in on top of std::string
+class String {
+ public:
+  String(const char* str = "") : s(str ? str : "") {}
+  String(const std::string& str) : s(str) {}
+
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return static_cast<unsigned int>(s.size()); }
+  bool isEmpty() const { return s.empty(); }
+  bool reserve(unsigned int size) {
+    s.reserve(size);
+    return true;
+  }
+  bool concat(const char* str, unsigned int length) {
+    s.append(str, length);
+    return true;
+  }
+  bool concat(const String& str) {
+    s += str.s;
+    return true;
+  }
+  String& operator+=(const String& str) {
+    s += str.s;
+    return *this;
+  }
+  String& operator+=(const char* str) {
+    s += str;
+    return *this;
+  }
+  String& operator+=(char c) {
+    s += c;
+    return *this;
+  }
+  bool operator==(const String& other) const { return s == other.s; }
+  bool operator==(const char* other) const { return s == other; }
+  bool operator!=(const String& other) const { return s != other.s; }
+  bool endsWith(const String& suffix) const {
+    return s.size() >= suffix.s.size() && s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0;
+  }
+  bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+  int indexOf(char c) const {
+    const size_t i = s.find(c);
+    return i == std::string::npos ? -1 : static_cast<int>(i);
+  }
+  String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < s.size() && from < to ? String(s.substr(from, to - from)) : String();
+  }
+  char operator[](unsigned int index) const { return index < s.size() ? s[index] : '\0'; }
+
+ private:
+  std::string s;
+};
@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+"""Converts a BDF or TrueType/OpenType font into the packed bitmap formats read by libs/graphics/BitmapFont.
+
+BDF fonts are used as they are. TTF/OTF fonts are rasterized with FreeType (pip install freetype-py) at --size pixels,
+either with monochrome hinting or, with --threshold, antialiased and thresholded, which keeps thin strokes on some
+faces. Kerning pairs come from the font's `kern` table (TrueType only, GPOS kerning is not read).
+
+Output is a C header with a PROGMEM array (.h) or the raw font (anything else, e.g. to load from the SD card).
+With --streamed the output is a StreamedFont file instead, for large fonts read from the SD card glyph by glyph;
+it has no kerning.
+
+Examples:
+  fontconvert.py Bookerly.ttf --size 22 -o bookerly22.h
+  fontconvert.py --ranges 0x20-0x7E,0x2018-0x201D unifont.bdf -o unifont.xbf
+  fontconvert.py --streamed --ranges 0x3000-0x30FF,0x4E00-0x9FFF,0xFF00-0xFFEF NotoSansSC.otf --size 24 -o sc24.xbs
+"""
+
+import argparse
+import os
+import struct
+import sys
+import zlib
+
+DEFAULT_RANGES = "0x20-0x7E,0xA0-0x17F,0x2010-0x2027,0x2030-0x203A,0x20AC,0xFFFD"
+
+HEADER_SIZE = 16
+MAGIC = b"XBF1"
+STREAMED_HEADER_SIZE = 32
+STREAMED_MAGIC = b"XBS1"
+DIRECTORY_ENTRIES = 0x1100
+NO_PAGE = 0xFFFF
+MISSING = 0xFFFFFF
+
+
+class Glyph:
+    def __init__(self, codepoint, advance, width, height, left, top, rows):
+        self.codepoint = codepoint
+        self.advance = advance
+        self.width = width
+        self.height = height
+        self.left = left  # Origin to the first column
+        self.top = top  # Baseline to the first row, up is positive
+        self.rows = rows  # One int per row, bit (width - 1) is the first column
+
+
+def parse_ranges(text):
+    codepoints = set()
+    for part in text.split(","):
+        part = part.strip()
+        if not part:
+            continue
+        if "-" in part:
+            first, last = part.split("-", 1)
+            codepoints.update(range(int(first, 0), int(last, 0) + 1))
+        else:
+            codepoints.add(int(part, 0))
+    return codepoints
+
+
+def trim(glyph):
+    """Drops empty rows and columns around the ink, keeping the glyph's position."""
+    rows = glyph.rows
+    while rows and rows[0] == 0:
+        rows = rows[1:]
+        glyph.top -= 1
+    while rows and rows[-1] == 0:
+        rows = rows[:-1]
+    if not rows:
+        glyph.width = glyph.height = 0
+        glyph.left = glyph.top = 0
+        glyph.rows = []
+        return glyph
+    ink = 0
+    for row in rows:
+        ink |= row
+    trailing = (ink & -ink).bit_length() - 1
+    leading = glyph.width - ink.bit_length()
+    glyph.rows = [row >> trailing for row in rows]
+    glyph.width -= leading + trailing
+    glyph.left += leading
+    glyph.height = len(rows)
+    return glyph
+
+
+def load_bdf(path, wanted):
+    glyphs = {}
+    ascent = descent = None
+    with open(path, "r", encoding="latin-1") as f:
+        lines = iter(f.read().splitlines())
+    for line in lines:
+        words = line.split()
+        if not words:
+            continue
+        if words[0] == "FONT_ASCENT":
+            ascent = int(words[1])
+        elif words[0] == "FONT_DESCENT":
+            descent = int(words[1])
+        elif words[0] == "STARTCHAR":
+            codepoint = advance = None
+            bbx = None
+            rows = []
+            for line in lines:
+                words = line.split()
+                if not words:
+                    continue
+                if words[0] == "ENCODING":
+                    codepoint = int(words[-1])
+                elif words[0] == "DWIDTH":
+                    advance = int(words[1])
+                elif words[0] == "BBX":
+                    bbx = [int(w) for w in words[1:5]]
+                elif words[0] == "BITMAP":
+                    for line in lines:
+                        if line.startswith("ENDCHAR"):
+                            break
+                        rows.append(line.strip())
+                    break
+            if codepoint is None or codepoint < 0 or codepoint not in wanted or bbx is None:
+                continue
+            width, height, xoff, yoff = bbx
+            bits = []
+            for row in rows[:height]:
+                value = int(row, 16) if row else 0
+                padded = len(row) * 4
+                bits.append(value >> (padded - width) if padded >= width else value << (width - padded))
+            glyphs[codepoint] = trim(Glyph(codepoint, advance or width, width, height, xoff, yoff + height, bits))
+    if ascent is None or descent is None:
+        sys.exit("%s: missing FONT_ASCENT/FONT_DESCENT" % path)
+    return glyphs, ascent, descent, {}
+
+
+def load_freetype(path, wanted, size, threshold, kerning):
+    try:
+        import freetype
+    except ImportError:
+        sys.exit("TTF/OTF input needs FreeType: pip install freetype-py")
+    face = freetype.Face(path)
+    face.set_pixel_sizes(0, size)
+    if threshold is None:
+        flags = freetype.FT_LOAD_RENDER | freetype.FT_LOAD_TARGET_MONO
+    else:
+        flags = freetype.FT_LOAD_RENDER
+    glyphs = {}
+    indexes = {}
+    for codepoint in sorted(wanted):
+        index = face.get_char_index(codepoint)
+        if index == 0:
+            continue
+        face.load_glyph(index, flags)
+        slot = face.glyph
+        bitmap = slot.bitmap
+        rows = []
+        for y in range(bitmap.rows):
+            value = 0
+            for x in range(bitmap.width):
+                if threshold is None:
+                    ink = bitmap.buffer[y * bitmap.pitch + (x >> 3)] & (0x80 >> (x & 7))
+                else:
+                    ink = bitmap.buffer[y * bitmap.pitch + x] >= threshold
+                value = (value << 1) | (1 if ink else 0)
+            rows.append(value)
+        advance = (slot.advance.x + 32) >> 6
+        glyphs[codepoint] = trim(Glyph(codepoint, advance, bitmap.width, bitmap.rows, slot.bitmap_left,
+                                       slot.bitmap_top, rows))
+        indexes[codepoint] = index
+    metrics = face.size
+    ascent = (metrics.ascender + 63) >> 6
+    descent = (-metrics.descender + 63) >> 6
+    pairs = {}
+    if kerning and face.has_kerning:
+        for left, left_index in indexes.items():
+            for right, right_index in indexes.items():
+                vector = face.get_kerning(left_index, right_index)
+                adjust = int(round(vector.x / 64.0))
+                if adjust:
+                    pairs[(left, right)] = max(-128, min(127, adjust))
+    return glyphs, ascent, descent, pairs
+
+
+def check_metrics(glyph):
+    for name, value, low, high in (("advance", glyph.advance, 0, 255), ("width", glyph.width, 0, 255),
+                                   ("height", glyph.height, 0, 255), ("left", glyph.left, -128, 127),
+                                   ("top", glyph.top, -128, 127)):
+        if not low <= value <= high:
+            sys.exit("U+%04X: %s %d out of range" % (glyph.codepoint, name, value))
+
+
+def packed_rows(glyph):
+    row_bytes = (glyph.width + 7) // 8
+    data = bytearray()
+    for row in glyph.rows:
+        data += (row << (row_bytes * 8 - glyph.width)).to_bytes(row_bytes, "big")
+    return bytes(data)
+
+
+def pack(glyphs, ascent, descent, pairs, line_height, font_id):
+    ordered = sorted(glyphs.values(), key=lambda g: g.codepoint)
+    index_of = {g.codepoint: i for i, g in enumerate(ordered)}
+    bitmaps = bytearray()
+    offsets = {}
+    records = bytearray()
+    for glyph in ordered:
+        data = packed_rows(glyph)
+        # Identical bitmaps (e.g. Latin letters shared with Cyrillic) are stored once
+        if data not in offsets:
+            offsets[data] = len(bitmaps)
+            bitmaps += data
+        check_metrics(glyph)
+        records += struct.pack("<I", glyph.codepoint)
+        records += offsets[data].to_bytes(3, "little")
+        records += struct.pack("<BBBbb", glyph.advance, glyph.width, glyph.height, glyph.left, glyph.top)
+    kerning = bytearray()
+    for (left, right), adjust in sorted(pairs.items(), key=lambda p: (index_of[p[0][0]], index_of[p[0][1]])):
+        kerning += struct.pack("<HHbx", index_of[left], index_of[right], adjust)
+    if len(bitmaps) >= 1 << 24:
+        sys.exit("bitmaps exceed 16 MB")
+    header = MAGIC + struct.pack("<HHBBBBI", len(ordered), len(pairs), line_height, ascent, descent, 0, font_id)
+    assert len(header) == HEADER_SIZE
+    return bytes(header + records + kerning + bitmaps)
+
+
+def pack_streamed(glyphs, ascent, descent, line_height, font_id):
+    """Two-level table: a directory of 256 codepoint blocks pointing at pages of 8 byte glyph entries."""
+    blocks = sorted({codepoint >> 8 for codepoint in glyphs})
+    if blocks and blocks[-1] >= DIRECTORY_ENTRIES:
+        sys.exit("codepoints beyond U+10FFFF")
+    directory = [NO_PAGE] * DIRECTORY_ENTRIES
+    for page, block in enumerate(blocks):
+        directory[block] = page
+    entries = bytearray(struct.pack("<I", MISSING)[:3] + bytes(5)) * (256 * len(blocks))
+    bitmaps = bytearray()
+    offsets = {}
+    largest = 0
+    for codepoint, glyph in sorted(glyphs.items()):
+        check_metrics(glyph)
+        data = packed_rows(glyph)
+        if data not in offsets:
+            offsets[data] = len(bitmaps)
+            bitmaps += data
+        largest = max(largest, len(data))
+        at = (directory[codepoint >> 8] * 256 + (codepoint & 0xFF)) * 8
+        entries[at:at + 8] = offsets[data].to_bytes(3, "little") + struct.pack(
+            "<BBBbb", glyph.advance, glyph.width, glyph.height, glyph.left, glyph.top)
+    if len(bitmaps) >= MISSING:
+        sys.exit("bitmaps exceed 16 MB")
+    directory_offset = STREAMED_HEADER_SIZE
+    pages_offset = directory_offset + DIRECTORY_ENTRIES * 2
+    bitmaps_offset = pages_offset + len(entries)
+    header = STREAMED_MAGIC + struct.pack("<IBBBBIHHIII", len(glyphs), line_height, ascent, descent, 0, font_id,
+                                          max(largest, 1), len(blocks), directory_offset, pages_offset,
+                                          bitmaps_offset)
+    assert len(header) == STREAMED_HEADER_SIZE
+    return bytes(header + struct.pack("<%dH" % DIRECTORY_ENTRIES, *directory) + entries + bitmaps)
+
+
+def write_header(path, name, data, source):
+    with open(path, "w") as f:
+        f.write("#pragma once\n\n#include <Arduino.h>\n\n")
+        f.write("// Generated by tools/assets/fontconvert.py from %s, load with BitmapFont::begin()\n" % source)
+        f.write("static const uint8_t %s[%d] PROGMEM = {\n" % (name, len(data)))
+        for i in range(0, len(data), 16):
+            f.write("    " + " ".join("0x%02X," % b for b in data[i:i + 16]) + "\n")
+        f.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("font", help="BDF, TTF or OTF file")
+    parser.add_argument("-o", "--output", required=True, help=".h for a C array, anything else for the raw font")
+    parser.add_argument("--size", type=int, default=20, help="pixel size for TTF/OTF (default 20)")
+    parser.add_argument("--ranges", default=DEFAULT_RANGES, help="codepoints, e.g. 0x20-0x7E,0xA0-0xFF")
+    parser.add_argument("--line-height", type=int, help="baseline to baseline distance (default ascent + descent)")
+    parser.add_argument("--threshold", type=int, help="rasterize antialiased and ink pixels with coverage >= this")
+    parser.add_argument("--no-kerning", action="store_true", help="leave the kerning table out")
+    parser.add_argument("--name", help="array name for .h output (default from the output file name)")
+    parser.add_argument("--streamed", action="store_true", help="write a StreamedFont file for the SD card")
+    args = parser.parse_args()
+
+    wanted = parse_ranges(args.ranges)
+    if args.font.lower().endswith(".bdf"):
+        glyphs, ascent, descent, pairs = load_bdf(args.font, wanted)
+    else:
+        glyphs, ascent, descent, pairs = load_freetype(args.font, wanted, args.size, args.threshold,
+                                                       not args.no_kerning and not args.streamed)
+    if args.no_kerning or args.streamed:
+        pairs = {}
+    if not glyphs:
+        sys.exit("no glyphs in the requested ranges")
+
+    line_height = args.line_height or ascent + descent
+    with open(args.font, "rb") as f:
+        font_id = zlib.crc32(f.read())
+    font_id = zlib.crc32(("%d %s %d %s" % (args.size, args.ranges, line_height, args.threshold)).encode(), font_id)
+    if args.streamed:
+        data = pack_streamed(glyphs, ascent, descent, line_height, font_id)
+    else:
+        data = pack(glyphs, ascent, descent, pairs, line_height, font_id)
+
+    if args.output.endswith(".h") and not args.streamed:
+        name = args.name or os.path.splitext(os.path.basename(args.output))[0].replace("-", "_")
+        write_header(args.output, name, data, os.path.basename(args.font))
+    else:
+        with open(args.output, "wb") as f:
+            f.write(data)
+    missing = len(wanted) - len(glyphs)
+    print("%s: %d glyphs (%d missing), %d kerning pairs, %d bytes" % (args.output, len(glyphs), missing, len(pairs),
+                                                                     len(data)))
+
+
+if __name__ == "__main__":
+    main()
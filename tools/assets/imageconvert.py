@@ -0,0 +1,281 @@
+#!/usr/bin/env python3
+"""Converts an image into the compressed PackedImage format read by EInkDisplay::drawImage() and displayStream().
+
+The image is reduced to black and white, or with --gray to four levels written as the BW, LSB and MSB planes that
+copyGrayscaleBuffers() takes, optionally dithered the way ImageDecoder's GrayScaler does it. Each plane is cut into
+bands of --band rows; every band is coded both as it is and predicted from the row above, and the smaller one is kept.
+
+PBM, PGM and PPM files are read directly; anything else needs Pillow (pip install pillow). Transparent pixels are
+composited over white. The image is used at its own size, scale it beforehand.
+
+Output is a C header with a PROGMEM array (.h) or the raw image (anything else, e.g. to load from the SD card).
+
+Examples:
+  imageconvert.py logo.png -o logo.h
+  imageconvert.py --gray --dither diffusion sleep.jpg -o sleep.xpi
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+HEADER_SIZE = 16
+MAGIC = b"XPI1"
+PREDICTED = 0x80000000
+MAX_WIDTH = 1024
+
+BAYER = [
+    [0, 32, 8, 40, 2, 34, 10, 42], [48, 16, 56, 24, 50, 18, 58, 26], [12, 44, 4, 36, 14, 46, 6, 38],
+    [60, 28, 52, 20, 62, 30, 54, 22], [3, 35, 11, 43, 1, 33, 9, 41], [51, 19, 59, 27, 49, 17, 57, 25],
+    [15, 47, 7, 39, 13, 45, 5, 37], [63, 31, 55, 23, 61, 29, 53, 21],
+]
+
+
+def read_netpbm(path):
+    """Returns (width, height, rows of 0-255 luminance) for P1-P6 files."""
+    with open(path, "rb") as f:
+        data = f.read()
+    tokens = []
+    pos = 0
+    wanted = 3 if data[:2] in (b"P1", b"P4") else 4
+    while len(tokens) < wanted:
+        while data[pos:pos + 1].isspace():
+            pos += 1
+        if data[pos:pos + 1] == b"#":
+            while data[pos:pos + 1] not in (b"\n", b""):
+                pos += 1
+            continue
+        start = pos
+        while pos < len(data) and not data[pos:pos + 1].isspace():
+            pos += 1
+        tokens.append(data[start:pos])
+    kind = tokens[0]
+    width, height = int(tokens[1]), int(tokens[2])
+    maxval = int(tokens[3]) if wanted == 4 else 1
+    if kind in (b"P1", b"P2", b"P3"):
+        values = [int(v) for v in data[pos:].split()]
+    elif kind == b"P4":
+        pos += 1
+        row_bytes = (width + 7) // 8
+        values = []
+        for y in range(height):
+            row = data[pos + y * row_bytes:pos + (y + 1) * row_bytes]
+            values += [(row[x >> 3] >> (7 - (x & 7))) & 1 for x in range(width)]
+    else:
+        pos += 1
+        if maxval > 255:
+            raw = data[pos:]
+            values = [(raw[i] << 8 | raw[i + 1]) for i in range(0, len(raw) - 1, 2)]
+        else:
+            values = list(data[pos:])
+    channels = 3 if kind in (b"P3", b"P6") else 1
+    if len(values) < width * height * channels:
+        sys.exit("%s: truncated image data" % path)
+    rows = []
+    for y in range(height):
+        row = []
+        for x in range(width):
+            at = (y * width + x) * channels
+            if kind in (b"P1", b"P4"):
+                row.append(0 if values[at] else 255)  # 1 is black in PBM
+            elif channels == 3:
+                r, g, b = (values[at + i] * 255 // maxval for i in range(3))
+                row.append((r * 77 + g * 150 + b * 29) >> 8)
+            else:
+                row.append(values[at] * 255 // maxval)
+        rows.append(row)
+    return width, height, rows
+
+
+def read_pillow(path):
+    try:
+        from PIL import Image
+    except ImportError:
+        sys.exit("%s: only PBM, PGM and PPM can be read without Pillow (pip install pillow)" % path)
+    image = Image.open(path)
+    if image.mode in ("RGBA", "LA", "P"):
+        image = image.convert("RGBA")
+        background = Image.new("RGBA", image.size, (255, 255, 255, 255))
+        image = Image.alpha_composite(background, image)
+    rgb = image.convert("RGB")
+    width, height = rgb.size
+    pixels = list(rgb.getdata())
+    rows = []
+    for y in range(height):
+        rows.append([(r * 77 + g * 150 + b * 29) >> 8 for r, g, b in pixels[y * width:(y + 1) * width]])
+    return width, height, rows
+
+
+def quantize(rows, width, steps, dither):
+    """Levels 0 (black) to `steps` (white) per pixel, with GrayScaler's rounding and dithering."""
+    levels = []
+    errors = [0] * (width + 2)
+    for y, row in enumerate(rows):
+        next_errors = [0] * (width + 2)
+        out = []
+        for x, value in enumerate(row):
+            if dither == "diffusion":
+                # Sixteenths, spread 7/16 right, 3/16 down left, 5/16 down and 1/16 down right
+                v = value + ((errors[x + 1] + 8) >> 4)
+                level = 0 if v <= 0 else min(steps, (v * steps + 127) // 255)
+                error = v - level * 255 // steps
+                errors[x + 2] += error * 7
+                next_errors[x] += error * 3
+                next_errors[x + 1] += error * 5
+                next_errors[x + 2] += error
+            elif dither == "ordered":
+                scaled = value * steps
+                base = scaled // 255
+                fraction = scaled - base * 255
+                level = base + (1 if fraction * 128 > (2 * BAYER[y & 7][x & 7] + 1) * 255 else 0)
+            else:
+                level = (value * steps + 127) // 255
+            out.append(level)
+        errors = next_errors
+        levels.append(out)
+    return levels
+
+
+def planes_of(levels, width, steps):
+    """Packed planes: BW (1 white), and for four levels LSB (1 dark gray) and MSB (1 light or dark gray)."""
+    row_bytes = (width + 7) // 8
+    tests = [lambda level: level == steps]
+    padding = [1]  # Bits past the width are white in the BW plane, drawImage() copies whole bytes
+    if steps == 3:
+        tests += [lambda level: level == 1, lambda level: level in (1, 2)]
+        padding += [0, 0]
+    planes = []
+    for test, pad in zip(tests, padding):
+        rows = []
+        for row in levels:
+            bits = 0
+            for x in range(row_bytes * 8):
+                bits = bits << 1 | (int(test(row[x])) if x < width else pad)
+            rows.append(bits.to_bytes(row_bytes, "big"))
+        planes.append(rows)
+    return planes
+
+
+def code_row(row):
+    """Literal, zero run and repeat codes for one row, never crossing its end."""
+    out = bytearray()
+    literal = bytearray()
+
+    def flush():
+        for i in range(0, len(literal), 128):
+            chunk = literal[i:i + 128]
+            out.append(len(chunk) - 1)
+            out.extend(chunk)
+        literal.clear()
+
+    i = 0
+    while i < len(row):
+        run = 1
+        while i + run < len(row) and row[i + run] == row[i]:
+            run += 1
+        if row[i] == 0 and (run >= 2 or not literal):
+            flush()
+            for j in range(0, run, 64):
+                out.append(0x80 | (min(64, run - j) - 1))
+        elif run >= 3:
+            flush()
+            left = run
+            while left > 0:
+                n = min(65, left)
+                if n == 1:
+                    literal.append(row[i])
+                else:
+                    out.append(0xC0 | (n - 2))
+                    out.append(row[i])
+                left -= n
+        else:
+            literal.extend(row[i:i + run])
+        i += run
+    flush()
+    return bytes(out)
+
+
+def code_band(rows, predicted):
+    out = bytearray()
+    previous = bytes(len(rows[0]))
+    for row in rows:
+        out += code_row(bytes(a ^ b for a, b in zip(row, previous)) if predicted else row)
+        previous = row
+    return bytes(out)
+
+
+def pack(planes, width, height, band_height):
+    band_count = (height + band_height - 1) // band_height
+    table = bytearray()
+    code = bytearray()
+    for rows in planes:
+        for band in range(band_count):
+            band_rows = rows[band * band_height:(band + 1) * band_height]
+            plain = code_band(band_rows, False)
+            predicted = code_band(band_rows, True)
+            offset = len(code)
+            if len(predicted) < len(plain):
+                table += struct.pack("<I", offset | PREDICTED)
+                code += predicted
+            else:
+                table += struct.pack("<I", offset)
+                code += plain
+    if len(code) >= PREDICTED:
+        sys.exit("image code exceeds 2 GB")
+    header = MAGIC + struct.pack("<HHBBHI", width, height, len(planes), band_height, 0, len(code))
+    assert len(header) == HEADER_SIZE
+    return bytes(header + table + code)
+
+
+def write_header(path, name, data, source, width, height, gray):
+    with open(path, "w") as f:
+        f.write("#pragma once\n\n#include <Arduino.h>\n\n")
+        f.write("// Generated by tools/assets/imageconvert.py from %s, %dx%d%s, load with PackedImage::begin()\n" %
+                (source, width, height, " with gray planes" if gray else ""))
+        f.write("static const uint8_t %s[%d] PROGMEM = {\n" % (name, len(data)))
+        for i in range(0, len(data), 16):
+            f.write("    " + " ".join("0x%02X," % b for b in data[i:i + 16]) + "\n")
+        f.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", help="PBM, PGM or PPM file, or anything Pillow reads")
+    parser.add_argument("-o", "--output", required=True, help=".h for a C array, anything else for the raw image")
+    parser.add_argument("--gray", action="store_true", help="four levels with LSB and MSB planes")
+    parser.add_argument("--dither", choices=("none", "ordered", "diffusion"), default="none",
+                        help="none for line art and icons (default), ordered or diffusion for photos")
+    parser.add_argument("--band", type=int, help="rows per independently decodable band (default 16, or the whole "
+                        "image up to 64 rows tall)")
+    parser.add_argument("--name", help="array name for .h output (default from the output file name)")
+    args = parser.parse_args()
+
+    if args.image.lower().endswith((".pbm", ".pgm", ".ppm", ".pnm")):
+        width, height, rows = read_netpbm(args.image)
+    else:
+        width, height, rows = read_pillow(args.image)
+    if not 0 < width <= MAX_WIDTH or not 0 < height <= 0xFFFF:
+        sys.exit("%s: %dx%d is outside 1-%d x 1-65535" % (args.image, width, height, MAX_WIDTH))
+    # Bands only pay off where rows are streamed out of order, small images save the table entries
+    band = args.band or (height if height <= 64 else 16)
+    if not 1 <= band <= 255:
+        sys.exit("--band must be 1-255")
+
+    steps = 3 if args.gray else 1
+    planes = planes_of(quantize(rows, width, steps, args.dither), width, steps)
+    data = pack(planes, width, height, band)
+
+    if args.output.endswith(".h"):
+        name = args.name or os.path.splitext(os.path.basename(args.output))[0].replace("-", "_")
+        write_header(args.output, name, data, os.path.basename(args.image), width, height, args.gray)
+    else:
+        with open(args.output, "wb") as f:
+            f.write(data)
+    raw = (width + 7) // 8 * height * len(planes)
+    print("%s: %dx%d, %d plane(s), %d bytes packed from %d (%.1fx)" % (args.output, width, height, len(planes),
+                                                                       len(data), raw, raw / len(data)))
+
+
+if __name__ == "__main__":
+    main()